@@ -0,0 +1,289 @@
+//
+//  AFPacketDevice.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include "AFPacketDevice.hpp"
+
+using std::string;
+using std::unique_ptr;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+const char* fanout_mode_name(FanoutMode m) {
+    switch (m) {
+        case FanoutMode::HASH:
+            return "hash";
+        case FanoutMode::CPU:
+            return "cpu";
+        case FanoutMode::ROLLOVER:
+            return "rollover";
+    }
+    return "invalid";
+}
+
+bool parse_fanout_mode(const string& name, FanoutMode& mode) {
+    const FanoutMode modes[] = {FanoutMode::HASH, FanoutMode::CPU, FanoutMode::ROLLOVER};
+    for (FanoutMode m : modes) {
+        if (name == fanout_mode_name(m)) {
+            mode = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+void AFPacketDevice::setup_ring() {
+    // Blocks have to be a multiple of the page size
+    ssize_t page = sysconf(_SC_PAGESIZE);
+    max_buffer_len = ((max_buffer_len + page - 1) / page) * page;
+
+    int version = TPACKET_V3;
+    if(setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == -1) {
+        string m {"Setting TPACKET_V3: "};
+        m += strerror(errno);
+        m += "\n";
+        throw AFPacketDeviceNotOpened {m};
+    }
+
+    tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = static_cast<unsigned int>(max_buffer_len);
+    req.tp_block_nr = block_nr;
+    req.tp_frame_size = TPACKET_ALIGNMENT << 7; // Only a hint for V3, frames are packed to their real size
+    req.tp_frame_nr = (req.tp_block_size / req.tp_frame_size) * block_nr;
+    req.tp_retire_blk_tov = block_timeout_ms;
+    if(setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) == -1) {
+        string m {"Setting up RX ring: "};
+        m += strerror(errno);
+        m += "\n";
+        throw AFPacketDeviceNotOpened {m};
+    }
+
+    void* mapped = mmap(nullptr, max_buffer_len * block_nr, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        // MAP_LOCKED needs RLIMIT_MEMLOCK headroom, fall back to pageable memory
+        mapped = mmap(nullptr, max_buffer_len * block_nr, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mapped == MAP_FAILED) {
+        string m {"Mapping RX ring: "};
+        m += strerror(errno);
+        m += "\n";
+        throw AFPacketDeviceNotOpened {m};
+    }
+    ring = static_cast<byte_t*>(mapped);
+    curr_block = 0;
+    block = nullptr;
+    frames_left = 0;
+}
+
+bool AFPacketDevice::refill_buffer() {
+    LATENCY_SCOPE(LatencyStage::REFILL);
+    if (block != nullptr) {
+        // Done with this block, the kernel may fill it again
+        block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        __sync_synchronize();
+        curr_block = (curr_block + 1) % block_nr;
+        block = nullptr;
+    }
+
+    tpacket_block_desc* next = reinterpret_cast<tpacket_block_desc*>(ring + curr_block * max_buffer_len);
+    while (!(__atomic_load_n(&next->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+        pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN | POLLERR;
+        pfd.revents = 0;
+        int ready = poll(&pfd, 1, read_timeout_ms);
+        if (ready == -1 && errno != EINTR) {
+            string m {"Refilling buffer: "};
+            m += strerror(errno);
+            m += "\n";
+            throw CouldNotRead {m};
+        }
+        if (ready == 0) {
+            return false;
+        }
+    }
+
+    block = next;
+    frames_left = block->hdr.bh1.num_pkts;
+    next_frame = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<byte_t*>(block) + block->hdr.bh1.offset_to_first_pkt);
+    last_read_len = block->hdr.bh1.blk_len;
+    curr_bytes_consumed = block->hdr.bh1.offset_to_first_pkt;
+    return true;
+}
+
+tpacket3_hdr* AFPacketDevice::advance() {
+    // The kernel can retire a block with nothing in it when the timeout fires
+    while (frames_left == 0) {
+        refill_buffer();
+    }
+    tpacket3_hdr* frame = next_frame;
+    --frames_left;
+
+    if (frames_left == 0) {
+        curr_bytes_consumed = last_read_len;
+    } else {
+        curr_bytes_consumed += frame->tp_next_offset;
+        next_frame = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<byte_t*>(frame) + frame->tp_next_offset);
+    }
+    return frame;
+}
+
+ssize_t AFPacketDevice::get_max_buffer_len() {
+    return max_buffer_len;
+}
+
+size_t AFPacketDevice::get_last_read_len() {
+    return last_read_len;
+}
+
+size_t AFPacketDevice::get_curr_bytes_consumed() {
+    return curr_bytes_consumed;
+}
+
+string AFPacketDevice::get_device_name() {
+    return device;
+}
+
+int AFPacketDevice::get_fd() {
+    return fd;
+}
+
+void AFPacketDevice::set_read_timeout(int ms) {
+    read_timeout_ms = ms;
+}
+
+bool AFPacketDevice::set_filter(const std::vector<sock_filter>& program) {
+    sock_fprog prog;
+    prog.len = static_cast<unsigned short>(program.size());
+    prog.filter = const_cast<sock_filter*>(program.data());
+    if(setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) == -1) {
+        LOG_ERROR("Could not attach filter: %s", strerror(errno));
+        return false;
+    }
+
+    if (block != nullptr) {
+        block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        curr_block = (curr_block + 1) % block_nr;
+        block = nullptr;
+    }
+    tpacket_block_desc* next = reinterpret_cast<tpacket_block_desc*>(ring + curr_block * max_buffer_len);
+    while (__atomic_load_n(&next->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) {
+        next->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        curr_block = (curr_block + 1) % block_nr;
+        next = reinterpret_cast<tpacket_block_desc*>(ring + curr_block * max_buffer_len);
+    }
+    __sync_synchronize();
+    frames_left = 0;
+    last_read_len = 0;
+    curr_bytes_consumed = 0;
+    return true;
+}
+
+void AFPacketDevice::set_buffer_len(ssize_t new_len) {
+    release_ring();
+
+    // An empty request tears down the kernel side of the old ring
+    tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    if(setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) == -1) {
+        LOG_WARNING("Could not release RX ring: %s", strerror(errno));
+    }
+
+    max_buffer_len = new_len;
+    setup_ring();
+}
+
+bool AFPacketDevice::get_kernel_stats(KernelStats& stats) {
+    tpacket_stats_v3 st;
+    socklen_t len = sizeof(st);
+    if (getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == -1) {
+        LOG_WARNING("Could not read packet statistics: %s", strerror(errno));
+        return false;
+    }
+    // tp_packets already includes the drops
+    kernel_received += st.tp_packets;
+    kernel_dropped += st.tp_drops;
+    stats.received = kernel_received;
+    stats.dropped = kernel_dropped;
+    return true;
+}
+
+bool AFPacketDevice::join_fanout(uint16_t group_id, FanoutMode mode) {
+    int type = PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG;
+    if (mode == FanoutMode::CPU) {
+        type = PACKET_FANOUT_CPU;
+    } else if (mode == FanoutMode::ROLLOVER) {
+        type = PACKET_FANOUT_ROLLOVER;
+    }
+    int arg = group_id | (type << 16);
+    if(setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) == -1) {
+        LOG_ERROR("Could not join fanout group %u (%s): %s", group_id, fanout_mode_name(mode), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+std::pair<const byte_t*,size_t> AFPacketDevice::readPacketInPlace() {
+    tpacket3_hdr* frame = advance();
+    if (frame->tp_snaplen != frame->tp_len) {
+        LOG_WARNING("Packet truncated (%u of %u bytes)", frame->tp_snaplen, frame->tp_len);
+    }
+    return {reinterpret_cast<const byte_t*>(frame) + frame->tp_mac, frame->tp_snaplen};
+}
+
+std::pair<unique_ptr<byte_t>,size_t> AFPacketDevice::readPacket() {
+    std::pair<const byte_t*,size_t> in_place = readPacketInPlace();
+
+    // Copy data from ring (just the underlying packet)
+    unique_ptr<byte_t> out {new byte_t[in_place.second]};
+    memcpy(out.get(), in_place.first, in_place.second);
+
+    return {std::move(out), in_place.second};
+}
+
+std::pair<const byte_t*,size_t> AFPacketDevice::readPacket(PacketArena& arena) {
+    std::pair<const byte_t*,size_t> in_place = readPacketInPlace();
+
+    byte_t* out = static_cast<byte_t*>(arena.allocate(in_place.second));
+    memcpy(out, in_place.first, in_place.second);
+
+    return {out, in_place.second};
+}
+
+std::pair<unique_ptr<byte_t>,size_t> AFPacketDevice::readRaw() {
+    tpacket3_hdr* frame = advance();
+    if (frame->tp_snaplen != frame->tp_len) {
+        LOG_WARNING("Packet truncated (%u of %u bytes)", frame->tp_snaplen, frame->tp_len);
+    }
+
+    bpf_hdr bhdr = AFPacketRecord {frame}.get_bpf_header();
+
+    // Copy data (bpf header followed by the packet)
+    size_t data_size = bhdr.bh_caplen + bhdr.bh_hdrlen;
+    unique_ptr<byte_t> out {new byte_t[data_size]};
+    memcpy(out.get(), &bhdr, sizeof(bhdr));
+    memcpy(out.get()+bhdr.bh_hdrlen, reinterpret_cast<const byte_t*>(frame) + frame->tp_mac, bhdr.bh_caplen);
+
+    return {std::move(out), data_size};
+}
+
+AFPacketBatch AFPacketDevice::readBatch() {
+    while (frames_left == 0) {
+        if (!refill_buffer()) {
+            return AFPacketBatch {};
+        }
+    }
+    AFPacketBatch out {next_frame, frames_left};
+    
+    // The caller takes the rest of the block
+    frames_left = 0;
+    curr_bytes_consumed = last_read_len;
+    
+    return out;
+}
@@ -0,0 +1,307 @@
+//
+//  AFPacketDevice.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef AFPacketDevice_hpp
+#define AFPacketDevice_hpp
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <exception>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#include <net/if.h>
+#include "Packet.hpp"
+#include "BPFPacket.hpp"
+#include "LatencyHistogram.hpp"
+#include "Log.hpp"
+
+/*
+ Used to signal that a packet socket (or its ring) could not be set up
+ */
+class AFPacketDeviceNotOpened : public std::exception {
+private:
+    std::string message;
+public:
+    AFPacketDeviceNotOpened() {};
+    AFPacketDeviceNotOpened(std::string m) :message{m} {};
+
+    const char * what() {
+        message += "AF_PACKET Device not opened";
+        return message.c_str();
+    }
+};
+
+/*
+ Used by AFPacketDevice to signal that it could not wait on the ring.
+ Same name as the BPFDevice one so callers can catch it without caring which backend they have
+ */
+class CouldNotRead : public std::exception {
+private:
+    std::string message;
+public:
+    CouldNotRead() {};
+    CouldNotRead(std::string m) :message{m} {};
+
+    const char * what() {
+        message += "Could not read from packet socket";
+        return message.c_str();
+    }
+};
+
+/*
+ How a PACKET_FANOUT group spreads packets over its sockets (see AFPacketDevice::join_fanout):
+    HASH: by flow, the kernel's hash of addresses and ports, so both directions of a flow go to the same socket.
+          IP fragments are reassembled first so they hash with the rest of their flow
+    CPU: by the CPU that received the packet, so it follows the NIC's receive queues and their IRQ affinity
+    ROLLOVER: fills one socket until its ring is full, then moves on to the next
+ */
+enum class FanoutMode {HASH, CPU, ROLLOVER};
+
+// Lowercase name, as parse_fanout_mode takes it
+const char* fanout_mode_name(FanoutMode m);
+
+// Parses "hash", "cpu" or "rollover"; returns false (and leaves mode alone) for anything else
+bool parse_fanout_mode(const std::string& name, FanoutMode& mode);
+
+/*
+ One frame of a ring block, read in place. Counterpart of BPFRecord
+ 
+ Non-owning, only valid until the block is handed back to the kernel (the next read call on the device)
+ */
+class AFPacketRecord {
+private:
+    const tpacket3_hdr* frame;
+public:
+    AFPacketRecord(const tpacket3_hdr* frame) :frame{frame} {};
+    
+    const tpacket3_hdr& get_frame_header(void) const { return *frame; }
+    
+    /*
+     The kernel gives us a tpacket3_hdr, not a bpf_hdr, so this one is built on the fly (by value, no allocation)
+     */
+    bpf_hdr get_bpf_header(void) const {
+        bpf_hdr bhdr;
+        memset(&bhdr, 0, sizeof(bhdr));
+        bhdr.bh_tstamp.tv_sec = frame->tp_sec;
+        bhdr.bh_tstamp.tv_usec = frame->tp_nsec / 1000;
+        bhdr.bh_caplen = frame->tp_snaplen;
+        bhdr.bh_datalen = frame->tp_len;
+        bhdr.bh_hdrlen = sizeof(bpf_hdr);
+        return bhdr;
+    }
+    
+    // Just the underlying packet
+    const byte_t* get_data(void) const { return reinterpret_cast<const byte_t*>(frame) + frame->tp_mac; }
+    size_t get_data_len(void) const { return frame->tp_snaplen; }
+    
+    // Whether the capture was cut short of the original packet length
+    bool is_truncated(void) const { return frame->tp_snaplen != frame->tp_len; }
+    
+    // An outgoing packet whose checksums the NIC has yet to fill in (TX checksum offload)
+    bool is_checksum_partial(void) const { return (frame->tp_status & TP_STATUS_CSUMNOTREADY) != 0; }
+};
+
+/*
+ Iterable range over the frames of one ring block (following tp_next_offset). Counterpart of BPFBatch
+ 
+ Non-owning, only valid until the block is handed back to the kernel (the next read call on the device)
+ */
+class AFPacketBatch {
+private:
+    const tpacket3_hdr* first;
+    uint32_t count;
+    
+public:
+    class iterator {
+    private:
+        const tpacket3_hdr* frame;
+        uint32_t remaining;
+    public:
+        iterator(const tpacket3_hdr* frame, uint32_t remaining) :frame{frame}, remaining{remaining} {};
+        
+        AFPacketRecord operator*(void) const { return AFPacketRecord {frame}; }
+        
+        iterator& operator++(void) {
+            --remaining;
+            if (remaining > 0) {
+                frame = reinterpret_cast<const tpacket3_hdr*>(reinterpret_cast<const byte_t*>(frame) + frame->tp_next_offset);
+            }
+            return *this;
+        }
+        
+        bool operator!=(const iterator& other) const { return remaining != other.remaining; }
+        bool operator==(const iterator& other) const { return remaining == other.remaining; }
+    };
+    
+    AFPacketBatch() :first{nullptr}, count{0} {};
+    AFPacketBatch(const tpacket3_hdr* first, uint32_t count) :first{first}, count{count} {};
+    
+    iterator begin(void) const { return iterator {first, count}; }
+    iterator end(void) const { return iterator {nullptr, 0}; }
+    
+    bool empty(void) const { return count == 0; }
+    uint32_t size(void) const { return count; }
+};
+
+/*
+ Linux counterpart of BPFDevice: manages an AF_PACKET socket with a TPACKET_V3 receive ring mapped into our address space
+
+ The kernel fills whole blocks of the ring and hands them over by flipping their status, so there is no read() per buffer and
+ no copy out of the kernel. A block plays the role of one BPFDevice buffer fill: get_last_read_len() is the used length of the
+ current block and get_curr_bytes_consumed() is our offset into it. A block is only given back to the kernel once we move past
+ it, so pointers from readPacketInPlace() stay valid until the next read call.
+
+ Supports the same reading interface as BPFDevice (readPacket / readRaw), where readRaw prefixes a bpf_hdr so callers can
+ treat both backends the same.
+ */
+class AFPacketDevice {
+private:
+    int fd;
+    std::string device;
+    ssize_t max_buffer_len; // Block size
+    unsigned int block_nr; // Blocks in the ring
+    size_t last_read_len, curr_bytes_consumed; // Where we are in the current block
+
+    byte_t* ring; // mmap'd ring, block_nr blocks of max_buffer_len bytes
+    unsigned int curr_block;
+    tpacket_block_desc* block; // Block we are currently reading, nullptr if we hold none
+    tpacket3_hdr* next_frame; // Next frame to hand out from block
+    uint32_t frames_left; // Frames left in block
+    int read_timeout_ms; // How long readBatch waits for a block, -1 for forever
+    uint64_t kernel_received, kernel_dropped; // Added up from PACKET_STATISTICS, which resets on read
+
+    static const int block_timeout_ms = 64; // How long the kernel may hold a partially filled block
+
+    // Create the ring for the current buffer params and map it
+    void setup_ring(void);
+
+    // Unmap and release the ring
+    void release_ring(void) {
+        if (ring != nullptr) {
+            munmap(ring, max_buffer_len * block_nr);
+            ring = nullptr;
+        }
+        block = nullptr;
+        frames_left = 0;
+        last_read_len = 0;
+        curr_bytes_consumed = 0;
+    }
+
+    void close(void) {
+        release_ring();
+        if (fd != -1) {
+            ::close(fd);
+        }
+    }
+
+    // Hands the current block back to the kernel and waits for the next one to be filled
+    // Returns false if the read timeout ran out first
+    bool refill_buffer(void);
+
+    // Returns the next frame, moving to the next block if the current one is used up
+    tpacket3_hdr* advance(void);
+
+public:
+
+    AFPacketDevice() :fd{-1}, max_buffer_len{0}, block_nr{0}, last_read_len{0}, curr_bytes_consumed{0}, ring{nullptr}, curr_block{0}, block{nullptr}, next_frame{nullptr}, frames_left{0}, read_timeout_ms{-1}, kernel_received{0}, kernel_dropped{0} {};
+
+    AFPacketDevice(int fd, std::string dev, ssize_t len, unsigned int blocks) :fd{fd}, device{dev}, max_buffer_len{len}, block_nr{blocks}, last_read_len{0}, curr_bytes_consumed{0}, ring{nullptr}, curr_block{0}, block{nullptr}, next_frame{nullptr}, frames_left{0}, read_timeout_ms{-1}, kernel_received{0}, kernel_dropped{0} {
+        if (fd < 0) {
+            throw AFPacketDeviceNotOpened {"Device Constructor: "};
+        }
+        setup_ring();
+    }
+
+    AFPacketDevice(const AFPacketDevice& other)= delete;
+    AFPacketDevice operator=(const AFPacketDevice& other)=delete;
+
+    AFPacketDevice(AFPacketDevice&& other) :fd{other.fd}, device{std::move(other.device)}, max_buffer_len{other.max_buffer_len}, block_nr{other.block_nr}, last_read_len{other.last_read_len}, curr_bytes_consumed{other.curr_bytes_consumed}, ring{other.ring}, curr_block{other.curr_block}, block{other.block}, next_frame{other.next_frame}, frames_left{other.frames_left}, read_timeout_ms{other.read_timeout_ms}, kernel_received{other.kernel_received}, kernel_dropped{other.kernel_dropped} {
+        other.fd = -1;
+        other.ring = nullptr;
+        other.block = nullptr;
+    };
+
+    ~AFPacketDevice() {
+        close();
+    };
+
+    ssize_t get_max_buffer_len(void);
+    size_t get_last_read_len(void);
+    size_t get_curr_bytes_consumed(void);
+    std::string get_device_name(void);
+    int get_fd(void);
+
+    /*
+     Rebuilds the ring with blocks of new_len bytes (rounded up to a page multiple)
+     Anything still in the old ring is dropped
+     */
+    void set_buffer_len(ssize_t new_len);
+    
+    /*
+     Bounds how long readBatch waits for traffic before returning an empty batch (-1, the default, waits forever)
+     readPacket and readRaw always wait for a packet
+     */
+    void set_read_timeout(int ms);
+
+    /*
+     Has the kernel run program on every packet before it is put in the ring (SO_ATTACH_FILTER), dropping those it rejects
+     Blocks already waiting in the ring are handed back unread, as they were filled without the filter
+     Returns false if the kernel refused it
+     */
+    bool set_filter(const std::vector<sock_filter>& program);
+
+    /*
+     Packet counts from the kernel (PACKET_STATISTICS). Returns false if they could not be read
+     The kernel resets its counters on every read, so only call this from one thread at a time
+     */
+    bool get_kernel_stats(KernelStats& stats);
+
+    /*
+     Joins the socket to fanout group group_id (PACKET_FANOUT): the kernel then spreads the interface's packets over
+     every socket in the group instead of copying them to each. Every member has to be bound to the same interface and
+     join with the same mode. Returns false if the kernel refused it
+     */
+    bool join_fanout(uint16_t group_id, FanoutMode mode);
+
+    /*
+     Does not return BPF header
+     */
+    std::pair<std::unique_ptr<byte_t>,size_t> readPacket(void);
+
+    /*
+     Same packet copied into arena instead of its own heap buffer, valid until the arena's reset()
+     */
+    std::pair<const byte_t*,size_t> readPacket(PacketArena& arena);
+
+    /*
+     Includes a BPF Header (built from the tpacket3_hdr) so the output matches BPFDevice::readRaw
+     */
+    std::pair<std::unique_ptr<byte_t>,size_t> readRaw(void);
+
+    /*
+     Points straight into the ring (no copy). Valid until the next read call on this device
+     */
+    std::pair<const byte_t*,size_t> readPacketInPlace(void);
+    
+    /*
+     Every frame left in the current block (waiting for the next block if it has all been consumed), read in place
+     Empty if the read timeout runs out first
+     
+     The batch points into the ring, so it is only valid until the next read call
+     */
+    AFPacketBatch readBatch(void);
+};
+
+#endif /* AFPacketDevice_hpp */
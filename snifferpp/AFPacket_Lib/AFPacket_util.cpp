@@ -0,0 +1,70 @@
+//
+//  AFPacket_util.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include "AFPacket_util.hpp"
+
+using std::unique_ptr;
+using std::string;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+unique_ptr<AFPacketDevice> open_new_device(string physicalDevice, ssize_t buffer_len, unsigned int block_nr) {
+    int fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (fd == -1) {
+        string m {"Opening packet socket: "};
+        m += strerror(errno);
+        m += "\n";
+        throw AFPacketDeviceNotOpened {m};
+    }
+    LOG_INFO("Chose File Descriptor %d", fd);
+
+    // Binding to index 0 would capture every interface on the host, so a name that does not resolve is fatal
+    unsigned int if_index = if_nametoindex(physicalDevice.c_str());
+    if (if_index == 0) {
+        string m {"Finding interface " + physicalDevice + ": "};
+        m += strerror(errno);
+        m += "\n";
+        ::close(fd);
+        throw AFPacketDeviceNotOpened {m};
+    }
+
+    // The ring has to exist before we bind, otherwise packets queue up on the socket instead
+    unique_ptr<AFPacketDevice> res;
+    try {
+        res.reset(new AFPacketDevice {fd, physicalDevice, buffer_len, block_nr});
+    } catch(AFPacketDeviceNotOpened e) {
+        // Reported by the caller
+        ::close(fd);
+        throw;
+    }
+
+    sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = if_index;
+    if(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+        string m {"Binding to " + physicalDevice + ": "};
+        m += strerror(errno);
+        m += "\n";
+        // The device owns fd now: dropping it unmaps the ring and closes the socket
+        res.reset();
+        throw AFPacketDeviceNotOpened {m};
+    }
+
+    packet_mreq mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = if_index;
+    mreq.mr_type = PACKET_MR_PROMISC;
+    if(setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == -1) {
+        LOG_WARNING("Could not set promiscuous mode: %s", strerror(errno));
+    }
+
+    return res;
+}
@@ -0,0 +1,25 @@
+//
+//  AFPacket_util.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef AFPacket_util_hpp
+#define AFPacket_util_hpp
+
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
+#include "AFPacketDevice.hpp"
+#include "BPFPacket.hpp"
+#include "PacketHeader.hpp"
+
+/*
+ Opens an AF_PACKET socket bound to physicalDevice (in promiscuous mode) with a ring of block_nr blocks of buffer_len bytes.
+ Mirrors open_new_device in BPF_util so main does not care which backend it runs on
+ Throws AFPacketDeviceNotOpened if the socket cannot be opened, the interface does not exist or the bind fails
+ */
+std::unique_ptr<AFPacketDevice> open_new_device(std::string physicalDevice, ssize_t buffer_len, unsigned int block_nr = 64);
+
+#endif /* AFPacket_util_hpp */
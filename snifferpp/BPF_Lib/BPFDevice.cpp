@@ -29,24 +29,56 @@ size_t BPFDevice::get_curr_bytes_consumed() {
 
 void BPFDevice::set_buffer_len(ssize_t new_len) {
     if(ioctl(fd, BIOCSBLEN, &max_buffer_len) == -1) {
-        std::cout << "Could not set buffer len: " << strerror(errno) << std::endl;
+        LOG_WARNING("Could not set buffer len: %s", strerror(errno));
     }
 }
 
+void BPFDevice::set_read_timeout(int ms) {
+    timeval tv;
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    if(ioctl(fd, BIOCSRTIMEOUT, &tv) == -1) {
+        LOG_WARNING("Could not set read timeout: %s", strerror(errno));
+    }
+}
+
+bool BPFDevice::set_filter(const std::vector<bpf_insn>& program) {
+    bpf_program prog;
+    prog.bf_len = static_cast<u_int>(program.size());
+    prog.bf_insns = const_cast<bpf_insn*>(program.data());
+    if(ioctl(fd, BIOCSETF, &prog) == -1) {
+        LOG_ERROR("Could not attach filter: %s", strerror(errno));
+        return false;
+    }
+    // BIOCSETF flushed the kernel buffer, drop what we still had from our last read too
+    last_read_len = 0;
+    curr_bytes_consumed = 0;
+    return true;
+}
+
 string BPFDevice::get_device_name() {
     return device;
 }
 
+bool BPFDevice::get_kernel_stats(KernelStats& stats) {
+    bpf_stat st;
+    if(ioctl(fd, BIOCGSTATS, &st) == -1) {
+        LOG_WARNING("Could not read packet statistics: %s", strerror(errno));
+        return false;
+    }
+    stats.received = st.bs_recv;
+    stats.dropped = st.bs_drop;
+    return true;
+}
+
 std::pair<unique_ptr<byte_t>,size_t> BPFDevice::readPacket() {
-    if(curr_bytes_consumed >= last_read_len) {
-        cout << "Refilling buffer ..." << endl;
-        clear_buffer();
+    while(curr_bytes_consumed >= last_read_len) {
         refill_buffer();
     }
     unique_ptr<bpf_hdr> bhdr = strip_header<bpf_hdr>(buffer.get()+curr_bytes_consumed);
     
     if (bhdr->bh_caplen != bhdr->bh_datalen) {
-        cerr << "Packet truncated" << endl;
+        LOG_WARNING("Packet truncated (%u of %u bytes)", static_cast<unsigned int>(bhdr->bh_caplen), static_cast<unsigned int>(bhdr->bh_datalen));
     }
     
     // Copy data from buffer (just the underlying packet)
@@ -60,16 +92,33 @@ std::pair<unique_ptr<byte_t>,size_t> BPFDevice::readPacket() {
     return {std::move(out), data_size};
 }
 
+std::pair<const byte_t*,size_t> BPFDevice::readPacket(PacketArena& arena) {
+    while(curr_bytes_consumed >= last_read_len) {
+        refill_buffer();
+    }
+    bpf_hdr bhdr;
+    memcpy(&bhdr, buffer.get()+curr_bytes_consumed, sizeof(bpf_hdr));
+    
+    if (bhdr.bh_caplen != bhdr.bh_datalen) {
+        LOG_WARNING("Packet truncated (%u of %u bytes)", static_cast<unsigned int>(bhdr.bh_caplen), static_cast<unsigned int>(bhdr.bh_datalen));
+    }
+    
+    size_t data_size = bhdr.bh_caplen;
+    byte_t* out = static_cast<byte_t*>(arena.allocate(data_size));
+    memcpy(out, buffer.get()+curr_bytes_consumed+bhdr.bh_hdrlen, data_size);
+    
+    curr_bytes_consumed += BPF_WORDALIGN(bhdr.bh_caplen + bhdr.bh_hdrlen);
+    
+    return {out, data_size};
+}
+
 std::pair<unique_ptr<byte_t>,size_t> BPFDevice::readRaw() {
-    if(curr_bytes_consumed >= last_read_len) {
-        cout << "Refilling buffer ..." << endl;
-        clear_buffer();
+    while(curr_bytes_consumed >= last_read_len) {
         refill_buffer();
     }
     unique_ptr<bpf_hdr> bhdr = strip_header<bpf_hdr>(buffer.get()+curr_bytes_consumed);
-    cout << "Captured " << std::dec << bhdr->bh_caplen << " bytes from original length of " << bhdr->bh_datalen << endl;
     if (bhdr->bh_caplen != bhdr->bh_datalen) {
-        cerr << "Packet truncated" << endl;
+        LOG_WARNING("Packet truncated (%u of %u bytes)", static_cast<unsigned int>(bhdr->bh_caplen), static_cast<unsigned int>(bhdr->bh_datalen));
     }
     
     // Copy data (entire wrapped packet)
@@ -82,3 +131,15 @@ std::pair<unique_ptr<byte_t>,size_t> BPFDevice::readRaw() {
     
     return {std::move(out), data_size};
 }
+
+BPFBatch BPFDevice::readBatch() {
+    if(curr_bytes_consumed >= last_read_len) {
+        refill_buffer();
+    }
+    BPFBatch out {buffer.get()+curr_bytes_consumed, last_read_len-curr_bytes_consumed};
+    
+    // The caller takes the rest of the fill
+    curr_bytes_consumed = last_read_len;
+    
+    return out;
+}
@@ -11,6 +11,7 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 #include <exception>
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,6 +22,8 @@
 #include <net/if.h>
 #include "Packet.hpp"
 #include "BPFPacket.hpp"
+#include "LatencyHistogram.hpp"
+#include "Log.hpp"
 
 /*
 Used to signal that a BPF device could not be opened
@@ -74,12 +77,8 @@ private:
         buffer.reset(); // Free the underlying buffer -- for closing
     }
     
-    // Clearing buffer for refilling (not for closing)
-    void clear_buffer(void) {
-        memset(buffer.get(), 0, max_buffer_len);
-    }
-    
     void refill_buffer(void) {
+        LATENCY_SCOPE(LatencyStage::REFILL);
         size_t len;
         if((len = read(fd, buffer.get(),max_buffer_len)) == -1) {
             std::string m {"Refilling buffer: "};
@@ -89,7 +88,6 @@ private:
         }
         last_read_len = len;
         curr_bytes_consumed = 0;
-        std::cout << "Read " << len << " bytes" << std::endl;
     }
     
 public:
@@ -131,7 +129,7 @@ public:
     }
     
     ~BPFDevice() {
-        std::cout << "Closing " << fd << std::endl;
+        LOG_VERBOSE("Closing %d", fd);
         close();
     };
     
@@ -142,15 +140,45 @@ public:
     
     void set_buffer_len(ssize_t new_len);
     
+    /*
+     Bounds how long a read waits for traffic (BIOCSRTIMEOUT). When it runs out readBatch returns an empty batch
+     readPacket and readRaw always wait for a packet
+     */
+    void set_read_timeout(int ms);
+
+    /*
+     Has the kernel run program on every packet before it is copied into our buffer (BIOCSETF), dropping those it rejects
+     Also flushes the buffer, so nothing captured before the filter is read. Returns false if the kernel refused it
+     */
+    bool set_filter(const std::vector<bpf_insn>& program);
+    
+    /*
+     Packet counts from the kernel (BIOCGSTATS). Returns false if they could not be read
+     */
+    bool get_kernel_stats(KernelStats& stats);
+    
     /*
      Does not return BPF header
      */
     std::pair<std::unique_ptr<byte_t>,size_t> readPacket(void);
+
+    /*
+     Same packet copied into arena instead of its own heap buffer, valid until the arena's reset()
+     */
+    std::pair<const byte_t*,size_t> readPacket(PacketArena& arena);
     
     /*
      Includes BPF Header
      */
     std::pair<std::unique_ptr<byte_t>,size_t> readRaw(void);
+    
+    /*
+     Every record left in the current buffer fill (refilling first if it has all been consumed), read in place
+     Empty if the read timeout runs out first
+     
+     The batch points into our buffer, so it is only valid until the next read call
+     */
+    BPFBatch readBatch(void);
 };
 
 #endif /* BPFDevice_hpp */
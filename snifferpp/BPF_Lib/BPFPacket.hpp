@@ -12,7 +12,7 @@
 #include <iostream>
 #include <iomanip>
 #include <ctime>
-#include <net/bpf.h>
+#include "bpf_compat.hpp"
 #include "Packet.hpp"
 
 class BPFPacket {
@@ -32,6 +32,79 @@ public:
     std::vector<byte_t> get_bytes();
 };
 
+/*
+ One record of a BPF buffer fill, read in place: the bpf_hdr followed (after bh_hdrlen bytes) by the captured packet
+ 
+ Non-owning, only valid until the buffer it points into is refilled
+ */
+class BPFRecord {
+private:
+    const byte_t* record;
+public:
+    BPFRecord(const byte_t* record) :record{record} {};
+    
+    const bpf_hdr& get_bpf_header(void) const { return *reinterpret_cast<const bpf_hdr*>(record); }
+    
+    // Just the underlying packet
+    const byte_t* get_data(void) const { return record + get_bpf_header().bh_hdrlen; }
+    size_t get_data_len(void) const { return get_bpf_header().bh_caplen; }
+    
+    // Whether the capture was cut short of the original packet length
+    bool is_truncated(void) const { return get_bpf_header().bh_caplen != get_bpf_header().bh_datalen; }
+    
+    // BPF does not say whether checksums were left to the NIC (see verify_checksums for how that is guessed)
+    bool is_checksum_partial(void) const { return false; }
+};
+
+/*
+ Iterable range over every record in one buffer fill, walking the BPF_WORDALIGN'd offsets without copying anything
+ 
+ Non-owning, only valid until the buffer it points into is refilled
+ */
+class BPFBatch {
+private:
+    const byte_t* buffer;
+    size_t len;
+    
+public:
+    class iterator {
+    private:
+        const byte_t* buffer;
+        size_t offset;
+    public:
+        iterator(const byte_t* buffer, size_t offset) :buffer{buffer}, offset{offset} {};
+        
+        BPFRecord operator*(void) const { return BPFRecord {buffer+offset}; }
+        
+        iterator& operator++(void) {
+            const bpf_hdr* bhdr = reinterpret_cast<const bpf_hdr*>(buffer+offset);
+            offset += BPF_WORDALIGN(bhdr->bh_caplen + bhdr->bh_hdrlen);
+            return *this;
+        }
+        
+        // Records are variable length, so the last one can step past len
+        bool operator!=(const iterator& other) const { return offset < other.offset; }
+        bool operator==(const iterator& other) const { return !(*this != other); }
+    };
+    
+    BPFBatch() :buffer{nullptr}, len{0} {};
+    BPFBatch(const byte_t* buffer, size_t len) :buffer{buffer}, len{len} {};
+    
+    iterator begin(void) const { return iterator {buffer, 0}; }
+    iterator end(void) const { return iterator {buffer, len}; }
+    
+    bool empty(void) const { return len == 0; }
+    size_t get_len(void) const { return len; }
+};
+
+/*
+ The kernel's side of a capture device (BPFDevice / AFPacketDevice::get_kernel_stats), totals since it was opened
+ */
+struct KernelStats {
+    uint64_t received; // Packets that reached the device's filter
+    uint64_t dropped; // Accepted but lost because our buffer (ring) was full
+};
+
 std::ostream& operator<<(std::ostream& os, const bpf_hdr& bhdr);
 std::ostream& operator<<(std::ostream& os, WrappedHeader<bpf_hdr> bhdr);
 std::ostream& operator<<(std::ostream& os, BPFPacket p);
@@ -21,9 +21,9 @@ int pick_device() {
     int fd;
     for (int i = 0; i < max_device; ++i) {
         bpfDeviceName = "/dev/bpf" + std::to_string(i);
-        cout << "Trying " << bpfDeviceName << endl;
+        LOG_VERBOSE("Trying %s", bpfDeviceName.c_str());
         if((fd = open(bpfDeviceName.c_str(), O_RDWR)) != -1) {
-            cout << "Chose " << bpfDeviceName << endl;
+            LOG_INFO("Chose %s", bpfDeviceName.c_str());
            return fd;
         }
     }
@@ -32,28 +32,22 @@ int pick_device() {
 
 unique_ptr<BPFDevice> open_new_device(string physicalDevice, ssize_t buffer_len) {
     int fd = pick_device();
-    cout << "Chose File Descriptor " << fd << endl;
+    LOG_INFO("Chose File Descriptor %d", fd);
     
     if(ioctl(fd, BIOCSBLEN, &buffer_len) == -1) {
-        cout << "Could set buffer len: " << strerror(errno) << endl;
+        LOG_WARNING("Could not set buffer len: %s", strerror(errno));
     }
     
     ifreq if_req;
     strcpy(if_req.ifr_name, physicalDevice.c_str());
     if(ioctl(fd, BIOCSETIF, &if_req) == -1) {
-        cout << "Could not set interface: " << strerror(errno) << endl;
+        LOG_ERROR("Could not set interface: %s", strerror(errno));
     }
     
     if(ioctl(fd, BIOCPROMISC, nullptr) == -1) {
-        cout << "Could not set promiscuous mode: " << strerror(errno) << endl;
+        LOG_WARNING("Could not set promiscuous mode: %s", strerror(errno));
     }
     
-    unique_ptr<BPFDevice> res;
-    try {
-        res.reset(new BPFDevice {fd, physicalDevice, buffer_len});
-    } catch(BPFDeviceNotOpened e) {
-        cerr << e.what() << endl;
-        throw;
-    }
-    return res;
+    // Throws BPFDeviceNotOpened, for the caller to report
+    return unique_ptr<BPFDevice> {new BPFDevice {fd, physicalDevice, buffer_len}};
 }
@@ -0,0 +1,46 @@
+//
+//  bpf_compat.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef bpf_compat_hpp
+#define bpf_compat_hpp
+
+#ifndef __linux__
+#include <net/bpf.h>
+#else
+#include <cstdint>
+#include <sys/time.h>
+#include <linux/filter.h>
+
+// Classic BPF instructions have the same layout on both, Linux just calls them sock_filter
+typedef struct sock_filter bpf_insn;
+
+/*
+ Linux has no /dev/bpf, so there is no bpf_hdr either. We mirror the BSD record header here so that
+ other capture sources (see AFPacket_Lib) can hand out records in the same layout as BPFDevice::readRaw,
+ and everything downstream of the capture device (BPFPacket, main) stays the same.
+ */
+struct bpf_hdr {
+    struct timeval bh_tstamp; // Time stamp
+    uint32_t bh_caplen; // Length of captured portion
+    uint32_t bh_datalen; // Original length of packet
+    unsigned short bh_hdrlen; // Length of bpf header (this struct plus alignment padding)
+};
+
+#define BPF_ALIGNMENT sizeof(long)
+#define BPF_WORDALIGN(x) (((x)+(BPF_ALIGNMENT-1))&~(BPF_ALIGNMENT-1))
+#endif
+
+// Not every net/bpf.h has the newer ALU ops
+#ifndef BPF_MOD
+#define BPF_MOD 0x90
+#endif
+#ifndef BPF_XOR
+#define BPF_XOR 0xa0
+#endif
+
+#endif /* bpf_compat_hpp */
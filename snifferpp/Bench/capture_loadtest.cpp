@@ -0,0 +1,578 @@
+//
+//  capture_loadtest.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+/*
+ End-to-end capture load test (Linux): blasts synthetic frames at one end of a link and captures them at the other with
+ the same AFPacketDevice (and optionally Pipeline or FanoutCapture) code snifferpp uses, to find where each
+ configuration starts dropping
+
+ Link: a veth pair created for the run (--veth NAME makes NAME and NAMEp, sends on NAME, captures on NAMEp, and
+ deletes them afterwards), or an existing interface (--interface, default lo) used for both. Where the capture socket
+ sees a frame twice (outgoing and looped back) the second copy is counted as a duplicate.
+
+ Frames are Ethernet/IPv4/UDP to port 9, deterministic for a given sequence number: sizes cycle through --sizes, the
+ source port through 64 values (so --workers and --fanout hash spread them) and the payload starts with a magic, the sequence number and
+ the CLOCK_REALTIME send time. They go out in sendmmsg batches over a raw packet socket, paced to --rate packets/sec
+ (0 sends as fast as the socket takes them).
+
+ Reports sent and received rates, duplicates and losses, the kernel's PACKET_STATISTICS (packets and drops) and
+ latency percentiles from send to the kernel timestamp and from send to the capture loop reading the frame.
+
+    snifferpp_loadtest [--veth NAME | --interface IF] [--count N] [--rate PPS] [--sizes 64,512,1500] [--batch N]
+                       [--workers N | --fanout hash|cpu|rollover [--cpus 0,2-3]] [--buffer-kb N] [--blocks N]
+                       [--json FILE]
+
+ --fanout captures on one socket and pinned thread per --cpus entry (every CPU by default) instead of a single
+ device, to see how capture scales with cores.
+
+ Needs root (or CAP_NET_RAW and CAP_NET_ADMIN for --veth).
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include "AFPacket_util.hpp"
+#include "Pipeline.hpp"
+#include "FanoutCapture.hpp"
+#include "packet_sniffer.hpp"
+
+using std::string;
+using std::vector;
+using std::unordered_map;
+using std::unique_ptr;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static const char probe_magic[8] = {'S','N','F','L','O','A','D','1'};
+static const size_t probe_len = 24; // Magic, sequence number, send time
+static const size_t min_frame_len = sizeof(ether_header) + 20 + 8 + probe_len;
+static const uint16_t probe_port = 9;
+
+struct LoadOptions {
+    string tx_interface = "lo";
+    string rx_interface = "lo";
+    string veth;
+    uint64_t count = 1000000;
+    uint64_t rate = 0;
+    vector<size_t> sizes {64, 512, 1500};
+    unsigned int batch = 64;
+    unsigned int workers = 0; // 0 reads in the capture thread itself, as snifferpp does without --workers
+    bool fanout = false; // One socket and pinned capture thread per entry of cpus instead
+    FanoutMode fanout_mode = FanoutMode::HASH;
+    vector<int> cpus;
+    ssize_t buffer_len = 1 << 20;
+    unsigned int blocks = 64;
+    string json_path;
+};
+
+/*
+ What the capture side learned about one probe
+ */
+struct Sample {
+    uint64_t seq;
+    int64_t kernel_ns; // Kernel timestamp - send time
+    int64_t user_ns; // Read by the capture loop - send time
+};
+
+static uint64_t realtime_ns(void) {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+// Runs a command (no shell), returns whether it exited 0
+static bool run_command(const vector<string>& args) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        return false;
+    }
+    if (pid == 0) {
+        vector<char*> argv;
+        for (const string& a : args) {
+            argv.push_back(const_cast<char*>(a.c_str()));
+        }
+        argv.push_back(nullptr);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/*
+ A veth pair that exists for as long as this object does
+ */
+class VethPair {
+private:
+    string name;
+    bool created;
+
+    static void disable_ipv6(const string& dev) {
+        // Keeps router solicitations and the like off the link
+        std::ofstream f {"/proc/sys/net/ipv6/conf/" + dev + "/disable_ipv6"};
+        f << "1";
+    }
+
+public:
+    VethPair(const string& name) :name{name}, created{false} {
+        if (!run_command({"ip", "link", "add", name, "type", "veth", "peer", "name", name + "p"})) {
+            throw AFPacketDeviceNotOpened {"Creating veth pair " + name + ": "};
+        }
+        created = true;
+        disable_ipv6(name);
+        disable_ipv6(name + "p");
+        run_command({"ip", "link", "set", name, "up"});
+        run_command({"ip", "link", "set", name + "p", "up"});
+    }
+
+    VethPair(const VethPair& other)= delete;
+    VethPair operator=(const VethPair& other)=delete;
+
+    ~VethPair() {
+        if (created) {
+            run_command({"ip", "link", "del", name});
+        }
+    }
+};
+
+/*
+ Frame for sequence number seq, written to out (which has room for the largest size). Returns its length
+ */
+static size_t build_frame(byte_t* out, uint64_t seq, const vector<size_t>& sizes, uint64_t send_ns) {
+    size_t len = std::max(sizes[seq % sizes.size()], min_frame_len);
+    memset(out, 0, min_frame_len);
+
+    ether_header* eth = reinterpret_cast<ether_header*>(out);
+    const uint8_t dst[ETHER_ADDR_LEN] = {0x02, 0, 0, 0, 0, 0x02};
+    const uint8_t src[ETHER_ADDR_LEN] = {0x02, 0, 0, 0, 0, 0x01};
+    memcpy(eth->ether_dhost, dst, ETHER_ADDR_LEN);
+    memcpy(eth->ether_shost, src, ETHER_ADDR_LEN);
+    eth->ether_type = htons(ETHERTYPE_IP);
+
+    ip* iph = reinterpret_cast<ip*>(out + sizeof(ether_header));
+    iph->ip_v = 4;
+    iph->ip_hl = 5;
+    iph->ip_len = htons(static_cast<uint16_t>(len - sizeof(ether_header)));
+    iph->ip_id = htons(static_cast<uint16_t>(seq));
+    iph->ip_ttl = 64;
+    iph->ip_p = IPPROTO_UDP;
+    iph->ip_src.s_addr = htonl(0x0aff0001);
+    iph->ip_dst.s_addr = htonl(0x0aff0002);
+
+    udphdr* udp = reinterpret_cast<udphdr*>(out + sizeof(ether_header) + 20);
+    udp->uh_sport = htons(static_cast<uint16_t>(40000 + seq % 64));
+    udp->uh_dport = htons(probe_port);
+    udp->uh_ulen = htons(static_cast<uint16_t>(len - sizeof(ether_header) - 20));
+
+    byte_t* payload = out + sizeof(ether_header) + 20 + 8;
+    memcpy(payload, probe_magic, sizeof(probe_magic));
+    memcpy(payload + 8, &seq, sizeof(seq));
+    memcpy(payload + 16, &send_ns, sizeof(send_ns));
+    for (size_t i = min_frame_len; i < len; ++i) {
+        out[i] = static_cast<byte_t>(seq + i);
+    }
+    return len;
+}
+
+// Pulls the sequence number and send time out of a UDP payload, false if it is not one of ours
+static bool read_probe(const byte_t* payload, size_t len, uint64_t& seq, uint64_t& send_ns) {
+    if (len < probe_len || memcmp(payload, probe_magic, sizeof(probe_magic)) != 0) {
+        return false;
+    }
+    memcpy(&seq, payload + 8, sizeof(seq));
+    memcpy(&send_ns, payload + 16, sizeof(send_ns));
+    return true;
+}
+
+struct SendResult {
+    uint64_t sent;
+    uint64_t retries; // sendmmsg calls that came back with ENOBUFS/EAGAIN
+    uint64_t bytes;
+    double seconds;
+};
+
+/*
+ Sends opts.count probes on opts.tx_interface in batches, paced to opts.rate
+ */
+static SendResult send_probes(const LoadOptions& opts) {
+    int fd = socket(AF_PACKET, SOCK_RAW, 0); // Protocol 0: transmit only
+    if (fd == -1) {
+        throw AFPacketDeviceNotOpened {string {"Opening send socket: "} + strerror(errno) + "\n"};
+    }
+    sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_ifindex = if_nametoindex(opts.tx_interface.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+        ::close(fd);
+        throw AFPacketDeviceNotOpened {string {"Binding send socket: "} + strerror(errno) + "\n"};
+    }
+    int one = 1;
+    setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+    int sndbuf = 4 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    size_t max_len = std::max(*std::max_element(opts.sizes.begin(), opts.sizes.end()), min_frame_len);
+    vector<byte_t> frames(max_len * opts.batch);
+    vector<iovec> iovs(opts.batch);
+    vector<mmsghdr> msgs(opts.batch);
+
+    SendResult res {0, 0, 0, 0};
+    uint64_t start = realtime_ns();
+    double interval_ns = opts.rate ? 1e9 / opts.rate : 0;
+    while (res.sent < opts.count) {
+        if (opts.rate) {
+            // Wait for this batch's slot; sleep while it is far off, spin the last stretch
+            uint64_t due = start + static_cast<uint64_t>(res.sent * interval_ns);
+            for (uint64_t now = realtime_ns(); now < due; now = realtime_ns()) {
+                if (due - now > 200000) {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(due - now - 100000));
+                }
+            }
+        }
+
+        unsigned int n = static_cast<unsigned int>(std::min<uint64_t>(opts.batch, opts.count - res.sent));
+        uint64_t now = realtime_ns();
+        for (unsigned int i = 0; i < n; ++i) {
+            byte_t* f = frames.data() + i * max_len;
+            iovs[i].iov_base = f;
+            iovs[i].iov_len = build_frame(f, res.sent + i, opts.sizes, now);
+            memset(&msgs[i], 0, sizeof(mmsghdr));
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        unsigned int done = 0;
+        while (done < n) {
+            int r = sendmmsg(fd, msgs.data() + done, n - done, 0);
+            if (r == -1) {
+                if (errno == ENOBUFS || errno == EAGAIN || errno == EINTR) {
+                    ++res.retries;
+                    std::this_thread::yield();
+                    continue;
+                }
+                ::close(fd);
+                throw CouldNotRead {string {"Sending probes: "} + strerror(errno) + "\n"};
+            }
+            for (int i = 0; i < r; ++i) {
+                res.bytes += iovs[done + i].iov_len;
+            }
+            done += r;
+        }
+        res.sent += n;
+    }
+    res.seconds = (realtime_ns() - start) / 1e9;
+    ::close(fd);
+    return res;
+}
+
+struct Percentiles {
+    double p50, p90, p99, p999, max; // usec
+};
+
+static Percentiles percentiles(vector<int64_t>& v) {
+    Percentiles p {0, 0, 0, 0, 0};
+    if (v.empty()) {
+        return p;
+    }
+    std::sort(v.begin(), v.end());
+    auto at = [&v](double q) { return v[std::min(v.size() - 1, static_cast<size_t>(q * v.size()))] / 1000.0; };
+    p.p50 = at(0.5);
+    p.p90 = at(0.9);
+    p.p99 = at(0.99);
+    p.p999 = at(0.999);
+    p.max = v.back() / 1000.0;
+    return p;
+}
+
+static std::ostream& operator<<(std::ostream& os, const Percentiles& p) {
+    return os << "p50 " << p.p50 << ", p90 " << p.p90 << ", p99 " << p.p99 << ", p99.9 " << p.p999 << ", max " << p.max << " usec";
+}
+
+// Generic code for parsing commandline arguments into a map, as in main.cpp
+static unordered_map<string, string> get_arg_dict(int argc, const char * argv[]) {
+    unordered_map<string, string> arg_dict;
+    if (argc == 1 || !(argc % 2)) {
+        return arg_dict;
+    }
+    for (int i = 1; i < argc; i+=2) {
+        arg_dict[string {argv[i]}] = string {argv[i+1]};
+    }
+    return arg_dict;
+}
+
+static LoadOptions get_load_options(unordered_map<string, string>& arg_dict) {
+    LoadOptions opts;
+    if (arg_dict.count("--interface")) {
+        opts.tx_interface = opts.rx_interface = arg_dict["--interface"];
+    }
+    if (arg_dict.count("--veth")) {
+        opts.veth = arg_dict["--veth"];
+        opts.tx_interface = opts.veth;
+        opts.rx_interface = opts.veth + "p";
+    }
+    if (arg_dict.count("--count")) {
+        opts.count = std::stoull(arg_dict["--count"]);
+    }
+    if (arg_dict.count("--rate")) {
+        opts.rate = std::stoull(arg_dict["--rate"]);
+    }
+    if (arg_dict.count("--sizes")) {
+        opts.sizes.clear();
+        std::istringstream is {arg_dict["--sizes"]};
+        string size;
+        while (std::getline(is, size, ',')) {
+            opts.sizes.push_back(std::min<size_t>(std::stoul(size), 9000));
+        }
+    }
+    if (arg_dict.count("--batch")) {
+        opts.batch = std::max(1u, static_cast<unsigned int>(std::stoul(arg_dict["--batch"])));
+    }
+    if (arg_dict.count("--workers")) {
+        opts.workers = static_cast<unsigned int>(std::stoul(arg_dict["--workers"]));
+    }
+    if (arg_dict.count("--fanout")) {
+        opts.fanout = true;
+        if (!parse_fanout_mode(arg_dict["--fanout"], opts.fanout_mode)) {
+            cerr << "Unknown fanout mode " << arg_dict["--fanout"] << ", using hash" << endl;
+        }
+        opts.cpus = arg_dict.count("--cpus") ? parse_cpu_list(arg_dict["--cpus"]) : allowed_cpus();
+    }
+    if (arg_dict.count("--buffer-kb")) {
+        opts.buffer_len = static_cast<ssize_t>(std::stoul(arg_dict["--buffer-kb"])) << 10;
+    }
+    if (arg_dict.count("--blocks")) {
+        opts.blocks = static_cast<unsigned int>(std::stoul(arg_dict["--blocks"]));
+    }
+    if (arg_dict.count("--json")) {
+        opts.json_path = arg_dict["--json"];
+    }
+    if (opts.sizes.empty()) {
+        opts.sizes.push_back(min_frame_len);
+    }
+    return opts;
+}
+
+int main(int argc, const char * argv[]) {
+    unordered_map<string, string> arg_dict = get_arg_dict(argc, argv);
+    LoadOptions opts = get_load_options(arg_dict);
+
+    try {
+        unique_ptr<VethPair> veth;
+        if (!opts.veth.empty()) {
+            veth.reset(new VethPair {opts.veth});
+        }
+
+        // Fanout members open their own sockets
+        unique_ptr<AFPacketDevice> dev;
+        if (!opts.fanout) {
+            dev = open_new_device(opts.rx_interface, opts.buffer_len, opts.blocks);
+            dev->set_read_timeout(20);
+        }
+
+        // One sample list per consumer, merged afterwards
+        unsigned int consumers = opts.fanout ? static_cast<unsigned int>(opts.cpus.size()) : opts.workers ? opts.workers : 1;
+        vector<vector<Sample>> samples(consumers);
+        for (auto& s : samples) {
+            s.reserve(opts.count / consumers + 1024);
+        }
+        std::atomic<uint64_t> matched {0};
+        auto record = [&](unsigned int consumer, const bpf_hdr& bhdr, const PacketView& p, uint64_t read_ns) {
+            uint64_t seq, send_ns;
+            if (p.get_transport_kind() != TransportKind::UDP || !read_probe(p.get_data(), p.get_data_len(), seq, send_ns)) {
+                return;
+            }
+            uint64_t kernel_ns = static_cast<uint64_t>(bhdr.bh_tstamp.tv_sec) * 1000000000ull + bhdr.bh_tstamp.tv_usec * 1000ull;
+            samples[consumer].push_back(Sample {seq, static_cast<int64_t>(kernel_ns - send_ns), static_cast<int64_t>(read_ns - send_ns)});
+            matched.fetch_add(1, std::memory_order_relaxed);
+        };
+
+        unique_ptr<FanoutCapture> fanout;
+        if (opts.fanout) {
+            FanoutOptions fopts;
+            fopts.interface = opts.rx_interface;
+            fopts.mode = opts.fanout_mode;
+            fopts.cpus = opts.cpus;
+            fopts.block_len = opts.buffer_len;
+            fopts.blocks = opts.blocks;
+            fopts.read_timeout_ms = 20;
+            fanout.reset(new FanoutCapture {fopts, [&](unsigned int member, const bpf_hdr& bhdr, const PacketView& p) {
+                record(member, bhdr, p, realtime_ns());
+            }});
+            fanout->start();
+        }
+        auto kernel_stats = [&](KernelStats& stats) {
+            return opts.fanout ? fanout->get_kernel_stats(stats) : dev->get_kernel_stats(stats);
+        };
+        // Whatever arrived before we start sending is not ours
+        KernelStats kernel_before {0, 0};
+        kernel_stats(kernel_before);
+
+        std::atomic<bool> sender_done {false};
+        SendResult sent {0, 0, 0, 0};
+        std::thread sender {[&] {
+            try {
+                sent = send_probes(opts);
+            } catch(AFPacketDeviceNotOpened e) {
+                cerr << e.what() << endl;
+            } catch(CouldNotRead e) {
+                cerr << e.what() << endl;
+            }
+            sender_done = true;
+        }};
+
+        // Keep reading until everything arrived, or nothing new has for a while after the sender finished
+        auto keep_going = [&](uint64_t& last_matched, uint64_t& idle_since) {
+            if (!sender_done) {
+                return true;
+            }
+            uint64_t now = realtime_ns();
+            uint64_t m = matched.load(std::memory_order_relaxed);
+            if (m != last_matched) {
+                last_matched = m;
+                idle_since = now;
+            }
+            return m < sent.sent && now - idle_since < 500000000ull;
+        };
+
+        PipelineStats pipeline_stats;
+        FanoutStats fanout_stats {0, 0, 0, 0, {}};
+        uint64_t last_matched = 0;
+        uint64_t idle_since = realtime_ns();
+        if (opts.fanout) {
+            while (keep_going(last_matched, idle_since)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            fanout->stop();
+            fanout->wait();
+            fanout_stats = fanout->get_stats();
+        } else if (opts.workers) {
+            PipelineOptions popts;
+            popts.workers = opts.workers;
+            Pipeline pipeline {popts, [&](unsigned int worker, const bpf_hdr& bhdr, const PacketView& p) {
+                record(worker, bhdr, p, realtime_ns());
+            }};
+            pipeline.start(*dev);
+            while (keep_going(last_matched, idle_since)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            pipeline.stop();
+            pipeline.wait();
+            pipeline_stats = pipeline.get_stats();
+        } else {
+            while (keep_going(last_matched, idle_since)) {
+                AFPacketBatch batch = dev->readBatch();
+                uint64_t read_ns = realtime_ns();
+                for (auto&& rec : batch) {
+                    const byte_t* data = rec.get_data();
+                    size_t len = rec.get_data_len();
+                    if (len < min_frame_len || reinterpret_cast<const ether_header*>(data)->ether_type != htons(ETHERTYPE_IP)) {
+                        continue;
+                    }
+                    PacketView p = parse_packet(data, len);
+                    if (p.ok()) {
+                        record(0, rec.get_bpf_header(), p, read_ns);
+                    }
+                }
+            }
+        }
+        sender.join();
+        KernelStats kstats {0, 0};
+        kernel_stats(kstats);
+        kstats.received -= kernel_before.received;
+        kstats.dropped -= kernel_before.dropped;
+
+        // First sighting of each probe counts, later ones (lo's second copy) are duplicates
+        vector<bool> seen(sent.sent);
+        vector<int64_t> kernel_lat, user_lat;
+        uint64_t received = 0, duplicates = 0;
+        for (auto& list : samples) {
+            for (const Sample& s : list) {
+                if (s.seq >= seen.size() || seen[s.seq]) {
+                    ++duplicates;
+                    continue;
+                }
+                seen[s.seq] = true;
+                ++received;
+                kernel_lat.push_back(s.kernel_ns);
+                user_lat.push_back(s.user_ns);
+            }
+        }
+        uint64_t lost = sent.sent - received;
+        Percentiles kp = percentiles(kernel_lat);
+        Percentiles up = percentiles(user_lat);
+        uint64_t ring_drops = 0;
+        for (const WorkerStats& w : pipeline_stats.workers) {
+            ring_drops += w.dropped;
+        }
+
+        double send_pps = sent.seconds > 0 ? sent.sent / sent.seconds : 0;
+        cout << "Load Test" << endl;
+        cout << "\t|-Link: " << opts.tx_interface << " -> " << opts.rx_interface << (opts.veth.empty() ? "" : " (veth)") << endl;
+        if (opts.fanout) {
+            cout << "\t|-Capture: " << fanout_mode_name(opts.fanout_mode) << " fanout, " << opts.cpus.size() << " sockets";
+        } else {
+            cout << "\t|-Capture: " << (opts.workers ? "pipeline, " + std::to_string(opts.workers) + " workers" : string {"direct"});
+        }
+        cout << ", " << opts.blocks << " blocks of " << (opts.buffer_len >> 10) << " KiB" << endl;
+        cout << "\t|-Sent: " << sent.sent << " packets in " << sent.seconds << " sec (" << static_cast<uint64_t>(send_pps) << " pps, ";
+        cout << (sent.seconds > 0 ? sent.bytes * 8 / sent.seconds / 1e6 : 0) << " Mbit/s), " << sent.retries << " send retries" << endl;
+        cout << "\t|-Received: " << received << " (" << duplicates << " duplicates), lost " << lost;
+        cout << " (" << (sent.sent ? 100.0 * lost / sent.sent : 0) << "%)" << endl;
+        cout << "\t|-Kernel: " << kstats.received << " packets, " << kstats.dropped << " dropped" << endl;
+        if (opts.workers) {
+            cout << "\t|-Pipeline: " << pipeline_stats.captured << " captured, " << ring_drops << " dropped (ring full)" << endl;
+        }
+        for (const FanoutMemberStats& m : fanout_stats.members) {
+            cout << "\t|-Socket on CPU " << m.cpu << " (node " << m.node << "): " << m.captured << " captured" << endl;
+        }
+        cout << "\t|-Latency to kernel timestamp: " << kp << endl;
+        cout << "\t|-Latency to capture loop: " << up << endl;
+
+        if (!opts.json_path.empty()) {
+            std::ofstream js {opts.json_path};
+            auto lat = [&js](const char* name, const Percentiles& p) {
+                js << "\"" << name << "\":{\"p50\":" << p.p50 << ",\"p90\":" << p.p90 << ",\"p99\":" << p.p99 << ",\"p999\":" << p.p999 << ",\"max\":" << p.max << "}";
+            };
+            js << "{\"tx\":\"" << opts.tx_interface << "\",\"rx\":\"" << opts.rx_interface << "\",\"workers\":" << opts.workers;
+            js << ",\"fanout_sockets\":" << (opts.fanout ? opts.cpus.size() : 0);
+            js << ",\"rate\":" << opts.rate << ",\"batch\":" << opts.batch << ",\"sent\":" << sent.sent << ",\"send_seconds\":" << sent.seconds;
+            js << ",\"send_pps\":" << send_pps << ",\"send_retries\":" << sent.retries << ",\"received\":" << received;
+            js << ",\"duplicates\":" << duplicates << ",\"lost\":" << lost << ",\"kernel_packets\":" << kstats.received;
+            js << ",\"kernel_drops\":" << kstats.dropped << ",\"ring_drops\":" << ring_drops << ",";
+            lat("kernel_latency_us", kp);
+            js << ",";
+            lat("capture_latency_us", up);
+            js << "}" << endl;
+        }
+    } catch(AFPacketDeviceNotOpened e) {
+        cerr << e.what() << endl;
+        return 1;
+    } catch(CouldNotRead e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
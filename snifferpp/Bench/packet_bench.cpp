@@ -0,0 +1,551 @@
+//
+//  packet_bench.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+/*
+ Microbenchmarks for the per-packet hot paths: parsing (in place and owning, plus rejecting unsupported frames with and
+ without exceptions), the WrappedHeader / PacketHeader copies, the operator<< chain, the buffered formatter, hex dumps,
+ filters, checksum verification, payload pattern search, flow tracking, traffic sketches, rollups and column export
+
+ Runs on synthetic Ethernet/IPv4 frames (TCP and UDP, with and without IP and TCP options, payloads from empty to a
+ full MSS), so no device or capture privileges are needed. Each stage is run over the same frames and reports
+ packets/sec, ns/packet, heap allocations and allocated bytes per packet (every copy the owning paths make lands in a
+ fresh allocation, so the latter is also what they copy), output bytes per packet for the printing stages, and GB/s of
+ payload for the pattern search (--patterns of them, 1000 by default, plus a stage with only 16 where its prefilter
+ runs).
+
+ Results go to stdout as one JSON document, for comparing runs across commits:
+
+    snifferpp_bench [--packets N] [--frames N] [--seed N] [--patterns N] [--stage name]
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include "packet_sniffer.hpp"
+#include "BPFPacket.hpp"
+#include "PacketFormatter.hpp"
+#include "FilterCompiler.hpp"
+#include "FlowTable.hpp"
+#include "HexDump.hpp"
+#include "Checksum.hpp"
+#include "PatternMatcher.hpp"
+#include "TrafficSketch.hpp"
+#include "TrafficRollup.hpp"
+#include "ColumnWriter.hpp"
+
+using std::string;
+using std::vector;
+using std::unordered_map;
+using std::unique_ptr;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+// Every heap allocation in the process goes through these, so a stage's allocations are the difference across it
+static uint64_t alloc_count = 0;
+static uint64_t alloc_bytes = 0;
+
+void* operator new(size_t size) {
+    ++alloc_count;
+    alloc_bytes += size;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc {};
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+/*
+ A streambuf that only counts what is written to it, so the operator<< stages measure formatting rather than I/O
+ */
+class CountingBuf : public std::streambuf {
+private:
+    uint64_t written;
+protected:
+    int_type overflow(int_type c) override {
+        ++written;
+        return c;
+    }
+    std::streamsize xsputn(const char*, std::streamsize n) override {
+        written += n;
+        return n;
+    }
+public:
+    CountingBuf() :written{0} {};
+    uint64_t get_written(void) const { return written; }
+};
+
+/*
+ One synthetic capture record: a bpf_hdr and the frame it describes
+ */
+struct Frame {
+    bpf_hdr bhdr;
+    vector<byte_t> data;
+};
+
+static void put16(vector<byte_t>& v, size_t off, uint16_t x) {
+    v[off] = static_cast<byte_t>(x >> 8);
+    v[off+1] = static_cast<byte_t>(x);
+}
+
+static void put32(vector<byte_t>& v, size_t off, uint32_t x) {
+    put16(v, off, static_cast<uint16_t>(x >> 16));
+    put16(v, off+2, static_cast<uint16_t>(x));
+}
+
+/*
+ Mostly TCP with some UDP; a third with IP options, half the TCP with options; payloads empty (acks), small or full size
+ */
+static vector<Frame> make_frames(size_t count, uint32_t seed) {
+    std::mt19937 rng {seed};
+    vector<Frame> frames;
+    frames.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        bool tcp = rng() % 4 != 0;
+        size_t ip_opts = rng() % 3 == 0 ? 4 * (1 + rng() % 10) : 0;
+        size_t l4_len = tcp ? 20 + (rng() % 2 ? 4 * (1 + rng() % 10) : 0) : 8;
+        size_t payload;
+        switch (rng() % 3) {
+            case 0: payload = 0; break;
+            case 1: payload = 1 + rng() % 200; break;
+            default: payload = 1 + rng() % 1460; break;
+        }
+
+        Frame f;
+        size_t ip_len = 20 + ip_opts + l4_len + payload;
+        f.data.assign(14 + ip_len, 0);
+        vector<byte_t>& d = f.data;
+        for (int b = 0; b < 6; ++b) {
+            d[b] = static_cast<byte_t>(0x02);
+            d[6+b] = static_cast<byte_t>(rng());
+        }
+        put16(d, 12, 0x0800);
+
+        size_t ip = 14;
+        d[ip] = static_cast<byte_t>(0x40 | ((20 + ip_opts) / 4));
+        put16(d, ip+2, static_cast<uint16_t>(ip_len));
+        put16(d, ip+4, static_cast<uint16_t>(rng()));
+        d[ip+8] = 64;
+        d[ip+9] = tcp ? IPPROTO_TCP : IPPROTO_UDP;
+        put32(d, ip+12, 0x0a000000 | (rng() & 0xffff));
+        put32(d, ip+16, 0x0a010000 | (rng() & 0xff));
+        memset(&d[ip+20], 1, ip_opts); // NOPs
+
+        size_t l4 = ip + 20 + ip_opts;
+        put16(d, l4, static_cast<uint16_t>(1024 + rng() % 60000));
+        put16(d, l4+2, rng() % 10 == 0 ? 80 : static_cast<uint16_t>(1024 + rng() % 60000));
+        if (tcp) {
+            put32(d, l4+4, static_cast<uint32_t>(rng()));
+            put32(d, l4+8, static_cast<uint32_t>(rng()));
+            d[l4+12] = static_cast<byte_t>((l4_len / 4) << 4);
+            d[l4+13] = static_cast<byte_t>(payload ? TH_ACK | TH_PUSH : TH_ACK);
+            put16(d, l4+14, 65535);
+            memset(&d[l4+20], 1, l4_len - 20);
+        } else {
+            put16(d, l4+4, static_cast<uint16_t>(8 + payload));
+        }
+        for (size_t b = l4 + l4_len; b < d.size(); ++b) {
+            d[b] = static_cast<byte_t>(0x20 + rng() % 0x60);
+        }
+
+        memset(&f.bhdr, 0, sizeof(f.bhdr));
+        f.bhdr.bh_tstamp.tv_sec = static_cast<decltype(f.bhdr.bh_tstamp.tv_sec)>(1700000000 + i / 1000);
+        f.bhdr.bh_tstamp.tv_usec = static_cast<decltype(f.bhdr.bh_tstamp.tv_usec)>(i % 1000 * 1000);
+        f.bhdr.bh_caplen = static_cast<uint32_t>(d.size());
+        f.bhdr.bh_datalen = static_cast<uint32_t>(d.size());
+        f.bhdr.bh_hdrlen = sizeof(bpf_hdr);
+        frames.push_back(std::move(f));
+    }
+    return frames;
+}
+
+/*
+ count patterns 4 to 16 bytes long: one in ten cut from the frames' payloads (so some of them match), the rest random
+ text like the payloads (so most do not)
+ */
+static vector<string> make_patterns(const vector<Frame>& frames, size_t count, uint32_t seed) {
+    std::mt19937 rng {seed + 1};
+    vector<string> patterns;
+    patterns.reserve(count);
+    while (patterns.size() < count) {
+        size_t len = 4 + rng() % 13;
+        if (rng() % 10 == 0) {
+            const Frame& f = frames[rng() % frames.size()];
+            PacketView p = view_packet(f.data.data(), f.data.size());
+            if (p.get_data_len() >= len) {
+                size_t start = rng() % (p.get_data_len() - len + 1);
+                patterns.push_back(string {p.get_data() + start, len});
+            }
+            continue;
+        }
+        string pattern;
+        for (size_t b = 0; b < len; ++b) {
+            pattern += static_cast<char>(0x20 + rng() % 0x60);
+        }
+        patterns.push_back(pattern);
+    }
+    return patterns;
+}
+
+struct StageResult {
+    string name;
+    uint64_t packets;
+    double seconds;
+    uint64_t allocs;
+    uint64_t alloc_bytes;
+    uint64_t output_bytes;
+    uint64_t scanned_bytes; // Payload searched, for the stages that report GB/s
+};
+
+/*
+ Runs body(frame index) for packets iterations, cycling over the frames, after one untimed pass to warm caches
+ body returns the output bytes it produced (0 for stages that print nothing)
+ */
+template <typename Body>
+StageResult run_stage(const string& name, size_t frame_count, uint64_t packets, Body body) {
+    for (size_t i = 0; i < frame_count; ++i) {
+        body(i);
+    }
+
+    uint64_t allocs_before = alloc_count;
+    uint64_t bytes_before = alloc_bytes;
+    uint64_t output = 0;
+    auto start = std::chrono::steady_clock::now();
+    size_t idx = 0;
+    for (uint64_t n = 0; n < packets; ++n) {
+        output += body(idx);
+        if (++idx == frame_count) {
+            idx = 0;
+        }
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    StageResult r;
+    r.name = name;
+    r.packets = packets;
+    r.seconds = std::chrono::duration<double>(stop - start).count();
+    r.allocs = alloc_count - allocs_before;
+    r.alloc_bytes = alloc_bytes - bytes_before;
+    r.output_bytes = output;
+    r.scanned_bytes = 0;
+    return r;
+}
+
+// Stops the optimiser from dropping work whose result is otherwise unused
+static volatile uint64_t sink;
+
+// Generic code for parsing commandline arguments into a map, as in main.cpp
+static unordered_map<string, string> get_arg_dict(int argc, const char * argv[]) {
+    unordered_map<string, string> arg_dict;
+    if (argc == 1 || !(argc % 2)) {
+        return arg_dict;
+    }
+    for (int i = 1; i < argc; i+=2) {
+        arg_dict[string {argv[i]}] = string {argv[i+1]};
+    }
+    return arg_dict;
+}
+
+int main(int argc, const char * argv[]) {
+    unordered_map<string, string> arg_dict = get_arg_dict(argc, argv);
+    uint64_t packets = arg_dict.count("--packets") ? std::stoull(arg_dict["--packets"]) : 500000;
+    size_t frame_count = arg_dict.count("--frames") ? std::stoul(arg_dict["--frames"]) : 4096;
+    uint32_t seed = arg_dict.count("--seed") ? static_cast<uint32_t>(std::stoul(arg_dict["--seed"])) : 1;
+    string only = arg_dict.count("--stage") ? arg_dict["--stage"] : "";
+    if (frame_count == 0) {
+        cerr << "--frames must be at least 1" << endl;
+        return 1;
+    }
+
+    vector<Frame> frames = make_frames(frame_count, seed);
+    uint64_t total_len = 0;
+    for (const Frame& f : frames) {
+        total_len += f.data.size();
+    }
+
+    vector<Frame> unsupported = frames;
+    for (Frame& f : unsupported) {
+        reinterpret_cast<ether_header*>(f.data.data())->ether_type = htons(0x88cc); // LLDP
+    }
+    // Those would otherwise be logged (rate limited, but still to the terminal)
+    set_log_level(LogLevel::ERROR);
+
+    // Owning copies for the stages that start from a Packet
+    vector<Packet> stripped;
+    vector<PacketHeader> headers;
+    stripped.reserve(frame_count);
+    headers.reserve(frame_count);
+    for (const Frame& f : frames) {
+        stripped.push_back(view_packet(f.data.data(), f.data.size()).to_packet());
+        headers.push_back(stripped.back().get_header());
+    }
+
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull == -1) {
+        cerr << "Could not open /dev/null: " << strerror(errno) << endl;
+        return 1;
+    }
+    OutputBuffer out {devnull};
+    CountingBuf counting;
+    std::ostream null_stream {&counting};
+    BPFProgram filter = compile_filter("tcp port 80 or udp");
+    FlowTable flows {FlowTableOptions {}};
+
+    vector<StageResult> results;
+    auto want = [&only](const char* name) { return only.empty() || only == name; };
+
+    if (want("view_packet")) {
+        results.push_back(run_stage("view_packet", frame_count, packets, [&](size_t i) -> uint64_t {
+            PacketView p = view_packet(frames[i].data.data(), frames[i].data.size());
+            sink = p.get_data_len();
+            return 0;
+        }));
+    }
+    if (want("parse_packet")) {
+        results.push_back(run_stage("parse_packet", frame_count, packets, [&](size_t i) -> uint64_t {
+            PacketView p = parse_packet(frames[i].data.data(), frames[i].data.size());
+            sink = p.get_data_len();
+            return 0;
+        }));
+    }
+    // The same frames with an EtherType nothing is registered for, as on a link carrying mostly other protocols
+    if (want("view_packet_unsupported")) {
+        results.push_back(run_stage("view_packet_unsupported", frame_count, packets, [&](size_t i) -> uint64_t {
+            try {
+                sink = view_packet(unsupported[i].data.data(), unsupported[i].data.size()).get_data_len();
+            } catch(UnsupportedProtocol e) {
+                sink = 0;
+            }
+            return 0;
+        }));
+    }
+    if (want("parse_packet_unsupported")) {
+        results.push_back(run_stage("parse_packet_unsupported", frame_count, packets, [&](size_t i) -> uint64_t {
+            PacketView p = parse_packet(unsupported[i].data.data(), unsupported[i].data.size());
+            sink = p.get_data_len();
+            return 0;
+        }));
+    }
+    if (want("strip_packet")) {
+        // As BPFDevice::readPacket hands it over: the frame copied into its own buffer first
+        results.push_back(run_stage("strip_packet", frame_count, packets, [&](size_t i) -> uint64_t {
+            size_t len = frames[i].data.size();
+            unique_ptr<byte_t> buffer {new byte_t[len]};
+            memcpy(buffer.get(), frames[i].data.data(), len);
+            Packet p = strip_packet(std::move(buffer), len);
+            sink = p.get_data_len();
+            return 0;
+        }));
+    }
+    if (want("strip_packet_arena")) {
+        // Same, with the frame and the Packet in an arena reset once per batch of 256, as a capture loop would
+        PacketArena arena;
+        results.push_back(run_stage("strip_packet_arena", frame_count, packets, [&](size_t i) -> uint64_t {
+            if (i % 256 == 0) {
+                arena.reset();
+            }
+            size_t len = frames[i].data.size();
+            byte_t* buffer = static_cast<byte_t*>(arena.allocate(len));
+            memcpy(buffer, frames[i].data.data(), len);
+            Packet p = strip_packet(buffer, len, arena);
+            sink = p.get_data_len();
+            return 0;
+        }));
+    }
+    if (want("packet_copy")) {
+        results.push_back(run_stage("packet_copy", frame_count, packets, [&](size_t i) -> uint64_t {
+            Packet p {stripped[i]};
+            sink = reinterpret_cast<uintptr_t>(&p);
+            return 0;
+        }));
+    }
+    if (want("header_getters")) {
+        // The by-value getter chain a caller walks to reach the transport header
+        results.push_back(run_stage("header_getters", frame_count, packets, [&](size_t i) -> uint64_t {
+            PacketHeader h = stripped[i].get_header();
+            WrappedHeader<ip> iph = h.get_ip_header();
+            TransportHeader tph = h.get_transport_header();
+            sink = iph.get_header()->ip_ttl + static_cast<int>(tph.get_kind());
+            return 0;
+        }));
+    }
+    if (want("header_get_bytes")) {
+        results.push_back(run_stage("header_get_bytes", frame_count, packets, [&](size_t i) -> uint64_t {
+            sink = headers[i].get_bytes().size();
+            return 0;
+        }));
+    }
+    if (want("ostream_packet")) {
+        results.push_back(run_stage("ostream_packet", frame_count, packets, [&](size_t i) -> uint64_t {
+            uint64_t before = counting.get_written();
+            null_stream << frames[i].bhdr << endl << stripped[i] << endl;
+            return counting.get_written() - before;
+        }));
+    }
+    if (want("ostream_view")) {
+        results.push_back(run_stage("ostream_view", frame_count, packets, [&](size_t i) -> uint64_t {
+            uint64_t before = counting.get_written();
+            null_stream << frames[i].bhdr << endl << view_packet(frames[i].data.data(), frames[i].data.size()) << endl;
+            return counting.get_written() - before;
+        }));
+    }
+
+    const OutputFormat formats[] = {OutputFormat::HUMAN, OutputFormat::LINE, OutputFormat::NDJSON, OutputFormat::CSV};
+    const char* format_stages[] = {"format_human", "format_line", "format_json", "format_csv"};
+    for (int f = 0; f < 4; ++f) {
+        if (!want(format_stages[f])) {
+            continue;
+        }
+        PacketFormatter formatter {out, formats[f]};
+        results.push_back(run_stage(format_stages[f], frame_count, packets, [&](size_t i) -> uint64_t {
+            uint64_t before = out.get_total();
+            formatter.write(frames[i].bhdr, view_packet(frames[i].data.data(), frames[i].data.size()));
+            return out.get_total() - before;
+        }));
+        out.flush();
+    }
+
+    if (want("hex_dump")) {
+        vector<char> dump(hex_dump_size(2048));
+        results.push_back(run_stage("hex_dump", frame_count, packets, [&](size_t i) -> uint64_t {
+            PacketView p = view_packet(frames[i].data.data(), frames[i].data.size());
+            return hex_dump(dump.data(), p.get_data(), p.get_data_len());
+        }));
+    }
+    if (want("bpf_filter")) {
+        results.push_back(run_stage("bpf_filter", frame_count, packets, [&](size_t i) -> uint64_t {
+            sink = filter.run(frames[i].data.data(), frames[i].data.size(), frames[i].data.size());
+            return 0;
+        }));
+    }
+    if (want("verify_checksums")) {
+        results.push_back(run_stage("verify_checksums", frame_count, packets, [&](size_t i) -> uint64_t {
+            FrameChecksums sums = verify_checksums(frames[i].data.data(), frames[i].data.size());
+            sink = static_cast<uint64_t>(sums.ip) + static_cast<uint64_t>(sums.transport);
+            return 0;
+        }));
+    }
+    const char* match_stages[] = {"pattern_match", "pattern_match_few"};
+    size_t match_patterns[] = {arg_dict.count("--patterns") ? std::stoul(arg_dict["--patterns"]) : 1000, 16};
+    for (int m = 0; m < 2; ++m) {
+        if (!want(match_stages[m])) {
+            continue;
+        }
+        PatternMatcher matcher {make_patterns(frames, match_patterns[m], seed)};
+        results.push_back(run_stage(match_stages[m], frame_count, packets, [&](size_t i) -> uint64_t {
+            PacketView p = view_packet(frames[i].data.data(), frames[i].data.size());
+            uint64_t found = 0;
+            matcher.scan(p.get_data(), p.get_data_len(), [&found](uint32_t, size_t) { ++found; });
+            sink = found;
+            return 0;
+        }));
+        // The frames are cycled through in order, so the payload covered is whole passes plus a first part
+        vector<uint64_t> payload_upto(frame_count + 1, 0);
+        for (size_t i = 0; i < frame_count; ++i) {
+            payload_upto[i + 1] = payload_upto[i] + view_packet(frames[i].data.data(), frames[i].data.size()).get_data_len();
+        }
+        results.back().scanned_bytes = packets / frame_count * payload_upto[frame_count] + payload_upto[packets % frame_count];
+        cerr << match_stages[m] << ": " << matcher.get_pattern_count() << " patterns, " << matcher.get_state_count() << " states, ";
+        cerr << matcher.get_table_bytes() / 1024 << " KB, prefilter " << (matcher.has_prefilter() ? pattern_prefilter_name() : "off") << endl;
+    }
+    if (want("flow_update")) {
+        results.push_back(run_stage("flow_update", frame_count, packets, [&](size_t i) -> uint64_t {
+            flows.update(frames[i].bhdr, view_packet(frames[i].data.data(), frames[i].data.size()));
+            return 0;
+        }));
+    }
+    if (want("sketch_update")) {
+        // Sources, ports and flows are nearly all distinct here, so most top-K updates replace a counter: the slow case
+        TrafficSketch sketch;
+        results.push_back(run_stage("sketch_update", frame_count, packets, [&](size_t i) -> uint64_t {
+            sketch.update(frames[i].bhdr, view_packet(frames[i].data.data(), frames[i].data.size()));
+            return 0;
+        }));
+    }
+    if (want("rollup_update")) {
+        // Its own clock, 10us a packet, as the frames' timestamps start over on every pass: a 1ms window of 100 packets
+        // is written out every 100th
+        RollupOptions opts;
+        opts.key = RollupKey::SOURCE;
+        opts.link_bps = 10000000000ULL;
+        TrafficRollup rollup {"bench", out, opts};
+        uint64_t now_us = 1700000000000000ULL;
+        results.push_back(run_stage("rollup_update", frame_count, packets, [&](size_t i) -> uint64_t {
+            uint64_t before = out.get_total();
+            bpf_hdr bhdr = frames[i].bhdr;
+            now_us += 10;
+            bhdr.bh_tstamp.tv_sec = static_cast<decltype(bhdr.bh_tstamp.tv_sec)>(now_us / 1000000);
+            bhdr.bh_tstamp.tv_usec = static_cast<decltype(bhdr.bh_tstamp.tv_usec)>(now_us % 1000000);
+            rollup.update(bhdr, parse_packet(frames[i].data.data(), frames[i].data.size()));
+            return out.get_total() - before;
+        }));
+        rollup.flush();
+    }
+    if (want("column_export")) {
+        // A block is encoded every 65536th packet, which takes its share of the time and output
+        ColumnWriter writer {out};
+        results.push_back(run_stage("column_export", frame_count, packets, [&](size_t i) -> uint64_t {
+            uint64_t before = out.get_total();
+            writer.add(frames[i].bhdr, parse_packet(frames[i].data.data(), frames[i].data.size()));
+            return out.get_total() - before;
+        }));
+        writer.flush();
+    }
+    close(devnull);
+
+    // One JSON document; numbers only, so no escaping needed
+    std::ostringstream os;
+    os.precision(6);
+    os << std::fixed;
+    os << "{\"benchmark\":\"snifferpp\",\"compiler\":\"" << __VERSION__ << "\",\"frames\":" << frame_count;
+    os << ",\"avg_frame_len\":" << static_cast<double>(total_len) / frame_count << ",\"seed\":" << seed << ",\"checksum_kernel\":\"" << checksum_kernel_name() << "\",\"stages\":[";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const StageResult& r = results[i];
+        double per = r.packets ? static_cast<double>(r.packets) : 1.0;
+        os << (i ? "," : "") << "\n  {\"name\":\"" << r.name << "\",\"packets\":" << r.packets;
+        os << ",\"seconds\":" << r.seconds;
+        os << ",\"packets_per_sec\":" << (r.seconds > 0 ? r.packets / r.seconds : 0.0);
+        os << ",\"ns_per_packet\":" << r.seconds * 1e9 / per;
+        os << ",\"allocs_per_packet\":" << r.allocs / per;
+        os << ",\"alloc_bytes_per_packet\":" << r.alloc_bytes / per;
+        os << ",\"output_bytes_per_packet\":" << r.output_bytes / per;
+        os << ",\"gbytes_per_sec\":" << (r.seconds > 0 ? r.scanned_bytes / r.seconds / 1e9 : 0.0) << "}";
+    }
+    os << "\n]}\n";
+    cout << os.str();
+    return 0;
+}
@@ -0,0 +1,318 @@
+//
+//  ColumnFile.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include "ColumnFile.hpp"
+
+using std::string;
+using std::to_string;
+
+// Encoding and length before each column's data
+static const size_t column_header_len = 5;
+
+ColumnFile::ColumnFile(string p) :fd{-1}, path{p}, map{nullptr}, map_len{0}, offset{0}, rows{0}, blocks{0}, truncated{false} {
+    if ((fd = open(path.c_str(), O_RDONLY)) == -1) {
+        string m {"Opening " + path + ": "};
+        m += strerror(errno);
+        m += "\n";
+        throw ColumnFileNotOpened {m};
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        string m {"Reading size of " + path + ": "};
+        m += strerror(errno);
+        m += "\n";
+        close();
+        throw ColumnFileNotOpened {m};
+    }
+    map_len = st.st_size;
+    if (map_len < sizeof(COLUMN_FILE_MAGIC)) {
+        close();
+        throw ColumnFileNotOpened {"Short header in " + path + ": "};
+    }
+
+    void* mapped = mmap(nullptr, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+        string m {"Mapping " + path + ": "};
+        m += strerror(errno);
+        m += "\n";
+        close();
+        throw ColumnFileNotOpened {m};
+    }
+    map = static_cast<const byte_t*>(mapped);
+    madvise(mapped, map_len, MADV_SEQUENTIAL);
+
+    read_header();
+}
+
+void ColumnFile::read_header() {
+    if (memcmp(map, COLUMN_FILE_MAGIC, sizeof(COLUMN_FILE_MAGIC)) != 0) {
+        close();
+        throw ColumnFileNotOpened {"Not a column file " + path + ": "};
+    }
+    offset = sizeof(COLUMN_FILE_MAGIC);
+    if (map_len - offset < 6) {
+        close();
+        throw ColumnFileNotOpened {"Short header in " + path + ": "};
+    }
+    uint32_t version = static_cast<uint32_t>(load_le(map + offset, 4));
+    if (version != COLUMN_FILE_VERSION) {
+        close();
+        throw ColumnFileNotOpened {"Version " + to_string(version) + " of " + path + ": "};
+    }
+    size_t count = load_le(map + offset + 4, 2);
+    offset += 6;
+
+    for (size_t i = 0; i < count; ++i) {
+        size_t name_len = offset < map_len ? static_cast<uint8_t>(map[offset]) : 0;
+        if (offset == map_len || map_len - offset < 1 + name_len + 2) {
+            close();
+            throw ColumnFileNotOpened {"Short header in " + path + ": "};
+        }
+        ColumnInfo info;
+        info.name.assign(map + offset + 1, name_len);
+        offset += 1 + name_len;
+        uint8_t type = static_cast<uint8_t>(map[offset]);
+        info.width = static_cast<uint8_t>(map[offset + 1]);
+        offset += 2;
+        info.type = static_cast<ColumnType>(type);
+        bool valid_width = info.type == ColumnType::UINT ? info.width == 1 || info.width == 2 || info.width == 4 || info.width == 8 : info.width != 0;
+        if (type > static_cast<uint8_t>(ColumnType::BYTES) || !valid_width) {
+            close();
+            throw ColumnFileNotOpened {"Column " + info.name + " of " + path + " has an unknown type: "};
+        }
+        infos.push_back(info);
+    }
+    columns.resize(count);
+}
+
+int ColumnFile::find_column(const string& name) const {
+    for (size_t i = 0; i < infos.size(); ++i) {
+        if (infos[i].name == name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+bool ColumnFile::next_block() {
+    rows = 0;
+    if (map == nullptr || offset == map_len) {
+        return false;
+    }
+    // Only move on once the whole block is known to be there
+    size_t pos = offset;
+    if (map_len - pos < 4) {
+        truncated = true;
+        return false;
+    }
+    uint32_t block_rows = static_cast<uint32_t>(load_le(map + pos, 4));
+    if (block_rows == 0) {
+        throw MalformedColumns {"Empty block at " + to_string(pos) + " of " + path + ": "};
+    }
+    pos += 4;
+    for (Column& c : columns) {
+        if (map_len - pos < column_header_len) {
+            truncated = true;
+            return false;
+        }
+        c.encoding = static_cast<ColumnEncoding>(map[pos]);
+        c.len = load_le(map + pos + 1, 4);
+        pos += column_header_len;
+        if (map_len - pos < c.len) {
+            truncated = true;
+            return false;
+        }
+        c.data = map + pos;
+        c.values = nullptr;
+        pos += c.len;
+    }
+    offset = pos;
+    rows = block_rows;
+    ++blocks;
+    return true;
+}
+
+/*
+ Looks every row's index up in a dictionary of entries of Width bytes (width, for Width 0). A template so the common
+ widths copy with one load and store. Returns false if an index is past the end
+ */
+template <size_t Width>
+static bool expand_dictionary(const byte_t* dictionary, size_t entries, const byte_t* indices, size_t index_width, uint32_t rows, byte_t* out, size_t width = Width) {
+    for (uint32_t r = 0; r < rows; ++r) {
+        size_t e = load_le(indices + r * index_width, index_width);
+        if (e >= entries) {
+            return false;
+        }
+        memcpy(out + r * width, dictionary + e * width, Width != 0 ? Width : width);
+    }
+    return true;
+}
+
+void ColumnFile::decode(size_t i) {
+    Column& c = columns[i];
+    const ColumnInfo& info = infos[i];
+    size_t width = info.width;
+    const byte_t* p = c.data;
+    const byte_t* end = c.data + c.len;
+    string where = " of column " + info.name + " in block " + to_string(blocks) + " of " + path + ": ";
+    if (c.encoding == ColumnEncoding::PLAIN) {
+        if (c.len != rows * width) {
+            throw MalformedColumns {"Wrong length" + where};
+        }
+        c.values = c.data;
+        return;
+    }
+
+    // Everything the length can be checked against is checked before allocating, so a hostile row count in a short
+    // column does not get the whole of it
+    byte_t* out;
+    uint64_t v;
+    switch (c.encoding) {
+        case ColumnEncoding::VARINT:
+        case ColumnEncoding::DELTA: {
+            if (info.type != ColumnType::UINT) {
+                throw MalformedColumns {string {"Encoding "} + column_encoding_name(c.encoding) + where};
+            }
+            // Every value takes at least a byte
+            if (c.len < rows) {
+                throw MalformedColumns {"Values run out" + where};
+            }
+            c.decoded.resize(rows * width);
+            out = c.decoded.data();
+            bool delta = c.encoding == ColumnEncoding::DELTA;
+            uint64_t prev = 0;
+            for (uint32_t r = 0; r < rows; ++r) {
+                if ((p = get_varint(p, end, v)) == nullptr) {
+                    throw MalformedColumns {"Values run out" + where};
+                }
+                if (delta) {
+                    v = prev + static_cast<uint64_t>(zigzag_decode(v));
+                    // Wraps at the column's width, as the writer took the differences
+                    v = width == 8 ? v : v & ((uint64_t {1} << (8 * width)) - 1);
+                    prev = v;
+                } else if (width != 8 && v >> (8 * width) != 0) {
+                    throw MalformedColumns {"Value too wide" + where};
+                }
+                store_le(out + r * width, v, width);
+            }
+            break;
+        }
+        case ColumnEncoding::DICTIONARY: {
+            if ((p = get_varint(p, end, v)) == nullptr || p == end) {
+                throw MalformedColumns {"Short dictionary" + where};
+            }
+            size_t entries = v;
+            size_t index_width = static_cast<uint8_t>(*p++);
+            if (entries == 0 || entries > MAX_DICTIONARY_ENTRIES || index_width > 2 || entries > (size_t {1} << (8 * index_width))) {
+                throw MalformedColumns {"Bad dictionary" + where};
+            }
+            const byte_t* dictionary = p;
+            if (static_cast<size_t>(end - p) != entries * width + rows * index_width) {
+                throw MalformedColumns {"Wrong length" + where};
+            }
+            p += entries * width;
+            c.decoded.resize(rows * width);
+            out = c.decoded.data();
+            bool in_range;
+            switch (width) {
+                case 1:
+                    in_range = expand_dictionary<1>(dictionary, entries, p, index_width, rows, out);
+                    break;
+                case 2:
+                    in_range = expand_dictionary<2>(dictionary, entries, p, index_width, rows, out);
+                    break;
+                case 4:
+                    in_range = expand_dictionary<4>(dictionary, entries, p, index_width, rows, out);
+                    break;
+                case 6:
+                    in_range = expand_dictionary<6>(dictionary, entries, p, index_width, rows, out);
+                    break;
+                case 8:
+                    in_range = expand_dictionary<8>(dictionary, entries, p, index_width, rows, out);
+                    break;
+                case 16:
+                    in_range = expand_dictionary<16>(dictionary, entries, p, index_width, rows, out);
+                    break;
+                default:
+                    in_range = expand_dictionary<0>(dictionary, entries, p, index_width, rows, out, width);
+            }
+            if (!in_range) {
+                throw MalformedColumns {"Index past dictionary" + where};
+            }
+            p += rows * index_width;
+            break;
+        }
+        default:
+            throw MalformedColumns {"Unknown encoding" + where};
+    }
+    if (p != end) {
+        throw MalformedColumns {"Wrong length" + where};
+    }
+    c.values = c.decoded.data();
+}
+
+static void write_address(OutputBuffer& out, const byte_t* v) {
+    static const byte_t mapped_prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, static_cast<byte_t>(0xff), static_cast<byte_t>(0xff)};
+    static const byte_t zero[16] = {};
+    if (memcmp(v, zero, sizeof(zero)) == 0) {
+        return;
+    }
+    if (memcmp(v, mapped_prefix, sizeof(mapped_prefix)) == 0) {
+        // inet_ntop goes through sprintf, which would be most of the cost of a row
+        for (int i = 12; i < 16; ++i) {
+            if (i != 12) {
+                out.put('.');
+            }
+            out.write_uint(static_cast<uint8_t>(v[i]));
+        }
+        return;
+    }
+    char addr[INET6_ADDRSTRLEN];
+    out.write(inet_ntop(AF_INET6, v, addr, sizeof(addr)));
+}
+
+void write_columns_csv(ColumnFile& file, OutputBuffer& out) {
+    const std::vector<ColumnInfo>& infos = file.get_columns();
+    for (size_t i = 0; i < infos.size(); ++i) {
+        if (i != 0) {
+            out.put(',');
+        }
+        out.write(infos[i].name);
+    }
+    out.put('\n');
+
+    std::vector<const byte_t*> values(infos.size());
+    while (file.next_block()) {
+        for (size_t i = 0; i < infos.size(); ++i) {
+            values[i] = file.get_values(i);
+        }
+        for (uint32_t r = 0; r < file.get_rows(); ++r) {
+            for (size_t i = 0; i < infos.size(); ++i) {
+                size_t width = infos[i].width;
+                const byte_t* v = values[i] + r * width;
+                if (i != 0) {
+                    out.put(',');
+                }
+                if (infos[i].type == ColumnType::UINT) {
+                    out.write_uint(load_le(v, width));
+                } else if (width == 16) {
+                    write_address(out, v);
+                } else {
+                    for (size_t b = 0; b < width; ++b) {
+                        if (width == ETHER_ADDR_LEN && b != 0) {
+                            out.put(':');
+                        }
+                        out.write_hex(static_cast<uint8_t>(v[b]));
+                    }
+                }
+            }
+            out.put('\n');
+        }
+    }
+}
@@ -0,0 +1,131 @@
+//
+//  ColumnFile.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef ColumnFile_hpp
+#define ColumnFile_hpp
+
+#include <string>
+#include <vector>
+#include <exception>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ColumnFormat.hpp"
+#include "OutputBuffer.hpp"
+
+/*
+ Used to signal that a column file could not be opened or does not start like one
+ */
+class ColumnFileNotOpened : public std::exception {
+private:
+    std::string message;
+public:
+    ColumnFileNotOpened() {};
+    ColumnFileNotOpened(std::string m) :message{m} {};
+
+    const char * what() {
+        message += "Column file not opened";
+        return message.c_str();
+    }
+};
+
+/*
+ A column file (see ColumnFormat.hpp) mapped into memory, read a block at a time. Any file in the format reads, whatever
+ its columns: get_columns() says what they are.
+
+ A block's columns are decoded the first time they are asked for, so a reader only pays for the columns it uses;
+ PLAIN ones are handed out in place. What get_values() returns is valid until the next next_block().
+ */
+class ColumnFile {
+private:
+    struct Column {
+        ColumnEncoding encoding;
+        const byte_t* data; // Encoded, in the mapping
+        size_t len;
+        const byte_t* values; // Decoded, nullptr until asked for
+        std::vector<byte_t> decoded;
+    };
+
+    int fd;
+    std::string path;
+    const byte_t* map;
+    size_t map_len;
+    size_t offset; // Next block
+    std::vector<ColumnInfo> infos;
+    std::vector<Column> columns;
+    uint32_t rows;
+    uint64_t blocks;
+    bool truncated;
+
+    void close(void) {
+        if (map != nullptr) {
+            munmap(const_cast<byte_t*>(map), map_len);
+            map = nullptr;
+        }
+        if (fd != -1) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    void read_header(void);
+    void decode(size_t i);
+
+public:
+    // Throws ColumnFileNotOpened
+    ColumnFile(std::string path);
+
+    ColumnFile(const ColumnFile& other)= delete;
+    ColumnFile operator=(const ColumnFile& other)=delete;
+
+    ~ColumnFile() {
+        close();
+    }
+
+    const std::vector<ColumnInfo>& get_columns(void) const { return infos; }
+
+    // Index of the column called name, -1 if there is none
+    int find_column(const std::string& name) const;
+
+    /*
+     Moves on to the next block. Returns false at the end of the file, or at a block cut short (get_truncated()), as
+     a writer that was stopped midway leaves. Throws MalformedColumns if a whole block does not add up
+     */
+    bool next_block(void);
+
+    uint32_t get_rows(void) const { return rows; }
+    uint64_t get_blocks(void) const { return blocks; }
+    bool get_truncated(void) const { return truncated; }
+
+    ColumnEncoding get_encoding(size_t column) const { return columns[column].encoding; }
+
+    // A column's values in this block, get_rows() of its width each, little-endian. Throws MalformedColumns
+    const byte_t* get_values(size_t column) {
+        if (columns[column].values == nullptr) {
+            decode(column);
+        }
+        return columns[column].values;
+    }
+
+    // A UINT column's value in row of this block. Throws MalformedColumns
+    uint64_t get_uint(size_t column, size_t row) {
+        size_t width = infos[column].width;
+        return load_le(get_values(column) + row * width, width);
+    }
+};
+
+/*
+ Every row of the blocks left in file, as CSV with a header row of the column names. UINT columns are
+ numbers; 6 byte columns MACs, 16 byte ones addresses (IPv4-mapped as a.b.c.d, empty if all zero), any others hex.
+ Throws MalformedColumns
+ */
+void write_columns_csv(ColumnFile& file, OutputBuffer& out);
+
+#endif /* ColumnFile_hpp */
@@ -0,0 +1,47 @@
+//
+//  ColumnFormat.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include "ColumnFormat.hpp"
+
+static const ColumnInfo header_columns[HEADER_COLUMNS] = {
+    {"ts_us", ColumnType::UINT, 8},
+    {"caplen", ColumnType::UINT, 4},
+    {"wirelen", ColumnType::UINT, 4},
+    {"src_mac", ColumnType::BYTES, 6},
+    {"dst_mac", ColumnType::BYTES, 6},
+    {"ether_type", ColumnType::UINT, 2},
+    {"src_ip", ColumnType::BYTES, 16},
+    {"dst_ip", ColumnType::BYTES, 16},
+    {"ttl", ColumnType::UINT, 1},
+    {"protocol", ColumnType::UINT, 1},
+    {"sport", ColumnType::UINT, 2},
+    {"dport", ColumnType::UINT, 2},
+    {"tcp_seq", ColumnType::UINT, 4},
+    {"tcp_ack", ColumnType::UINT, 4},
+    {"tcp_flags", ColumnType::UINT, 1},
+    {"tcp_window", ColumnType::UINT, 2},
+    {"payload_len", ColumnType::UINT, 4},
+};
+
+const ColumnInfo& header_column_info(HeaderColumn c) {
+    return header_columns[static_cast<size_t>(c)];
+}
+
+const char* column_encoding_name(ColumnEncoding e) {
+    switch (e) {
+        case ColumnEncoding::PLAIN:
+            return "plain";
+        case ColumnEncoding::VARINT:
+            return "varint";
+        case ColumnEncoding::DELTA:
+            return "delta";
+        case ColumnEncoding::DICTIONARY:
+            return "dictionary";
+    }
+    return "invalid";
+}
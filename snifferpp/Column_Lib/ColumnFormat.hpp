@@ -0,0 +1,189 @@
+//
+//  ColumnFormat.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef ColumnFormat_hpp
+#define ColumnFormat_hpp
+
+#include <string>
+#include <exception>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include "standard_headers.hpp"
+
+/*
+ Layout of a header column file, as ColumnWriter writes and ColumnFile reads it. Every integer is little-endian.
+
+    file:    magic "SNFCOLMN", u32 version, u16 column count, then per column: u8 name length, name, u8 type, u8 width
+    block:   u32 rows (never 0), then per column in file order: u8 encoding, u32 length, length bytes of data
+
+ A column's values are width bytes each: UINT columns an unsigned integer of 1, 2, 4 or 8 bytes, BYTES columns opaque
+ (a MAC, an address). Each block picks the smallest encoding for each column:
+
+    PLAIN:      rows values of width bytes
+    VARINT:     rows LEB128 values (UINT only)
+    DELTA:      rows LEB128 zigzag differences from the value before, the first from 0; differences wrap at the
+                column's width, so a TCP sequence number going round is a small step (UINT only)
+    DICTIONARY: LEB128 entry count, u8 index width (0, 1 or 2; 0 for a column with one value), the entries as PLAIN,
+                then rows indices of index width bytes
+
+ Blocks follow each other to the end of the file, so a file cut short still reads up to its last whole block, and a
+ reader can skip the columns it does not want by their lengths.
+ */
+
+const char COLUMN_FILE_MAGIC[8] = {'S', 'N', 'F', 'C', 'O', 'L', 'M', 'N'};
+const uint32_t COLUMN_FILE_VERSION = 1;
+
+enum class ColumnType : uint8_t {UINT, BYTES};
+
+enum class ColumnEncoding : uint8_t {PLAIN, VARINT, DELTA, DICTIONARY};
+
+// Lowercase names, for messages
+const char* column_encoding_name(ColumnEncoding e);
+
+const size_t COLUMN_ENCODINGS = 4;
+
+// Largest dictionary: indices are at most 2 bytes
+const size_t MAX_DICTIONARY_ENTRIES = 1 << 16;
+
+struct ColumnInfo {
+    std::string name;
+    ColumnType type;
+    uint8_t width;
+};
+
+/*
+ The columns ColumnWriter fills in from a packet, in file order. Fields a packet does not have are 0: addresses and
+ TTL of a non-IP frame, ports of anything but TCP and UDP, the tcp_ columns of anything but TCP
+ */
+enum class HeaderColumn {
+    TIMESTAMP, // ts_us: capture time, microseconds since the epoch
+    CAPLEN, // caplen: bytes captured
+    WIRELEN, // wirelen: bytes on the wire
+    SRC_MAC, DST_MAC, // src_mac, dst_mac
+    ETHER_TYPE, // ether_type: of the network layer, inside any VLAN tags
+    SRC_IP, DST_IP, // src_ip, dst_ip: 16 bytes, IPv4 (and ARP's) as IPv4-mapped IPv6 (::ffff:a.b.c.d)
+    TTL, // ttl: or IPv6 hop limit
+    PROTOCOL, // protocol: IP protocol of the transport layer, after any IPv6 extension headers
+    SRC_PORT, DST_PORT, // sport, dport
+    TCP_SEQ, TCP_ACK, TCP_FLAGS, TCP_WINDOW, // tcp_seq, tcp_ack, tcp_flags, tcp_window
+    PAYLOAD_LEN // payload_len: after the transport header, from the IP length (so a short snaplen does not shrink it)
+};
+
+const size_t HEADER_COLUMNS = 17;
+
+// Name, type and width of each HeaderColumn
+const ColumnInfo& header_column_info(HeaderColumn c);
+
+/*
+ Used to signal a column file whose header or blocks do not add up
+ */
+class MalformedColumns : public std::exception {
+private:
+    std::string message;
+public:
+    MalformedColumns() {};
+    MalformedColumns(std::string m) :message{m} {};
+
+    const char * what() {
+        message += "Malformed column file";
+        return message.c_str();
+    }
+};
+
+inline uint64_t zigzag_encode(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+inline size_t varint_len(uint64_t v) {
+    // 7 bits a byte: 1 byte up to 127, 10 for 64 bits
+    return (64 - __builtin_clzll(v | 1) + 6) / 7;
+}
+
+// Writes v at p, returns the byte after it
+inline byte_t* put_varint(byte_t* p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = static_cast<byte_t>(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<byte_t>(v);
+    return p;
+}
+
+/*
+ Reads a varint at p, no further than end. Returns the byte after it, nullptr if it runs past end or over 64 bits
+ */
+inline const byte_t* get_varint(const byte_t* p, const byte_t* end, uint64_t& v) {
+    v = 0;
+    for (unsigned int shift = 0; shift < 64 && p != end; shift += 7) {
+        uint8_t b = static_cast<uint8_t>(*p++);
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+// width bytes at p, little-endian. The common widths are one load, so loops over a column of them stay cheap
+inline uint64_t load_le(const byte_t* p, size_t width) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint16_t v16;
+    uint32_t v32;
+    uint64_t v64;
+    switch (width) {
+        case 1:
+            return static_cast<uint8_t>(*p);
+        case 2:
+            memcpy(&v16, p, sizeof(v16));
+            return v16;
+        case 4:
+            memcpy(&v32, p, sizeof(v32));
+            return v32;
+        case 8:
+            memcpy(&v64, p, sizeof(v64));
+            return v64;
+    }
+#endif
+    uint64_t v = 0;
+    for (size_t i = width; i-- > 0;) {
+        v = v << 8 | static_cast<uint8_t>(p[i]);
+    }
+    return v;
+}
+
+inline void store_le(byte_t* p, uint64_t v, size_t width) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint16_t v16 = static_cast<uint16_t>(v);
+    uint32_t v32 = static_cast<uint32_t>(v);
+    switch (width) {
+        case 1:
+            *p = static_cast<byte_t>(v);
+            return;
+        case 2:
+            memcpy(p, &v16, sizeof(v16));
+            return;
+        case 4:
+            memcpy(p, &v32, sizeof(v32));
+            return;
+        case 8:
+            memcpy(p, &v, sizeof(v));
+            return;
+    }
+#endif
+    for (size_t i = 0; i < width; ++i) {
+        p[i] = static_cast<byte_t>(v);
+        v >>= 8;
+    }
+}
+
+#endif /* ColumnFormat_hpp */
@@ -0,0 +1,303 @@
+//
+//  ColumnWriter.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include <algorithm>
+#include "ColumnWriter.hpp"
+
+// Encoding and length before each column's data
+static const size_t column_header_len = 5;
+
+ColumnWriter::ColumnWriter(OutputBuffer& out, ColumnWriterOptions opts) :out{out}, opts{opts}, rows{0}, stats{}, stamp{0} {
+    this->opts.block_rows = std::max<uint32_t>(opts.block_rows, 1);
+    for (size_t i = 0; i < HEADER_COLUMNS; ++i) {
+        columns[i].info = &header_column_info(static_cast<HeaderColumn>(i));
+        columns[i].values.resize(static_cast<size_t>(this->opts.block_rows) * columns[i].info->width);
+    }
+
+    size_t max_entries = std::min<size_t>(this->opts.block_rows, MAX_DICTIONARY_ENTRIES);
+    size_t slots = size_t {1} << 16;
+    while (slots < 2 * max_entries) {
+        slots <<= 1;
+    }
+    dict_mask = static_cast<uint32_t>(slots - 1);
+    dict_slots.assign(slots, DictionarySlot {0, 0});
+    dict_rows.resize(max_entries);
+    dict_indices.resize(this->opts.block_rows);
+
+    size_t header_len = sizeof(COLUMN_FILE_MAGIC) + 4 + 2;
+    for (const Column& c : columns) {
+        header_len += 1 + c.info->name.size() + 2;
+    }
+    byte_t* p = out.claim(header_len);
+    memcpy(p, COLUMN_FILE_MAGIC, sizeof(COLUMN_FILE_MAGIC));
+    p += sizeof(COLUMN_FILE_MAGIC);
+    store_le(p, COLUMN_FILE_VERSION, 4);
+    store_le(p + 4, HEADER_COLUMNS, 2);
+    p += 6;
+    for (const Column& c : columns) {
+        *p++ = static_cast<byte_t>(c.info->name.size());
+        memcpy(p, c.info->name.data(), c.info->name.size());
+        p += c.info->name.size();
+        *p++ = static_cast<byte_t>(c.info->type);
+        *p++ = static_cast<byte_t>(c.info->width);
+    }
+    out.commit(header_len);
+}
+
+void ColumnWriter::add(const bpf_hdr& bhdr, const PacketView& packet) {
+    set(HeaderColumn::TIMESTAMP, static_cast<uint64_t>(bhdr.bh_tstamp.tv_sec) * 1000000 + static_cast<uint64_t>(bhdr.bh_tstamp.tv_usec));
+    set(HeaderColumn::CAPLEN, bhdr.bh_caplen);
+    set(HeaderColumn::WIRELEN, bhdr.bh_datalen);
+
+    if (packet.get_len() >= sizeof(ether_header)) {
+        const ether_header& eth = packet.get_ether_header().get_header();
+        memcpy(field(HeaderColumn::SRC_MAC), eth.ether_shost, ETHER_ADDR_LEN);
+        memcpy(field(HeaderColumn::DST_MAC), eth.ether_dhost, ETHER_ADDR_LEN);
+    } else {
+        memset(field(HeaderColumn::SRC_MAC), 0, ETHER_ADDR_LEN);
+        memset(field(HeaderColumn::DST_MAC), 0, ETHER_ADDR_LEN);
+    }
+    set(HeaderColumn::ETHER_TYPE, packet.get_ether_type());
+
+    byte_t* src = field(HeaderColumn::SRC_IP);
+    byte_t* dst = field(HeaderColumn::DST_IP);
+    memset(src, 0, sizeof(in6_addr));
+    memset(dst, 0, sizeof(in6_addr));
+    uint64_t ttl = 0, protocol = 0, payload_len = 0;
+    // Headers a failed parse did get through are still good
+    bool network = packet.ok() || packet.get_failed_layer() == ParseLayer::TRANSPORT;
+    if (network && packet.get_network_kind() == NetworkKind::IPV4) {
+        HeaderView<ip> h = packet.get_ip_header();
+        // IPv4-mapped, so one column holds both families
+        src[10] = dst[10] = static_cast<byte_t>(0xff);
+        src[11] = dst[11] = static_cast<byte_t>(0xff);
+        memcpy(src + 12, &h->ip_src, sizeof(in_addr));
+        memcpy(dst + 12, &h->ip_dst, sizeof(in_addr));
+        ttl = h->ip_ttl;
+        protocol = packet.get_protocol();
+        size_t headers = static_cast<size_t>(packet.get_data() - h.get_bytes());
+        size_t total = ntohs(h->ip_len);
+        payload_len = packet.ok() && total > headers ? total - headers : 0;
+    } else if (network && packet.get_network_kind() == NetworkKind::IPV6) {
+        HeaderView<ip6_hdr> h = packet.get_ip6_header();
+        memcpy(src, &h->ip6_src, sizeof(in6_addr));
+        memcpy(dst, &h->ip6_dst, sizeof(in6_addr));
+        ttl = h->ip6_hlim;
+        protocol = packet.get_protocol();
+        size_t headers = static_cast<size_t>(packet.get_data() - h.get_bytes());
+        size_t total = sizeof(ip6_hdr) + ntohs(h->ip6_plen);
+        payload_len = packet.ok() && total > headers ? total - headers : 0;
+    } else if (network && packet.get_network_kind() == NetworkKind::ARP) {
+        // Sender and target protocol addresses, as the text formats show them
+        HeaderView<ether_arp> h = packet.get_arp_header();
+        src[10] = dst[10] = static_cast<byte_t>(0xff);
+        src[11] = dst[11] = static_cast<byte_t>(0xff);
+        memcpy(src + 12, h->arp_spa, sizeof(in_addr));
+        memcpy(dst + 12, h->arp_tpa, sizeof(in_addr));
+    }
+    set(HeaderColumn::TTL, ttl);
+    set(HeaderColumn::PROTOCOL, protocol);
+    set(HeaderColumn::PAYLOAD_LEN, payload_len);
+
+    uint64_t sport = 0, dport = 0, seq = 0, ack = 0, flags = 0, window = 0;
+    if (packet.ok() && packet.get_transport_kind() == TransportKind::TCP) {
+        HeaderView<tcphdr> h = packet.get_tcp_header();
+        sport = ntohs(h->th_sport);
+        dport = ntohs(h->th_dport);
+        seq = ntohl(h->th_seq);
+        ack = ntohl(h->th_ack);
+        flags = h->th_flags;
+        window = ntohs(h->th_win);
+    } else if (packet.ok() && packet.get_transport_kind() == TransportKind::UDP) {
+        HeaderView<udphdr> h = packet.get_udp_header();
+        sport = ntohs(h->uh_sport);
+        dport = ntohs(h->uh_dport);
+    }
+    set(HeaderColumn::SRC_PORT, sport);
+    set(HeaderColumn::DST_PORT, dport);
+    set(HeaderColumn::TCP_SEQ, seq);
+    set(HeaderColumn::TCP_ACK, ack);
+    set(HeaderColumn::TCP_FLAGS, flags);
+    set(HeaderColumn::TCP_WINDOW, window);
+
+    if (++rows == opts.block_rows) {
+        write_block();
+    }
+}
+
+void ColumnWriter::flush() {
+    if (rows > 0) {
+        write_block();
+    }
+    out.flush();
+}
+
+void ColumnWriter::write_block() {
+    store_le(out.claim(4), rows, 4);
+    out.commit(4);
+    for (size_t i = 0; i < HEADER_COLUMNS; ++i) {
+        write_column(i);
+    }
+    stats.rows += rows;
+    ++stats.blocks;
+    rows = 0;
+}
+
+size_t ColumnWriter::build_dictionary(const Column& c, size_t limit) {
+    if (++stamp == 0) {
+        std::fill(dict_slots.begin(), dict_slots.end(), DictionarySlot {0, 0});
+        stamp = 1;
+    }
+    limit = std::min(limit, dict_rows.size());
+    size_t width = c.info->width;
+    const byte_t* values = c.values.data();
+    bool direct = width <= 2;
+    size_t entries = 0;
+    for (uint32_t r = 0; r < rows; ++r) {
+        const byte_t* v = values + r * width;
+        uint32_t s;
+        if (direct) {
+            s = static_cast<uint32_t>(load_le(v, width));
+        } else {
+            uint64_t a = load_le(v, std::min<size_t>(width, 8));
+            uint64_t b = width > 8 ? load_le(v + 8, width - 8) : 0;
+            // Murmur3 finaliser
+            uint64_t h = a ^ (b * 0x9e3779b97f4a7c15ULL);
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 33;
+            s = static_cast<uint32_t>(h) & dict_mask;
+        }
+        while (true) {
+            DictionarySlot& slot = dict_slots[s];
+            if (slot.stamp != stamp) {
+                if (entries == limit) {
+                    return 0;
+                }
+                slot.stamp = stamp;
+                slot.entry = static_cast<uint32_t>(entries);
+                dict_rows[entries] = r;
+                dict_indices[r] = static_cast<uint32_t>(entries++);
+                break;
+            }
+            if (direct || memcmp(values + dict_rows[slot.entry] * width, v, width) == 0) {
+                dict_indices[r] = slot.entry;
+                break;
+            }
+            s = (s + 1) & dict_mask;
+        }
+    }
+    return entries;
+}
+
+// Differences wrap at the column's width: shifting up and back sign extends them from there
+static int64_t wrapped_delta(uint64_t v, uint64_t prev, size_t width) {
+    unsigned int shift = static_cast<unsigned int>(64 - 8 * width);
+    return static_cast<int64_t>((v - prev) << shift) >> shift;
+}
+
+/*
+ Sizes of a UINT column of Width byte values as VARINT and as DELTA. A template so the loads are fixed width
+ */
+template <size_t Width>
+static void measure_uint(const byte_t* values, uint32_t rows, size_t& varint_total, size_t& delta_total) {
+    uint64_t prev = 0;
+    for (uint32_t r = 0; r < rows; ++r) {
+        uint64_t v = load_le(values + r * Width, Width);
+        varint_total += varint_len(v);
+        delta_total += varint_len(zigzag_encode(wrapped_delta(v, prev, Width)));
+        prev = v;
+    }
+}
+
+void ColumnWriter::write_column(size_t i) {
+    const Column& c = columns[i];
+    size_t width = c.info->width;
+    const byte_t* values = c.values.data();
+
+    ColumnEncoding encoding = ColumnEncoding::PLAIN;
+    size_t len = rows * width;
+    if (c.info->type == ColumnType::UINT) {
+        size_t varint_total = 0, delta_total = 0;
+        switch (width) {
+            case 1:
+                measure_uint<1>(values, rows, varint_total, delta_total);
+                break;
+            case 2:
+                measure_uint<2>(values, rows, varint_total, delta_total);
+                break;
+            case 4:
+                measure_uint<4>(values, rows, varint_total, delta_total);
+                break;
+            default:
+                measure_uint<8>(values, rows, varint_total, delta_total);
+        }
+        if (varint_total < len) {
+            encoding = ColumnEncoding::VARINT;
+            len = varint_total;
+        }
+        if (delta_total < len) {
+            encoding = ColumnEncoding::DELTA;
+            len = delta_total;
+        }
+    }
+    // Only worth building while it can still come out smaller: the entries alone must be, and an index of 1 (or 2)
+    // bytes a row must leave room for them
+    size_t limit = len <= rows ? 1 : len <= 2 * rows ? std::min<size_t>(len / width, 256) : len / width;
+    size_t entries = build_dictionary(c, limit);
+    size_t index_width = 0;
+    if (entries != 0) {
+        index_width = entries == 1 ? 0 : entries <= 256 ? 1 : 2;
+        size_t dict_len = varint_len(entries) + 1 + entries * width + rows * index_width;
+        if (dict_len < len) {
+            encoding = ColumnEncoding::DICTIONARY;
+            len = dict_len;
+        }
+    }
+
+    byte_t* p = out.claim(column_header_len + len);
+    *p = static_cast<byte_t>(encoding);
+    store_le(p + 1, len, 4);
+    p += column_header_len;
+    switch (encoding) {
+        case ColumnEncoding::PLAIN:
+            memcpy(p, values, len);
+            break;
+        case ColumnEncoding::VARINT:
+            for (uint32_t r = 0; r < rows; ++r) {
+                p = put_varint(p, load_le(values + r * width, width));
+            }
+            break;
+        case ColumnEncoding::DELTA: {
+            uint64_t prev = 0;
+            for (uint32_t r = 0; r < rows; ++r) {
+                uint64_t v = load_le(values + r * width, width);
+                p = put_varint(p, zigzag_encode(wrapped_delta(v, prev, width)));
+                prev = v;
+            }
+            break;
+        }
+        case ColumnEncoding::DICTIONARY:
+            p = put_varint(p, entries);
+            *p++ = static_cast<byte_t>(index_width);
+            for (size_t e = 0; e < entries; ++e) {
+                memcpy(p, values + dict_rows[e] * width, width);
+                p += width;
+            }
+            for (uint32_t r = 0; r < rows; ++r) {
+                store_le(p, dict_indices[r], index_width);
+                p += index_width;
+            }
+            break;
+    }
+    out.commit(column_header_len + len);
+    stats.column_bytes[i] += column_header_len + len;
+    ++stats.encodings[static_cast<size_t>(encoding)];
+}
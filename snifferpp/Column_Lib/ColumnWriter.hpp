@@ -0,0 +1,105 @@
+//
+//  ColumnWriter.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef ColumnWriter_hpp
+#define ColumnWriter_hpp
+
+#include <vector>
+#include <cstdint>
+#include "ColumnFormat.hpp"
+#include "PacketView.hpp"
+#include "BPFPacket.hpp"
+#include "OutputBuffer.hpp"
+
+struct ColumnWriterOptions {
+    uint32_t block_rows = 65536; // Packets per block: bigger blocks encode smaller, smaller ones reach the file sooner
+};
+
+/*
+ Totals over a writer's life
+ */
+struct ColumnWriterStats {
+    uint64_t rows;
+    uint64_t blocks;
+    uint64_t column_bytes[HEADER_COLUMNS]; // Encoded, with each block's column header
+    uint64_t encodings[COLUMN_ENCODINGS]; // How often each encoding was the smallest for a column of a block
+};
+
+/*
+ Decoded header fields of every packet (the HeaderColumn columns) as a column file (see ColumnFormat.hpp), for loading
+ into analysis tools without going through text: a row per packet, columns of fixed width values.
+
+ add() only copies the fields into per-column buffers sized for a block at construction, so nothing is allocated per
+ packet. Every block_rows packets the block is encoded, each column as whichever of plain, varint, delta or dictionary
+ comes out smallest for it, and handed to out. Capture traffic suits them well: timestamps are small steps, lengths
+ and ports a few values, addresses and MACs a dictionary of the hosts talking, so a row takes a few tens of bytes
+ against a pcap record's 16 plus the frame.
+
+ Not thread safe: feed it from the capture thread.
+ */
+class ColumnWriter {
+private:
+    struct Column {
+        const ColumnInfo* info;
+        std::vector<byte_t> values; // block_rows of info->width bytes, little-endian
+    };
+
+    OutputBuffer& out;
+    ColumnWriterOptions opts;
+    Column columns[HEADER_COLUMNS];
+    uint32_t rows; // In the block being filled
+    ColumnWriterStats stats;
+
+    struct DictionarySlot {
+        uint32_t stamp; // Slots not stamped with the current build are empty, so nothing is cleared between builds
+        uint32_t entry;
+    };
+
+    // Dictionary building, shared by every column of every block. Values of up to 2 bytes index it directly, wider
+    // ones are hashed into it
+    std::vector<DictionarySlot> dict_slots;
+    uint32_t stamp;
+    uint32_t dict_mask;
+    std::vector<uint32_t> dict_rows; // First row holding each entry
+    std::vector<uint32_t> dict_indices; // Entry of each row
+
+    byte_t* field(HeaderColumn c) {
+        Column& col = columns[static_cast<size_t>(c)];
+        return col.values.data() + static_cast<size_t>(rows) * col.info->width;
+    }
+
+    void set(HeaderColumn c, uint64_t v) {
+        store_le(field(c), v, columns[static_cast<size_t>(c)].info->width);
+    }
+
+    /*
+     Entries in a dictionary of c's values, building dict_rows and dict_indices. 0 if it would take more than limit
+     entries (or MAX_DICTIONARY_ENTRIES)
+     */
+    size_t build_dictionary(const Column& c, size_t limit);
+
+    void write_block(void);
+    void write_column(size_t i);
+
+public:
+    // Writes the file header to out
+    ColumnWriter(OutputBuffer& out, ColumnWriterOptions opts = ColumnWriterOptions {});
+
+    ColumnWriter(const ColumnWriter& other)= delete;
+    ColumnWriter operator=(const ColumnWriter& other)=delete;
+
+    // packet may be only partly parsed (see parse_packet): fields past where it stopped are 0
+    void add(const bpf_hdr& bhdr, const PacketView& packet);
+
+    // Writes out the rows of a block not yet full and flushes out (at the end of a capture)
+    void flush(void);
+
+    const ColumnWriterStats& get_stats(void) const { return stats; }
+};
+
+#endif /* ColumnWriter_hpp */
@@ -0,0 +1,305 @@
+//
+//  BPFProgram.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include <iomanip>
+#include <sstream>
+#include "BPFProgram.hpp"
+
+using std::ostream;
+using std::endl;
+
+// Loads are big endian, whatever the host
+static uint32_t load_word(const byte_t* p) {
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    return (uint32_t {b[0]} << 24) | (uint32_t {b[1]} << 16) | (uint32_t {b[2]} << 8) | b[3];
+}
+
+static uint32_t load_half(const byte_t* p) {
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    return (uint32_t {b[0]} << 8) | b[1];
+}
+
+uint32_t BPFProgram::run(const byte_t* packet, size_t wire_len, size_t buffer_len) const {
+    uint32_t A = 0;
+    uint32_t X = 0;
+    uint32_t mem[BPF_MEMWORDS] = {0};
+
+    size_t pc = 0;
+    while (pc < insns.size()) {
+        const bpf_insn& in = insns[pc++];
+        uint32_t k = in.k;
+        switch (BPF_CLASS(in.code)) {
+            case BPF_LD:
+            case BPF_LDX: {
+                bool to_x = BPF_CLASS(in.code) == BPF_LDX;
+                uint32_t value;
+                switch (BPF_MODE(in.code)) {
+                    case BPF_IMM:
+                        value = k;
+                        break;
+                    case BPF_LEN:
+                        value = static_cast<uint32_t>(wire_len);
+                        break;
+                    case BPF_MEM:
+                        if (k >= BPF_MEMWORDS) {
+                            return 0;
+                        }
+                        value = mem[k];
+                        break;
+                    case BPF_MSH:
+                        // 4 * (low nibble of a byte): the IP header length
+                        if (k >= buffer_len) {
+                            return 0;
+                        }
+                        value = (packet[k] & 0xf) << 2;
+                        break;
+                    case BPF_ABS:
+                    case BPF_IND: {
+                        uint64_t off = k;
+                        if (BPF_MODE(in.code) == BPF_IND) {
+                            off += X;
+                        }
+                        size_t size = BPF_SIZE(in.code) == BPF_W ? 4 : BPF_SIZE(in.code) == BPF_H ? 2 : 1;
+                        if (off + size > buffer_len) {
+                            return 0;
+                        }
+                        if (size == 4) {
+                            value = load_word(packet + off);
+                        } else if (size == 2) {
+                            value = load_half(packet + off);
+                        } else {
+                            value = static_cast<unsigned char>(packet[off]);
+                        }
+                        break;
+                    }
+                    default:
+                        return 0;
+                }
+                if (to_x) {
+                    X = value;
+                } else {
+                    A = value;
+                }
+                break;
+            }
+            case BPF_ST:
+            case BPF_STX:
+                if (k >= BPF_MEMWORDS) {
+                    return 0;
+                }
+                mem[k] = BPF_CLASS(in.code) == BPF_ST ? A : X;
+                break;
+            case BPF_ALU: {
+                uint32_t v = BPF_SRC(in.code) == BPF_X ? X : k;
+                switch (BPF_OP(in.code)) {
+                    case BPF_ADD: A += v; break;
+                    case BPF_SUB: A -= v; break;
+                    case BPF_MUL: A *= v; break;
+                    case BPF_DIV:
+                        if (v == 0) {
+                            return 0;
+                        }
+                        A /= v;
+                        break;
+                    case BPF_MOD:
+                        if (v == 0) {
+                            return 0;
+                        }
+                        A %= v;
+                        break;
+                    case BPF_OR: A |= v; break;
+                    case BPF_AND: A &= v; break;
+                    case BPF_XOR: A ^= v; break;
+                    case BPF_LSH: A = v < 32 ? A << v : 0; break;
+                    case BPF_RSH: A = v < 32 ? A >> v : 0; break;
+                    case BPF_NEG: A = -A; break;
+                    default:
+                        return 0;
+                }
+                break;
+            }
+            case BPF_JMP: {
+                if (BPF_OP(in.code) == BPF_JA) {
+                    pc += k;
+                    break;
+                }
+                uint32_t v = BPF_SRC(in.code) == BPF_X ? X : k;
+                bool taken;
+                switch (BPF_OP(in.code)) {
+                    case BPF_JEQ: taken = A == v; break;
+                    case BPF_JGT: taken = A > v; break;
+                    case BPF_JGE: taken = A >= v; break;
+                    case BPF_JSET: taken = (A & v) != 0; break;
+                    default:
+                        return 0;
+                }
+                pc += taken ? in.jt : in.jf;
+                break;
+            }
+            case BPF_RET:
+                return BPF_RVAL(in.code) == BPF_A ? A : k;
+            case BPF_MISC:
+                if (BPF_MISCOP(in.code) == BPF_TAX) {
+                    X = A;
+                } else {
+                    A = X;
+                }
+                break;
+        }
+    }
+    // Fell off the end (validate() rules this out)
+    return 0;
+}
+
+bool BPFProgram::validate() const {
+    if (insns.empty() || insns.size() > BPF_MAXINSNS) {
+        return false;
+    }
+    for (size_t i = 0; i < insns.size(); ++i) {
+        const bpf_insn& in = insns[i];
+        size_t left = insns.size() - i - 1;
+        switch (BPF_CLASS(in.code)) {
+            case BPF_LD:
+            case BPF_LDX:
+                if (BPF_MODE(in.code) == BPF_MEM && in.k >= BPF_MEMWORDS) {
+                    return false;
+                }
+                break;
+            case BPF_ST:
+            case BPF_STX:
+                if (in.k >= BPF_MEMWORDS) {
+                    return false;
+                }
+                break;
+            case BPF_ALU:
+                if ((BPF_OP(in.code) == BPF_DIV || BPF_OP(in.code) == BPF_MOD) && BPF_SRC(in.code) == BPF_K && in.k == 0) {
+                    return false;
+                }
+                break;
+            case BPF_JMP:
+                if (BPF_OP(in.code) == BPF_JA) {
+                    if (in.k >= left) {
+                        return false;
+                    }
+                } else if (in.jt >= left || in.jf >= left) {
+                    return false;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return BPF_CLASS(insns.back().code) == BPF_RET;
+}
+
+// Mnemonics for printing
+static const char* ld_name(uint16_t code) {
+    if (BPF_CLASS(code) == BPF_LDX) {
+        return BPF_MODE(code) == BPF_MSH ? "ldxb" : "ldx";
+    }
+    switch (BPF_SIZE(code)) {
+        case BPF_H: return "ldh";
+        case BPF_B: return "ldb";
+        default: return "ld";
+    }
+}
+
+static const char* alu_name(uint16_t code) {
+    switch (BPF_OP(code)) {
+        case BPF_ADD: return "add";
+        case BPF_SUB: return "sub";
+        case BPF_MUL: return "mul";
+        case BPF_DIV: return "div";
+        case BPF_MOD: return "mod";
+        case BPF_OR: return "or";
+        case BPF_AND: return "and";
+        case BPF_XOR: return "xor";
+        case BPF_LSH: return "lsh";
+        case BPF_RSH: return "rsh";
+        case BPF_NEG: return "neg";
+        default: return "alu?";
+    }
+}
+
+static const char* jmp_name(uint16_t code) {
+    switch (BPF_OP(code)) {
+        case BPF_JA: return "ja";
+        case BPF_JEQ: return "jeq";
+        case BPF_JGT: return "jgt";
+        case BPF_JGE: return "jge";
+        case BPF_JSET: return "jset";
+        default: return "j?";
+    }
+}
+
+ostream& operator<<(ostream& os, const BPFProgram& prog) {
+    std::ios tmp {NULL};
+    tmp.copyfmt(os);
+    const std::vector<bpf_insn>& insns = prog.get_insns();
+    for (size_t i = 0; i < insns.size(); ++i) {
+        const bpf_insn& in = insns[i];
+        os << "(" << std::dec << std::right << std::setfill('0') << std::setw(3) << i << ") " << std::setfill(' ') << std::left;
+        switch (BPF_CLASS(in.code)) {
+            case BPF_LD:
+            case BPF_LDX:
+                os << std::setw(9) << ld_name(in.code);
+                switch (BPF_MODE(in.code)) {
+                    case BPF_IMM: os << "#" << in.k; break;
+                    case BPF_LEN: os << "#pktlen"; break;
+                    case BPF_MEM: os << "M[" << in.k << "]"; break;
+                    case BPF_ABS: os << "[" << in.k << "]"; break;
+                    case BPF_IND: os << "[x + " << in.k << "]"; break;
+                    case BPF_MSH: os << "4*([" << in.k << "]&0xf)"; break;
+                }
+                break;
+            case BPF_ST:
+            case BPF_STX:
+                os << std::setw(9) << (BPF_CLASS(in.code) == BPF_ST ? "st" : "stx") << "M[" << in.k << "]";
+                break;
+            case BPF_ALU:
+                os << std::setw(9) << alu_name(in.code);
+                if (BPF_OP(in.code) != BPF_NEG) {
+                    if (BPF_SRC(in.code) == BPF_X) {
+                        os << "x";
+                    } else {
+                        os << "#0x" << std::hex << in.k << std::dec;
+                    }
+                }
+                break;
+            case BPF_JMP:
+                os << std::setw(9) << jmp_name(in.code);
+                if (BPF_OP(in.code) == BPF_JA) {
+                    os << i + 1 + in.k;
+                } else {
+                    if (BPF_SRC(in.code) == BPF_X) {
+                        os << std::setw(17) << "x";
+                    } else {
+                        std::ostringstream k;
+                        k << "#0x" << std::hex << in.k;
+                        os << std::setw(17) << k.str();
+                    }
+                    os << "jt " << std::setw(5) << i + 1 + in.jt << "jf " << i + 1 + in.jf;
+                }
+                break;
+            case BPF_RET:
+                os << std::setw(9) << "ret";
+                if (BPF_RVAL(in.code) == BPF_A) {
+                    os << "a";
+                } else {
+                    os << "#" << in.k;
+                }
+                break;
+            case BPF_MISC:
+                os << (BPF_MISCOP(in.code) == BPF_TAX ? "tax" : "txa");
+                break;
+        }
+        os << endl;
+    }
+    os.copyfmt(tmp);
+    return os;
+}
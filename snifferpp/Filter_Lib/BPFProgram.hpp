@@ -0,0 +1,52 @@
+//
+//  BPFProgram.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef BPFProgram_hpp
+#define BPFProgram_hpp
+
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include "standard_headers.hpp"
+#include "bpf_compat.hpp"
+
+/*
+ A classic BPF program, as understood by BIOCSETF and SO_ATTACH_FILTER
+
+ run() is a userspace interpreter for the same bytecode, so a program can be checked against packets we build by hand
+ (or applied to capture files) and gives the same answer the kernel would.
+ */
+class BPFProgram {
+private:
+    std::vector<bpf_insn> insns;
+
+public:
+    BPFProgram() {};
+    BPFProgram(std::vector<bpf_insn> insns) :insns{std::move(insns)} {};
+
+    const std::vector<bpf_insn>& get_insns(void) const { return insns; }
+    size_t get_len(void) const { return insns.size(); }
+
+    /*
+     Bytes of the packet to keep, 0 to drop it. wire_len is the original length (BPF_LEN), the first buffer_len bytes
+     were captured; loads past buffer_len reject the packet, as they do in the kernel
+     */
+    uint32_t run(const byte_t* packet, size_t wire_len, size_t buffer_len) const;
+    bool matches(const byte_t* packet, size_t wire_len, size_t buffer_len) const { return run(packet, wire_len, buffer_len) != 0; }
+
+    /*
+     The checks the kernel makes before accepting a program: every jump lands inside it, scratch memory indices are in
+     range, no constant division by zero, and it ends in a return
+     */
+    bool validate(void) const;
+};
+
+// One instruction per line, in the format of tcpdump -d
+std::ostream& operator<<(std::ostream& os, const BPFProgram& prog);
+
+#endif /* BPFProgram_hpp */
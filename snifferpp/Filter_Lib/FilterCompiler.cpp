@@ -0,0 +1,891 @@
+//
+//  FilterCompiler.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include <memory>
+#include <vector>
+#include <cctype>
+#include <arpa/inet.h>
+#include "FilterCompiler.hpp"
+
+using std::string;
+using std::vector;
+using std::unique_ptr;
+
+// Where things sit in an ethernet frame carrying IPv4 (options make the transport header offset variable, see BPF_MSH)
+const uint32_t ETHERTYPE_OFFSET = 12;
+const uint32_t IP_OFFSET = 14;
+const uint32_t IP_FRAGMENT_OFFSET = IP_OFFSET + 6;
+const uint32_t IP_PROTO_OFFSET = IP_OFFSET + 9;
+const uint32_t IP_SRC_OFFSET = IP_OFFSET + 12;
+const uint32_t IP_DST_OFFSET = IP_OFFSET + 16;
+const uint32_t SPORT_OFFSET = IP_OFFSET; // Plus the IP header length in X
+const uint32_t DPORT_OFFSET = IP_OFFSET + 2;
+const uint32_t TCP_FLAGS_OFFSET = IP_OFFSET + 13;
+const uint32_t IP_FRAGMENT_MASK = 0x1fff;
+
+/*
+ Parsing
+ */
+static vector<string> tokenize(const string& expression) {
+    vector<string> tokens;
+    size_t i = 0;
+    while (i < expression.size()) {
+        char c = expression[i];
+        if (isspace(static_cast<unsigned char>(c))) {
+            ++i;
+        } else if (c == '(' || c == ')' || (c == '!' )) {
+            tokens.push_back(string {c});
+            ++i;
+        } else if ((c == '&' || c == '|') && i + 1 < expression.size() && expression[i+1] == c) {
+            tokens.push_back(expression.substr(i, 2));
+            i += 2;
+        } else {
+            size_t start = i;
+            while (i < expression.size() && !isspace(static_cast<unsigned char>(expression[i])) && expression[i] != '(' && expression[i] != ')') {
+                ++i;
+            }
+            string word = expression.substr(start, i - start);
+            for (char& w : word) {
+                w = tolower(static_cast<unsigned char>(w));
+            }
+            tokens.push_back(word);
+        }
+    }
+    return tokens;
+}
+
+enum class Primitive {ETHERTYPE, PROTO, HOST, NET, PORT, TCP_FLAGS};
+enum class Direction {ANY, SRC, DST};
+
+struct FilterNode {
+    enum class Kind {AND, OR, NOT, LEAF};
+
+    Kind kind;
+    unique_ptr<FilterNode> left, right;
+
+    // Leaves only
+    Primitive primitive;
+    Direction dir;
+    uint32_t value;
+    uint32_t mask; // Net mask, or TCP flags
+    uint8_t proto; // Port primitives: 0 for TCP or UDP
+
+    FilterNode(Kind kind) :kind{kind}, primitive{Primitive::ETHERTYPE}, dir{Direction::ANY}, value{0}, mask{0xffffffff}, proto{0} {};
+};
+
+class FilterParser {
+private:
+    vector<string> tokens;
+    size_t pos;
+
+    bool at_end(void) const { return pos == tokens.size(); }
+    const string& peek(void) const { return tokens[pos]; }
+
+    const string& next(const char* what) {
+        if (at_end()) {
+            string m {"Expected "};
+            m += what;
+            m += " at end of filter: ";
+            throw FilterSyntaxError {m};
+        }
+        return tokens[pos++];
+    }
+
+    [[noreturn]] void unexpected(const string& token, const char* what) {
+        string m {"Expected "};
+        m += what;
+        m += ", got '" + token + "': ";
+        throw FilterSyntaxError {m};
+    }
+
+    static unique_ptr<FilterNode> join(FilterNode::Kind kind, unique_ptr<FilterNode> l, unique_ptr<FilterNode> r) {
+        unique_ptr<FilterNode> n {new FilterNode {kind}};
+        n->left = std::move(l);
+        n->right = std::move(r);
+        return n;
+    }
+
+    uint32_t parse_number(const string& token, uint32_t max, const char* what) {
+        if (token.empty() || token.find_first_not_of("0123456789") != string::npos || token.size() > 10) {
+            unexpected(token, what);
+        }
+        unsigned long v = std::stoul(token);
+        if (v > max) {
+            unexpected(token, what);
+        }
+        return static_cast<uint32_t>(v);
+    }
+
+    // Host byte order, which is how BPF loads see it
+    uint32_t parse_address(const string& token) {
+        in_addr addr;
+        if (inet_pton(AF_INET, token.c_str(), &addr) != 1) {
+            unexpected(token, "an IPv4 address");
+        }
+        return ntohl(addr.s_addr);
+    }
+
+    uint8_t parse_proto(const string& token) {
+        if (token == "tcp") {
+            return IPPROTO_TCP;
+        } else if (token == "udp") {
+            return IPPROTO_UDP;
+        } else if (token == "icmp") {
+            return IPPROTO_ICMP;
+        }
+        return static_cast<uint8_t>(parse_number(token, 255, "a protocol"));
+    }
+
+    uint32_t parse_flags(const string& token) {
+        static const char* names[] = {"fin", "syn", "rst", "psh", "ack", "urg", "ece", "cwr"};
+        uint32_t mask = 0;
+        size_t start = 0;
+        while (start <= token.size()) {
+            size_t end = token.find('|', start);
+            if (end == string::npos) {
+                end = token.size();
+            }
+            string name = token.substr(start, end - start);
+            bool found = false;
+            for (int i = 0; i < 8; ++i) {
+                if (name == names[i]) {
+                    mask |= 1u << i;
+                    found = true;
+                }
+            }
+            if (!found) {
+                unexpected(name, "a TCP flag");
+            }
+            start = end + 1;
+        }
+        return mask;
+    }
+
+    unique_ptr<FilterNode> parse_primitive(void) {
+        unique_ptr<FilterNode> n {new FilterNode {FilterNode::Kind::LEAF}};
+        string token = next("a primitive");
+
+        // tcp port 80, udp src port 53
+        if ((token == "tcp" || token == "udp") && !at_end() && (peek() == "port" || peek() == "src" || peek() == "dst")) {
+            n->proto = parse_proto(token);
+            token = next("port");
+        }
+        if (token == "src" || token == "dst") {
+            n->dir = token == "src" ? Direction::SRC : Direction::DST;
+            token = next("host, net or port");
+            if (token != "host" && token != "net" && token != "port") {
+                unexpected(token, "host, net or port");
+            }
+        }
+        if (n->proto != 0 && token != "port") {
+            unexpected(token, "port");
+        }
+
+        if (token == "ip") {
+            n->primitive = Primitive::ETHERTYPE;
+            n->value = ETHERTYPE_IP;
+        } else if (token == "arp") {
+            n->primitive = Primitive::ETHERTYPE;
+            n->value = ETHERTYPE_ARP;
+        } else if (token == "tcp" || token == "udp" || token == "icmp") {
+            n->primitive = Primitive::PROTO;
+            n->value = parse_proto(token);
+        } else if (token == "proto") {
+            n->primitive = Primitive::PROTO;
+            n->value = parse_proto(next("a protocol"));
+        } else if (token == "host") {
+            n->primitive = Primitive::HOST;
+            n->value = parse_address(next("an IPv4 address"));
+        } else if (token == "net") {
+            n->primitive = Primitive::NET;
+            string net = next("a network");
+            size_t slash = net.find('/');
+            uint32_t len = 32;
+            if (slash != string::npos) {
+                len = parse_number(net.substr(slash + 1), 32, "a prefix length");
+                net = net.substr(0, slash);
+            }
+            n->mask = len == 0 ? 0 : 0xffffffffu << (32 - len);
+            n->value = parse_address(net) & n->mask;
+        } else if (token == "port") {
+            n->primitive = Primitive::PORT;
+            n->value = parse_number(next("a port"), 65535, "a port");
+        } else if (token == "flags") {
+            n->primitive = Primitive::TCP_FLAGS;
+            n->mask = parse_flags(next("TCP flags"));
+        } else {
+            unexpected(token, "a primitive");
+        }
+        return n;
+    }
+
+    unique_ptr<FilterNode> parse_primary(void) {
+        if (!at_end() && peek() == "(") {
+            ++pos;
+            unique_ptr<FilterNode> n = parse_or();
+            const string& close = next("')'");
+            if (close != ")") {
+                unexpected(close, "')'");
+            }
+            return n;
+        }
+        return parse_primitive();
+    }
+
+    unique_ptr<FilterNode> parse_not(void) {
+        if (!at_end() && (peek() == "not" || peek() == "!")) {
+            ++pos;
+            unique_ptr<FilterNode> n {new FilterNode {FilterNode::Kind::NOT}};
+            n->left = parse_not();
+            return n;
+        }
+        return parse_primary();
+    }
+
+    unique_ptr<FilterNode> parse_and(void) {
+        unique_ptr<FilterNode> n = parse_not();
+        while (!at_end() && (peek() == "and" || peek() == "&&")) {
+            ++pos;
+            n = join(FilterNode::Kind::AND, std::move(n), parse_not());
+        }
+        return n;
+    }
+
+    unique_ptr<FilterNode> parse_or(void) {
+        unique_ptr<FilterNode> n = parse_and();
+        while (!at_end() && (peek() == "or" || peek() == "||")) {
+            ++pos;
+            n = join(FilterNode::Kind::OR, std::move(n), parse_and());
+        }
+        return n;
+    }
+
+public:
+    FilterParser(const string& expression) :tokens{tokenize(expression)}, pos{0} {};
+
+    unique_ptr<FilterNode> parse(void) {
+        if (tokens.empty()) {
+            throw FilterSyntaxError {"Empty filter: "};
+        }
+        unique_ptr<FilterNode> n = parse_or();
+        if (!at_end()) {
+            unexpected(peek(), "and, or or the end of the filter");
+        }
+        return n;
+    }
+};
+
+/*
+ Intermediate code: instructions with absolute jump targets (indices into the vector), so the optimiser can delete and
+ retarget freely before the relative offsets are worked out
+ */
+struct FilterInsn {
+    uint16_t code;
+    uint32_t k;
+    size_t jt, jf; // Conditional jumps: both targets. BPF_JA: jt
+    bool live;
+};
+
+static bool is_ja(uint16_t code) { return code == (BPF_JMP | BPF_JA); }
+static bool is_cond(uint16_t code) { return BPF_CLASS(code) == BPF_JMP && !is_ja(code); }
+static bool is_jump(uint16_t code) { return BPF_CLASS(code) == BPF_JMP; }
+
+/*
+ Code generation: each primitive becomes a short block of tests that jumps to the true or false label,
+ and/or/not just wire blocks to each other's labels
+ */
+class FilterCodegen {
+private:
+    vector<FilterInsn> insns;
+    vector<size_t> label_pos;
+
+    size_t new_label(void) {
+        label_pos.push_back(0);
+        return label_pos.size() - 1;
+    }
+    void place(size_t label) { label_pos[label] = insns.size(); }
+
+    void stmt(uint16_t code, uint32_t k) { insns.push_back(FilterInsn {code, k, 0, 0, true}); }
+    void jump(uint16_t code, uint32_t k, size_t lt, size_t lf) { insns.push_back(FilterInsn {code, k, lt, lf, true}); }
+
+    void ipv4(size_t lf) {
+        size_t next = new_label();
+        stmt(BPF_LD | BPF_H | BPF_ABS, ETHERTYPE_OFFSET);
+        jump(BPF_JMP | BPF_JEQ | BPF_K, ETHERTYPE_IP, next, lf);
+        place(next);
+    }
+
+    // Leaves X holding the IP header length, so transport fields are at [x + offset]
+    void first_fragment(size_t lf) {
+        size_t next = new_label();
+        stmt(BPF_LD | BPF_H | BPF_ABS, IP_FRAGMENT_OFFSET);
+        jump(BPF_JMP | BPF_JSET | BPF_K, IP_FRAGMENT_MASK, lf, next);
+        place(next);
+        stmt(BPF_LDX | BPF_B | BPF_MSH, IP_OFFSET);
+    }
+
+    void address(uint32_t offset, const FilterNode& n, size_t lt, size_t lf) {
+        stmt(BPF_LD | BPF_W | BPF_ABS, offset);
+        if (n.mask != 0xffffffff) {
+            stmt(BPF_ALU | BPF_AND | BPF_K, n.mask);
+        }
+        jump(BPF_JMP | BPF_JEQ | BPF_K, n.value, lt, lf);
+    }
+
+    void port(uint32_t offset, const FilterNode& n, size_t lt, size_t lf) {
+        stmt(BPF_LD | BPF_H | BPF_IND, offset);
+        jump(BPF_JMP | BPF_JEQ | BPF_K, n.value, lt, lf);
+    }
+
+    // Checks the source, the destination or (trying the source first) either
+    template <typename Test>
+    void either(const FilterNode& n, uint32_t src, uint32_t dst, size_t lt, size_t lf, Test test) {
+        if (n.dir == Direction::SRC) {
+            test(src, n, lt, lf);
+        } else if (n.dir == Direction::DST) {
+            test(dst, n, lt, lf);
+        } else {
+            size_t try_dst = new_label();
+            test(src, n, lt, try_dst);
+            place(try_dst);
+            test(dst, n, lt, lf);
+        }
+    }
+
+    void leaf(const FilterNode& n, size_t lt, size_t lf) {
+        switch (n.primitive) {
+            case Primitive::ETHERTYPE:
+                stmt(BPF_LD | BPF_H | BPF_ABS, ETHERTYPE_OFFSET);
+                jump(BPF_JMP | BPF_JEQ | BPF_K, n.value, lt, lf);
+                break;
+            case Primitive::PROTO:
+                ipv4(lf);
+                stmt(BPF_LD | BPF_B | BPF_ABS, IP_PROTO_OFFSET);
+                jump(BPF_JMP | BPF_JEQ | BPF_K, n.value, lt, lf);
+                break;
+            case Primitive::HOST:
+            case Primitive::NET:
+                ipv4(lf);
+                either(n, IP_SRC_OFFSET, IP_DST_OFFSET, lt, lf, [this](uint32_t off, const FilterNode& n, size_t lt, size_t lf) { address(off, n, lt, lf); });
+                break;
+            case Primitive::PORT: {
+                ipv4(lf);
+                size_t has_ports = new_label();
+                stmt(BPF_LD | BPF_B | BPF_ABS, IP_PROTO_OFFSET);
+                if (n.proto != 0) {
+                    jump(BPF_JMP | BPF_JEQ | BPF_K, n.proto, has_ports, lf);
+                } else {
+                    size_t try_udp = new_label();
+                    jump(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP, has_ports, try_udp);
+                    place(try_udp);
+                    jump(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, has_ports, lf);
+                }
+                place(has_ports);
+                first_fragment(lf);
+                either(n, SPORT_OFFSET, DPORT_OFFSET, lt, lf, [this](uint32_t off, const FilterNode& n, size_t lt, size_t lf) { port(off, n, lt, lf); });
+                break;
+            }
+            case Primitive::TCP_FLAGS: {
+                ipv4(lf);
+                size_t is_tcp = new_label();
+                stmt(BPF_LD | BPF_B | BPF_ABS, IP_PROTO_OFFSET);
+                jump(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP, is_tcp, lf);
+                place(is_tcp);
+                first_fragment(lf);
+                stmt(BPF_LD | BPF_B | BPF_IND, TCP_FLAGS_OFFSET);
+                jump(BPF_JMP | BPF_JSET | BPF_K, n.mask, lt, lf);
+                break;
+            }
+        }
+    }
+
+    void gen(const FilterNode& n, size_t lt, size_t lf) {
+        switch (n.kind) {
+            case FilterNode::Kind::AND: {
+                size_t right = new_label();
+                gen(*n.left, right, lf);
+                place(right);
+                gen(*n.right, lt, lf);
+                break;
+            }
+            case FilterNode::Kind::OR: {
+                size_t right = new_label();
+                gen(*n.left, lt, right);
+                place(right);
+                gen(*n.right, lt, lf);
+                break;
+            }
+            case FilterNode::Kind::NOT:
+                gen(*n.left, lf, lt);
+                break;
+            case FilterNode::Kind::LEAF:
+                leaf(n, lt, lf);
+                break;
+        }
+    }
+
+public:
+    vector<FilterInsn> generate(const FilterNode& root, uint32_t snaplen) {
+        size_t accept = new_label();
+        size_t reject = new_label();
+        gen(root, accept, reject);
+        place(accept);
+        stmt(BPF_RET | BPF_K, snaplen);
+        place(reject);
+        stmt(BPF_RET | BPF_K, 0);
+
+        for (FilterInsn& in : insns) {
+            if (is_jump(in.code)) {
+                in.jt = label_pos[in.jt];
+                in.jf = is_cond(in.code) ? label_pos[in.jf] : 0;
+            }
+        }
+        return std::move(insns);
+    }
+};
+
+/*
+ Optimisation, all on the intermediate code. Jumps only go forward, so the code is a DAG and one pass in index order
+ sees every predecessor of an instruction before the instruction itself
+ */
+class FilterOptimizer {
+private:
+    // What a successful comparison tells us about a packet field
+    enum class FactOp {EQ, NE, ANY_SET, NONE_SET};
+
+    struct Fact {
+        uint16_t load_code;
+        uint32_t load_k;
+        FactOp op;
+        uint32_t value;
+
+        bool operator==(const Fact& other) const {
+            return load_code == other.load_code && load_k == other.load_k && op == other.op && value == other.value;
+        }
+    };
+
+    // What holds on every path into an instruction
+    struct State {
+        bool reached;
+        bool a_known; // A still holds the packet field loaded by (a_code, a_k)
+        uint16_t a_code;
+        uint32_t a_k;
+        vector<Fact> facts;
+    };
+
+    static const size_t MAX_FACTS = 64;
+
+    vector<FilterInsn>& insns;
+
+    size_t next_live(size_t i) const {
+        while (i < insns.size() && !insns[i].live) {
+            ++i;
+        }
+        return i;
+    }
+
+    size_t resolve(size_t target) const {
+        target = next_live(target);
+        // Follow chains of unconditional jumps
+        for (size_t hops = 0; hops < insns.size() && target < insns.size() && is_ja(insns[target].code); ++hops) {
+            target = next_live(insns[target].jt);
+        }
+        return target;
+    }
+
+    template <typename F>
+    void for_each_successor(size_t i, F f) const {
+        const FilterInsn& in = insns[i];
+        if (BPF_CLASS(in.code) == BPF_RET) {
+            return;
+        } else if (is_ja(in.code)) {
+            f(next_live(in.jt));
+        } else if (is_cond(in.code)) {
+            f(next_live(in.jt));
+            f(next_live(in.jf));
+        } else {
+            f(next_live(i + 1));
+        }
+    }
+
+    static bool abs_load(uint16_t code) { return BPF_CLASS(code) == BPF_LD && BPF_MODE(code) == BPF_ABS; }
+
+    static void merge(State& into, const State& from) {
+        if (!into.reached) {
+            into = from;
+            into.reached = true;
+            return;
+        }
+        into.a_known = into.a_known && from.a_known && into.a_code == from.a_code && into.a_k == from.a_k;
+        vector<Fact> common;
+        for (const Fact& f : into.facts) {
+            for (const Fact& g : from.facts) {
+                if (f == g) {
+                    common.push_back(f);
+                    break;
+                }
+            }
+        }
+        into.facts = std::move(common);
+    }
+
+    static void learn(State& s, FactOp op, uint32_t value) {
+        Fact f {s.a_code, s.a_k, op, value};
+        for (const Fact& g : s.facts) {
+            if (g == f) {
+                return;
+            }
+        }
+        if (s.facts.size() < MAX_FACTS) {
+            s.facts.push_back(f);
+        }
+    }
+
+    static bool proven_loaded(const State& s, uint16_t code, uint32_t k) {
+        if (s.a_known && s.a_code == code && s.a_k == k) {
+            return true;
+        }
+        for (const Fact& f : s.facts) {
+            if (f.load_code == code && f.load_k == k) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 1 or 0 if the facts settle the comparison of A against k, -1 if not
+    static int decide(const State& s, uint16_t op, uint32_t k) {
+        for (const Fact& f : s.facts) {
+            if (f.load_code != s.a_code || f.load_k != s.a_k) {
+                continue;
+            }
+            switch (f.op) {
+                case FactOp::EQ:
+                    switch (op) {
+                        case BPF_JEQ: return f.value == k;
+                        case BPF_JGT: return f.value > k;
+                        case BPF_JGE: return f.value >= k;
+                        case BPF_JSET: return (f.value & k) != 0;
+                    }
+                    break;
+                case FactOp::NE:
+                    if (op == BPF_JEQ && f.value == k) {
+                        return 0;
+                    }
+                    break;
+                case FactOp::ANY_SET:
+                    if (op == BPF_JSET && (f.value & ~k) == 0) {
+                        return 1;
+                    }
+                    break;
+                case FactOp::NONE_SET:
+                    if (op == BPF_JSET && (k & ~f.value) == 0) {
+                        return 0;
+                    }
+                    break;
+            }
+        }
+        return -1;
+    }
+
+    bool thread_jumps(void) {
+        bool changed = false;
+        for (size_t i = 0; i < insns.size(); ++i) {
+            FilterInsn& in = insns[i];
+            if (!in.live || !is_jump(in.code)) {
+                continue;
+            }
+            size_t jt = resolve(in.jt);
+            size_t jf = is_cond(in.code) ? resolve(in.jf) : 0;
+            if (jt != in.jt || (is_cond(in.code) && jf != in.jf)) {
+                in.jt = jt;
+                in.jf = jf;
+                changed = true;
+            }
+            if (is_cond(in.code) && in.jt == in.jf) {
+                in.code = BPF_JMP | BPF_JA;
+                changed = true;
+            }
+            if (is_ja(in.code) && in.jt == next_live(i + 1)) {
+                in.live = false;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    bool remove_unreachable(void) {
+        vector<bool> reached(insns.size() + 1, false);
+        vector<size_t> todo {next_live(0)};
+        while (!todo.empty()) {
+            size_t i = todo.back();
+            todo.pop_back();
+            if (i >= insns.size() || reached[i]) {
+                continue;
+            }
+            reached[i] = true;
+            for_each_successor(i, [&todo](size_t s) { todo.push_back(s); });
+        }
+        bool changed = false;
+        for (size_t i = 0; i < insns.size(); ++i) {
+            if (insns[i].live && !reached[i]) {
+                insns[i].live = false;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    static bool reads_a(uint16_t code) {
+        uint16_t cls = BPF_CLASS(code);
+        return is_cond(code) || cls == BPF_ALU || cls == BPF_ST || (cls == BPF_RET && BPF_RVAL(code) == BPF_A) || (cls == BPF_MISC && BPF_MISCOP(code) == BPF_TAX);
+    }
+
+    static bool writes_a(uint16_t code) {
+        uint16_t cls = BPF_CLASS(code);
+        return cls == BPF_LD || cls == BPF_ALU || (cls == BPF_MISC && BPF_MISCOP(code) == BPF_TXA);
+    }
+
+    // Whether A's value on entry to each instruction can still be read
+    vector<bool> a_liveness(void) const {
+        vector<bool> live_in(insns.size() + 1, false);
+        for (size_t i = insns.size(); i-- > 0; ) {
+            if (!insns[i].live) {
+                continue;
+            }
+            bool live_out = false;
+            for_each_successor(i, [&](size_t s) { live_out = live_out || live_in[s]; });
+            live_in[i] = reads_a(insns[i].code) || (!writes_a(insns[i].code) && live_out);
+        }
+        return live_in;
+    }
+
+    /*
+     Sends state s along the jump edge stored in target. If the edge lands on "load a field, compare it" and s already
+     settles that comparison, the edge is pointed straight at the outcome instead (when nothing there needs A)
+     */
+    bool follow_edge(size_t& target, State s, vector<State>& states, const vector<bool>& a_live_in) {
+        size_t t = next_live(target);
+        if (t < insns.size() && abs_load(insns[t].code) && proven_loaded(s, insns[t].code, insns[t].k)) {
+            size_t test = next_live(t + 1);
+            if (test < insns.size() && is_cond(insns[test].code) && BPF_SRC(insns[test].code) == BPF_K) {
+                State probe = s;
+                probe.a_known = true;
+                probe.a_code = insns[t].code;
+                probe.a_k = insns[t].k;
+                int outcome = decide(probe, BPF_OP(insns[test].code), insns[test].k);
+                if (outcome != -1) {
+                    size_t to = next_live(outcome == 1 ? insns[test].jt : insns[test].jf);
+                    if (!a_live_in[to]) {
+                        target = to;
+                        s.a_known = false;
+                        merge(states[to], s);
+                        return true;
+                    }
+                }
+            }
+        }
+        merge(states[t], s);
+        return false;
+    }
+
+    /*
+     Settles comparisons the facts already decide (for the instruction on every path, or for single jump edges), drops
+     loads of a value A already holds, then drops loads nobody reads (only if they cannot fail, i.e. the same field was
+     loaded successfully on every path there)
+     */
+    bool propagate_facts(void) {
+        bool changed = false;
+        vector<State> states(insns.size() + 1, State {false, false, 0, 0, {}});
+        vector<bool> proven(insns.size(), false);
+        vector<bool> a_live_in = a_liveness();
+        states[next_live(0)].reached = true;
+
+        for (size_t i = 0; i < insns.size(); ++i) {
+            FilterInsn& in = insns[i];
+            if (!in.live || !states[i].reached) {
+                continue;
+            }
+            State s = states[i];
+            uint16_t cls = BPF_CLASS(in.code);
+
+            if (abs_load(in.code)) {
+                proven[i] = proven_loaded(s, in.code, in.k);
+                if (s.a_known && s.a_code == in.code && s.a_k == in.k) {
+                    in.live = false;
+                    changed = true;
+                } else {
+                    s.a_known = true;
+                    s.a_code = in.code;
+                    s.a_k = in.k;
+                }
+            } else if (writes_a(in.code)) {
+                s.a_known = false;
+            }
+
+            if (cls == BPF_RET) {
+                continue;
+            } else if (is_ja(in.code)) {
+                changed |= follow_edge(in.jt, s, states, a_live_in);
+            } else if (is_cond(in.code)) {
+                if (!s.a_known || BPF_SRC(in.code) != BPF_K) {
+                    changed |= follow_edge(in.jt, s, states, a_live_in);
+                    changed |= follow_edge(in.jf, s, states, a_live_in);
+                    continue;
+                }
+                int outcome = decide(s, BPF_OP(in.code), in.k);
+                State taken = s;
+                State not_taken = s;
+                if (BPF_OP(in.code) == BPF_JEQ) {
+                    learn(taken, FactOp::EQ, in.k);
+                    learn(not_taken, FactOp::NE, in.k);
+                } else if (BPF_OP(in.code) == BPF_JSET) {
+                    learn(taken, FactOp::ANY_SET, in.k);
+                    learn(not_taken, FactOp::NONE_SET, in.k);
+                }
+                if (outcome == 1) {
+                    in.code = BPF_JMP | BPF_JA;
+                    follow_edge(in.jt, taken, states, a_live_in);
+                    changed = true;
+                } else if (outcome == 0) {
+                    in.code = BPF_JMP | BPF_JA;
+                    in.jt = in.jf;
+                    follow_edge(in.jt, not_taken, states, a_live_in);
+                    changed = true;
+                } else {
+                    changed |= follow_edge(in.jt, taken, states, a_live_in);
+                    changed |= follow_edge(in.jf, not_taken, states, a_live_in);
+                }
+            } else {
+                merge(states[next_live(i + 1)], s);
+            }
+        }
+
+        // Loads nobody reads
+        a_live_in = a_liveness();
+        for (size_t i = 0; i < insns.size(); ++i) {
+            FilterInsn& in = insns[i];
+            if (!in.live || BPF_CLASS(in.code) != BPF_LD) {
+                continue;
+            }
+            bool live_out = false;
+            for_each_successor(i, [&](size_t s) { live_out = live_out || a_live_in[s]; });
+            bool cannot_fail = BPF_MODE(in.code) == BPF_IMM || BPF_MODE(in.code) == BPF_LEN || BPF_MODE(in.code) == BPF_MEM || (abs_load(in.code) && proven[i]);
+            if (!live_out && cannot_fail) {
+                in.live = false;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+public:
+    FilterOptimizer(vector<FilterInsn>& insns) :insns{insns} {};
+
+    void run(void) {
+        bool changed = true;
+        for (int pass = 0; changed && pass < 100; ++pass) {
+            changed = false;
+            changed |= propagate_facts();
+            changed |= thread_jumps();
+            changed |= remove_unreachable();
+        }
+    }
+};
+
+/*
+ Lays the live instructions out with relative offsets. Conditional jumps only reach 255 instructions ahead, so any that
+ would need more become a short jump over a pair of BPF_JA (which take 32 bit offsets)
+ */
+static vector<bpf_insn> assemble(const vector<FilterInsn>& insns) {
+    auto next_live = [&insns](size_t i) {
+        while (i < insns.size() && !insns[i].live) {
+            ++i;
+        }
+        return i;
+    };
+
+    vector<bool> expand(insns.size(), false);
+    vector<size_t> pos(insns.size() + 1, 0);
+    bool again = true;
+    while (again) {
+        again = false;
+        size_t p = 0;
+        for (size_t i = 0; i < insns.size(); ++i) {
+            pos[i] = p;
+            if (insns[i].live) {
+                p += expand[i] ? 3 : 1;
+            }
+        }
+        pos[insns.size()] = p;
+        for (size_t i = 0; i < insns.size(); ++i) {
+            if (insns[i].live && is_cond(insns[i].code) && !expand[i]) {
+                size_t jt = pos[next_live(insns[i].jt)] - pos[i] - 1;
+                size_t jf = pos[next_live(insns[i].jf)] - pos[i] - 1;
+                if (jt > 255 || jf > 255) {
+                    expand[i] = true;
+                    again = true;
+                }
+            }
+        }
+    }
+
+    vector<bpf_insn> out;
+    for (size_t i = 0; i < insns.size(); ++i) {
+        const FilterInsn& in = insns[i];
+        if (!in.live) {
+            continue;
+        }
+        bpf_insn b;
+        b.code = in.code;
+        b.jt = 0;
+        b.jf = 0;
+        b.k = in.k;
+        if (is_ja(in.code)) {
+            b.k = static_cast<uint32_t>(pos[next_live(in.jt)] - pos[i] - 1);
+            out.push_back(b);
+        } else if (is_cond(in.code) && expand[i]) {
+            b.jf = 1;
+            out.push_back(b);
+            bpf_insn ja;
+            ja.code = BPF_JMP | BPF_JA;
+            ja.jt = 0;
+            ja.jf = 0;
+            ja.k = static_cast<uint32_t>(pos[next_live(in.jt)] - (pos[i] + 1) - 1);
+            out.push_back(ja);
+            ja.k = static_cast<uint32_t>(pos[next_live(in.jf)] - (pos[i] + 2) - 1);
+            out.push_back(ja);
+        } else if (is_cond(in.code)) {
+            b.jt = static_cast<unsigned char>(pos[next_live(in.jt)] - pos[i] - 1);
+            b.jf = static_cast<unsigned char>(pos[next_live(in.jf)] - pos[i] - 1);
+            out.push_back(b);
+        } else {
+            out.push_back(b);
+        }
+    }
+    return out;
+}
+
+BPFProgram compile_filter(const string& expression, bool optimize, uint32_t snaplen) {
+    FilterParser parser {expression};
+    unique_ptr<FilterNode> root = parser.parse();
+
+    vector<FilterInsn> insns = FilterCodegen {}.generate(*root, snaplen);
+    if (optimize) {
+        FilterOptimizer {insns}.run();
+    }
+
+    BPFProgram prog {assemble(insns)};
+    if (!prog.validate()) {
+        string m {"Filter compiles to "};
+        m += std::to_string(prog.get_len());
+        m += " instructions, more than the kernel accepts: ";
+        throw FilterSyntaxError {m};
+    }
+    return prog;
+}
@@ -0,0 +1,54 @@
+//
+//  FilterCompiler.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef FilterCompiler_hpp
+#define FilterCompiler_hpp
+
+#include <string>
+#include <exception>
+#include "BPFProgram.hpp"
+
+/*
+ Used to signal a filter expression we could not parse
+ */
+class FilterSyntaxError : public std::exception {
+private:
+    std::string message;
+public:
+    FilterSyntaxError() {};
+    FilterSyntaxError(std::string m) :message{m} {};
+
+    const char * what() {
+        message += "Invalid filter expression";
+        return message.c_str();
+    }
+};
+
+/*
+ Compiles a filter expression into a classic BPF program for ethernet frames
+
+ The language is a small subset of tcpdump's:
+
+    ip | arp | tcp | udp | icmp | proto <name or number>
+    [src|dst] host <a.b.c.d>
+    [src|dst] net <a.b.c.d>[/len]
+    [tcp|udp] [src|dst] port <number>
+    flags <syn|ack|fin|rst|psh|urg|ece|cwr>[|...]     (TCP with any of those flags set)
+
+ combined with and/&&, or/||, not/! and parentheses. Only IPv4 is understood; ports and flags only match the first
+ fragment of a datagram, which is the only one carrying the transport header.
+
+ Code is generated naively, one block per primitive, then optimised: comparisons whose outcome is already known on every
+ path to them (e.g. the ethertype check repeated by each primitive) become jumps, loads left with no reader are removed,
+ and jump chains and unreachable code are cleaned up.
+
+ Accepted packets return snaplen bytes. Throws FilterSyntaxError.
+ */
+BPFProgram compile_filter(const std::string& expression, bool optimize = true, uint32_t snaplen = 262144);
+
+#endif /* FilterCompiler_hpp */
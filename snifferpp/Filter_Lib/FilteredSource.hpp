@@ -0,0 +1,102 @@
+//
+//  FilteredSource.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef FilteredSource_hpp
+#define FilteredSource_hpp
+
+#include "BPFProgram.hpp"
+
+/*
+ The records of a batch that a BPFProgram accepts. Works with single pass batches (PcapBatch): the underlying range is
+ only walked once, so iterate a FilteredBatch once
+ */
+template <typename Batch>
+class FilteredBatch {
+public:
+    using base_iterator = typename Batch::iterator;
+
+    class iterator {
+    private:
+        base_iterator curr, last;
+        const BPFProgram* program;
+
+        void skip_rejected(void) {
+            while (curr != last) {
+                auto&& record = *curr;
+                if (program->matches(record.get_data(), record.get_bpf_header().bh_datalen, record.get_data_len())) {
+                    break;
+                }
+                ++curr;
+            }
+        }
+
+    public:
+        iterator(base_iterator curr, base_iterator last, const BPFProgram* program) :curr{curr}, last{last}, program{program} {
+            skip_rejected();
+        };
+
+        decltype(auto) operator*(void) const { return *curr; }
+
+        iterator& operator++(void) {
+            ++curr;
+            skip_rejected();
+            return *this;
+        }
+
+        bool operator!=(const iterator& other) const { return curr != other.curr; }
+        bool operator==(const iterator& other) const { return !(*this != other); }
+    };
+
+private:
+    iterator first; // Already on the first accepted record
+    iterator last;
+
+public:
+    FilteredBatch(base_iterator begin, base_iterator end, const BPFProgram* program) :first{begin, end, program}, last{end, end, program} {};
+
+    iterator begin(void) const { return first; }
+    iterator end(void) const { return last; }
+
+    bool empty(void) const { return !(first != last); }
+};
+
+/*
+ Wraps a source (anything with readBatch(), e.g. PcapFile) so that only the packets program accepts come out of it
+
+ This is the userspace counterpart of attaching the program to a device: capture files never pass through the kernel,
+ so the interpreter in BPFProgram::run does the same job. Batches in which nothing matched are skipped, so an empty
+ batch still means the underlying source returned one.
+ */
+template <typename Source>
+class FilteredSource {
+private:
+    Source& source;
+    BPFProgram program;
+
+public:
+    FilteredSource(Source& source, BPFProgram program) :source{source}, program{std::move(program)} {};
+
+    FilteredSource(const FilteredSource& other)= delete;
+    FilteredSource operator=(const FilteredSource& other)=delete;
+
+    auto readBatch(void) {
+        while (true) {
+            auto batch = source.readBatch();
+            // begin() only once, it reads the first record of single pass batches
+            auto it = batch.begin();
+            auto end = batch.end();
+            bool exhausted = !(it != end); // Nothing at all, as opposed to nothing accepted
+            FilteredBatch<decltype(batch)> filtered {it, end, &program};
+            if (exhausted || !filtered.empty()) {
+                return filtered;
+            }
+        }
+    }
+};
+
+#endif /* FilteredSource_hpp */
@@ -0,0 +1,226 @@
+//
+//  FlowTable.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include "FlowTable.hpp"
+
+using std::ostream;
+using std::vector;
+using std::endl;
+
+// Linear probing degrades quickly past this
+const size_t MAX_LOAD_PERCENT = 75;
+const size_t MIN_SLOTS = 16;
+
+const uint32_t FlowTable::NIL;
+
+FlowTable::FlowTable(FlowTableOptions o) :opts{o}, count{0}, wheel_time{0}, started{false}, insert_failures{0}, expired{0} {
+    if (opts.wheel_slots == 0) {
+        opts.wheel_slots = 1;
+    }
+    // Largest power of two that fits the budget
+    size_t n = MIN_SLOTS;
+    while (n * 2 * sizeof(Slot) <= opts.memory_budget) {
+        n *= 2;
+    }
+    slots.resize(n);
+    for (Slot& s : slots) {
+        s.used = false;
+    }
+    mask = n - 1;
+    max_flows = n * MAX_LOAD_PERCENT / 100;
+    wheel.assign(opts.wheel_slots + 1, NIL);
+}
+
+void FlowTable::link(uint32_t idx, uint32_t bucket) {
+    Slot& s = slots[idx];
+    s.bucket = bucket;
+    s.prev = NIL;
+    s.next = wheel[bucket];
+    if (s.next != NIL) {
+        slots[s.next].prev = idx;
+    }
+    wheel[bucket] = idx;
+}
+
+void FlowTable::unlink(uint32_t idx) {
+    Slot& s = slots[idx];
+    if (s.prev != NIL) {
+        slots[s.prev].next = s.next;
+    } else {
+        wheel[s.bucket] = s.next;
+    }
+    if (s.next != NIL) {
+        slots[s.next].prev = s.prev;
+    }
+}
+
+void FlowTable::schedule(uint32_t idx) {
+    Slot& s = slots[idx];
+    s.deadline = static_cast<uint64_t>(s.flow.last_seen.tv_sec) + opts.idle_timeout;
+    if (s.deadline <= wheel_time) {
+        // Already due (timestamps can run backwards), pick it up on the next tick
+        s.deadline = wheel_time + 1;
+    }
+    link(idx, static_cast<uint32_t>(s.deadline % opts.wheel_slots));
+}
+
+void FlowTable::begin_sweep(uint64_t tick) {
+    uint32_t bucket = static_cast<uint32_t>(tick % opts.wheel_slots);
+    wheel[opts.wheel_slots] = wheel[bucket];
+    wheel[bucket] = NIL;
+    for (uint32_t i = sweep_head(); i != NIL; i = slots[i].next) {
+        slots[i].bucket = opts.wheel_slots;
+    }
+}
+
+void FlowTable::move_slot(uint32_t from, uint32_t to) {
+    slots[to] = slots[from];
+    slots[from].used = false;
+    // Point the wheel list at the new position
+    Slot& s = slots[to];
+    if (s.prev != NIL) {
+        slots[s.prev].next = to;
+    } else {
+        wheel[s.bucket] = to;
+    }
+    if (s.next != NIL) {
+        slots[s.next].prev = to;
+    }
+}
+
+void FlowTable::erase(uint32_t idx) {
+    // Caller has already taken it off the wheel
+    slots[idx].used = false;
+    --count;
+
+    // Backward shift: pull later entries of the probe chain into the hole if that keeps them reachable from their home
+    uint32_t hole = idx;
+    uint32_t j = idx;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (!slots[j].used) {
+            return;
+        }
+        size_t dist_home = (j - home(slots[j].hash)) & mask;
+        size_t dist_hole = (j - hole) & mask;
+        if (dist_home >= dist_hole) {
+            move_slot(j, hole);
+            hole = j;
+        }
+    }
+}
+
+FlowRecord* FlowTable::update(const FlowKey& key, const timeval& ts, uint32_t len, uint8_t tcp_flags) {
+    if (!started) {
+        wheel_time = ts.tv_sec;
+        started = true;
+    }
+
+    uint64_t hash = key.symmetric_hash();
+    uint32_t idx = static_cast<uint32_t>(home(hash));
+    int dir = 0;
+    for (;;) {
+        Slot& s = slots[idx];
+        if (!s.used) {
+            break;
+        }
+        if (s.hash == hash) {
+            if (s.flow.key == key) {
+                break;
+            } else if (s.flow.key == key.reversed()) {
+                dir = 1;
+                break;
+            }
+        }
+        idx = (idx + 1) & mask;
+    }
+
+    Slot& s = slots[idx];
+    if (!s.used) {
+        if (count >= max_flows) {
+            ++insert_failures;
+            return nullptr;
+        }
+        s.used = true;
+        s.hash = hash;
+        s.flow = FlowRecord {key, {0, 0}, {0, 0}, {0, 0}, ts, ts};
+        ++count;
+        schedule(idx);
+    }
+
+    FlowRecord& flow = s.flow;
+    ++flow.packets[dir];
+    flow.bytes[dir] += len;
+    flow.tcp_flags[dir] |= tcp_flags;
+    if (timercmp(&ts, &flow.last_seen, >)) {
+        flow.last_seen = ts;
+    }
+    return &flow;
+}
+
+FlowRecord* FlowTable::update(const bpf_hdr& bhdr, const PacketView& packet) {
+    if (packet.get_network_kind() != NetworkKind::IPV4) {
+        return nullptr;
+    }
+    uint8_t flags = packet.get_transport_kind() == TransportKind::TCP ? packet.get_tcp_header()->th_flags : 0;
+    // bh_tstamp is a timeval32 on 64-bit BSDs, so copy it field by field
+    timeval ts;
+    ts.tv_sec = bhdr.bh_tstamp.tv_sec;
+    ts.tv_usec = bhdr.bh_tstamp.tv_usec;
+    return update(flow_key(packet), ts, bhdr.bh_datalen, flags);
+}
+
+const FlowRecord* FlowTable::find(const FlowKey& key) const {
+    uint64_t hash = key.symmetric_hash();
+    for (size_t idx = home(hash); slots[idx].used; idx = (idx + 1) & mask) {
+        const Slot& s = slots[idx];
+        if (s.hash == hash && (s.flow.key == key || s.flow.key == key.reversed())) {
+            return &s.flow;
+        }
+    }
+    return nullptr;
+}
+
+vector<FlowRecord> FlowTable::collect_expired(uint64_t now_sec) {
+    vector<FlowRecord> res;
+    expire(now_sec, [&res](const FlowRecord& flow) { res.push_back(flow); });
+    return res;
+}
+
+static void print_tcp_flags(ostream& os, uint8_t flags) {
+    const char names[] = "FSRPAUEC";
+    for (int i = 0; i < 8; ++i) {
+        os << ((flags & (1 << i)) ? names[i] : '.');
+    }
+}
+
+ostream& operator<<(ostream& os, const FlowRecord& flow) {
+    std::ios tmp {NULL};
+    tmp.copyfmt(os);
+    in_addr src {flow.key.src};
+    in_addr dst {flow.key.dst};
+    os << "Flow" << endl;
+    os << "\t|-Protocol: " << +flow.key.proto << endl;
+    os << "\t|-Source: " << inet_ntoa(src) << ":" << ntohs(flow.key.sport) << endl;
+    os << "\t|-Destination: " << inet_ntoa(dst) << ":" << ntohs(flow.key.dport) << endl;
+    os << "\t|-Sent: " << flow.packets[0] << " packets, " << flow.bytes[0] << " Bytes";
+    if (flow.key.proto == IPPROTO_TCP) {
+        os << ", flags ";
+        print_tcp_flags(os, flow.tcp_flags[0]);
+    }
+    os << endl;
+    os << "\t|-Received: " << flow.packets[1] << " packets, " << flow.bytes[1] << " Bytes";
+    if (flow.key.proto == IPPROTO_TCP) {
+        os << ", flags ";
+        print_tcp_flags(os, flow.tcp_flags[1]);
+    }
+    os << endl;
+    os << "\t|-Duration: " << (flow.last_seen.tv_sec - flow.first_seen.tv_sec) << " sec" << endl;
+    os.copyfmt(tmp);
+    return os;
+}
@@ -0,0 +1,182 @@
+//
+//  FlowTable.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef FlowTable_hpp
+#define FlowTable_hpp
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <sys/time.h>
+#include "FlowKey.hpp"
+#include "PacketView.hpp"
+#include "BPFPacket.hpp"
+
+/*
+ Everything we keep about one flow. Index 0 of the per-direction counters is traffic from key.src, index 1 the replies
+ */
+struct FlowRecord {
+    FlowKey key; // As first seen, so key.src is whoever sent the first packet we caught
+    uint64_t packets[2];
+    uint64_t bytes[2]; // Original (wire) length
+    uint8_t tcp_flags[2]; // Every TCP flag seen in that direction, OR'd together
+    timeval first_seen;
+    timeval last_seen;
+};
+
+std::ostream& operator<<(std::ostream& os, const FlowRecord& flow);
+
+/*
+ Sizing and aging for a FlowTable
+ */
+struct FlowTableOptions {
+    size_t memory_budget = 64 << 20; // Bytes for the table, fixed at construction
+    uint32_t idle_timeout = 60; // Seconds without a packet before a flow expires
+    uint32_t wheel_slots = 256; // One-second ticks in the timer wheel
+};
+
+/*
+ Per-flow state for every 5-tuple we see, in a fixed block of memory
+
+ Open addressing with linear probing: the flows sit inline in one array, so a lookup is a hash and (usually) a single
+ cache line. Both directions of a flow hash to the same place (FlowKey::symmetric_hash). Erasing shifts later entries
+ back instead of leaving tombstones, so probe chains stay short however much churn there is. Nothing is allocated after
+ construction: once the table is at its load limit new flows are refused and counted (get_insert_failures()).
+
+ Aging runs on capture time (bh_tstamp), not the wall clock, so offline files age the same way as live traffic. Every flow
+ sits in one bucket of a timer wheel of one-second ticks. Packets only update last_seen; the flow is not moved in the wheel
+ until its bucket comes up, and is then either expired or pushed on to its real deadline. expire() only visits the
+ buckets for the ticks that have passed, so aging costs a little on every call rather than a sweep of the whole table.
+
+ Not thread safe: use one table per thread (e.g. per Pipeline worker, which already sees whole flows).
+ */
+class FlowTable {
+private:
+    static const uint32_t NIL = UINT32_MAX;
+
+    struct Slot {
+        FlowRecord flow;
+        uint64_t hash;
+        uint64_t deadline; // Second this flow's wheel bucket stands for
+        uint32_t prev, next; // Links in its wheel bucket
+        uint32_t bucket; // Which list it is on (wheel_slots is the list being swept)
+        bool used;
+    };
+
+    FlowTableOptions opts;
+    std::vector<Slot> slots;
+    size_t mask;
+    size_t max_flows;
+    size_t count;
+
+    // Heads of the wheel buckets, plus one extra for the bucket being swept
+    std::vector<uint32_t> wheel;
+    uint64_t wheel_time; // Last tick expire() has processed
+    bool started;
+
+    uint64_t insert_failures;
+    uint64_t expired;
+
+    size_t home(uint64_t hash) const { return hash & mask; }
+
+    void link(uint32_t idx, uint32_t bucket);
+    void unlink(uint32_t idx);
+    void schedule(uint32_t idx);
+    void move_slot(uint32_t from, uint32_t to);
+    void erase(uint32_t idx);
+
+    // Moves the bucket for tick onto the sweep list
+    void begin_sweep(uint64_t tick);
+    uint32_t sweep_head(void) const { return wheel[opts.wheel_slots]; }
+
+public:
+    FlowTable(FlowTableOptions opts = FlowTableOptions {});
+
+    /*
+     Counts one packet against its flow, creating the flow if needed
+     Returns the flow (valid until the next update/expire), or nullptr if the table is full
+     */
+    FlowRecord* update(const FlowKey& key, const timeval& ts, uint32_t len, uint8_t tcp_flags);
+    FlowRecord* update(const bpf_hdr& bhdr, const PacketView& packet); // nullptr for anything but IPv4 too
+
+    // nullptr if we have never seen the flow (either direction)
+    const FlowRecord* find(const FlowKey& key) const;
+
+    /*
+     Expires every flow idle for idle_timeout seconds as of now_sec, passing each to on_expired before it is removed
+     Returns how many expired
+     */
+    template <typename Callback>
+    size_t expire(uint64_t now_sec, Callback&& on_expired) {
+        if (!started || now_sec <= wheel_time) {
+            return 0;
+        }
+        size_t n = 0;
+        // Past a whole turn of the wheel, one visit per bucket covers everything
+        uint64_t tick = now_sec - wheel_time > opts.wheel_slots ? now_sec - opts.wheel_slots : wheel_time;
+        while (tick < now_sec) {
+            ++tick;
+            begin_sweep(tick);
+            uint32_t idx;
+            while ((idx = sweep_head()) != NIL) {
+                unlink(idx);
+                Slot& s = slots[idx];
+                if (static_cast<uint64_t>(s.flow.last_seen.tv_sec) + opts.idle_timeout <= now_sec) {
+                    on_expired(s.flow);
+                    erase(idx);
+                    ++n;
+                } else {
+                    schedule(idx);
+                }
+            }
+        }
+        wheel_time = now_sec;
+        expired += n;
+        return n;
+    }
+
+    // Same, collecting the expired flows instead
+    std::vector<FlowRecord> collect_expired(uint64_t now_sec);
+
+    /*
+     Expires everything that is left (e.g. at the end of a capture file)
+     */
+    template <typename Callback>
+    size_t flush(Callback&& on_expired) {
+        size_t n = 0;
+        for (uint32_t i = 0; i < slots.size(); ++i) {
+            if (slots[i].used) {
+                on_expired(slots[i].flow);
+                slots[i].used = false;
+                ++n;
+            }
+        }
+        std::fill(wheel.begin(), wheel.end(), NIL);
+        count = 0;
+        expired += n;
+        return n;
+    }
+
+    // Visits every live flow, in table order
+    template <typename Callback>
+    void for_each(Callback&& f) const {
+        for (const Slot& s : slots) {
+            if (s.used) {
+                f(s.flow);
+            }
+        }
+    }
+
+    size_t get_len(void) const { return count; }
+    size_t get_capacity(void) const { return max_flows; }
+    uint64_t get_insert_failures(void) const { return insert_failures; }
+    uint64_t get_expired(void) const { return expired; }
+};
+
+#endif /* FlowTable_hpp */
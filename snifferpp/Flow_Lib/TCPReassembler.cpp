@@ -0,0 +1,283 @@
+//
+//  TCPReassembler.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include "TCPReassembler.hpp"
+
+using std::ostream;
+using std::unordered_map;
+
+const uint32_t SegmentPool::NIL;
+
+// Sequence number comparisons, modulo 2^32 (RFC 1982)
+static bool seq_lt(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) < 0; }
+static bool seq_le(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) <= 0; }
+static bool seq_gt(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) > 0; }
+
+SegmentPool::SegmentPool(size_t total_bytes, size_t len) :chunk_len{len == 0 ? 1 : len} {
+    size_t n = total_bytes / chunk_len;
+    memory.resize(n * chunk_len);
+    chunks.resize(n);
+    free_list.reserve(n);
+    // Hand out low indices first
+    for (size_t i = n; i > 0; --i) {
+        free_list.push_back(static_cast<uint32_t>(i - 1));
+    }
+}
+
+ostream& operator<<(ostream& os, StreamClose reason) {
+    switch (reason) {
+        case StreamClose::FIN:
+            return os << "FIN";
+        case StreamClose::RST:
+            return os << "RST";
+        case StreamClose::TIMEOUT:
+            return os << "Timeout";
+        case StreamClose::FLUSH:
+            return os << "Flush";
+    }
+    return os;
+}
+
+TCPReassembler::TCPReassembler(TCPReassemblerOptions o, DataHandler d, CloseHandler c) :opts{o}, on_data{d}, on_close{c}, pool{o.pool_bytes, o.chunk_len}, stats{} {
+    connections.reserve(opts.max_connections);
+}
+
+void TCPReassembler::deliver(const Connection& conn, int dir, const byte_t* data, size_t len) {
+    stats.delivered_bytes += len;
+    on_data(conn.key, dir, data, len);
+}
+
+void TCPReassembler::queue(HalfStream& h, uint32_t seq, const byte_t* data, size_t len) {
+    if (h.pending_bytes + len > opts.max_pending_per_stream) {
+        ++stats.dropped_segments;
+        return;
+    }
+    ++stats.out_of_order_segments;
+
+    // One chunk per chunk_len bytes, each slotted into the sorted queue on its own
+    while (len > 0) {
+        size_t piece = len < pool.get_chunk_len() ? len : pool.get_chunk_len();
+        uint32_t idx = pool.acquire();
+        if (idx == SegmentPool::NIL) {
+            ++stats.dropped_segments;
+            return;
+        }
+        SegmentPool::Chunk& c = pool.get_chunk(idx);
+        c.seq = seq;
+        c.len = static_cast<uint32_t>(piece);
+        memcpy(pool.get_data(idx), data, piece);
+
+        uint32_t* link = &h.pending;
+        bool duplicate = false;
+        while (*link != SegmentPool::NIL && seq_le(pool.get_chunk(*link).seq, seq)) {
+            SegmentPool::Chunk& other = pool.get_chunk(*link);
+            if (other.seq == seq && other.len >= piece) {
+                duplicate = true;
+                break;
+            }
+            link = &other.next;
+        }
+        if (duplicate) {
+            stats.duplicate_bytes += piece;
+            pool.release(idx);
+        } else {
+            c.next = *link;
+            *link = idx;
+            h.pending_bytes += piece;
+        }
+
+        seq += piece;
+        data += piece;
+        len -= piece;
+    }
+}
+
+void TCPReassembler::drain(Connection& conn, int dir) {
+    HalfStream& h = conn.half[dir];
+    while (h.pending != SegmentPool::NIL) {
+        uint32_t idx = h.pending;
+        SegmentPool::Chunk& c = pool.get_chunk(idx);
+        if (seq_gt(c.seq, h.next_seq)) {
+            break; // Still a hole in front of it
+        }
+        uint32_t end = c.seq + c.len;
+        if (seq_gt(end, h.next_seq)) {
+            uint32_t overlap = h.next_seq - c.seq;
+            stats.duplicate_bytes += overlap;
+            deliver(conn, dir, pool.get_data(idx) + overlap, c.len - overlap);
+            h.next_seq = end;
+        } else {
+            stats.duplicate_bytes += c.len;
+        }
+        h.pending = c.next;
+        h.pending_bytes -= c.len;
+        pool.release(idx);
+    }
+
+    if (h.fin_seen && !h.closed && seq_le(h.fin_seq, h.next_seq)) {
+        h.closed = true;
+    }
+}
+
+void TCPReassembler::skip_to(Connection& conn, int dir, uint32_t seq) {
+    HalfStream& h = conn.half[dir];
+    if (seq_gt(seq, h.next_seq)) {
+        stats.gap_bytes += seq - h.next_seq;
+        h.next_seq = seq;
+    }
+    drain(conn, dir);
+}
+
+void TCPReassembler::release_pending(HalfStream& h) {
+    while (h.pending != SegmentPool::NIL) {
+        uint32_t idx = h.pending;
+        h.pending = pool.get_chunk(idx).next;
+        pool.release(idx);
+    }
+    h.pending_bytes = 0;
+}
+
+void TCPReassembler::close(unordered_map<FlowKey, Connection, FlowKeyHash>::iterator it, StreamClose reason) {
+    Connection& conn = it->second;
+    // Hand over whatever is still queued, jumping the holes that are never going to fill
+    for (int dir = 0; dir < 2; ++dir) {
+        HalfStream& h = conn.half[dir];
+        while (h.pending != SegmentPool::NIL) {
+            skip_to(conn, dir, pool.get_chunk(h.pending).seq);
+        }
+        release_pending(h);
+    }
+    if (on_close) {
+        on_close(conn.key, reason);
+    }
+    connections.erase(it);
+}
+
+void TCPReassembler::process(const FlowKey& key, const tcphdr& tcp, const byte_t* payload, size_t payload_len, uint64_t ts_sec) {
+    uint8_t flags = tcp.th_flags;
+    uint32_t seq = ntohl(tcp.th_seq);
+    uint32_t ack = ntohl(tcp.th_ack);
+
+    auto it = connections.find(key.canonical());
+    if (it == connections.end()) {
+        // Only a SYN or some data is worth tracking a connection for (pure ACKs, FINs and RSTs are not)
+        if ((flags & TH_RST) || (payload_len == 0 && !(flags & TH_SYN))) {
+            return;
+        }
+        if (connections.size() >= opts.max_connections) {
+            ++stats.connections_refused;
+            return;
+        }
+        Connection fresh;
+        fresh.key = key;
+        for (HalfStream& h : fresh.half) {
+            h = HalfStream {0, 0, false, false, false, SegmentPool::NIL, 0};
+        }
+        it = connections.emplace(key.canonical(), fresh).first;
+    }
+    Connection& conn = it->second;
+    conn.last_seen_sec = ts_sec;
+    int dir = key == conn.key ? 0 : 1;
+    HalfStream& h = conn.half[dir];
+
+    if (flags & TH_RST) {
+        close(it, StreamClose::RST);
+        return;
+    }
+
+    if (flags & TH_SYN) {
+        // The SYN takes up a sequence number of its own
+        ++seq;
+        if (!h.synced) {
+            h.next_seq = seq;
+            h.synced = true;
+        }
+    } else if (!h.synced) {
+        // Picked up mid-stream
+        h.next_seq = seq;
+        h.synced = true;
+    }
+
+    if (payload_len > 0 && !h.closed) {
+        uint32_t end = seq + static_cast<uint32_t>(payload_len);
+        if (seq_le(end, h.next_seq)) {
+            stats.duplicate_bytes += payload_len;
+        } else if (seq_le(seq, h.next_seq)) {
+            // In order (maybe overlapping what we have): straight from the capture buffer
+            uint32_t overlap = h.next_seq - seq;
+            stats.duplicate_bytes += overlap;
+            deliver(conn, dir, payload + overlap, payload_len - overlap);
+            h.next_seq = end;
+        } else {
+            queue(h, seq, payload, payload_len);
+        }
+    }
+
+    if ((flags & TH_FIN) && !h.fin_seen) {
+        h.fin_seen = true;
+        h.fin_seq = seq + static_cast<uint32_t>(payload_len);
+    }
+    drain(conn, dir);
+
+    // The other side has acknowledged bytes we never saw: the hole in front of its queue is not going to fill
+    HalfStream& other = conn.half[1-dir];
+    if ((flags & TH_ACK) && other.synced && other.pending != SegmentPool::NIL && seq_gt(ack, other.next_seq)) {
+        uint32_t first = pool.get_chunk(other.pending).seq;
+        skip_to(conn, 1-dir, seq_lt(ack, first) ? ack : first);
+    }
+
+    bool done0 = conn.half[0].closed || !conn.half[0].synced;
+    bool done1 = conn.half[1].closed || !conn.half[1].synced;
+    if (done0 && done1 && (conn.half[0].closed || conn.half[1].closed)) {
+        close(it, StreamClose::FIN);
+    }
+}
+
+void TCPReassembler::process(const bpf_hdr& bhdr, const PacketView& packet) {
+    if (packet.get_network_kind() != NetworkKind::IPV4 || packet.get_transport_kind() != TransportKind::TCP) {
+        return;
+    }
+    const ip& iph = packet.get_ip_header().get_header();
+    const tcphdr& tcp = packet.get_tcp_header().get_header();
+
+    // Trust the IP length over the capture length, which can include ethernet padding
+    size_t headers_len = 4*iph.ip_hl + 4*tcp.th_off;
+    size_t ip_len = ntohs(iph.ip_len);
+    size_t payload_len = packet.get_data_len();
+    if (ip_len != 0 && ip_len >= headers_len && ip_len - headers_len < payload_len) {
+        payload_len = ip_len - headers_len;
+    }
+    process(flow_key(packet), tcp, packet.get_data(), payload_len, bhdr.bh_tstamp.tv_sec);
+}
+
+size_t TCPReassembler::expire(uint64_t now_sec) {
+    size_t n = 0;
+    for (auto it = connections.begin(); it != connections.end(); ) {
+        auto next = std::next(it);
+        if (it->second.last_seen_sec + opts.idle_timeout <= now_sec) {
+            close(it, StreamClose::TIMEOUT);
+            ++n;
+        }
+        it = next;
+    }
+    return n;
+}
+
+void TCPReassembler::flush() {
+    while (!connections.empty()) {
+        close(connections.begin(), StreamClose::FLUSH);
+    }
+}
+
+TCPReassemblerStats TCPReassembler::get_stats() const {
+    TCPReassemblerStats res = stats;
+    res.connections = connections.size();
+    res.pool_in_use = pool.get_in_use();
+    res.pool_capacity = pool.get_capacity();
+    return res;
+}
@@ -0,0 +1,179 @@
+//
+//  TCPReassembler.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef TCPReassembler_hpp
+#define TCPReassembler_hpp
+
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+#include "FlowKey.hpp"
+#include "PacketView.hpp"
+#include "BPFPacket.hpp"
+
+/*
+ Fixed-size chunks of segment memory, all allocated up front. Handing one out or back is a push/pop on a free list
+ */
+class SegmentPool {
+public:
+    static const uint32_t NIL = UINT32_MAX;
+
+    // What a chunk holds: up to chunk_len bytes of one stream starting at seq, and the next chunk queued behind it
+    struct Chunk {
+        uint32_t seq;
+        uint32_t len;
+        uint32_t next;
+    };
+
+private:
+    size_t chunk_len;
+    std::vector<byte_t> memory;
+    std::vector<Chunk> chunks;
+    std::vector<uint32_t> free_list;
+
+public:
+    SegmentPool(size_t total_bytes, size_t chunk_len);
+
+    SegmentPool(const SegmentPool& other)= delete;
+    SegmentPool operator=(const SegmentPool& other)=delete;
+
+    // NIL when the pool is exhausted
+    uint32_t acquire(void) {
+        if (free_list.empty()) {
+            return NIL;
+        }
+        uint32_t idx = free_list.back();
+        free_list.pop_back();
+        return idx;
+    }
+    void release(uint32_t idx) { free_list.push_back(idx); }
+
+    Chunk& get_chunk(uint32_t idx) { return chunks[idx]; }
+    byte_t* get_data(uint32_t idx) { return memory.data() + idx * chunk_len; }
+
+    size_t get_chunk_len(void) const { return chunk_len; }
+    size_t get_capacity(void) const { return chunks.size(); }
+    size_t get_in_use(void) const { return chunks.size() - free_list.size(); }
+};
+
+/*
+ Why a connection was handed to the close handler
+ */
+enum class StreamClose {FIN, RST, TIMEOUT, FLUSH};
+
+std::ostream& operator<<(std::ostream& os, StreamClose reason);
+
+/*
+ Memory limits for a TCPReassembler
+ */
+struct TCPReassemblerOptions {
+    size_t pool_bytes = 64 << 20; // Out-of-order data held across all connections
+    size_t chunk_len = 2048; // Pool granularity, fits a full-size ethernet segment
+    size_t max_pending_per_stream = 1 << 20; // Out-of-order data held for one direction of one connection
+    size_t max_connections = 1 << 16; // Connections tracked at once, further ones are ignored
+    uint32_t idle_timeout = 120; // Seconds of capture time before expire() gives up on a connection
+};
+
+struct TCPReassemblerStats {
+    size_t connections; // Being tracked now
+    uint64_t connections_refused; // Over max_connections
+    uint64_t delivered_bytes;
+    uint64_t duplicate_bytes; // Retransmissions and overlaps we had already delivered
+    uint64_t out_of_order_segments; // Held back waiting for a hole to fill
+    uint64_t dropped_segments; // Could not be held (pool or per-stream cap), their bytes end up as gaps
+    uint64_t gap_bytes; // Skipped because we never saw them
+    size_t pool_in_use; // Chunks
+    size_t pool_capacity;
+};
+
+/*
+ Rebuilds the two byte streams of every TCP connection from captured segments
+
+ Each direction tracks the next sequence number it expects. A segment that starts there is delivered straight from the
+ capture buffer, with no copy. One that starts later is copied into pooled chunks and queued (sorted by sequence number)
+ until the hole before it fills; anything at or before the expected sequence number is a retransmission or overlap and
+ only its new bytes, if any, are delivered. All comparisons are modulo 2^32, so streams wrap around safely.
+
+ Holes that will never fill (the capture lost a segment the receiver got) are skipped once the other side acknowledges
+ past them, or when the connection closes. Streams picked up mid-connection start at the first segment we see.
+
+ Memory is bounded: out-of-order data comes from one SegmentPool with a per-direction cap on top, and at most
+ max_connections are tracked, so a flood of half-open connections costs a fixed amount.
+
+ Handlers are called synchronously from process()/expire()/flush() and must not call back into the reassembler.
+ Not thread safe, use one per thread.
+ */
+class TCPReassembler {
+public:
+    // dir 0 is data from conn.src (the side that sent the first segment we saw), 1 the other way
+    using DataHandler = std::function<void(const FlowKey& conn, int dir, const byte_t* data, size_t len)>;
+    using CloseHandler = std::function<void(const FlowKey& conn, StreamClose reason)>;
+
+private:
+    struct HalfStream {
+        uint32_t next_seq;
+        uint32_t fin_seq;
+        bool synced; // next_seq is known
+        bool fin_seen;
+        bool closed; // Everything up to the FIN has been delivered
+        uint32_t pending; // Head of the queued chunks
+        size_t pending_bytes;
+    };
+
+    struct Connection {
+        FlowKey key;
+        HalfStream half[2];
+        uint64_t last_seen_sec;
+    };
+
+    TCPReassemblerOptions opts;
+    DataHandler on_data;
+    CloseHandler on_close;
+    SegmentPool pool;
+
+    // Keyed on the canonical 5-tuple, so both directions find the same connection
+    std::unordered_map<FlowKey, Connection, FlowKeyHash> connections;
+
+    TCPReassemblerStats stats;
+
+    void deliver(const Connection& conn, int dir, const byte_t* data, size_t len);
+    void queue(HalfStream& h, uint32_t seq, const byte_t* data, size_t len);
+    void drain(Connection& conn, int dir);
+    void skip_to(Connection& conn, int dir, uint32_t seq);
+    void release_pending(HalfStream& h);
+    void close(std::unordered_map<FlowKey, Connection, FlowKeyHash>::iterator it, StreamClose reason);
+
+public:
+    TCPReassembler(TCPReassemblerOptions opts, DataHandler on_data, CloseHandler on_close = nullptr);
+
+    TCPReassembler(const TCPReassembler& other)= delete;
+    TCPReassembler operator=(const TCPReassembler& other)=delete;
+
+    /*
+     Feeds one segment. key is the segment's own 5-tuple (src is the sender), payload_len excludes any link-layer padding
+     */
+    void process(const FlowKey& key, const tcphdr& tcp, const byte_t* payload, size_t payload_len, uint64_t ts_sec);
+
+    // Same, from a parsed packet. Anything but TCP over IPv4 is ignored
+    void process(const bpf_hdr& bhdr, const PacketView& packet);
+
+    /*
+     Closes connections idle for idle_timeout seconds as of now_sec (delivering what they had queued, skipping holes)
+     Returns how many were closed
+     */
+    size_t expire(uint64_t now_sec);
+
+    // Closes every connection (e.g. at the end of a capture file)
+    void flush(void);
+
+    TCPReassemblerStats get_stats(void) const;
+};
+
+#endif /* TCPReassembler_hpp */
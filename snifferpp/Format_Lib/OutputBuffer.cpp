@@ -0,0 +1,77 @@
+//
+//  OutputBuffer.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include <cerrno>
+#include "OutputBuffer.hpp"
+
+using std::cerr;
+using std::endl;
+
+const size_t OutputBuffer::default_capacity;
+
+void OutputBuffer::write_out(const char* data, size_t n) {
+    written += n;
+    if (failed) {
+        return;
+    }
+    size_t done = 0;
+    while (done < n) {
+        ssize_t w = ::write(fd, data + done, n - done);
+        if (w == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Could not write output: %s", strerror(errno));
+            failed = true;
+            return;
+        }
+        done += w;
+    }
+}
+
+char* OutputBuffer::claim(size_t n) {
+    reserve(n);
+    if (n > capacity) {
+        // Nothing is pending after the flush in reserve()
+        buffer.reset(new char[n]);
+        capacity = n;
+    }
+    return buffer.get() + len;
+}
+
+void OutputBuffer::write_uint(uint64_t value) {
+    // Digits come out backwards, 20 is enough for any uint64_t
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    reserve(n);
+    while (n > 0) {
+        buffer[len++] = digits[--n];
+    }
+}
+
+void OutputBuffer::write_uint(uint64_t value, int width) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    reserve(width > n ? width : n);
+    for (int pad = width - n; pad > 0; --pad) {
+        buffer[len++] = '0';
+    }
+    while (n > 0) {
+        buffer[len++] = digits[--n];
+    }
+}
@@ -0,0 +1,110 @@
+//
+//  OutputBuffer.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef OutputBuffer_hpp
+#define OutputBuffer_hpp
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include "Log.hpp"
+
+/*
+ Text output staged in one reusable buffer and handed to write() in large chunks, instead of an ostream call (and
+ possibly a flush) per field
+
+ The number helpers convert straight into the buffer with no locale or stream state involved. If a write fails the
+ error is printed once and everything after it is discarded.
+
+ Not thread safe.
+ */
+class OutputBuffer {
+private:
+    int fd;
+    std::unique_ptr<char[]> buffer;
+    size_t capacity, len;
+    uint64_t written; // Handed to write() so far
+    bool failed;
+
+    void write_out(const char* data, size_t n);
+
+    // Makes sure n more bytes fit without flushing midway
+    void reserve(size_t n) {
+        if (len + n > capacity) {
+            flush();
+        }
+    }
+
+public:
+    static const size_t default_capacity = 1 << 16;
+
+    OutputBuffer(int fd = STDOUT_FILENO, size_t capacity = default_capacity) :fd{fd}, buffer{new char[capacity]}, capacity{capacity}, len{0}, written{0}, failed{false} {};
+
+    OutputBuffer(const OutputBuffer& other)= delete;
+    OutputBuffer operator=(const OutputBuffer& other)=delete;
+
+    ~OutputBuffer() {
+        flush();
+    }
+
+    void write(const char* data, size_t n) {
+        if (len + n > capacity) {
+            flush();
+            if (n > capacity) {
+                write_out(data, n);
+                return;
+            }
+        }
+        memcpy(buffer.get() + len, data, n);
+        len += n;
+    }
+
+    void write(const char* str) { write(str, strlen(str)); }
+    void write(const std::string& str) { write(str.data(), str.size()); }
+
+    void put(char c) {
+        reserve(1);
+        buffer[len++] = c;
+    }
+
+    /*
+     Room to write up to n bytes in place, kept by commit(used). Grows the buffer when n is more than it holds
+     */
+    char* claim(size_t n);
+    void commit(size_t used) { len += used; }
+
+    void write_uint(uint64_t value);
+
+    // Left-padded with zeros to width digits (e.g. the microseconds of a timestamp)
+    void write_uint(uint64_t value, int width);
+
+    // Two lowercase hex digits
+    void write_hex(uint8_t value) {
+        static const char digits[] = "0123456789abcdef";
+        reserve(2);
+        buffer[len++] = digits[value >> 4];
+        buffer[len++] = digits[value & 0xf];
+    }
+
+    void flush(void) {
+        if (len > 0) {
+            write_out(buffer.get(), len);
+            len = 0;
+        }
+    }
+
+    bool get_failed(void) const { return failed; }
+
+    // Everything written so far, flushed or not
+    uint64_t get_total(void) const { return written + len; }
+};
+
+#endif /* OutputBuffer_hpp */
@@ -0,0 +1,623 @@
+//
+//  PacketFormatter.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include "PacketFormatter.hpp"
+#include "LatencyHistogram.hpp"
+
+using std::string;
+
+OutputFormat parse_output_format(const string& name) {
+    if (name == "human") {
+        return OutputFormat::HUMAN;
+    }
+    if (name == "line") {
+        return OutputFormat::LINE;
+    }
+    if (name == "json") {
+        return OutputFormat::NDJSON;
+    }
+    if (name == "csv") {
+        return OutputFormat::CSV;
+    }
+    string m {"Output format "};
+    m += name;
+    m += ": ";
+    throw UnknownOutputFormat {m};
+}
+
+PacketFormatter::PacketFormatter(OutputBuffer& out, OutputFormat format, HexDumpOptions dump_opts) :out{out}, format{format}, dump_opts{dump_opts}, cached_sec{-1}, cached_time_len{0} {
+    if (format == OutputFormat::CSV) {
+        out.write("ts,caplen,len,eth_src,eth_dst,ethertype,src,dst,proto,ttl,ip_id,sport,dport,seq,ack,flags,win,payload_len,vlan,icmp_type,icmp_code\n");
+    }
+}
+
+void PacketFormatter::write(const bpf_hdr& bhdr, const PacketView& packet) {
+    LATENCY_SCOPE(LatencyStage::OUTPUT);
+    switch (format) {
+        case OutputFormat::HUMAN:
+            write_human(bhdr, packet);
+            break;
+        case OutputFormat::LINE:
+            write_line(bhdr, packet);
+            break;
+        case OutputFormat::NDJSON:
+            write_json(bhdr, packet);
+            break;
+        case OutputFormat::CSV:
+            write_csv(bhdr, packet);
+            break;
+    }
+}
+
+// Payload bytes the IP header says the packet carried (not counting link-layer padding, even if the capture was cut short)
+// Without an IP header, whatever was captured past the last header we know
+static uint32_t payload_len(const PacketView& packet) {
+    size_t headers, ip_len;
+    switch (packet.get_network_kind()) {
+        case NetworkKind::IPV4:
+            headers = packet.get_data() - packet.get_ip_header().get_bytes();
+            ip_len = ntohs(packet.get_ip_header()->ip_len);
+            break;
+        case NetworkKind::IPV6:
+            headers = packet.get_data() - packet.get_ip6_header().get_bytes();
+            ip_len = sizeof(ip6_hdr) + ntohs(packet.get_ip6_header()->ip6_plen);
+            break;
+        default:
+            return static_cast<uint32_t>(packet.get_data_len());
+    }
+    return ip_len > headers ? static_cast<uint32_t>(ip_len - headers) : 0;
+}
+
+static bool has_ports(const PacketView& packet) {
+    return packet.get_transport_kind() == TransportKind::TCP || packet.get_transport_kind() == TransportKind::UDP;
+}
+
+// Source and destination ports, in network order (0 for protocols without them)
+static void get_ports(const PacketView& packet, uint16_t& sport, uint16_t& dport) {
+    switch (packet.get_transport_kind()) {
+        case TransportKind::TCP:
+            sport = packet.get_tcp_header()->th_sport;
+            dport = packet.get_tcp_header()->th_dport;
+            break;
+        case TransportKind::UDP:
+            sport = packet.get_udp_header()->uh_sport;
+            dport = packet.get_udp_header()->uh_dport;
+            break;
+        default:
+            sport = 0;
+            dport = 0;
+    }
+}
+
+static const char* transport_name(TransportKind kind) {
+    switch (kind) {
+        case TransportKind::TCP:
+            return "TCP";
+        case TransportKind::UDP:
+            return "UDP";
+        case TransportKind::ICMP:
+            return "ICMP";
+        case TransportKind::ICMPV6:
+            return "ICMPv6";
+        case TransportKind::NONE:
+            break;
+    }
+    return nullptr;
+}
+
+void PacketFormatter::write_timestamp(uint64_t sec, uint64_t usec) {
+    out.write_uint(sec);
+    out.put('.');
+    out.write_uint(usec, 6);
+}
+
+void PacketFormatter::write_mac(const u_char* addr) {
+    for (int i = 0; i < ETHER_ADDR_LEN; ++i) {
+        out.write_hex(addr[i]);
+        if (i < ETHER_ADDR_LEN-1) {
+            out.put(':');
+        }
+    }
+}
+
+void PacketFormatter::write_ipv4(const in_addr& addr) {
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(&addr.s_addr);
+    out.write_uint(b[0]);
+    out.put('.');
+    out.write_uint(b[1]);
+    out.put('.');
+    out.write_uint(b[2]);
+    out.put('.');
+    out.write_uint(b[3]);
+}
+
+void PacketFormatter::write_ipv6(const in6_addr& addr) {
+    char text[INET6_ADDRSTRLEN];
+    inet_ntop(AF_INET6, &addr, text, sizeof(text));
+    out.write(text);
+}
+
+void PacketFormatter::write_address(const PacketView& packet, bool source) {
+    switch (packet.get_network_kind()) {
+        case NetworkKind::IPV4:
+            write_ipv4(source ? packet.get_ip_header()->ip_src : packet.get_ip_header()->ip_dst);
+            break;
+        case NetworkKind::IPV6:
+            write_ipv6(source ? packet.get_ip6_header()->ip6_src : packet.get_ip6_header()->ip6_dst);
+            break;
+        case NetworkKind::ARP: {
+            in_addr addr;
+            memcpy(&addr, source ? packet.get_arp_header()->arp_spa : packet.get_arp_header()->arp_tpa, sizeof(addr));
+            write_ipv4(addr);
+            break;
+        }
+        case NetworkKind::OTHER:
+            break;
+    }
+}
+
+void PacketFormatter::write_vlan_ids(const PacketView& packet, char separator) {
+    for (size_t i = 0; i < packet.get_vlan_count(); ++i) {
+        if (i != 0) {
+            out.put(separator);
+        }
+        out.write_uint(packet.get_vlan_id(i));
+    }
+}
+
+void PacketFormatter::write_tcp_flags(uint8_t flags) {
+    // Same letters as the flow summaries, only the ones that are set
+    const char names[] = "FSRPAUEC";
+    for (int i = 0; i < 8; ++i) {
+        if (flags & (1 << i)) {
+            out.put(names[i]);
+        }
+    }
+}
+
+void PacketFormatter::write_human(const bpf_hdr& bhdr, const PacketView& packet) {
+    out.write("BPF Header\n\t|-Timestamp: ");
+    time_t sec {bhdr.bh_tstamp.tv_sec};
+    if (sec != cached_sec) {
+        tm local;
+        localtime_r(&sec, &local);
+        cached_time_len = strftime(cached_time, sizeof(cached_time), "%c %Z", &local);
+        cached_sec = sec;
+    }
+    out.write(cached_time, cached_time_len);
+    out.write(" and ");
+    out.write_uint(static_cast<uint64_t>(bhdr.bh_tstamp.tv_usec));
+    out.write(" usec\n\t|-Captured length: ");
+    out.write_uint(bhdr.bh_caplen);
+    out.write(" Bytes\n\t|-Original length: ");
+    out.write_uint(bhdr.bh_datalen);
+    out.write(" Bytes\n\t|-Header length: ");
+    out.write_uint(bhdr.bh_hdrlen);
+    out.write(" Bytes\n\n");
+
+    const ether_header& eth = packet.get_ether_header().get_header();
+    out.write("Packet\nEthernet Header\n\t|-Source Address: ");
+    write_mac(eth.ether_shost);
+    out.write("\n\t|-Destination Address: ");
+    write_mac(eth.ether_dhost);
+    out.write("\n\t|-Protocol: ");
+    out.write_uint(eth.ether_type);
+    out.write("\n");
+
+    for (size_t i = 0; i < packet.get_vlan_count(); ++i) {
+        out.write("VLAN Tag\n\t|-ID: ");
+        out.write_uint(packet.get_vlan_id(i));
+        out.write("\n");
+    }
+
+    switch (packet.get_network_kind()) {
+        case NetworkKind::IPV4: {
+            const ip& iph = packet.get_ip_header().get_header();
+            out.write("IP Header\n\t|-Version: ");
+            out.write_uint(iph.ip_v);
+            out.write("\n\t|-IP Header Length: ");
+            out.write_uint(iph.ip_hl);
+            out.write(" double-words\n\t|-Type of Service: ");
+            out.write_uint(iph.ip_tos);
+            out.write("\n\t|-Total Length: ");
+            out.write_uint(iph.ip_len);
+            out.write("\n\t|-Identification: ");
+            out.write_uint(iph.ip_id);
+            out.write("\n\t|-Time To Live: ");
+            out.write_uint(iph.ip_ttl);
+            out.write("\n\t|-Protocol: ");
+            out.write_uint(iph.ip_p);
+            out.write("\n\t|-Header Checksum: ");
+            out.write_uint(iph.ip_sum);
+            out.write("\n\t|-Source IP: ");
+            write_ipv4(iph.ip_src);
+            out.write("\n\t|-Destination IP: ");
+            write_ipv4(iph.ip_dst);
+            out.write("\n\n\n");
+            break;
+        }
+        case NetworkKind::IPV6: {
+            const ip6_hdr& ip6 = packet.get_ip6_header().get_header();
+            uint32_t flow = ntohl(ip6.ip6_flow);
+            out.write("IPv6 Header\n\t|-Version: ");
+            out.write_uint(flow >> 28);
+            out.write("\n\t|-Traffic Class: ");
+            out.write_uint((flow >> 20) & 0xff);
+            out.write("\n\t|-Flow Label: ");
+            out.write_uint(flow & 0xfffff);
+            out.write("\n\t|-Payload Length: ");
+            out.write_uint(ntohs(ip6.ip6_plen));
+            out.write("\n\t|-Next Header: ");
+            out.write_uint(ip6.ip6_nxt);
+            out.write("\n\t|-Hop Limit: ");
+            out.write_uint(ip6.ip6_hlim);
+            out.write("\n\t|-Source IP: ");
+            write_ipv6(ip6.ip6_src);
+            out.write("\n\t|-Destination IP: ");
+            write_ipv6(ip6.ip6_dst);
+            out.write("\n\n\n");
+            break;
+        }
+        case NetworkKind::ARP: {
+            const ether_arp& arp = packet.get_arp_header().get_header();
+            out.write("ARP Header\n\t|-Hardware Type: ");
+            out.write_uint(ntohs(arp.arp_hrd));
+            out.write("\n\t|-Protocol Type: ");
+            out.write_uint(ntohs(arp.arp_pro));
+            out.write("\n\t|-Operation: ");
+            out.write_uint(ntohs(arp.arp_op));
+            out.write("\n\t|-Sender Address: ");
+            write_mac(arp.arp_sha);
+            out.write("\n\t|-Sender IP: ");
+            write_address(packet, true);
+            out.write("\n\t|-Target Address: ");
+            write_mac(arp.arp_tha);
+            out.write("\n\t|-Target IP: ");
+            write_address(packet, false);
+            out.write("\n\n\n");
+            break;
+        }
+        case NetworkKind::OTHER:
+            break;
+    }
+
+    switch (packet.get_transport_kind()) {
+        case TransportKind::TCP: {
+            const tcphdr& tcp = packet.get_tcp_header().get_header();
+            out.write("TCP Header\n\t|-Source Port: ");
+            out.write_uint(tcp.th_sport);
+            out.write("\n\t|-Destination Port: ");
+            out.write_uint(tcp.th_dport);
+            out.write("\n\t|-Sequence Number: ");
+            out.write_uint(tcp.th_seq);
+            out.write("\n\t|-Ack Number: ");
+            out.write_uint(tcp.th_ack);
+            out.write("\n\t|-Header Length (Offset): ");
+            out.write_uint(tcp.th_off);
+            out.write(" dwords\n\t|-Flags: \n\t\t|-Urgent: ");
+            out.write_uint(tcp.th_flags & TH_URG);
+            out.write("\n\t\t|-Ack: ");
+            out.write_uint(tcp.th_flags & TH_ACK);
+            out.write("\n\t\t|-Push: ");
+            out.write_uint(tcp.th_flags & TH_PUSH);
+            out.write("\n\t\t|-Reset: ");
+            out.write_uint(tcp.th_flags & TH_RST);
+            out.write("\n\t\t|-Sync: ");
+            out.write_uint(tcp.th_flags & TH_SYN);
+            out.write("\n\t\t|-Finish: ");
+            out.write_uint(tcp.th_flags & TH_FIN);
+            out.write("\n\t\t|-ECE: ");
+            out.write_uint(tcp.th_flags & TH_ECE);
+            out.write("\n\t\t|-CWR: ");
+            out.write_uint(tcp.th_flags & TH_CWR);
+            out.write("\n\t|-Window Size: ");
+            out.write_uint(tcp.th_win);
+            out.write("\n\t|-Checksum: ");
+            out.write_uint(tcp.th_sum);
+            out.write("\n\t|-Urgent Pointer: ");
+            out.write_uint(tcp.th_urp);
+            out.write("\n\n\n\n");
+            break;
+        }
+        case TransportKind::UDP: {
+            const udphdr& udp = packet.get_udp_header().get_header();
+            out.write("UDP Header\n\t|-Source Port: ");
+            out.write_uint(udp.uh_sport);
+            out.write("\n\t|-Destination Port: ");
+            out.write_uint(udp.uh_dport);
+            out.write("\n\t|-UDP Length: ");
+            out.write_uint(udp.uh_ulen);
+            out.write("\n\t|-UDP Checksum: ");
+            out.write_uint(udp.uh_sum);
+            out.write("\n\n\n\n");
+            break;
+        }
+        case TransportKind::ICMP:
+        case TransportKind::ICMPV6: {
+            const icmp_header& icmp = packet.get_icmp_header().get_header();
+            out.write(packet.get_transport_kind() == TransportKind::ICMP ? "ICMP Header\n\t|-Type: " : "ICMPv6 Header\n\t|-Type: ");
+            out.write_uint(icmp.icmp_type);
+            out.write("\n\t|-Code: ");
+            out.write_uint(icmp.icmp_code);
+            out.write("\n\t|-Checksum: ");
+            out.write_uint(ntohs(icmp.icmp_cksum));
+            out.write("\n\n\n\n");
+            break;
+        }
+        case TransportKind::NONE:
+            break;
+    }
+
+    out.write("Raw Packet Data\n");
+    size_t data_len = packet.get_data_len();
+    char* dump = out.claim(hex_dump_size(data_len, dump_opts));
+    out.commit(hex_dump(dump, packet.get_data(), data_len, dump_opts));
+}
+
+void PacketFormatter::write_line(const bpf_hdr& bhdr, const PacketView& packet) {
+    write_timestamp(static_cast<uint64_t>(bhdr.bh_tstamp.tv_sec), static_cast<uint64_t>(bhdr.bh_tstamp.tv_usec));
+    if (packet.get_vlan_count() != 0) {
+        out.write(" vlan ");
+        write_vlan_ids(packet, '.');
+    }
+
+    if (packet.get_network_kind() == NetworkKind::ARP) {
+        const ether_arp& arp = packet.get_arp_header().get_header();
+        out.write(ntohs(arp.arp_op) == ARPOP_REQUEST ? " ARP request " : (ntohs(arp.arp_op) == ARPOP_REPLY ? " ARP reply " : " ARP "));
+        write_address(packet, true);
+        out.write(" (");
+        write_mac(arp.arp_sha);
+        out.write(") > ");
+        write_address(packet, false);
+        out.put('\n');
+        return;
+    }
+    if (packet.get_network_kind() == NetworkKind::OTHER) {
+        out.write(" ethertype ");
+        out.write_uint(packet.get_ether_type());
+        out.write(" len ");
+        out.write_uint(payload_len(packet));
+        out.put('\n');
+        return;
+    }
+
+    const char* name = transport_name(packet.get_transport_kind());
+    if (name != nullptr) {
+        out.put(' ');
+        out.write(name);
+        out.put(' ');
+    } else {
+        out.write(" IP proto ");
+        out.write_uint(packet.get_protocol());
+        out.put(' ');
+    }
+    // IPv6 addresses go in brackets so the port after them reads unambiguously
+    bool bracket = packet.get_network_kind() == NetworkKind::IPV6 && has_ports(packet);
+    uint16_t sport, dport;
+    get_ports(packet, sport, dport);
+    if (bracket) {
+        out.put('[');
+    }
+    write_address(packet, true);
+    if (bracket) {
+        out.put(']');
+    }
+    if (has_ports(packet)) {
+        out.put(':');
+        out.write_uint(ntohs(sport));
+    }
+    out.write(" > ");
+    if (bracket) {
+        out.put('[');
+    }
+    write_address(packet, false);
+    if (bracket) {
+        out.put(']');
+    }
+    if (has_ports(packet)) {
+        out.put(':');
+        out.write_uint(ntohs(dport));
+    }
+    switch (packet.get_transport_kind()) {
+        case TransportKind::TCP: {
+            const tcphdr& tcp = packet.get_tcp_header().get_header();
+            out.write(" flags ");
+            write_tcp_flags(tcp.th_flags);
+            out.write(" seq ");
+            out.write_uint(ntohl(tcp.th_seq));
+            out.write(" ack ");
+            out.write_uint(ntohl(tcp.th_ack));
+            out.write(" win ");
+            out.write_uint(ntohs(tcp.th_win));
+            break;
+        }
+        case TransportKind::ICMP:
+        case TransportKind::ICMPV6: {
+            const icmp_header& icmp = packet.get_icmp_header().get_header();
+            out.write(" type ");
+            out.write_uint(icmp.icmp_type);
+            out.write(" code ");
+            out.write_uint(icmp.icmp_code);
+            break;
+        }
+        default:
+            break;
+    }
+    out.write(" len ");
+    out.write_uint(payload_len(packet));
+    out.put('\n');
+}
+
+void PacketFormatter::write_json(const bpf_hdr& bhdr, const PacketView& packet) {
+    const ether_header& eth = packet.get_ether_header().get_header();
+    uint16_t sport, dport;
+    get_ports(packet, sport, dport);
+
+    out.write("{\"ts\":");
+    write_timestamp(static_cast<uint64_t>(bhdr.bh_tstamp.tv_sec), static_cast<uint64_t>(bhdr.bh_tstamp.tv_usec));
+    out.write(",\"caplen\":");
+    out.write_uint(bhdr.bh_caplen);
+    out.write(",\"len\":");
+    out.write_uint(bhdr.bh_datalen);
+    out.write(",\"eth_src\":\"");
+    write_mac(eth.ether_shost);
+    out.write("\",\"eth_dst\":\"");
+    write_mac(eth.ether_dhost);
+    out.write("\",\"ethertype\":");
+    out.write_uint(packet.get_ether_type());
+    if (packet.get_vlan_count() != 0) {
+        out.write(",\"vlan\":[");
+        write_vlan_ids(packet, ',');
+        out.put(']');
+    }
+    if (packet.get_network_kind() != NetworkKind::OTHER) {
+        out.write(",\"src\":\"");
+        write_address(packet, true);
+        out.write("\",\"dst\":\"");
+        write_address(packet, false);
+        out.put('"');
+    }
+    switch (packet.get_network_kind()) {
+        case NetworkKind::IPV4: {
+            const ip& iph = packet.get_ip_header().get_header();
+            out.write(",\"proto\":");
+            out.write_uint(iph.ip_p);
+            out.write(",\"ttl\":");
+            out.write_uint(iph.ip_ttl);
+            out.write(",\"ip_id\":");
+            out.write_uint(ntohs(iph.ip_id));
+            break;
+        }
+        case NetworkKind::IPV6:
+            out.write(",\"proto\":");
+            out.write_uint(packet.get_protocol());
+            out.write(",\"ttl\":");
+            out.write_uint(packet.get_ip6_header()->ip6_hlim);
+            break;
+        case NetworkKind::ARP:
+            out.write(",\"arp_op\":");
+            out.write_uint(ntohs(packet.get_arp_header()->arp_op));
+            break;
+        case NetworkKind::OTHER:
+            break;
+    }
+    if (has_ports(packet)) {
+        out.write(",\"sport\":");
+        out.write_uint(ntohs(sport));
+        out.write(",\"dport\":");
+        out.write_uint(ntohs(dport));
+    }
+    switch (packet.get_transport_kind()) {
+        case TransportKind::TCP: {
+            const tcphdr& tcp = packet.get_tcp_header().get_header();
+            out.write(",\"seq\":");
+            out.write_uint(ntohl(tcp.th_seq));
+            out.write(",\"ack\":");
+            out.write_uint(ntohl(tcp.th_ack));
+            out.write(",\"flags\":\"");
+            write_tcp_flags(tcp.th_flags);
+            out.write("\",\"win\":");
+            out.write_uint(ntohs(tcp.th_win));
+            break;
+        }
+        case TransportKind::ICMP:
+        case TransportKind::ICMPV6: {
+            const icmp_header& icmp = packet.get_icmp_header().get_header();
+            out.write(",\"icmp_type\":");
+            out.write_uint(icmp.icmp_type);
+            out.write(",\"icmp_code\":");
+            out.write_uint(icmp.icmp_code);
+            break;
+        }
+        default:
+            break;
+    }
+    out.write(",\"payload_len\":");
+    out.write_uint(payload_len(packet));
+    out.write("}\n");
+}
+
+void PacketFormatter::write_csv(const bpf_hdr& bhdr, const PacketView& packet) {
+    const ether_header& eth = packet.get_ether_header().get_header();
+    uint16_t sport, dport;
+    get_ports(packet, sport, dport);
+
+    write_timestamp(static_cast<uint64_t>(bhdr.bh_tstamp.tv_sec), static_cast<uint64_t>(bhdr.bh_tstamp.tv_usec));
+    out.put(',');
+    out.write_uint(bhdr.bh_caplen);
+    out.put(',');
+    out.write_uint(bhdr.bh_datalen);
+    out.put(',');
+    write_mac(eth.ether_shost);
+    out.put(',');
+    write_mac(eth.ether_dhost);
+    out.put(',');
+    out.write_uint(packet.get_ether_type());
+    out.put(',');
+    write_address(packet, true);
+    out.put(',');
+    write_address(packet, false);
+    out.put(',');
+    // Empty fields for whatever the packet does not have
+    switch (packet.get_network_kind()) {
+        case NetworkKind::IPV4: {
+            const ip& iph = packet.get_ip_header().get_header();
+            out.write_uint(iph.ip_p);
+            out.put(',');
+            out.write_uint(iph.ip_ttl);
+            out.put(',');
+            out.write_uint(ntohs(iph.ip_id));
+            break;
+        }
+        case NetworkKind::IPV6:
+            out.write_uint(packet.get_protocol());
+            out.put(',');
+            out.write_uint(packet.get_ip6_header()->ip6_hlim);
+            out.put(',');
+            break;
+        default:
+            out.write(",,");
+    }
+    out.put(',');
+    if (has_ports(packet)) {
+        out.write_uint(ntohs(sport));
+        out.put(',');
+        out.write_uint(ntohs(dport));
+    } else {
+        out.put(',');
+    }
+    out.put(',');
+    if (packet.get_transport_kind() == TransportKind::TCP) {
+        const tcphdr& tcp = packet.get_tcp_header().get_header();
+        out.write_uint(ntohl(tcp.th_seq));
+        out.put(',');
+        out.write_uint(ntohl(tcp.th_ack));
+        out.put(',');
+        write_tcp_flags(tcp.th_flags);
+        out.put(',');
+        out.write_uint(ntohs(tcp.th_win));
+    } else {
+        // No sequence numbers, flags or window
+        out.write(",,,");
+    }
+    out.put(',');
+    out.write_uint(payload_len(packet));
+    out.put(',');
+    // VLAN IDs outermost first, separated by dots
+    write_vlan_ids(packet, '.');
+    out.put(',');
+    if (packet.get_transport_kind() == TransportKind::ICMP || packet.get_transport_kind() == TransportKind::ICMPV6) {
+        const icmp_header& icmp = packet.get_icmp_header().get_header();
+        out.write_uint(icmp.icmp_type);
+        out.put(',');
+        out.write_uint(icmp.icmp_code);
+    } else {
+        out.put(',');
+    }
+    out.put('\n');
+}
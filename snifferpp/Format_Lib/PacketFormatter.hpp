@@ -0,0 +1,92 @@
+//
+//  PacketFormatter.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef PacketFormatter_hpp
+#define PacketFormatter_hpp
+
+#include <string>
+#include <exception>
+#include <ctime>
+#include "bpf_compat.hpp"
+#include "PacketView.hpp"
+#include "HexDump.hpp"
+#include "OutputBuffer.hpp"
+
+/*
+ Used to signal an output format we do not know
+ */
+class UnknownOutputFormat : public std::exception {
+private:
+    std::string message;
+public:
+    UnknownOutputFormat() {};
+    UnknownOutputFormat(std::string m) :message{m} {};
+
+    const char * what() {
+        message += "Unknown output format (expected human, line, json or csv)";
+        return message.c_str();
+    }
+};
+
+/*
+ HUMAN: the multi-line layout of the operator<< overloads (bpf_hdr followed by the PacketView)
+ LINE: one line per packet, tcpdump style
+ NDJSON: one JSON object per line
+ CSV: one row per packet, after a header row
+
+ LINE, NDJSON and CSV give ports, lengths and sequence numbers in host order, for feeding other tools
+ */
+enum class OutputFormat {HUMAN, LINE, NDJSON, CSV};
+
+// From its command line name: human, line, json or csv. Throws UnknownOutputFormat
+OutputFormat parse_output_format(const std::string& name);
+
+/*
+ Writes parsed packets to an OutputBuffer in one of the OutputFormats
+
+ Fields are read straight out of the capture buffer (no header copies) and converted by hand, so the cost per packet is
+ a few hundred bytes of memcpy and digit conversion. Nothing reaches the fd until the buffer fills or flush() is called.
+ */
+class PacketFormatter {
+private:
+    OutputBuffer& out;
+    OutputFormat format;
+    HexDumpOptions dump_opts; // Payload layout for HUMAN
+
+    // The formatted local time of the last second printed (HUMAN), localtime is too slow to call per packet
+    time_t cached_sec;
+    char cached_time[64];
+    size_t cached_time_len;
+
+    void write_human(const bpf_hdr& bhdr, const PacketView& packet);
+    void write_line(const bpf_hdr& bhdr, const PacketView& packet);
+    void write_json(const bpf_hdr& bhdr, const PacketView& packet);
+    void write_csv(const bpf_hdr& bhdr, const PacketView& packet);
+
+    // sec.usec, the microseconds zero padded to 6 digits
+    void write_timestamp(uint64_t sec, uint64_t usec);
+    void write_mac(const u_char* addr);
+    void write_ipv4(const in_addr& addr);
+    void write_ipv6(const in6_addr& addr);
+    void write_address(const PacketView& packet, bool source); // IPv4, IPv6 or ARP sender/target; nothing otherwise
+    void write_vlan_ids(const PacketView& packet, char separator);
+    void write_tcp_flags(uint8_t flags);
+
+public:
+    PacketFormatter(OutputBuffer& out, OutputFormat format, HexDumpOptions dump_opts = HexDumpOptions {});
+
+    PacketFormatter(const PacketFormatter& other)= delete;
+    PacketFormatter operator=(const PacketFormatter& other)=delete;
+
+    void write(const bpf_hdr& bhdr, const PacketView& packet);
+    void flush(void) { out.flush(); }
+
+    OutputFormat get_format(void) const { return format; }
+};
+
+#endif /* PacketFormatter_hpp */
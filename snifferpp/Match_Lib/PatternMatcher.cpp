@@ -0,0 +1,397 @@
+//
+//  PatternMatcher.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <new>
+#include <sys/mman.h>
+#include "PatternMatcher.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SNIFFERPP_MATCH_X86
+#endif
+
+using std::string;
+using std::vector;
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+string parse_pattern(const string& text) {
+    string bytes;
+    bool in_hex = false;
+    int high = -1; // First digit of a hex byte, until the second
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (!in_hex) {
+            if (c == '\\') {
+                if (i + 1 == text.size() || (text[i+1] != '|' && text[i+1] != '\\')) {
+                    throw PatternSyntaxError {"Unknown escape in \"" + text + "\": "};
+                }
+                bytes += text[++i];
+            } else if (c == '|') {
+                in_hex = true;
+            } else {
+                bytes += c;
+            }
+            continue;
+        }
+        if (c == '|') {
+            if (high != -1) {
+                throw PatternSyntaxError {"Odd number of hex digits in \"" + text + "\": "};
+            }
+            in_hex = false;
+        } else if (c != ' ') {
+            int v = hex_value(c);
+            if (v == -1) {
+                throw PatternSyntaxError {string {"Bad hex digit '"} + c + "' in \"" + text + "\": "};
+            }
+            if (high == -1) {
+                high = v;
+            } else {
+                bytes += static_cast<char>(high << 4 | v);
+                high = -1;
+            }
+        }
+    }
+    if (in_hex) {
+        throw PatternSyntaxError {"Unterminated hex in \"" + text + "\": "};
+    }
+    if (bytes.empty()) {
+        throw PatternSyntaxError {"Empty pattern: "};
+    }
+    return bytes;
+}
+
+vector<string> read_pattern_file(const string& path) {
+    std::ifstream in {path};
+    if (!in) {
+        throw PatternFileNotOpened {path + ": "};
+    }
+    vector<string> lines;
+    string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        lines.push_back(line);
+    }
+    if (in.bad()) {
+        throw PatternFileNotOpened {path + ": "};
+    }
+    return lines;
+}
+
+/*
+ Prefilter kernels. Each returns the first position from pos that could begin a pattern, or len
+ */
+
+__attribute__((always_inline))
+static inline bool begins_pair(const PatternPrefilter& f, uint8_t a, uint8_t b) {
+    unsigned int pair = static_cast<unsigned int>(a) << 8 | b;
+    return (f.pairs[pair >> 6] >> (pair & 63)) & 1;
+}
+
+/*
+ Positions the vector loads cannot reach (the last 16 or 32), exactly. Always inlined so it is compiled for each kernel's
+ target, as in Checksum.cpp
+ */
+__attribute__((always_inline))
+static inline size_t skip_tail(const PatternPrefilter& f, const byte_t* data, size_t pos, size_t len) {
+    for (; pos + 1 < len; ++pos) {
+        if (begins_pair(f, static_cast<uint8_t>(data[pos]), static_cast<uint8_t>(data[pos+1]))) {
+            return pos;
+        }
+    }
+    // The last byte has nothing after it, so it only needs to begin a pattern
+    if (pos < len) {
+        uint8_t b = static_cast<uint8_t>(data[pos]);
+        if ((f.firsts[b >> 6] >> (b & 63)) & 1) {
+            return pos;
+        }
+    }
+    return len;
+}
+
+static size_t skip_scalar(const PatternPrefilter& f, const byte_t* data, size_t pos, size_t len) {
+    return skip_tail(f, data, pos, len);
+}
+
+#ifdef SNIFFERPP_MATCH_X86
+
+/*
+ Bit k of byte i is set if data[i], data[i+1] could be a pair from bucket k. Reads 17 bytes
+ */
+__attribute__((always_inline, target("ssse3")))
+static inline __m128i candidates16(const PatternPrefilter& f, const byte_t* p) {
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+    __m128i m = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(f.first_lo)), _mm_and_si128(a, nibble));
+    m = _mm_and_si128(m, _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(f.first_hi)), _mm_and_si128(_mm_srli_epi16(a, 4), nibble)));
+    m = _mm_and_si128(m, _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(f.second_lo)), _mm_and_si128(b, nibble)));
+    return _mm_and_si128(m, _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(f.second_hi)), _mm_and_si128(_mm_srli_epi16(b, 4), nibble)));
+}
+
+// 16 positions a step
+__attribute__((target("ssse3")))
+static size_t skip_ssse3(const PatternPrefilter& f, const byte_t* data, size_t pos, size_t len) {
+    const __m128i zero = _mm_setzero_si128();
+    while (pos + 17 <= len) {
+        unsigned int hits = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(candidates16(f, data + pos), zero))) ^ 0xffff;
+        if (hits != 0) {
+            return pos + __builtin_ctz(hits);
+        }
+        pos += 16;
+    }
+    return skip_tail(f, data, pos, len);
+}
+
+// 32 positions a step, the nibble tables repeated in both lanes (PSHUFB looks up within each lane)
+__attribute__((target("avx2")))
+static size_t skip_avx2(const PatternPrefilter& f, const byte_t* data, size_t pos, size_t len) {
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i first_lo = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(f.first_lo)));
+    const __m256i first_hi = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(f.first_hi)));
+    const __m256i second_lo = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(f.second_lo)));
+    const __m256i second_hi = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(f.second_hi)));
+    while (pos + 33 <= len) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos + 1));
+        __m256i m = _mm256_shuffle_epi8(first_lo, _mm256_and_si256(a, nibble));
+        m = _mm256_and_si256(m, _mm256_shuffle_epi8(first_hi, _mm256_and_si256(_mm256_srli_epi16(a, 4), nibble)));
+        m = _mm256_and_si256(m, _mm256_shuffle_epi8(second_lo, _mm256_and_si256(b, nibble)));
+        m = _mm256_and_si256(m, _mm256_shuffle_epi8(second_hi, _mm256_and_si256(_mm256_srli_epi16(b, 4), nibble)));
+        unsigned int hits = ~static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(m, zero)));
+        if (hits != 0) {
+            return pos + __builtin_ctz(hits);
+        }
+        pos += 32;
+    }
+    if (pos + 17 <= len) {
+        unsigned int hits = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(candidates16(f, data + pos), _mm_setzero_si128()))) ^ 0xffff;
+        if (hits != 0) {
+            return pos + __builtin_ctz(hits);
+        }
+        pos += 16;
+    }
+    return skip_tail(f, data, pos, len);
+}
+
+#endif
+
+using SkipKernel = size_t (*)(const PatternPrefilter& f, const byte_t* data, size_t pos, size_t len);
+
+struct Kernel {
+    SkipKernel skip;
+    const char* name;
+    bool nibbles; // Tests the nibble tables, not the exact pairs (so is less selective)
+};
+
+static Kernel pick_kernel() {
+#ifdef SNIFFERPP_MATCH_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return Kernel {skip_avx2, "avx2", true};
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return Kernel {skip_ssse3, "ssse3", true};
+    }
+#endif
+    return Kernel {skip_scalar, "scalar", false};
+}
+
+static const Kernel& kernel() {
+    static const Kernel k = pick_kernel();
+    return k;
+}
+
+const char* pattern_prefilter_name() {
+    return kernel().name;
+}
+
+PatternMatcher::PatternMatcher(vector<string> p) :patterns{std::move(p)}, stride{0}, transitions{nullptr}, transitions_len{0}, use_prefilter{false} {
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        if (patterns[i].empty()) {
+            throw PatternSyntaxError {"Pattern " + std::to_string(i) + " is empty: "};
+        }
+    }
+    build_automaton();
+    build_prefilter();
+}
+
+PatternMatcher::~PatternMatcher() {
+    if (transitions != nullptr) {
+        munmap(transitions, transitions_len * sizeof(uint32_t));
+    }
+}
+
+size_t PatternMatcher::skip(const byte_t* data, size_t pos, size_t len) const {
+    return kernel().skip(prefilter, data, pos, len);
+}
+
+void PatternMatcher::build_automaton() {
+    // Every byte some pattern uses gets its own column, the rest share column 0 (if there are any)
+    bool used[256] = {};
+    for (const string& p : patterns) {
+        for (char c : p) {
+            used[static_cast<uint8_t>(c)] = true;
+        }
+    }
+    uint32_t columns = std::count(used, used + 256, false) ? 1 : 0;
+    for (int b = 0; b < 256; ++b) {
+        classes[b] = used[b] ? static_cast<uint8_t>(columns++) : 0;
+    }
+    stride = columns;
+
+    // The trie, one row per state; NONE where it has no edge
+    const uint32_t NONE = UINT32_MAX;
+    vector<uint32_t> next(stride, NONE);
+    vector<vector<uint32_t>> ends(1); // Patterns spelled out by each state
+    for (uint32_t id = 0; id < patterns.size(); ++id) {
+        uint32_t state = 0;
+        for (char c : patterns[id]) {
+            uint32_t& edge = next[state * stride + classes[static_cast<uint8_t>(c)]];
+            if (edge == NONE) {
+                edge = static_cast<uint32_t>(ends.size());
+                ends.emplace_back();
+                next.resize(next.size() + stride, NONE);
+            }
+            // Not edge: resize may have moved it
+            state = next[state * stride + classes[static_cast<uint8_t>(c)]];
+        }
+        ends[state].push_back(id);
+    }
+    size_t states = ends.size();
+    if (states * stride > STATE_MASK) {
+        throw std::length_error {"Pattern automaton too large"};
+    }
+
+    // Breadth first, so a state's failure (a shorter string) is done before it: missing edges become the failure's
+    // transition on the same byte, and the patterns a state ends are its own then its failure's
+    vector<uint32_t> fail(states, 0);
+    vector<vector<uint32_t>> out(states);
+    vector<uint32_t> order {0};
+    order.reserve(states);
+    out[0] = ends[0];
+    for (size_t k = 0; k < order.size(); ++k) {
+        uint32_t s = order[k];
+        for (uint32_t c = 0; c < stride; ++c) {
+            uint32_t& edge = next[s * stride + c];
+            if (edge == NONE) {
+                edge = s == 0 ? 0 : next[fail[s] * stride + c];
+                continue;
+            }
+            uint32_t child = edge;
+            fail[child] = s == 0 ? 0 : next[fail[s] * stride + c];
+            out[child] = ends[child];
+            out[child].insert(out[child].end(), out[fail[child]].begin(), out[fail[child]].end());
+            order.push_back(child);
+        }
+    }
+
+    outputs_begin.assign(states + 1, 0);
+    for (size_t s = 0; s < states; ++s) {
+        outputs_begin[s] = static_cast<uint32_t>(outputs.size());
+        outputs.insert(outputs.end(), out[s].begin(), out[s].end());
+    }
+    outputs_begin[states] = static_cast<uint32_t>(outputs.size());
+
+    // Thousands of patterns make a table of megabytes, read at random: on 4K pages nearly every byte would also miss the
+    // TLB, so ask for huge pages (half as fast again at 16MB) before anything touches it
+    void* table = mmap(nullptr, next.size() * sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED) {
+        throw std::bad_alloc {};
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(table, next.size() * sizeof(uint32_t), MADV_HUGEPAGE);
+#endif
+    transitions = static_cast<uint32_t*>(table);
+    transitions_len = next.size();
+    for (size_t i = 0; i < next.size(); ++i) {
+        transitions[i] = next[i] * stride | (out[next[i]].empty() ? 0 : MATCH_FLAG);
+    }
+}
+
+void PatternMatcher::build_prefilter() {
+    PatternPrefilter& f = prefilter;
+    memset(&f, 0, sizeof(f));
+
+    // Exact: every pair a pattern starts with, or every pair starting with a one byte pattern
+    vector<uint16_t> pairs;
+    bool single_bytes = false;
+    for (const string& p : patterns) {
+        uint8_t first = static_cast<uint8_t>(p[0]);
+        f.firsts[first >> 6] |= uint64_t {1} << (first & 63);
+        if (p.size() == 1) {
+            single_bytes = true;
+            for (unsigned int second = 0; second < 256; ++second) {
+                unsigned int pair = static_cast<unsigned int>(first) << 8 | second;
+                f.pairs[pair >> 6] |= uint64_t {1} << (pair & 63);
+            }
+            continue;
+        }
+        unsigned int pair = static_cast<unsigned int>(first) << 8 | static_cast<uint8_t>(p[1]);
+        f.pairs[pair >> 6] |= uint64_t {1} << (pair & 63);
+        pairs.push_back(static_cast<uint16_t>(pair));
+    }
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+    // Nibble tables: sorted pairs in contiguous buckets, so each bucket's first bytes share high nibbles and a bucket's
+    // tables admit few pairs it does not hold. One byte patterns get their own bucket, open to any second byte
+    unsigned int buckets = single_bytes ? 7 : 8;
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        uint8_t bit = static_cast<uint8_t>(1 << (i * buckets / pairs.size()));
+        f.first_lo[(pairs[i] >> 8) & 0x0f] |= bit;
+        f.first_hi[pairs[i] >> 12] |= bit;
+        f.second_lo[pairs[i] & 0x0f] |= bit;
+        f.second_hi[(pairs[i] >> 4) & 0x0f] |= bit;
+    }
+    if (single_bytes) {
+        for (const string& p : patterns) {
+            if (p.size() == 1) {
+                f.first_lo[static_cast<uint8_t>(p[0]) & 0x0f] |= 0x80;
+                f.first_hi[static_cast<uint8_t>(p[0]) >> 4] |= 0x80;
+            }
+        }
+        for (int n = 0; n < 16; ++n) {
+            f.second_lo[n] |= 0x80;
+            f.second_hi[n] |= 0x80;
+        }
+    }
+
+    // How many of all 65536 pairs the kernel in use stops at. Each stop costs about what the automaton would have spent
+    // on a few bytes, and payloads are mostly text, which holds only a seventh of the pairs: past about 1/64 skipping
+    // is no faster than stepping
+    unsigned int admitted = 0;
+    for (unsigned int pair = 0; pair < 65536; ++pair) {
+        if (kernel().nibbles) {
+            uint8_t a = static_cast<uint8_t>(pair >> 8), b = static_cast<uint8_t>(pair);
+            admitted += (f.first_lo[a & 0x0f] & f.first_hi[a >> 4] & f.second_lo[b & 0x0f] & f.second_hi[b >> 4]) != 0;
+        } else {
+            admitted += (f.pairs[pair >> 6] >> (pair & 63)) & 1;
+        }
+    }
+    use_prefilter = admitted <= 65536 / 64;
+}
@@ -0,0 +1,198 @@
+//
+//  PatternMatcher.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef PatternMatcher_hpp
+#define PatternMatcher_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <exception>
+#include "standard_headers.hpp"
+
+/*
+ Used to signal a pattern we could not parse
+ */
+class PatternSyntaxError : public std::exception {
+private:
+    std::string message;
+public:
+    PatternSyntaxError() {};
+    PatternSyntaxError(std::string m) :message{m} {};
+
+    const char * what() {
+        message += "Invalid pattern";
+        return message.c_str();
+    }
+};
+
+class PatternFileNotOpened : public std::exception {
+private:
+    std::string message;
+public:
+    PatternFileNotOpened() {};
+    PatternFileNotOpened(std::string m) :message{m} {};
+
+    const char * what() {
+        message += "Could not read pattern file";
+        return message.c_str();
+    }
+};
+
+/*
+ The bytes of one pattern, written as literal text with hex runs between bars, Snort style:
+
+    GET /admin
+    |de ad be ef|
+    HTTP/1.|30 0d 0a|
+
+ Spaces inside a hex run are ignored; \| and \\ are a literal bar and backslash. Throws PatternSyntaxError
+ */
+std::string parse_pattern(const std::string& text);
+
+/*
+ The lines of a pattern file, one pattern each (as parse_pattern takes them), without blank lines and # comments.
+ Throws PatternFileNotOpened
+ */
+std::vector<std::string> read_pattern_file(const std::string& path);
+
+/*
+ One occurrence of a pattern
+ */
+struct PatternMatch {
+    uint32_t pattern; // Index into the patterns the matcher was built from
+    size_t offset; // Of its first byte in the scanned buffer
+};
+
+/*
+ Where a PatternMatcher's prefilter stops: the nibble tables of its vector kernels (bit k set if a pair in bucket k has
+ that nibble there), and the exact first byte pairs and first bytes for the positions their loads cannot reach
+ */
+struct PatternPrefilter {
+    alignas(16) uint8_t first_lo[16];
+    alignas(16) uint8_t first_hi[16];
+    alignas(16) uint8_t second_lo[16];
+    alignas(16) uint8_t second_hi[16];
+    uint64_t pairs[65536 / 64];
+    uint64_t firsts[256 / 64];
+};
+
+/*
+ Finds every occurrence of up to millions of byte strings in one pass over a buffer (a packet's payload, normally
+ PacketView::get_data(), in place).
+
+ The patterns are compiled into an Aho-Corasick automaton, made a full DFA so every byte costs one table load: bytes
+ no pattern uses share one column (byte classes), and the high bit of each transition says whether the state it goes to
+ ends a pattern, so the loop only leaves the table for matches.
+
+ While the automaton sits in its start state, nothing is in progress and it is only waiting for a pattern's first byte.
+ There a prefilter skips ahead to the next position whose byte and the one after it begin some pattern, 16 or 32
+ positions at a time (nibble lookups with PSHUFB over 8 buckets of first byte pairs, as in Hyperscan's Teddy). With
+ many patterns almost every pair begins one and the prefilter would only cost time, so it is built only if it is
+ selective enough; see has_prefilter.
+
+ Nothing is modified after construction, so one matcher can be scanned from any number of threads at once.
+ */
+class PatternMatcher {
+private:
+    static const uint32_t MATCH_FLAG = 0x80000000u;
+    static const uint32_t STATE_MASK = 0x7fffffffu;
+
+    std::vector<std::string> patterns;
+    uint8_t classes[256]; // Byte to column
+    uint32_t stride; // Columns, transitions[] rows are this long
+    uint32_t* transitions; // Next state, already multiplied by stride, | MATCH_FLAG if it ends a pattern (see build_automaton)
+    size_t transitions_len;
+    std::vector<uint32_t> outputs_begin; // Per state (not multiplied), into outputs; one more for the end
+    std::vector<uint32_t> outputs; // Patterns ending in each state, longest first
+    PatternPrefilter prefilter;
+    bool use_prefilter;
+
+    // First position from pos whose byte pair (or last byte) begins a pattern, len if none
+    size_t skip(const byte_t* data, size_t pos, size_t len) const;
+
+    void build_automaton(void);
+    void build_prefilter(void);
+
+    template <typename OnMatch>
+    void report(uint32_t state, size_t end, OnMatch& on_match) const {
+        uint32_t idx = state / stride;
+        for (uint32_t k = outputs_begin[idx]; k < outputs_begin[idx + 1]; ++k) {
+            uint32_t id = outputs[k];
+            on_match(id, end + 1 - patterns[id].size());
+        }
+    }
+
+public:
+    /*
+     Pattern i is reported as i. Throws PatternSyntaxError if one is empty, std::length_error if the automaton would
+     need more than 2^31 transitions
+     */
+    PatternMatcher(std::vector<std::string> patterns);
+
+    PatternMatcher(const PatternMatcher& other)= delete;
+    PatternMatcher operator=(const PatternMatcher& other)=delete;
+
+    ~PatternMatcher();
+
+    /*
+     Calls on_match(uint32_t pattern, size_t offset) for every occurrence in data, by where it ends then longest first.
+     Overlapping occurrences are all reported
+     */
+    template <typename OnMatch>
+    void scan(const byte_t* data, size_t len, OnMatch&& on_match) const {
+        const uint32_t* next = transitions;
+        uint32_t state = 0;
+        size_t i = 0;
+        if (!use_prefilter) {
+            for (; i < len; ++i) {
+                uint32_t t = next[state + classes[static_cast<uint8_t>(data[i])]];
+                state = t & STATE_MASK;
+                if (t & MATCH_FLAG) {
+                    report(state, i, on_match);
+                }
+            }
+            return;
+        }
+        while (i < len) {
+            if (state == 0) {
+                i = skip(data, i, len);
+                if (i == len) {
+                    break;
+                }
+            }
+            uint32_t t = next[state + classes[static_cast<uint8_t>(data[i])]];
+            state = t & STATE_MASK;
+            if (t & MATCH_FLAG) {
+                report(state, i, on_match);
+            }
+            ++i;
+        }
+    }
+
+    /*
+     Appends every occurrence in data to matches, returns how many there were
+     */
+    size_t find_all(const byte_t* data, size_t len, std::vector<PatternMatch>& matches) const {
+        size_t before = matches.size();
+        scan(data, len, [&matches](uint32_t pattern, size_t offset) { matches.push_back(PatternMatch {pattern, offset}); });
+        return matches.size() - before;
+    }
+
+    size_t get_pattern_count(void) const { return patterns.size(); }
+    const std::string& get_pattern(uint32_t id) const { return patterns[id]; }
+    size_t get_state_count(void) const { return outputs_begin.size() - 1; }
+    // Transition table and outputs
+    size_t get_table_bytes(void) const { return transitions_len * sizeof(uint32_t) + outputs.size() * sizeof(uint32_t); }
+    bool has_prefilter(void) const { return use_prefilter; }
+};
+
+// Which prefilter kernel matchers use: "avx2", "ssse3" or "scalar"
+const char* pattern_prefilter_name(void);
+
+#endif /* PatternMatcher_hpp */
@@ -0,0 +1,97 @@
+//
+//  CaptureCounters.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include <mutex>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include "CaptureCounters.hpp"
+
+using std::vector;
+
+// Every block handed out so far. Never freed: readers may still be summing them when threads exit
+static std::mutex registry_lock;
+static vector<CaptureCounters*> registry;
+
+const char* protocol_class_name(ProtocolClass c) {
+    switch (c) {
+        case ProtocolClass::TCP:
+            return "tcp";
+        case ProtocolClass::UDP:
+            return "udp";
+        case ProtocolClass::OTHER_IP:
+            return "other_ip";
+        case ProtocolClass::NON_IP:
+            return "non_ip";
+    }
+    return "invalid";
+}
+
+const char* checksum_protocol_name(ChecksumProtocol p) {
+    switch (p) {
+        case ChecksumProtocol::IPV4:
+            return "ipv4";
+        case ChecksumProtocol::TCP:
+            return "tcp";
+        case ChecksumProtocol::UDP:
+            return "udp";
+    }
+    return "invalid";
+}
+
+CaptureCounters::CaptureCounters() :packets{0}, bytes{0}, truncated{0}, unsupported{0}, invalid{0}, queue_dropped{0} {
+    for (size_t i = 0; i < PROTOCOL_CLASSES; ++i) {
+        protocol_packets[i].store(0, std::memory_order_relaxed);
+        protocol_bytes[i].store(0, std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < PARSE_STATUSES; ++i) {
+        parse_failures[i].store(0, std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < CHECKSUM_PROTOCOLS; ++i) {
+        checksums_verified[i].store(0, std::memory_order_relaxed);
+        checksum_errors[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+CaptureCounters* register_thread_counters() {
+    // Plain new only promises alignof(max_align_t) before C++17, and the whole point is the cache line alignment
+    void* memory = nullptr;
+    if (posix_memalign(&memory, CACHE_LINE_LEN, sizeof(CaptureCounters)) != 0) {
+        throw std::bad_alloc {};
+    }
+    CaptureCounters* counters = new (memory) CaptureCounters {};
+
+    std::lock_guard<std::mutex> guard {registry_lock};
+    registry.push_back(counters);
+    return counters;
+}
+
+CaptureTotals sum_thread_counters() {
+    CaptureTotals totals {};
+    std::lock_guard<std::mutex> guard {registry_lock};
+    for (const CaptureCounters* c : registry) {
+        totals.packets += c->packets.load(std::memory_order_relaxed);
+        totals.bytes += c->bytes.load(std::memory_order_relaxed);
+        totals.truncated += c->truncated.load(std::memory_order_relaxed);
+        totals.unsupported += c->unsupported.load(std::memory_order_relaxed);
+        totals.invalid += c->invalid.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < PARSE_STATUSES; ++i) {
+            totals.parse_failures[i] += c->parse_failures[i].load(std::memory_order_relaxed);
+        }
+        totals.queue_dropped += c->queue_dropped.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < PROTOCOL_CLASSES; ++i) {
+            totals.protocol_packets[i] += c->protocol_packets[i].load(std::memory_order_relaxed);
+            totals.protocol_bytes[i] += c->protocol_bytes[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < CHECKSUM_PROTOCOLS; ++i) {
+            totals.checksums_verified[i] += c->checksums_verified[i].load(std::memory_order_relaxed);
+            totals.checksum_errors[i] += c->checksum_errors[i].load(std::memory_order_relaxed);
+        }
+    }
+    return totals;
+}
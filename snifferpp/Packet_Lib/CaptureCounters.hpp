@@ -0,0 +1,164 @@
+//
+//  CaptureCounters.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef CaptureCounters_hpp
+#define CaptureCounters_hpp
+
+#include <atomic>
+#include <cstdint>
+#include "standard_headers.hpp"
+#include "Dissector.hpp"
+#include "Checksum.hpp"
+
+/*
+ What the packets counted per protocol are split into
+ */
+enum class ProtocolClass {TCP, UDP, OTHER_IP, NON_IP};
+
+const size_t PROTOCOL_CLASSES = 4;
+
+// Lowercase name, for metric labels
+const char* protocol_class_name(ProtocolClass c);
+
+/*
+ Which class a captured frame (from the ethernet header) falls in, from its EtherType and IP protocol alone, so frames
+ that do not dissect are classed too
+ */
+inline ProtocolClass classify_protocol(const byte_t* data, size_t caplen) {
+    uint16_t ether_type;
+    size_t ip_offset;
+    int protocol = -1;
+    if (skip_vlan_tags(data, caplen, ether_type, ip_offset)) {
+        if (ether_type == htons(ETHERTYPE_IP) && caplen >= ip_offset + sizeof(ip)) {
+            protocol = reinterpret_cast<const ip*>(data + ip_offset)->ip_p;
+        } else if (ether_type == htons(ETHERTYPE_IPV6) && caplen >= ip_offset + sizeof(ip6_hdr)) {
+            protocol = reinterpret_cast<const ip6_hdr*>(data + ip_offset)->ip6_nxt;
+        }
+    }
+    switch (protocol) {
+        case -1:
+            return ProtocolClass::NON_IP;
+        case IPPROTO_TCP:
+            return ProtocolClass::TCP;
+        case IPPROTO_UDP:
+            return ProtocolClass::UDP;
+        default:
+            return ProtocolClass::OTHER_IP;
+    }
+}
+
+/*
+ What checksums are counted per (see verify_checksums)
+ */
+enum class ChecksumProtocol {IPV4, TCP, UDP};
+
+const size_t CHECKSUM_PROTOCOLS = 3;
+
+// Lowercase name, for metric labels
+const char* checksum_protocol_name(ChecksumProtocol p);
+
+/*
+ Running totals of what one thread has seen, exported as metrics (see MetricsExporter)
+
+ Every thread has its own block (thread_counters()) on its own cache lines, so counting never touches a line another
+ thread writes and needs no atomic read-modify-write: the owner does a relaxed load and store, everyone else only reads.
+ */
+struct alignas(CACHE_LINE_LEN) CaptureCounters {
+    std::atomic<uint64_t> packets; // Records read from the capture source
+    std::atomic<uint64_t> bytes; // Their length on the wire
+    std::atomic<uint64_t> truncated; // Captured short of their length on the wire
+    std::atomic<uint64_t> unsupported; // Unsupported EtherType or protocol (view_packet threw UnsupportedProtocol)
+    std::atomic<uint64_t> invalid; // Truncated or malformed (view_packet threw InvalidInput)
+    std::atomic<uint64_t> parse_failures[PARSE_STATUSES]; // By ParseStatus. OK is left at 0, counting it would cost every packet a store
+    std::atomic<uint64_t> queue_dropped; // Pipeline ring was full
+    std::atomic<uint64_t> protocol_packets[PROTOCOL_CLASSES];
+    std::atomic<uint64_t> protocol_bytes[PROTOCOL_CLASSES];
+    std::atomic<uint64_t> checksums_verified[CHECKSUM_PROTOCOLS]; // By ChecksumProtocol, good or bad (UNVERIFIED is not counted)
+    std::atomic<uint64_t> checksum_errors[CHECKSUM_PROTOCOLS];
+
+    CaptureCounters();
+
+    CaptureCounters(const CaptureCounters& other)= delete;
+    CaptureCounters operator=(const CaptureCounters& other)=delete;
+
+    // Only ever called by the owning thread
+    static void add(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    /*
+     One record from a capture source: data is the captured packet (from the ethernet header), wire_len its original length
+     */
+    void count_record(const byte_t* data, size_t caplen, size_t wire_len) {
+        add(packets);
+        add(bytes, wire_len);
+        if (caplen != wire_len) {
+            add(truncated);
+        }
+        ProtocolClass c = classify_protocol(data, caplen);
+        add(protocol_packets[static_cast<size_t>(c)]);
+        add(protocol_bytes[static_cast<size_t>(c)], wire_len);
+    }
+
+    void count_checksum(ChecksumProtocol p, ChecksumResult r) {
+        if (r != ChecksumResult::UNVERIFIED) {
+            add(checksums_verified[static_cast<size_t>(p)]);
+            if (r == ChecksumResult::BAD) {
+                add(checksum_errors[static_cast<size_t>(p)]);
+            }
+        }
+    }
+
+    // What verify_checksums found for one record
+    void count_checksums(const FrameChecksums& sums) {
+        count_checksum(ChecksumProtocol::IPV4, sums.ip);
+        if (sums.protocol == IPPROTO_TCP) {
+            count_checksum(ChecksumProtocol::TCP, sums.transport);
+        } else if (sums.protocol == IPPROTO_UDP) {
+            count_checksum(ChecksumProtocol::UDP, sums.transport);
+        }
+    }
+};
+
+/*
+ Plain copy of counters, summed over every thread
+ */
+struct CaptureTotals {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t truncated;
+    uint64_t unsupported;
+    uint64_t invalid;
+    uint64_t parse_failures[PARSE_STATUSES];
+    uint64_t queue_dropped;
+    uint64_t protocol_packets[PROTOCOL_CLASSES];
+    uint64_t protocol_bytes[PROTOCOL_CLASSES];
+    uint64_t checksums_verified[CHECKSUM_PROTOCOLS];
+    uint64_t checksum_errors[CHECKSUM_PROTOCOLS];
+};
+
+// Sets up a new block for the calling thread. Blocks are kept after their thread exits, so nothing counted is lost
+CaptureCounters* register_thread_counters(void);
+
+/*
+ The calling thread's counters. A mutex is taken on a thread's first call only
+ */
+inline CaptureCounters& thread_counters(void) {
+    static thread_local CaptureCounters* counters = nullptr;
+    if (counters == nullptr) {
+        counters = register_thread_counters();
+    }
+    return *counters;
+}
+
+/*
+ Every thread's counters added up. Safe to call from any thread while the others keep counting
+ */
+CaptureTotals sum_thread_counters(void);
+
+#endif /* CaptureCounters_hpp */
@@ -0,0 +1,273 @@
+//
+//  Checksum.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include "Checksum.hpp"
+#include "Dissector.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SNIFFERPP_CHECKSUM_X86
+#endif
+
+/*
+ Every kernel adds up 32 bit words into 64 bit sums, so nothing can overflow however long the buffer.
+ Since 2^16 = 1 (mod 0xffff), where a 16 bit word sits inside the wider ones does not change the folded result
+ */
+
+/*
+ The last few bytes (fewer than 8 left from any kernel's main loop, 16 from the vector ones). Always inlined so it is
+ compiled for each kernel's target: legacy SSE code after AVX2 code stalls on the upper register halves
+ */
+__attribute__((always_inline))
+static inline uint64_t add_tail(const byte_t* p, size_t len, uint64_t sum) {
+    if (len >= 8) {
+        uint32_t w[2];
+        memcpy(w, p, sizeof(w));
+        sum += w[0];
+        sum += w[1];
+        p += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        uint32_t w;
+        memcpy(&w, p, sizeof(w));
+        sum += w;
+        p += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        uint16_t w;
+        memcpy(&w, p, sizeof(w));
+        sum += w;
+        p += 2;
+        len -= 2;
+    }
+    if (len == 1) {
+        // The byte goes first in its word, whichever byte order that makes it
+        uint16_t w = 0;
+        memcpy(&w, p, 1);
+        sum += w;
+    }
+    return sum;
+}
+
+#ifndef SNIFFERPP_CHECKSUM_X86
+
+static uint64_t add_scalar(const byte_t* p, size_t len, uint64_t sum) {
+    while (len >= 8) {
+        uint32_t w[2];
+        memcpy(w, p, sizeof(w));
+        sum += w[0];
+        sum += w[1];
+        p += 8;
+        len -= 8;
+    }
+    return add_tail(p, len, sum);
+}
+
+#else
+
+// The four 32 bit words of v widened into two 64 bit lanes each side
+__attribute__((always_inline))
+static inline __m128i add_words(__m128i acc, __m128i v) {
+    const __m128i zero = _mm_setzero_si128();
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+    return _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+}
+
+__attribute__((always_inline))
+static inline uint64_t sum_lanes(__m128i acc) {
+    return static_cast<uint64_t>(_mm_cvtsi128_si64(acc)) + static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc)));
+}
+
+// 16 bytes a step
+static uint64_t add_sse2(const byte_t* p, size_t len, uint64_t sum) {
+    __m128i acc = _mm_setzero_si128();
+    while (len >= 16) {
+        acc = add_words(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+        p += 16;
+        len -= 16;
+    }
+    return add_tail(p, len, sum + sum_lanes(acc));
+}
+
+// 64 bytes a step into two accumulators, so consecutive adds do not wait on each other
+__attribute__((target("avx2")))
+static uint64_t add_avx2(const byte_t* p, size_t len, uint64_t sum) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    while (len >= 64) {
+        __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+        p += 64;
+        len -= 64;
+    }
+    if (len >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+        p += 32;
+        len -= 32;
+    }
+    __m256i acc = _mm256_add_epi64(acc0, acc1);
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    if (len >= 16) {
+        half = add_words(half, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+        p += 16;
+        len -= 16;
+    }
+    return add_tail(p, len, sum + sum_lanes(half));
+}
+
+#endif
+
+using AddKernel = uint64_t (*)(const byte_t* p, size_t len, uint64_t sum);
+
+struct Kernel {
+    AddKernel add;
+    const char* name;
+};
+
+static Kernel pick_kernel() {
+#ifdef SNIFFERPP_CHECKSUM_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return Kernel {add_avx2, "avx2"};
+    }
+    return Kernel {add_sse2, "sse2"};
+#else
+    return Kernel {add_scalar, "scalar"};
+#endif
+}
+
+static const Kernel& kernel() {
+    static const Kernel k = pick_kernel();
+    return k;
+}
+
+uint64_t checksum_add(const byte_t* data, size_t len, uint64_t sum) {
+    return kernel().add(data, len, sum);
+}
+
+uint16_t checksum_fold(uint64_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(sum);
+}
+
+const char* checksum_kernel_name() {
+    return kernel().name;
+}
+
+// Over the whole buffer, checksum included: 0xffff, or its other representation 0 (only a sum of all zeroes)
+static bool sums_to_zero(uint64_t sum) {
+    uint16_t folded = checksum_fold(sum);
+    return folded == 0xffff || folded == 0;
+}
+
+/*
+ TCP or UDP checksum of the segment at data, given the sum of its pseudo header
+ */
+static ChecksumResult verify_transport(const byte_t* data, size_t len, int protocol, uint64_t pseudo, bool offloaded) {
+    size_t field;
+    if (protocol == IPPROTO_TCP) {
+        if (len < sizeof(tcphdr)) {
+            return ChecksumResult::UNVERIFIED;
+        }
+        field = offsetof(tcphdr, th_sum);
+    } else {
+        if (len < sizeof(udphdr)) {
+            return ChecksumResult::UNVERIFIED;
+        }
+        field = offsetof(udphdr, uh_sum);
+    }
+    uint16_t stored;
+    memcpy(&stored, data + field, sizeof(stored));
+    if (offloaded || (protocol == IPPROTO_UDP && stored == 0)) {
+        return ChecksumResult::UNVERIFIED;
+    }
+    if (sums_to_zero(checksum_add(data, len, pseudo))) {
+        return ChecksumResult::GOOD;
+    }
+    // What the stack leaves for the NIC to finish: the pseudo header sum, not yet complemented
+    uint16_t partial = checksum_fold(pseudo);
+    if (stored == partial) {
+        return ChecksumResult::UNVERIFIED;
+    }
+    return ChecksumResult::BAD;
+}
+
+FrameChecksums verify_checksums(const byte_t* frame, size_t caplen, bool offloaded) {
+    FrameChecksums result {ChecksumResult::UNVERIFIED, ChecksumResult::UNVERIFIED, -1};
+    uint16_t ether_type;
+    size_t ip_offset;
+    if (!skip_vlan_tags(frame, caplen, ether_type, ip_offset)) {
+        return result;
+    }
+
+    if (ether_type == htons(ETHERTYPE_IP)) {
+        if (caplen < ip_offset + sizeof(ip)) {
+            return result;
+        }
+        const ip* iph = reinterpret_cast<const ip*>(frame + ip_offset);
+        size_t header_len = 4*iph->ip_hl;
+        size_t total_len = ntohs(iph->ip_len);
+        if (header_len < sizeof(ip) || caplen < ip_offset + header_len) {
+            return result;
+        }
+        if (!(offloaded && iph->ip_sum == 0)) {
+            result.ip = sums_to_zero(checksum_add(frame + ip_offset, header_len)) ? ChecksumResult::GOOD : ChecksumResult::BAD;
+        }
+        if (iph->ip_p != IPPROTO_TCP && iph->ip_p != IPPROTO_UDP) {
+            return result;
+        }
+        result.protocol = iph->ip_p;
+        // The segment has to be all there, and not split across fragments
+        if (total_len < header_len || caplen < ip_offset + total_len || (iph->ip_off & htons(IP_MF | IP_OFFMASK))) {
+            return result;
+        }
+        size_t segment_len = total_len - header_len;
+        if (iph->ip_p == IPPROTO_UDP && segment_len >= sizeof(udphdr)) {
+            size_t udp_len = ntohs(reinterpret_cast<const udphdr*>(frame + ip_offset + header_len)->uh_ulen);
+            // A length that does not fit is the parser's problem, not the checksum's
+            if (udp_len < sizeof(udphdr) || udp_len > segment_len) {
+                return result;
+            }
+            segment_len = udp_len;
+        }
+
+        // Pseudo header: the addresses (next to each other in the header already), then the words {0, protocol} and length
+        uint64_t pseudo_sum = checksum_add(reinterpret_cast<const byte_t*>(&iph->ip_src), 2*sizeof(in_addr));
+        pseudo_sum += htons(iph->ip_p) + htons(static_cast<uint16_t>(segment_len));
+        result.transport = verify_transport(frame + ip_offset + header_len, segment_len, result.protocol, pseudo_sum, offloaded);
+    } else if (ether_type == htons(ETHERTYPE_IPV6)) {
+        if (caplen < ip_offset + sizeof(ip6_hdr)) {
+            return result;
+        }
+        const ip6_hdr* ip6 = reinterpret_cast<const ip6_hdr*>(frame + ip_offset);
+        if (ip6->ip6_nxt != IPPROTO_TCP && ip6->ip6_nxt != IPPROTO_UDP) {
+            return result;
+        }
+        result.protocol = ip6->ip6_nxt;
+        size_t segment_len = ntohs(ip6->ip6_plen);
+        if (caplen < ip_offset + sizeof(ip6_hdr) + segment_len) {
+            return result;
+        }
+
+        // Pseudo header: the addresses, then the 32 bit length and {0, 0, 0, next header}
+        uint64_t pseudo_sum = checksum_add(reinterpret_cast<const byte_t*>(&ip6->ip6_src), 2*sizeof(in6_addr));
+        pseudo_sum += htonl(static_cast<uint32_t>(segment_len)) + htonl(ip6->ip6_nxt);
+        result.transport = verify_transport(frame + ip_offset + sizeof(ip6_hdr), segment_len, result.protocol, pseudo_sum, offloaded);
+    }
+    return result;
+}
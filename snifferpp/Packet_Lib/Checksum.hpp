@@ -0,0 +1,61 @@
+//
+//  Checksum.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef Checksum_hpp
+#define Checksum_hpp
+
+#include <cstdint>
+#include "standard_headers.hpp"
+
+/*
+ Internet checksum (RFC 1071) verification for IPv4 headers and TCP / UDP segments
+
+ The one's complement sum is byte order independent, so words are summed as they load (host order) and only the final
+ 16 bit result is compared: a packet is good when the sum over it, checksum field included, comes to 0xffff. The
+ summing kernel is picked once at startup: AVX2 where the CPU has it, SSE2 on any other x86-64, 64 bit scalar adds
+ elsewhere. It runs at several bytes per cycle, cheap enough to leave on for every packet.
+ */
+
+/*
+ One's complement sum of len bytes added to sum, not yet folded to 16 bits. An odd trailing byte is padded with zero.
+ Sums of separate buffers can be added together as long as every buffer but the last has an even length
+ */
+uint64_t checksum_add(const byte_t* data, size_t len, uint64_t sum = 0);
+
+// The sum folded to 16 bits (0xffff over a buffer whose checksum is right)
+uint16_t checksum_fold(uint64_t sum);
+
+// Which kernel checksum_add uses: "avx2", "sse2" or "scalar"
+const char* checksum_kernel_name(void);
+
+enum class ChecksumResult {
+    GOOD,
+    BAD,
+    UNVERIFIED // Absent (UDP's 0), left to the NIC, not all captured (truncated, or a fragment), or lengths that do not add up
+};
+
+/*
+ What verify_checksums found. transport is only meaningful if protocol is IPPROTO_TCP or IPPROTO_UDP
+ */
+struct FrameChecksums {
+    ChecksumResult ip; // IPv4 header (IPv6 has none: UNVERIFIED)
+    ChecksumResult transport;
+    int protocol; // IPPROTO_TCP, IPPROTO_UDP, or -1 for anything else (including not IP)
+};
+
+/*
+ Checks the IPv4 header and TCP / UDP (over IPv4, or directly after the IPv6 header) checksums of an ethernet frame,
+ inside any VLAN tags. Like peek_flow_key it does its own minimal parse, without the checks or counting of parse_packet.
+
+ offloaded: the capture says the checksums are still to be filled in by the NIC (outgoing packets with TX checksum
+ offload, see AFPacketRecord::is_checksum_partial). Without that hint, a transport checksum holding just the pseudo
+ header sum, which is what such packets carry, is taken as offloaded too rather than bad.
+ */
+FrameChecksums verify_checksums(const byte_t* frame, size_t caplen, bool offloaded = false);
+
+#endif /* Checksum_hpp */
@@ -0,0 +1,390 @@
+//
+//  Dissector.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include "Dissector.hpp"
+#include "packet_sniffer.hpp"
+
+using std::ostream;
+
+ostream& operator<<(ostream& os, NetworkKind k) {
+    switch (k) {
+        case NetworkKind::IPV4:
+            os << "IPv4";
+            break;
+        case NetworkKind::IPV6:
+            os << "IPv6";
+            break;
+        case NetworkKind::ARP:
+            os << "ARP";
+            break;
+        case NetworkKind::OTHER:
+            os << "Other";
+            break;
+    }
+    return os;
+}
+
+const char* parse_status_name(ParseStatus s) {
+    switch (s) {
+        case ParseStatus::OK:
+            return "ok";
+        case ParseStatus::TRUNCATED:
+            return "truncated";
+        case ParseStatus::MALFORMED:
+            return "malformed";
+        case ParseStatus::UNSUPPORTED_ETHERTYPE:
+            return "unsupported_ethertype";
+        case ParseStatus::UNSUPPORTED_PROTOCOL:
+            return "unsupported_protocol";
+    }
+    return "invalid";
+}
+
+const char* parse_layer_name(ParseLayer l) {
+    switch (l) {
+        case ParseLayer::LINK:
+            return "link";
+        case ParseLayer::NETWORK:
+            return "network";
+        case ParseLayer::TRANSPORT:
+            return "transport";
+    }
+    return "invalid";
+}
+
+static DissectStep truncated(Dissection& d, ParseLayer layer, const char* where) {
+    return reject(d, ParseStatus::TRUNCATED, layer, where);
+}
+
+static DissectStep malformed(Dissection& d, ParseLayer layer, const char* where) {
+    return reject(d, ParseStatus::MALFORMED, layer, where);
+}
+
+// Ends the walk with everything from offset on as data
+static DissectStep done(Dissection& d) {
+    d.data_offset = d.offset;
+    return DissectStep::DONE;
+}
+
+static DissectStep dissect_vlan(Dissection& d) {
+    if (!d.has(sizeof(vlan_tag))) {
+        return truncated(d, ParseLayer::LINK, "In parsing VLAN tag");
+    }
+    if (d.vlan_count == MAX_VLAN_TAGS) {
+        return malformed(d, ParseLayer::LINK, "In parsing VLAN tags (too many)");
+    }
+    vlan_tag tag;
+    memcpy(&tag, d.at(), sizeof(tag));
+    d.vlan_ids[d.vlan_count++] = ntohs(tag.vlan_tci) & 0x0fff;
+    d.offset += sizeof(vlan_tag);
+    d.next = ntohs(tag.vlan_type);
+    return DissectStep::ETHERTYPE;
+}
+
+static DissectStep dissect_ipv4(Dissection& d) {
+    if (!d.has(sizeof(ip))) {
+        return truncated(d, ParseLayer::NETWORK, "In parsing IP header");
+    }
+    const ip* iph = reinterpret_cast<const ip*>(d.at());
+    size_t ip_len = 4*(iph->ip_hl);
+    if (ip_len < sizeof(ip)) {
+        return malformed(d, ParseLayer::NETWORK, "In parsing IP header length");
+    }
+    if (!d.has(ip_len)) {
+        return truncated(d, ParseLayer::NETWORK, "In parsing IP header length");
+    }
+    d.network = NetworkKind::IPV4;
+    d.network_offset = d.offset;
+    d.offset += ip_len;
+    d.transport_offset = d.offset;
+    d.next = iph->ip_p;
+    // Only the first fragment carries the transport header
+    if (iph->ip_off & htons(IP_OFFMASK)) {
+        d.protocol = iph->ip_p;
+        return done(d);
+    }
+    return DissectStep::PROTOCOL;
+}
+
+static DissectStep dissect_ipv6(Dissection& d) {
+    if (!d.has(sizeof(ip6_hdr))) {
+        return truncated(d, ParseLayer::NETWORK, "In parsing IPv6 header");
+    }
+    const ip6_hdr* ip6 = reinterpret_cast<const ip6_hdr*>(d.at());
+    d.network = NetworkKind::IPV6;
+    d.network_offset = d.offset;
+    d.offset += sizeof(ip6_hdr);
+    d.transport_offset = d.offset;
+    d.next = ip6->ip6_nxt;
+    return DissectStep::PROTOCOL;
+}
+
+static DissectStep dissect_arp(Dissection& d) {
+    if (!d.has(sizeof(ether_arp))) {
+        return truncated(d, ParseLayer::NETWORK, "In parsing ARP header");
+    }
+    d.network = NetworkKind::ARP;
+    d.network_offset = d.offset;
+    d.offset += sizeof(ether_arp);
+    d.transport_offset = d.offset;
+    return done(d);
+}
+
+// Hop-by-hop, routing and destination options: next header, then the length in 8 byte units not counting the first
+static DissectStep dissect_ipv6_options(Dissection& d) {
+    if (!d.has(8)) {
+        return truncated(d, ParseLayer::NETWORK, "In parsing IPv6 extension header");
+    }
+    const uint8_t* h = reinterpret_cast<const uint8_t*>(d.at());
+    size_t len = (size_t {h[1]} + 1) * 8;
+    if (!d.has(len)) {
+        return truncated(d, ParseLayer::NETWORK, "In parsing IPv6 extension header length");
+    }
+    d.offset += len;
+    d.transport_offset = d.offset;
+    d.next = h[0];
+    return DissectStep::PROTOCOL;
+}
+
+static DissectStep dissect_ipv6_fragment(Dissection& d) {
+    if (!d.has(sizeof(ip6_frag))) {
+        return truncated(d, ParseLayer::NETWORK, "In parsing IPv6 fragment header");
+    }
+    const ip6_frag* frag = reinterpret_cast<const ip6_frag*>(d.at());
+    d.offset += sizeof(ip6_frag);
+    d.transport_offset = d.offset;
+    d.next = frag->ip6f_nxt;
+    if (frag->ip6f_offlg & IP6F_OFF_MASK) {
+        d.protocol = frag->ip6f_nxt;
+        return done(d);
+    }
+    return DissectStep::PROTOCOL;
+}
+
+// Authentication header: its length is in 4 byte units, not counting the first two
+static DissectStep dissect_ah(Dissection& d) {
+    if (!d.has(8)) {
+        return truncated(d, ParseLayer::NETWORK, "In parsing authentication header");
+    }
+    const uint8_t* h = reinterpret_cast<const uint8_t*>(d.at());
+    size_t len = (size_t {h[1]} + 2) * 4;
+    if (!d.has(len)) {
+        return truncated(d, ParseLayer::NETWORK, "In parsing authentication header length");
+    }
+    d.offset += len;
+    d.transport_offset = d.offset;
+    d.next = h[0];
+    return DissectStep::PROTOCOL;
+}
+
+// ESP, or IPv6's "no next header": nothing more we can read
+static DissectStep dissect_opaque(Dissection& d) {
+    return done(d);
+}
+
+static DissectStep dissect_tcp(Dissection& d) {
+    if (!d.has(sizeof(tcphdr))) {
+        return truncated(d, ParseLayer::TRANSPORT, "In parsing TCP header");
+    }
+    const tcphdr* tcp = reinterpret_cast<const tcphdr*>(d.at());
+    size_t tcp_len = 4*(tcp->th_off);
+    if (tcp_len < sizeof(tcphdr)) {
+        return malformed(d, ParseLayer::TRANSPORT, "In parsing TCP header length");
+    }
+    if (!d.has(tcp_len)) {
+        return truncated(d, ParseLayer::TRANSPORT, "In parsing TCP header length");
+    }
+    d.transport = TransportKind::TCP;
+    d.offset += tcp_len;
+    return done(d);
+}
+
+static DissectStep dissect_udp(Dissection& d) {
+    if (!d.has(sizeof(udphdr))) {
+        return truncated(d, ParseLayer::TRANSPORT, "In parsing UDP header");
+    }
+    d.transport = TransportKind::UDP;
+    d.offset += sizeof(udphdr);
+    return done(d);
+}
+
+static DissectStep dissect_icmp(Dissection& d) {
+    if (!d.has(sizeof(icmp_header))) {
+        return truncated(d, ParseLayer::TRANSPORT, "In parsing ICMP header");
+    }
+    d.transport = d.network == NetworkKind::IPV6 ? TransportKind::ICMPV6 : TransportKind::ICMP;
+    d.offset += sizeof(icmp_header);
+    return done(d);
+}
+
+/*
+ EtherType to dissector, open addressed. The few types we see hash to distinct slots, so a lookup is usually one probe
+ Built at compile time, so it is ready before any static constructor could use it
+ */
+class EtherTypeTable {
+private:
+    static const size_t SLOTS = 64;
+
+    struct Entry {
+        uint16_t type;
+        Dissector dissector;
+    };
+    Entry entries[SLOTS];
+
+    static constexpr size_t slot_of(uint16_t type) { return (type ^ (type >> 8)) & (SLOTS - 1); }
+
+public:
+    constexpr EtherTypeTable() :entries{} {
+        add(ETHERTYPE_IP, dissect_ipv4);
+        add(ETHERTYPE_IPV6, dissect_ipv6);
+        add(ETHERTYPE_ARP, dissect_arp);
+        add(ETHERTYPE_VLAN, dissect_vlan);
+        add(ETHERTYPE_QINQ, dissect_vlan);
+        add(ETHERTYPE_QINQ_OLD, dissect_vlan);
+    }
+
+    // False only if every slot is taken
+    constexpr bool add(uint16_t type, Dissector dissector) {
+        for (size_t i = 0, s = slot_of(type); i < SLOTS; ++i, s = (s + 1) & (SLOTS - 1)) {
+            if (entries[s].dissector == nullptr || entries[s].type == type) {
+                entries[s].type = type;
+                entries[s].dissector = dissector;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Dissector find(uint16_t type) const {
+        for (size_t i = 0, s = slot_of(type); i < SLOTS && entries[s].dissector != nullptr; ++i, s = (s + 1) & (SLOTS - 1)) {
+            if (entries[s].type == type) {
+                return entries[s].dissector;
+            }
+        }
+        return nullptr;
+    }
+};
+
+/*
+ IP protocol number to dissector, indexed directly
+ */
+struct ProtocolTable {
+    Dissector dissectors[256];
+
+    constexpr ProtocolTable() :dissectors{} {
+        dissectors[IPPROTO_TCP] = dissect_tcp;
+        dissectors[IPPROTO_UDP] = dissect_udp;
+        dissectors[IPPROTO_ICMP] = dissect_icmp;
+        dissectors[IPPROTO_ICMPV6] = dissect_icmp;
+        dissectors[IPPROTO_HOPOPTS] = dissect_ipv6_options;
+        dissectors[IPPROTO_ROUTING] = dissect_ipv6_options;
+        dissectors[IPPROTO_DSTOPTS] = dissect_ipv6_options;
+        dissectors[IPPROTO_FRAGMENT] = dissect_ipv6_fragment;
+        dissectors[IPPROTO_AH] = dissect_ah;
+        dissectors[IPPROTO_ESP] = dissect_opaque;
+        dissectors[IPPROTO_NONE] = dissect_opaque;
+    }
+};
+
+static EtherTypeTable ether_types;
+static ProtocolTable protocols;
+
+void register_ethertype(uint16_t ether_type, Dissector dissector) {
+    if (!ether_types.add(ether_type, dissector)) {
+        LOG_ERROR("No room to register a dissector for EtherType 0x%04x", ether_type);
+    }
+}
+
+void register_protocol(uint8_t protocol, Dissector dissector) {
+    protocols.dissectors[protocol] = dissector;
+}
+
+// Failures are counted where they are found, so they show up in the metrics whichever entry point was used
+static void count(const Dissection& d) {
+    if (d.status == ParseStatus::OK) {
+        return;
+    }
+    CaptureCounters& counters = thread_counters();
+    CaptureCounters::add(counters.parse_failures[static_cast<size_t>(d.status)]);
+    switch (d.status) {
+        case ParseStatus::OK:
+            break;
+        case ParseStatus::TRUNCATED:
+        case ParseStatus::MALFORMED:
+            CaptureCounters::add(counters.invalid);
+            break;
+        case ParseStatus::UNSUPPORTED_ETHERTYPE:
+            LOG_WARNING("Unsupported EtherType 0x%04x", d.next);
+            CaptureCounters::add(counters.unsupported);
+            break;
+        case ParseStatus::UNSUPPORTED_PROTOCOL:
+            LOG_WARNING("Unsupported Transport Protocol %u", static_cast<unsigned int>(d.next));
+            CaptureCounters::add(counters.unsupported);
+            break;
+    }
+}
+
+Dissection try_dissect(const byte_t* buffer, size_t len) {
+    Dissection d {buffer, len};
+    if (!d.has(sizeof(ether_header))) {
+        truncated(d, ParseLayer::LINK, "In parsing ethernet header");
+        count(d);
+        return d;
+    }
+    d.next = ntohs(reinterpret_cast<const ether_header*>(buffer)->ether_type);
+    d.offset = sizeof(ether_header);
+
+    DissectStep step = DissectStep::ETHERTYPE;
+    for (;;) {
+        Dissector dissector = nullptr;
+        switch (step) {
+            case DissectStep::ETHERTYPE:
+                d.ether_type = d.next;
+                dissector = ether_types.find(d.next);
+                if (dissector == nullptr) {
+                    reject(d, ParseStatus::UNSUPPORTED_ETHERTYPE, ParseLayer::NETWORK, "In parsing EtherType");
+                }
+                break;
+            case DissectStep::PROTOCOL:
+                d.protocol = static_cast<uint8_t>(d.next);
+                dissector = protocols.dissectors[d.protocol];
+                if (dissector == nullptr) {
+                    reject(d, ParseStatus::UNSUPPORTED_PROTOCOL, ParseLayer::TRANSPORT, "In parsing transport protocol");
+                }
+                break;
+            case DissectStep::DONE:
+                break;
+            case DissectStep::INVALID:
+                // A registered dissector that gave up without saying why
+                if (d.status == ParseStatus::OK) {
+                    malformed(d, ParseLayer::NETWORK, "In dissecting packet");
+                }
+                break;
+        }
+        if (dissector == nullptr) {
+            count(d);
+            return d;
+        }
+        step = dissector(d);
+    }
+}
+
+Dissection dissect(const byte_t* buffer, size_t len) {
+    Dissection d = try_dissect(buffer, len);
+    switch (d.status) {
+        case ParseStatus::OK:
+            break;
+        case ParseStatus::TRUNCATED:
+        case ParseStatus::MALFORMED:
+            throw InvalidInput {d.error};
+        case ParseStatus::UNSUPPORTED_ETHERTYPE:
+        case ParseStatus::UNSUPPORTED_PROTOCOL:
+            throw UnsupportedProtocol {std::string {d.error} + ": "};
+    }
+    return d;
+}
@@ -0,0 +1,146 @@
+//
+//  Dissector.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef Dissector_hpp
+#define Dissector_hpp
+
+#include <cstdint>
+#include "standard_headers.hpp"
+#include "PacketHeader.hpp"
+
+/*
+ Network layer of a dissected frame. OTHER is anything a registered dissector decoded that is none of these
+ */
+enum class NetworkKind {IPV4, IPV6, ARP, OTHER};
+
+std::ostream& operator<<(std::ostream& os, NetworkKind k);
+
+const size_t MAX_VLAN_TAGS = 4; // Deeper stacks than this are rejected as malformed
+
+/*
+ How dissecting a frame went:
+    TRUNCATED: a header runs past the end of the capture
+    MALFORMED: a header's length field makes no sense (shorter than the header itself, or too many VLAN tags)
+    UNSUPPORTED_ETHERTYPE, UNSUPPORTED_PROTOCOL: no dissector registered for what comes next
+ */
+enum class ParseStatus {OK, TRUNCATED, MALFORMED, UNSUPPORTED_ETHERTYPE, UNSUPPORTED_PROTOCOL};
+
+const size_t PARSE_STATUSES = 5;
+
+// Which layer a failure was in (IPv6 extension headers count as NETWORK)
+enum class ParseLayer {LINK, NETWORK, TRANSPORT};
+
+// Lowercase names, for metric labels and messages
+const char* parse_status_name(ParseStatus s);
+const char* parse_layer_name(ParseLayer l);
+
+/*
+ Where each layer of a frame starts, filled in by the dissectors as they walk it front to back.
+ Offsets are from the start of the frame (the ethernet header)
+
+ If status is not OK, everything up to the failed layer is still filled in (e.g. the VLAN tags and IPv6 header of a
+ frame with a truncated TCP header)
+ */
+struct Dissection {
+    const byte_t* buffer;
+    size_t len;
+
+    // Scratch for the dissectors: the next header and its EtherType or IP protocol number (host order)
+    size_t offset;
+    uint16_t next;
+
+    ParseStatus status;
+    ParseLayer failed_layer; // Only meaningful if status is not OK
+    const char* error; // Where it failed, a string literal (nullptr if OK)
+
+    uint16_t vlan_ids[MAX_VLAN_TAGS]; // Outermost first
+    uint8_t vlan_count;
+
+    uint16_t ether_type; // Of the network layer, inside any VLAN tags (host order)
+    NetworkKind network;
+    size_t network_offset;
+
+    uint8_t protocol; // Of the transport layer, after any IPv6 extension headers
+    TransportKind transport;
+    size_t transport_offset;
+
+    size_t data_offset; // Whatever the last dissector did not claim
+
+    Dissection(const byte_t* buffer, size_t len) :buffer{buffer}, len{len}, offset{0}, next{0}, status{ParseStatus::OK}, failed_layer{ParseLayer::LINK}, error{nullptr}, vlan_ids{}, vlan_count{0}, ether_type{0}, network{NetworkKind::OTHER}, network_offset{0}, protocol{0}, transport{TransportKind::NONE}, transport_offset{0}, data_offset{0} {};
+
+    // Bytes left from offset on
+    bool has(size_t n) const { return len >= offset && len - offset >= n; }
+    const byte_t* at(void) const { return buffer + offset; }
+};
+
+/*
+ What a dissector tells the walk to do next: look d.next up as an EtherType or as an IP protocol, stop, or reject
+ the frame (see reject below)
+ */
+enum class DissectStep {ETHERTYPE, PROTOCOL, DONE, INVALID};
+
+// For dissectors: records why the frame is rejected. where must be a string literal
+inline DissectStep reject(Dissection& d, ParseStatus status, ParseLayer layer, const char* where) {
+    d.status = status;
+    d.failed_layer = layer;
+    d.error = where;
+    return DissectStep::INVALID;
+}
+
+/*
+ Decodes the header at d.offset: checks it fits, records what it found, moves d.offset past it and sets d.next.
+ A dissector that ends the walk sets d.data_offset.
+ */
+using Dissector = DissectStep (*)(Dissection& d);
+
+/*
+ Adds or replaces the dissector for an EtherType or an IP protocol number (IPv6 extension headers are IP protocols too).
+ IPv4, IPv6, ARP, 802.1Q/802.1ad tags, TCP, UDP, ICMP, ICMPv6, the IPv6 extension headers, AH and ESP are there from
+ the start. Not synchronised with dissect(): register before any capture thread starts.
+ */
+void register_ethertype(uint16_t ether_type, Dissector dissector);
+void register_protocol(uint8_t protocol, Dissector dissector);
+
+/*
+ Walks the frame in one pass: the EtherType, through any VLAN tags, picks the network dissector, whose protocol
+ number picks the next one, and so on until one is done. Each step is a table lookup, so supporting another protocol
+ costs the others nothing.
+
+ Never throws or allocates: a frame that cannot be fully dissected comes back with its status set. Failures are
+ counted (by status) in the calling thread's CaptureCounters, and unsupported protocols are logged
+ */
+Dissection try_dissect(const byte_t* buffer, size_t len);
+
+/*
+ try_dissect for callers that would rather catch: throws InvalidInput if the frame was TRUNCATED or MALFORMED,
+ UnsupportedProtocol if no dissector was registered for an EtherType or protocol on the way
+ */
+Dissection dissect(const byte_t* buffer, size_t len);
+
+/*
+ EtherType (network order) of the frame's network layer and the offset it starts at, skipping VLAN tags without any
+ other parsing (for classifying or hashing a frame before, or instead of, dissecting it)
+ Returns false if the frame ends first
+ */
+inline bool skip_vlan_tags(const byte_t* buffer, size_t len, uint16_t& ether_type, size_t& offset) {
+    size_t type_offset = offsetof(ether_header, ether_type);
+    for (size_t tags = 0; ; ++tags) {
+        if (len < type_offset + sizeof(uint16_t)) {
+            return false;
+        }
+        memcpy(&ether_type, buffer + type_offset, sizeof(uint16_t));
+        if (tags == MAX_VLAN_TAGS || (ether_type != htons(ETHERTYPE_VLAN) && ether_type != htons(ETHERTYPE_QINQ) && ether_type != htons(ETHERTYPE_QINQ_OLD))) {
+            break;
+        }
+        type_offset += sizeof(vlan_tag);
+    }
+    offset = type_offset + sizeof(uint16_t);
+    return true;
+}
+
+#endif /* Dissector_hpp */
@@ -0,0 +1,137 @@
+//
+//  FlowKey.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef FlowKey_hpp
+#define FlowKey_hpp
+
+#include <cstdint>
+#include "standard_headers.hpp"
+#include "PacketView.hpp"
+
+/*
+ The (src, dst, sport, dport, proto) 5-tuple identifying a flow. Addresses and ports are kept in network byte order,
+ exactly as they sit in the ip / tcphdr / udphdr, so building one is just a few loads
+ */
+struct FlowKey {
+    uint32_t src;
+    uint32_t dst;
+    uint16_t sport;
+    uint16_t dport;
+    uint8_t proto;
+
+    bool operator==(const FlowKey& other) const {
+        return src == other.src && dst == other.dst && sport == other.sport && dport == other.dport && proto == other.proto;
+    }
+    bool operator!=(const FlowKey& other) const { return !(*this == other); }
+
+    // The same key seen from the other end
+    FlowKey reversed(void) const { return FlowKey {dst, src, dport, sport, proto}; }
+
+    /*
+     Same key for both directions of a flow: the (address, port) pair that compares lower goes first
+     */
+    FlowKey canonical(void) const {
+        if (src < dst || (src == dst && sport <= dport)) {
+            return *this;
+        }
+        return reversed();
+    }
+
+    /*
+     Hash that is the same in both directions (hash of the canonical key), so a flow's two halves land together
+     */
+    uint64_t symmetric_hash(void) const {
+        FlowKey c = canonical();
+        uint64_t h = (uint64_t {c.src} << 32) | c.dst;
+        h ^= (uint64_t {c.sport} << 24) ^ (uint64_t {c.dport} << 8) ^ c.proto;
+        // Murmur3 finaliser
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+};
+
+/*
+ For keying standard containers on a flow (either direction of a flow hashes the same)
+ */
+struct FlowKeyHash {
+    size_t operator()(const FlowKey& key) const { return static_cast<size_t>(key.symmetric_hash()); }
+};
+
+// An IPv6 address folded into 32 bits, for a key that is only hashed
+inline uint32_t fold_ip6_addr(const in6_addr& addr) {
+    uint32_t words[4];
+    memcpy(words, &addr, sizeof(words));
+    return words[0] ^ words[1] ^ words[2] ^ words[3];
+}
+
+/*
+ Pulls the 5-tuple straight out of a raw ethernet frame (inside any VLAN tags), without the checks (or exceptions) of
+ view_packet. Returns false if the frame is too short or not IP. Protocols without ports get zero ports.
+
+ IPv6 addresses are folded into the 32 bit fields, and ports are only taken when TCP or UDP directly follows the fixed
+ header: good for spreading flows across workers (both directions still hash the same), not for telling flows apart
+ */
+inline bool peek_flow_key(const byte_t* buffer, size_t buffer_len, FlowKey& out) {
+    uint16_t ether_type;
+    size_t ip_offset;
+    if (!skip_vlan_tags(buffer, buffer_len, ether_type, ip_offset)) {
+        return false;
+    }
+    size_t transport_offset;
+    if (ether_type == htons(ETHERTYPE_IP) && buffer_len >= ip_offset + sizeof(ip)) {
+        const ip* iph = reinterpret_cast<const ip*>(buffer + ip_offset);
+        out.src = iph->ip_src.s_addr;
+        out.dst = iph->ip_dst.s_addr;
+        out.proto = iph->ip_p;
+        transport_offset = ip_offset + 4*iph->ip_hl;
+    } else if (ether_type == htons(ETHERTYPE_IPV6) && buffer_len >= ip_offset + sizeof(ip6_hdr)) {
+        const ip6_hdr* ip6 = reinterpret_cast<const ip6_hdr*>(buffer + ip_offset);
+        out.src = fold_ip6_addr(ip6->ip6_src);
+        out.dst = fold_ip6_addr(ip6->ip6_dst);
+        out.proto = ip6->ip6_nxt;
+        transport_offset = ip_offset + sizeof(ip6_hdr);
+    } else {
+        return false;
+    }
+    out.sport = 0;
+    out.dport = 0;
+
+    if ((out.proto == IPPROTO_TCP || out.proto == IPPROTO_UDP) && buffer_len >= transport_offset + 4) {
+        // Source and destination port lead both headers
+        memcpy(&out.sport, buffer + transport_offset, sizeof(out.sport));
+        memcpy(&out.dport, buffer + transport_offset + 2, sizeof(out.dport));
+    }
+    return true;
+}
+
+/*
+ The 5-tuple of an already parsed IPv4 packet (throws WrongNetworkProtocol for anything else)
+ */
+inline FlowKey flow_key(const PacketView& pv) {
+    const ip& iph = pv.get_ip_header().get_header();
+    FlowKey key {iph.ip_src.s_addr, iph.ip_dst.s_addr, 0, 0, iph.ip_p};
+    switch (pv.get_transport_kind()) {
+        case TransportKind::TCP:
+            key.sport = pv.get_tcp_header()->th_sport;
+            key.dport = pv.get_tcp_header()->th_dport;
+            break;
+        case TransportKind::UDP:
+            key.sport = pv.get_udp_header()->uh_sport;
+            key.dport = pv.get_udp_header()->uh_dport;
+            break;
+        default:
+            break;
+    }
+    return key;
+}
+
+#endif /* FlowKey_hpp */
@@ -0,0 +1,207 @@
+//
+//  HexDump.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include <cstdint>
+#include <cstring>
+#include "HexDump.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#define HEXDUMP_X86 1
+#include <immintrin.h>
+#endif
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/*
+ The kernels: n bytes of in become n "xx " groups at hex and n printable characters at ascii
+ */
+using DumpKernel = void (*)(const uint8_t* in, size_t n, char* hex, char* ascii);
+
+static void dump_scalar(const uint8_t* in, size_t n, char* hex, char* ascii) {
+    for (size_t i = 0; i < n; ++i) {
+        uint8_t b = in[i];
+        hex[3*i] = hex_digits[b >> 4];
+        hex[3*i+1] = hex_digits[b & 0xf];
+        hex[3*i+2] = ' ';
+        ascii[i] = (b >= 0x20 && b < 0x7f) ? static_cast<char>(b) : '.';
+    }
+}
+
+#ifdef HEXDUMP_X86
+
+// Printable bytes as themselves, the rest as '.'. Signed compares, so 0x80-0xff fall below 0x20
+static inline __m128i printable_sse2(__m128i v) {
+    __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1f)), _mm_cmplt_epi8(v, _mm_set1_epi8(0x7f)));
+    return _mm_or_si128(_mm_and_si128(ok, v), _mm_andnot_si128(ok, _mm_set1_epi8('.')));
+}
+
+/*
+ SSE2 has no byte shuffle, so nibbles become digits arithmetically ('0' + n, plus 39 more past 9) and the digit pairs
+ are spread out to "xx " groups with 16-bit stores
+ */
+static void dump_sse2(const uint8_t* in, size_t n, char* hex, char* ascii) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i mask = _mm_set1_epi8(0x0f);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+        __m128i lo = _mm_and_si128(v, mask);
+        __m128i nine = _mm_set1_epi8(9);
+        __m128i hi_c = _mm_add_epi8(_mm_add_epi8(hi, _mm_set1_epi8('0')), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), _mm_set1_epi8(39)));
+        __m128i lo_c = _mm_add_epi8(_mm_add_epi8(lo, _mm_set1_epi8('0')), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), _mm_set1_epi8(39)));
+
+        alignas(16) char pairs[32];
+        _mm_store_si128(reinterpret_cast<__m128i*>(pairs), _mm_unpacklo_epi8(hi_c, lo_c));
+        _mm_store_si128(reinterpret_cast<__m128i*>(pairs + 16), _mm_unpackhi_epi8(hi_c, lo_c));
+        char* h = hex + 3*i;
+        for (int j = 0; j < 16; ++j) {
+            memcpy(h + 3*j, pairs + 2*j, 2);
+            h[3*j+2] = ' ';
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(ascii + i), printable_sse2(v));
+    }
+    dump_scalar(in + i, n - i, hex + 3*i, ascii + i);
+}
+
+/*
+ AVX2: a byte shuffle looks the digits up in "0123456789abcdef", and three more shuffles per 16 bytes lay the digit
+ pairs out as "xx " groups (0x80 lanes come out zero and are filled with spaces). Shuffles stay within 128-bit lanes,
+ so a 256-bit register is two independent 16-byte blocks
+ */
+__attribute__((target("avx2")))
+static void dump_avx2(const uint8_t* in, size_t n, char* hex, char* ascii) {
+    const __m128i lut = _mm_setr_epi8('0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f');
+    const __m128i idx0 = _mm_setr_epi8(0,1,-128,2,3,-128,4,5,-128,6,7,-128,8,9,-128,10);
+    const __m128i idx1a = _mm_setr_epi8(11,-128,12,13,-128,14,15,-128,-128,-128,-128,-128,-128,-128,-128,-128);
+    const __m128i idx1b = _mm_setr_epi8(-128,-128,-128,-128,-128,-128,-128,-128,0,1,-128,2,3,-128,4,5);
+    const __m128i idx2 = _mm_setr_epi8(-128,6,7,-128,8,9,-128,10,11,-128,12,13,-128,14,15,-128);
+    const __m128i sp0 = _mm_setr_epi8(0,0,' ',0,0,' ',0,0,' ',0,0,' ',0,0,' ',0);
+    const __m128i sp1 = _mm_setr_epi8(0,' ',0,0,' ',0,0,' ',0,0,' ',0,0,' ',0,0);
+    const __m128i sp2 = _mm_setr_epi8(' ',0,0,' ',0,0,' ',0,0,' ',0,0,' ',0,0,' ');
+    const __m256i lut2 = _mm256_broadcastsi128_si256(lut);
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m256i hi_c = _mm256_shuffle_epi8(lut2, _mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+        __m256i lo_c = _mm256_shuffle_epi8(lut2, _mm256_and_si256(v, mask));
+        // Per lane: a holds the digit pairs of bytes 0-7 of that lane's block, b of bytes 8-15
+        __m256i a = _mm256_unpacklo_epi8(hi_c, lo_c);
+        __m256i b = _mm256_unpackhi_epi8(hi_c, lo_c);
+
+        __m256i out0 = _mm256_or_si256(_mm256_shuffle_epi8(a, _mm256_broadcastsi128_si256(idx0)), _mm256_broadcastsi128_si256(sp0));
+        __m256i out1 = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a, _mm256_broadcastsi128_si256(idx1a)), _mm256_shuffle_epi8(b, _mm256_broadcastsi128_si256(idx1b))), _mm256_broadcastsi128_si256(sp1));
+        __m256i out2 = _mm256_or_si256(_mm256_shuffle_epi8(b, _mm256_broadcastsi128_si256(idx2)), _mm256_broadcastsi128_si256(sp2));
+
+        char* h = hex + 3*i;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(h), _mm256_castsi256_si128(out0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(h + 16), _mm256_castsi256_si128(out1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(h + 32), _mm256_castsi256_si128(out2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(h + 48), _mm256_extracti128_si256(out0, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(h + 64), _mm256_extracti128_si256(out1, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(h + 80), _mm256_extracti128_si256(out2, 1));
+
+        __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(0x1f)), _mm256_cmpgt_epi8(_mm256_set1_epi8(0x7f), v));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(ascii + i), _mm256_blendv_epi8(_mm256_set1_epi8('.'), v, ok));
+    }
+    // A last 16 bytes with the same shuffles at 128 bits
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i m = _mm_set1_epi8(0x0f);
+        __m128i hi_c = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), m));
+        __m128i lo_c = _mm_shuffle_epi8(lut, _mm_and_si128(v, m));
+        __m128i a = _mm_unpacklo_epi8(hi_c, lo_c);
+        __m128i b = _mm_unpackhi_epi8(hi_c, lo_c);
+
+        char* h = hex + 3*i;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(h), _mm_or_si128(_mm_shuffle_epi8(a, idx0), sp0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(h + 16), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, idx1a), _mm_shuffle_epi8(b, idx1b)), sp1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(h + 32), _mm_or_si128(_mm_shuffle_epi8(b, idx2), sp2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(ascii + i), printable_sse2(v));
+    }
+    dump_scalar(in + i, n - i, hex + 3*i, ascii + i);
+}
+
+static DumpKernel pick_kernel(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return dump_avx2;
+    }
+    return dump_sse2;
+}
+
+#else
+
+static DumpKernel pick_kernel(void) {
+    return dump_scalar;
+}
+
+#endif
+
+// Chosen once, the first time anything is dumped
+static DumpKernel get_kernel(void) {
+    static const DumpKernel kernel = pick_kernel();
+    return kernel;
+}
+
+// "... N more bytes\n" after a truncated dump
+static const size_t truncation_note_len = 40;
+
+size_t hex_dump_size(size_t len, const HexDumpOptions& opts) {
+    size_t per_row = opts.bytes_per_row == 0 ? 16 : opts.bytes_per_row;
+    size_t shown = (opts.max_bytes != 0 && len > opts.max_bytes) ? opts.max_bytes : len;
+    size_t rows = (shown + per_row - 1) / per_row;
+    // Offset, two spaces, "xx " per byte, a space, the ASCII column and a newline
+    return rows * (8 + 2 + 4 * per_row + 2) + truncation_note_len;
+}
+
+size_t hex_dump(char* out, const byte_t* data, size_t len, const HexDumpOptions& opts) {
+    size_t per_row = opts.bytes_per_row == 0 ? 16 : opts.bytes_per_row;
+    size_t shown = (opts.max_bytes != 0 && len > opts.max_bytes) ? opts.max_bytes : len;
+    int offset_digits = len > 0x10000 ? 8 : 4;
+    DumpKernel kernel = get_kernel();
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(data);
+
+    char* p = out;
+    for (size_t row = 0; row < shown; row += per_row) {
+        size_t n = shown - row < per_row ? shown - row : per_row;
+        for (int d = offset_digits - 1; d >= 0; --d) {
+            *p++ = hex_digits[(row >> (4 * d)) & 0xf];
+        }
+        *p++ = ' ';
+        *p++ = ' ';
+
+        // The ASCII column starts after a full row of hex, even on a short last row
+        char* hex = p;
+        char* ascii = p + 3 * per_row + 1;
+        kernel(in + row, n, hex, ascii);
+        memset(hex + 3 * n, ' ', 3 * (per_row - n) + 1);
+        p = ascii + n;
+        *p++ = '\n';
+    }
+
+    if (shown < len) {
+        static const char prefix[] = "... ";
+        static const char suffix[] = " more bytes\n";
+        memcpy(p, prefix, sizeof(prefix) - 1);
+        p += sizeof(prefix) - 1;
+        char digits[20];
+        int nd = 0;
+        size_t left = len - shown;
+        do {
+            digits[nd++] = static_cast<char>('0' + left % 10);
+            left /= 10;
+        } while (left != 0);
+        while (nd > 0) {
+            *p++ = digits[--nd];
+        }
+        memcpy(p, suffix, sizeof(suffix) - 1);
+        p += sizeof(suffix) - 1;
+    }
+    return p - out;
+}
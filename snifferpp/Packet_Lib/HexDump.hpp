@@ -0,0 +1,43 @@
+//
+//  HexDump.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef HexDump_hpp
+#define HexDump_hpp
+
+#include <cstddef>
+#include "standard_headers.hpp"
+
+/*
+ Layout of a hex dump
+ */
+struct HexDumpOptions {
+    size_t bytes_per_row = 16;
+    size_t max_bytes = 0; // Dump at most this many bytes and say how many were left out, 0 for everything
+};
+
+/*
+ Upper bound on what hex_dump writes for len bytes, size the output buffer with it
+ */
+size_t hex_dump_size(size_t len, const HexDumpOptions& opts = HexDumpOptions {});
+
+/*
+ Classic offset / hex / printable ASCII rows:
+
+    0000  47 45 54 20 2f 20 48 54 54 50 2f 31 2e 31 0d 0a  GET / HTTP/1.1..
+
+ Bytes outside 0x20-0x7e show as '.' in the ASCII column, so control characters never reach the terminal.
+ Offsets take 4 hex digits, 8 when the data is longer than 64 KiB.
+
+ Rows are converted 16 (AVX2: 32) bytes at a time with SIMD shuffles: SSE2 on any x86-64, AVX2 when the CPU has it
+ (checked once at run time), and a table-driven scalar loop elsewhere.
+
+ Writes to out, which must have room for hex_dump_size(len, opts) bytes, and returns how many were written
+ */
+size_t hex_dump(char* out, const byte_t* data, size_t len, const HexDumpOptions& opts = HexDumpOptions {});
+
+#endif /* HexDump_hpp */
@@ -0,0 +1,125 @@
+//
+//  LatencyHistogram.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include <mutex>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include "LatencyHistogram.hpp"
+
+using std::string;
+using std::vector;
+
+const unsigned int LatencyHistogram::SUB_BITS;
+const unsigned int LatencyHistogram::MAX_EXPONENT;
+const size_t LatencyHistogram::BUCKETS;
+
+// Every thread's histograms. Never freed: a report may still be merging them when threads exit
+static std::mutex registry_lock;
+static vector<ThreadLatency*> registry;
+
+const char* latency_stage_name(LatencyStage s) {
+    switch (s) {
+        case LatencyStage::REFILL:
+            return "refill";
+        case LatencyStage::KERNEL_TO_USER:
+            return "kernel_to_user";
+        case LatencyStage::PARSE:
+            return "parse";
+        case LatencyStage::STRIP:
+            return "strip";
+        case LatencyStage::OUTPUT:
+            return "output";
+    }
+    return "invalid";
+}
+
+LatencyHistogram::LatencyHistogram() :count{0}, sum{0}, max{0} {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void LatencySnapshot::merge(const LatencyHistogram& h) {
+    for (size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        buckets[i] += h.buckets[i].load(std::memory_order_relaxed);
+    }
+    // Read separately from the buckets, so a snapshot taken mid-record can be off by the one value in flight
+    count += h.count.load(std::memory_order_relaxed);
+    sum += h.sum.load(std::memory_order_relaxed);
+    uint64_t m = h.max.load(std::memory_order_relaxed);
+    if (m > max) {
+        max = m;
+    }
+}
+
+uint64_t LatencySnapshot::percentile(double q) const {
+    uint64_t total = 0;
+    for (uint64_t b : buckets) {
+        total += b;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    // Rank of the value we want, counting from 1
+    uint64_t rank = static_cast<uint64_t>(q * total + 0.5);
+    rank = rank < 1 ? 1 : (rank > total ? total : rank);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint64_t value = LatencyHistogram::bucket_max(i);
+            return value < max ? value : max;
+        }
+    }
+    return max;
+}
+
+ThreadLatency* register_thread_latency() {
+    // Plain new only promises alignof(max_align_t) before C++17
+    void* memory = nullptr;
+    if (posix_memalign(&memory, CACHE_LINE_LEN, sizeof(ThreadLatency)) != 0) {
+        throw std::bad_alloc {};
+    }
+    ThreadLatency* latency = new (memory) ThreadLatency {};
+
+    std::lock_guard<std::mutex> guard {registry_lock};
+    registry.push_back(latency);
+    return latency;
+}
+
+LatencySnapshot merge_latency(LatencyStage s) {
+    LatencySnapshot snapshot;
+    std::lock_guard<std::mutex> guard {registry_lock};
+    for (ThreadLatency* t : registry) {
+        snapshot.merge((*t)[s]);
+    }
+    return snapshot;
+}
+
+string format_latency_report() {
+#ifndef SNIFFERPP_LATENCY
+    return "Latency histograms not compiled in (build with -DSNIFFERPP_LATENCY=ON)\n";
+#else
+    string out = "Stage            count        mean(us)   p50(us)    p90(us)    p99(us)    p99.9(us)  max(us)\n";
+    char line[160];
+    for (size_t i = 0; i < LATENCY_STAGES; ++i) {
+        LatencyStage s = static_cast<LatencyStage>(i);
+        LatencySnapshot snap = merge_latency(s);
+        if (snap.get_count() == 0) {
+            continue;
+        }
+        snprintf(line, sizeof(line), "%-16s %-12llu %-10.3f %-10.3f %-10.3f %-10.3f %-10.3f %.3f\n", latency_stage_name(s),
+                 static_cast<unsigned long long>(snap.get_count()), snap.get_mean() / 1000, snap.percentile(0.5) / 1000.0,
+                 snap.percentile(0.9) / 1000.0, snap.percentile(0.99) / 1000.0, snap.percentile(0.999) / 1000.0, snap.get_max() / 1000.0);
+        out += line;
+    }
+    return out;
+#endif
+}
@@ -0,0 +1,189 @@
+//
+//  LatencyHistogram.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef LatencyHistogram_hpp
+#define LatencyHistogram_hpp
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "standard_headers.hpp"
+
+/*
+ Where time per packet is measured. Each is only recorded in builds with SNIFFERPP_LATENCY defined (see LATENCY_SCOPE)
+ */
+enum class LatencyStage {
+    REFILL, // Waiting for and reading a buffer fill from the device (read() / the next ring block)
+    KERNEL_TO_USER, // Kernel timestamp (bh_tstamp) to the batch being handed to us
+    PARSE, // view_packet
+    STRIP, // strip_packet / to_packet (parse plus copying out)
+    OUTPUT // PacketFormatter::write
+};
+
+const size_t LATENCY_STAGES = 5;
+
+const char* latency_stage_name(LatencyStage s);
+
+/*
+ Log-linear (HDR style) histogram of nanosecond values: exact below 64ns, then 32 buckets per power of two, so any
+ reported value is within about 3% of the real one. Covers up to 2^47ns (about 39 hours); anything longer lands in the
+ last bucket, though max keeps the real value.
+
+ Single writer: the owning thread records with relaxed loads and stores, other threads may read at any time.
+ */
+class LatencyHistogram {
+public:
+    static const unsigned int SUB_BITS = 5;
+    static const unsigned int MAX_EXPONENT = 47;
+    static const size_t BUCKETS = (MAX_EXPONENT - SUB_BITS + 2) << SUB_BITS;
+
+private:
+    std::atomic<uint64_t> buckets[BUCKETS];
+    std::atomic<uint64_t> count, sum, max;
+
+    static void add(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+public:
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram& other)= delete;
+    LatencyHistogram operator=(const LatencyHistogram& other)=delete;
+
+    static size_t bucket_of(uint64_t ns) {
+        if (ns < (uint64_t {2} << SUB_BITS)) {
+            return static_cast<size_t>(ns);
+        }
+        unsigned int exponent = 63 - __builtin_clzll(ns);
+        if (exponent > MAX_EXPONENT) {
+            return BUCKETS - 1;
+        }
+        unsigned int shift = exponent - SUB_BITS;
+        return (static_cast<size_t>(shift) << SUB_BITS) + static_cast<size_t>(ns >> shift);
+    }
+
+    // Largest value that lands in bucket idx
+    static uint64_t bucket_max(size_t idx) {
+        if (idx < (size_t {2} << SUB_BITS)) {
+            return idx;
+        }
+        unsigned int shift = static_cast<unsigned int>(idx >> SUB_BITS) - 1;
+        uint64_t mantissa = (idx & ((size_t {1} << SUB_BITS) - 1)) + (uint64_t {1} << SUB_BITS);
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    void record(uint64_t ns) {
+        add(buckets[bucket_of(ns)], 1);
+        add(count, 1);
+        add(sum, ns);
+        if (ns > max.load(std::memory_order_relaxed)) {
+            max.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    friend class LatencySnapshot;
+};
+
+/*
+ Plain copy of one stage's histograms, merged over every thread
+ */
+class LatencySnapshot {
+private:
+    std::vector<uint64_t> buckets;
+    uint64_t count, sum, max;
+
+public:
+    LatencySnapshot() :buckets(LatencyHistogram::BUCKETS), count{0}, sum{0}, max{0} {};
+
+    // Adds in what h holds right now
+    void merge(const LatencyHistogram& h);
+
+    uint64_t get_count(void) const { return count; }
+    uint64_t get_max(void) const { return max; }
+    double get_mean(void) const { return count ? static_cast<double>(sum) / count : 0; }
+
+    // Value at quantile q (0.5, 0.99, ...) in ns, never more than max
+    uint64_t percentile(double q) const;
+};
+
+/*
+ One thread's histograms, one per stage, on their own cache lines
+ */
+struct alignas(CACHE_LINE_LEN) ThreadLatency {
+    LatencyHistogram stages[LATENCY_STAGES];
+
+    LatencyHistogram& operator[](LatencyStage s) { return stages[static_cast<size_t>(s)]; }
+};
+
+// Sets up the calling thread's histograms. Kept after the thread exits
+ThreadLatency* register_thread_latency(void);
+
+inline ThreadLatency& thread_latency(void) {
+    static thread_local ThreadLatency* latency = nullptr;
+    if (latency == nullptr) {
+        latency = register_thread_latency();
+    }
+    return *latency;
+}
+
+/*
+ A stage's histograms merged over every thread. Never blocks the threads recording
+ */
+LatencySnapshot merge_latency(LatencyStage s);
+
+/*
+ Count, mean, p50, p90, p99, p99.9 and max of every stage that has recorded anything, one line each (in usec)
+ Says so instead when the build has no instrumentation
+ */
+std::string format_latency_report(void);
+
+// Monotonic nanoseconds (CLOCK_MONOTONIC on Linux)
+inline uint64_t latency_now_ns(void) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+#ifdef SNIFFERPP_LATENCY
+
+/*
+ Records the time from its construction to the end of the enclosing scope
+ */
+class LatencyTimer {
+private:
+    LatencyStage stage;
+    uint64_t start;
+public:
+    LatencyTimer(LatencyStage stage) :stage{stage}, start{latency_now_ns()} {};
+
+    LatencyTimer(const LatencyTimer& other)= delete;
+    LatencyTimer operator=(const LatencyTimer& other)=delete;
+
+    ~LatencyTimer() {
+        thread_latency()[stage].record(latency_now_ns() - start);
+    }
+};
+
+#define LATENCY_TIMER_NAME2(line) latency_timer_##line
+#define LATENCY_TIMER_NAME(line) LATENCY_TIMER_NAME2(line)
+
+// Times the rest of the enclosing scope as stage
+#define LATENCY_SCOPE(stage) LatencyTimer LATENCY_TIMER_NAME(__LINE__) {stage}
+
+// Records ns for stage (ns is not evaluated at all in builds without SNIFFERPP_LATENCY)
+#define LATENCY_RECORD(stage, ns) thread_latency()[stage].record(ns)
+
+#else
+
+#define LATENCY_SCOPE(stage) do {} while (0)
+#define LATENCY_RECORD(stage, ns) do {} while (0)
+
+#endif
+
+#endif /* LatencyHistogram_hpp */
@@ -0,0 +1,256 @@
+//
+//  Log.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include "standard_headers.hpp"
+#include "Log.hpp"
+
+using std::string;
+
+std::atomic<int> log_threshold {static_cast<int>(LogLevel::INFO)};
+
+const char* log_level_name(LogLevel level) {
+    switch (level) {
+        case LogLevel::VERBOSE:
+            return "verbose";
+        case LogLevel::INFO:
+            return "info";
+        case LogLevel::WARNING:
+            return "warning";
+        case LogLevel::ERROR:
+            return "error";
+        case LogLevel::NONE:
+            return "none";
+    }
+    return "invalid";
+}
+
+bool parse_log_level(const string& name, LogLevel& level) {
+    const LogLevel levels[] = {LogLevel::VERBOSE, LogLevel::INFO, LogLevel::WARNING, LogLevel::ERROR, LogLevel::NONE};
+    for (LogLevel l : levels) {
+        if (name == log_level_name(l)) {
+            level = l;
+            return true;
+        }
+    }
+    return false;
+}
+
+void set_log_level(LogLevel level) {
+    log_threshold.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+static uint64_t now_seconds() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+bool LogSite::admit() {
+    uint64_t now = now_seconds();
+    uint64_t w = window.load(std::memory_order_relaxed);
+    if (w != now && window.compare_exchange_strong(w, now, std::memory_order_relaxed)) {
+        in_window.store(0, std::memory_order_relaxed);
+    }
+    if (in_window.fetch_add(1, std::memory_order_relaxed) < LOG_BURST) {
+        return true;
+    }
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+/*
+ The ring (bounded, many producers, one consumer: each slot's sequence number says whether it is free, being filled
+ or ready) and the thread that empties it. Started by the first message
+ */
+class Logger {
+private:
+    static const size_t RING_LEN = 1024;
+
+    struct Entry {
+        std::atomic<size_t> seq;
+        LogSite* site;
+        size_t len;
+        char text[LOG_LINE_LEN];
+    };
+
+    Entry ring[RING_LEN];
+    alignas(CACHE_LINE_LEN) std::atomic<size_t> enqueue_pos;
+    alignas(CACHE_LINE_LEN) size_t dequeue_pos; // Only the consumer uses it
+    std::atomic<uint64_t> ring_dropped;
+    std::atomic<LogSite*> sites; // Every site that has logged, for the suppressed summaries
+
+    std::mutex start_lock;
+    std::atomic<bool> started;
+    std::atomic<bool> stop_requested;
+    std::thread thread;
+
+    void start(void) {
+        std::lock_guard<std::mutex> guard {start_lock};
+        if (!started.load(std::memory_order_relaxed)) {
+            thread = std::thread {&Logger::run, this};
+            started.store(true, std::memory_order_release);
+        }
+    }
+
+    void list_site(LogSite& site) {
+        if (site.listed.exchange(true, std::memory_order_relaxed)) {
+            return;
+        }
+        LogSite* head = sites.load(std::memory_order_relaxed);
+        do {
+            site.next.store(head, std::memory_order_relaxed);
+        } while (!sites.compare_exchange_weak(head, &site, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // Consumer: everything ready in the ring, appended to out. Returns whether there was anything
+    bool drain(string& out) {
+        bool any = false;
+        for (;;) {
+            Entry& e = ring[dequeue_pos & (RING_LEN - 1)];
+            if (e.seq.load(std::memory_order_acquire) != dequeue_pos + 1) {
+                return any;
+            }
+            out += log_level_name(e.site->level);
+            out += ": ";
+            out.append(e.text, e.len);
+            out += '\n';
+
+            size_t keep = e.len < sizeof(e.site->last_text) - 1 ? e.len : sizeof(e.site->last_text) - 1;
+            memcpy(e.site->last_text, e.text, keep);
+            e.site->last_text[keep] = '\0';
+
+            e.seq.store(dequeue_pos + RING_LEN, std::memory_order_release);
+            ++dequeue_pos;
+            any = true;
+        }
+    }
+
+    // Consumer: one line for every site that has suppressed anything since last time
+    void summarize(string& out) {
+        char line[LOG_LINE_LEN];
+        for (LogSite* site = sites.load(std::memory_order_acquire); site != nullptr; site = site->next.load(std::memory_order_relaxed)) {
+            uint64_t n = site->suppressed.exchange(0, std::memory_order_relaxed);
+            if (n != 0) {
+                snprintf(line, sizeof(line), "%s: %s (%llu more suppressed)\n", log_level_name(site->level), site->last_text, static_cast<unsigned long long>(n));
+                out += line;
+            }
+        }
+        uint64_t dropped = ring_dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped != 0) {
+            snprintf(line, sizeof(line), "warning: %llu log messages dropped, logging fell behind\n", static_cast<unsigned long long>(dropped));
+            out += line;
+        }
+    }
+
+    static void write_out(const string& text) {
+        size_t done = 0;
+        while (done < text.size()) {
+            ssize_t w = ::write(STDERR_FILENO, text.data() + done, text.size() - done);
+            if (w == -1 && errno == EINTR) {
+                continue;
+            }
+            if (w <= 0) {
+                return;
+            }
+            done += w;
+        }
+    }
+
+    void run(void) {
+        // Messages show up within this long of being logged
+        const auto idle = std::chrono::milliseconds {20};
+        auto last_summary = std::chrono::steady_clock::now();
+        string out;
+        while (!stop_requested.load(std::memory_order_relaxed)) {
+            bool any = drain(out);
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_summary >= std::chrono::seconds {1}) {
+                summarize(out);
+                last_summary = now;
+            }
+            if (!out.empty()) {
+                write_out(out);
+                out.clear();
+            }
+            if (!any) {
+                std::this_thread::sleep_for(idle);
+            }
+        }
+    }
+
+public:
+    Logger() :enqueue_pos{0}, dequeue_pos{0}, ring_dropped{0}, sites{nullptr}, started{false}, stop_requested{false} {
+        for (size_t i = 0; i < RING_LEN; ++i) {
+            ring[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    Logger(const Logger& other)= delete;
+    Logger operator=(const Logger& other)=delete;
+
+    // Stops the thread and writes whatever is left, so messages logged just before exit are not lost
+    ~Logger() {
+        if (!started.load(std::memory_order_acquire)) {
+            return;
+        }
+        stop_requested.store(true, std::memory_order_relaxed);
+        thread.join();
+        string out;
+        drain(out);
+        summarize(out);
+        write_out(out);
+    }
+
+    void push(LogSite& site, const char* format, va_list args) {
+        if (!started.load(std::memory_order_acquire)) {
+            start();
+        }
+        list_site(site);
+
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Entry* e;
+        for (;;) {
+            e = &ring[pos & (RING_LEN - 1)];
+            size_t seq = e->seq.load(std::memory_order_acquire);
+            if (seq == pos) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (seq < pos) {
+                // Full: the consumer has not freed this slot from the last lap yet
+                ring_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        int len = vsnprintf(e->text, sizeof(e->text), format, args);
+        e->len = len < 0 ? 0 : (static_cast<size_t>(len) < sizeof(e->text) ? len : sizeof(e->text) - 1);
+        e->site = &site;
+        e->seq.store(pos + 1, std::memory_order_release);
+    }
+};
+
+static Logger& logger() {
+    static Logger instance;
+    return instance;
+}
+
+void log_write(LogSite& site, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    logger().push(site, format, args);
+    va_end(args);
+}
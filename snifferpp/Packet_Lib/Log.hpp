@@ -0,0 +1,97 @@
+//
+//  Log.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef Log_hpp
+#define Log_hpp
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+/*
+ Diagnostics that can come from the capture path (truncated or unsupported packets, failed ioctls) without slowing it
+ down: a message is formatted into a slot of a lock-free ring and written to stderr later by a background thread, in
+ one write per batch, so logging never flushes or blocks on the terminal.
+
+ Every call site is rate limited on its own: past LOG_BURST messages a second, further ones are only counted and the
+ background thread prints "N more suppressed" once a second instead. A burst of malformed traffic costs a few atomic
+ increments per packet, not a syscall each.
+ */
+
+enum class LogLevel {
+    VERBOSE, // Not DEBUG, which Xcode debug builds define as a macro
+    INFO,
+    WARNING,
+    ERROR,
+    NONE // Only for set_log_level, turns logging off
+};
+
+const char* log_level_name(LogLevel level);
+
+// Parses "verbose", "info", "warning", "error" or "none"; returns false (and leaves level alone) for anything else
+bool parse_log_level(const std::string& name, LogLevel& level);
+
+// Messages below level are dropped at the call site, before any formatting. INFO by default
+void set_log_level(LogLevel level);
+
+extern std::atomic<int> log_threshold;
+
+inline bool log_enabled(LogLevel level) {
+    return static_cast<int>(level) >= log_threshold.load(std::memory_order_relaxed);
+}
+
+/*
+ Per call site state, created by the LOG_ macros. Constant initialized and trivially destructible, so it is usable
+ from any thread at any point, including while static objects are being destroyed.
+ */
+class LogSite {
+private:
+    std::atomic<uint64_t> window; // Which second the count below is for
+    std::atomic<uint32_t> in_window;
+    std::atomic<uint64_t> suppressed; // Not printed yet
+    std::atomic<LogSite*> next; // In the list of every site that has logged
+    std::atomic<bool> listed;
+
+    // Last message printed from here, only touched by the logging thread
+    char last_text[96];
+
+    friend class Logger;
+
+public:
+    const LogLevel level;
+
+    constexpr LogSite(LogLevel level) :window{0}, in_window{0}, suppressed{0}, next{nullptr}, listed{false}, last_text{}, level{level} {};
+
+    LogSite(const LogSite& other)= delete;
+    LogSite operator=(const LogSite& other)=delete;
+
+    // Whether this message may be logged (it is counted as suppressed otherwise)
+    bool admit(void);
+};
+
+const uint32_t LOG_BURST = 10; // Messages per second per call site before suppression starts
+const size_t LOG_LINE_LEN = 240; // Longer messages are cut short
+
+// Formats the message into the ring. Never blocks: when the ring is full the message is only counted
+void log_write(LogSite& site, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+#define SNIFFERPP_LOG(level, ...) do { \
+    if (log_enabled(level)) { \
+        static LogSite log_site_ {level}; \
+        if (log_site_.admit()) { \
+            log_write(log_site_, __VA_ARGS__); \
+        } \
+    } \
+} while (0)
+
+#define LOG_VERBOSE(...) SNIFFERPP_LOG(LogLevel::VERBOSE, __VA_ARGS__)
+#define LOG_INFO(...) SNIFFERPP_LOG(LogLevel::INFO, __VA_ARGS__)
+#define LOG_WARNING(...) SNIFFERPP_LOG(LogLevel::WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) SNIFFERPP_LOG(LogLevel::ERROR, __VA_ARGS__)
+
+#endif /* Log_hpp */
@@ -16,7 +16,7 @@ PacketHeader Packet::get_header() {
 }
 
 vector<byte_t> Packet::get_data() {
-    return data;
+    return vector<byte_t> {data.begin(), data.end()};
 }
 
 vector<byte_t> Packet::get_bytes() {
@@ -28,22 +28,16 @@ vector<byte_t> Packet::get_bytes() {
     return res;
 }
 
+std::ostream& print_payload(std::ostream& os, const byte_t* data, size_t data_len, const HexDumpOptions& opts) {
+    std::vector<char> dump(hex_dump_size(data_len, opts));
+    size_t len = hex_dump(dump.data(), data, data_len, opts);
+    os << "Raw Packet Data" << '\n';
+    return os.write(dump.data(), len);
+}
+
 std::ostream& operator<<(std::ostream& os, Packet p){
-    std::ios tmp {NULL};
-    tmp.copyfmt(os);
     os << "Packet" << endl;
     os << p.get_header() << endl;
-    os << "Raw Packet Data" << endl;
-    for(auto b : p.get_data()) {
-        os << std::setfill('0') << std::setw(2) << std::hex << (0xff & b) << " ";
-    } // TODO: this is a jank way of doing this, unclear if right
-    os << endl;
-    os.copyfmt(tmp);
-    
-    os << "ASCII-encoded Packet Data" << endl;
-    for(auto b : p.get_data()) {
-        os << b;
-    } // TODO: this is a jank way of doing this, unclear if right
-    os.copyfmt(tmp);
-    return os;
+    std::vector<byte_t> data = p.get_data();
+    return print_payload(os, data.data(), data.size());
 }
@@ -10,18 +10,28 @@
 #define Packet_hpp
 
 #include "PacketHeader.hpp"
+#include "HexDump.hpp"
+
+/*
+ Payload storage of a Packet: on the heap, or in a PacketArena (see ArenaAllocator)
+ */
+using PacketData = std::vector<byte_t, ArenaAllocator<byte_t>>;
 
 /*
  Represents a complete packet (from the ethernet header to the data)
+ 
+ Built from a PacketArena (PacketView::to_packet(arena)) the headers and payload sit next to each other in the arena and
+ the packet must not outlive its reset(). Copies are always heap backed.
  */
 class Packet {
 private:
     PacketHeader phdr;
-    std::vector<byte_t> data;
+    PacketData data;
     
 public:
-    Packet(const PacketHeader& phdr, std::vector<byte_t> d) :phdr{phdr}, data{d} {};
-    Packet(PacketHeader&& phdr, std::vector<byte_t> d) :phdr{phdr}, data{d} {};
+    Packet(const PacketHeader& phdr, std::vector<byte_t> d) :phdr{phdr}, data{d.begin(), d.end()} {};
+    Packet(PacketHeader&& phdr, std::vector<byte_t> d) :phdr{std::move(phdr)}, data{d.begin(), d.end()} {};
+    Packet(PacketHeader&& phdr, PacketData&& d) :phdr{std::move(phdr)}, data{std::move(d)} {};
     
     Packet(const Packet& pack) :phdr{pack.phdr}, data{pack.data} {};
     Packet(Packet&& pack) :phdr{std::move(pack.phdr)}, data{std::move(pack.data)} {};
@@ -39,6 +49,10 @@ public:
     PacketHeader get_header(void);
     std::vector<byte_t> get_data(void);
     
+    // The payload in place, without the copy get_data() makes
+    const byte_t* get_data_ptr(void) const { return data.data(); }
+    size_t get_data_len(void) const { return data.size(); }
+    
     /*
      Stitches together the bytes of the underlying types
      */
@@ -47,4 +61,9 @@ public:
 
 std::ostream& operator<<(std::ostream& os, Packet p);
 
+/*
+ Prints a payload as offset / hex / ASCII rows (see hex_dump), shared by Packet and PacketView output
+ */
+std::ostream& print_payload(std::ostream& os, const byte_t* data, size_t data_len, const HexDumpOptions& opts = HexDumpOptions {});
+
 #endif /* Packet_hpp */
@@ -0,0 +1,38 @@
+//
+//  PacketArena.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include "PacketArena.hpp"
+
+const size_t PacketArena::default_chunk_size;
+
+void* PacketArena::allocate_slow(size_t n, size_t align) {
+    size_t needed = n + align - 1; // Enough whatever the chunk's alignment
+    if (current < chunks.size()) {
+        used += offset;
+        ++current;
+    }
+    offset = 0;
+
+    // Reuse a chunk kept from an earlier fill if one is big enough; smaller ones are skipped until the next reset
+    while (current < chunks.size() && chunks[current].size < needed) {
+        ++current;
+    }
+    if (current == chunks.size()) {
+        size_t size = needed > chunk_size ? needed : chunk_size;
+        chunks.push_back(Chunk {std::unique_ptr<unsigned char[]> {new unsigned char[size]}, size});
+    }
+    return allocate(n, align);
+}
+
+size_t PacketArena::get_capacity() const {
+    size_t total = 0;
+    for (const Chunk& c : chunks) {
+        total += c.size;
+    }
+    return total;
+}
@@ -0,0 +1,138 @@
+//
+//  PacketArena.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef PacketArena_hpp
+#define PacketArena_hpp
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/*
+ Bump allocator for everything decoded out of one buffer fill (a BPFDevice read, a ring block, a batch of a capture file)
+
+ Allocating is a pointer bump; nothing is freed on its own. reset() releases it all at once and keeps the chunks, so once
+ the arena has grown to the size of a batch the capture loop stops touching malloc:
+
+    PacketArena arena;
+    while (...) {
+        arena.reset();
+        for (auto&& rec : dev.readBatch()) {
+            Packet p = view_packet(rec.get_data(), rec.get_data_len()).to_packet(arena);
+            ...
+        }
+    }
+
+ Requests larger than a chunk get a chunk of their own. Not thread safe: use one arena per thread.
+ */
+class PacketArena {
+private:
+    struct Chunk {
+        std::unique_ptr<unsigned char[]> memory;
+        size_t size;
+    };
+
+    std::vector<Chunk> chunks;
+    size_t current; // Chunk being carved up
+    size_t offset; // Bytes of it already handed out
+    size_t chunk_size;
+    size_t used; // In earlier chunks since the last reset
+
+    // Moves on to (or adds) a chunk with room for n bytes at alignment align
+    void* allocate_slow(size_t n, size_t align);
+
+public:
+    static const size_t default_chunk_size = 1 << 16;
+
+    PacketArena(size_t chunk_size = default_chunk_size) :current{0}, offset{0}, chunk_size{chunk_size}, used{0} {};
+
+    PacketArena(const PacketArena& other)= delete;
+    PacketArena operator=(const PacketArena& other)=delete;
+
+    /*
+     n bytes aligned to align (a power of two). Valid until the next reset() or the arena's destruction
+     */
+    void* allocate(size_t n, size_t align = alignof(std::max_align_t)) {
+        if (current < chunks.size()) {
+            uintptr_t base = reinterpret_cast<uintptr_t>(chunks[current].memory.get());
+            size_t start = ((base + offset + align - 1) & ~(uintptr_t)(align - 1)) - base;
+            if (start + n <= chunks[current].size) {
+                offset = start + n;
+                return chunks[current].memory.get() + start;
+            }
+        }
+        return allocate_slow(n, align);
+    }
+
+    /*
+     Releases everything handed out so far in one go. The memory is kept for reuse
+     */
+    void reset(void) {
+        current = 0;
+        offset = 0;
+        used = 0;
+    }
+
+    // Bytes handed out since the last reset (including alignment padding)
+    size_t get_used(void) const { return used + offset; }
+
+    // Bytes held across all chunks
+    size_t get_capacity(void) const;
+    size_t get_chunk_count(void) const { return chunks.size(); }
+};
+
+/*
+ Standard allocator drawing from a PacketArena, for containers that live no longer than the arena's current fill
+ Deallocation is a no-op; the arena takes it all back on reset().
+
+ Default constructed (no arena) it falls back to the heap, so one container type serves both. Copying a container
+ gives the copy a heap allocator: copies are how data escapes a batch, and must not point into the arena
+ */
+template <typename T>
+class ArenaAllocator {
+private:
+    PacketArena* arena;
+
+    template <typename U> friend class ArenaAllocator;
+
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ArenaAllocator() noexcept :arena{nullptr} {};
+    ArenaAllocator(PacketArena& arena) noexcept :arena{&arena} {};
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept :arena{other.arena} {};
+
+    T* allocate(size_t n) {
+        if (arena) {
+            return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t) noexcept {
+        if (!arena) {
+            ::operator delete(p);
+        }
+    }
+
+    ArenaAllocator select_on_container_copy_construction(void) const { return ArenaAllocator {}; }
+
+    PacketArena* get_arena(void) const { return arena; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+#endif /* PacketArena_hpp */
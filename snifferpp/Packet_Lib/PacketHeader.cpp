@@ -24,6 +24,15 @@ std::ostream& operator<<(std::ostream& os, TransportKind k){
         case TransportKind::UDP:
             os << "UDP";
             break;
+        case TransportKind::ICMP:
+            os << "ICMP";
+            break;
+        case TransportKind::ICMPV6:
+            os << "ICMPv6";
+            break;
+        case TransportKind::NONE:
+            os << "None";
+            break;
         default:
             os << "Invalid";
     }
@@ -48,24 +57,15 @@ WrappedHeader<tcphdr> TransportHeader::get_tcp_header() {
 TransportKind TransportHeader::get_kind() { return kind; }
 
 vector<byte_t> TransportHeader::get_bytes(void) {
-    size_t size;
-    byte_t* bytes;
     switch (kind) {
         case TransportKind::TCP:
-            size = sizeof(tcphdr);
-            bytes = new byte_t[size];
-            memcpy(bytes, tcp.get_header().get(), size);
-            break;
+            return tcp.get_bytes();
         case TransportKind::UDP:
-            size = sizeof(udphdr);
-            bytes = new byte_t[size];
-            memcpy(bytes, udp.get_header().get(), size);
-            break;
+            return udp.get_bytes();
         default:
-            std::cerr << "Attempted to get bytes of empty transport header" << endl;
+            LOG_WARNING("Attempted to get bytes of empty transport header");
             return vector<byte_t> {};
     }
-    return vector<byte_t> {bytes,bytes+size};
 }
 
 //Packet Header
@@ -116,7 +116,7 @@ ostream& operator<<(ostream& os, TransportHeader tph) {
         case TransportKind::UDP:
             return os << tph.get_udp_header();
         default:
-            cerr << "Tried to print invalid header" << endl;
+            LOG_WARNING("Tried to print invalid header");
     return os;
     }
 }
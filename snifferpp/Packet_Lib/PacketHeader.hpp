@@ -14,6 +14,22 @@
 #include <vector>
 #include <exception>
 #include "standard_headers.hpp"
+#include "PacketArena.hpp"
+#include "Log.hpp"
+
+/*
+ Deleter for WrappedHeader: frees heap headers, leaves those in a PacketArena to the arena's reset()
+ */
+template <typename StandardHeader>
+struct HeaderDelete {
+    bool in_arena = false;
+
+    void operator()(StandardHeader* sth) const {
+        if (!in_arena) {
+            delete sth;
+        }
+    }
+};
 
 /*
  For representing a "Standard" network header as an object (rather than a struct or pointer to struct)
@@ -22,33 +38,39 @@
  
  Guaranteed to destroy headers at the end of its lifetime and when being reassigned
  
+ The header lives on the heap, or in a PacketArena when built with one (it is then only valid until the arena's reset).
+ Moves keep it where it is; copies always go to the heap, so a copy can outlive the arena.
+ 
  *** We currently DO NOT do any validating of the headers to check if they are valid ***
  */
 template <typename StandardHeader>
 class WrappedHeader {
 private:
-    std::unique_ptr<StandardHeader> sth;
+    std::unique_ptr<StandardHeader, HeaderDelete<StandardHeader>> sth;
     
 public:
     WrappedHeader() {};
     WrappedHeader(std::unique_ptr<StandardHeader> sth) :sth{sth.release()} {};
+    WrappedHeader(const StandardHeader& h, PacketArena& arena) :sth{static_cast<StandardHeader*>(arena.allocate(sizeof(StandardHeader), alignof(StandardHeader))), HeaderDelete<StandardHeader> {true}} {
+        memcpy(sth.get(), &h, sizeof(StandardHeader));
+    }
     
     WrappedHeader(const WrappedHeader<StandardHeader>& other) {
         sth.reset(new StandardHeader{});
         memcpy(sth.get(), other.sth.get(), sizeof(StandardHeader));
     }
-    WrappedHeader(WrappedHeader<StandardHeader>&& other) : sth{other.sth.release()} {};
+    WrappedHeader(WrappedHeader<StandardHeader>&& other) : sth{std::move(other.sth)} {};
     
     WrappedHeader<StandardHeader>& operator=(const WrappedHeader<StandardHeader>& other) {
         clear();
-        sth.reset(new StandardHeader{});
+        sth = std::unique_ptr<StandardHeader, HeaderDelete<StandardHeader>> {new StandardHeader{}}; // Heap, even if ours was in an arena
         memcpy(sth.get(), other.sth.get(), sizeof(StandardHeader));
         return *this;
     }
     
     WrappedHeader<StandardHeader>& operator=(WrappedHeader<StandardHeader>&& other) {
         clear();
-        sth.reset(other.sth.release());
+        sth = std::move(other.sth);
         return *this;
     }
     
@@ -66,8 +88,7 @@ public:
     }
     
     std::vector<byte_t> get_bytes(void) {
-        byte_t* bytes = new byte_t[sizeof(StandardHeader)];
-        memcpy(bytes, sth.get(), sizeof(StandardHeader));
+        const byte_t* bytes = reinterpret_cast<const byte_t*>(sth.get());
         return std::vector<byte_t> {bytes,bytes+sizeof(StandardHeader)};
     }
 };
@@ -95,8 +116,11 @@ public:
 
 /*
  Represents the distinct transport protocols in a strongly-typed manner (versus the macro definitions)
+ 
+ TransportHeader (and so Packet) only holds TCP and UDP; the others are for PacketView. NONE means there is no
+ transport header we know how to show (ARP, a non-first IP fragment, ESP, ...)
  */
-enum class TransportKind {TCP, UDP};
+enum class TransportKind {TCP, UDP, ICMP, ICMPV6, NONE};
     
 std::ostream& operator<<(std::ostream& os, TransportKind k);
     
@@ -118,8 +142,8 @@ public:
     // We provide a default constructor but it will throw exceptions whenever the returned object is used
     TransportHeader() {};
     
-    TransportHeader(WrappedHeader<tcphdr> tcph) :tcp{tcph}, kind{TransportKind::TCP} {};
-    TransportHeader(WrappedHeader<udphdr> udph) :udp{udph}, kind{TransportKind::UDP} {};
+    TransportHeader(WrappedHeader<tcphdr> tcph) :tcp{std::move(tcph)}, kind{TransportKind::TCP} {};
+    TransportHeader(WrappedHeader<udphdr> udph) :udp{std::move(udph)}, kind{TransportKind::UDP} {};
     
     TransportHeader(const TransportHeader& tph) :kind{tph.kind} {
         switch (kind) {
@@ -130,7 +154,7 @@ public:
                 udp = tph.udp;
                 break;
             default:
-                std::cerr << "Copying invalid TransportHeader" << std::endl;
+                LOG_WARNING("Copying invalid TransportHeader");
         }
     }
     
@@ -143,7 +167,7 @@ public:
                 udp = std::move(tph.udp);
                 break;
             default:
-                std::cerr << "Moving invalid TransportHeader" << std::endl;
+                LOG_WARNING("Moving invalid TransportHeader");
         }
     };
     
@@ -158,7 +182,7 @@ public:
                 udp = tph.udp;
                 break;
             default:
-                std::cerr << "Copying invalid TransportHeader" << std::endl;
+                LOG_WARNING("Copying invalid TransportHeader");
         }
         return *this;
     };
@@ -174,7 +198,7 @@ public:
                 udp = std::move(tph.udp);
                 break;
             default:
-                std::cerr << "Moving invalid TransportHeader" << std::endl;
+                LOG_WARNING("Moving invalid TransportHeader");
         }
         return *this;
     };
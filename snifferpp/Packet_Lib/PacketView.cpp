@@ -0,0 +1,126 @@
+//
+//  PacketView.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include "PacketView.hpp"
+
+using std::ostream;
+using std::vector;
+using std::endl;
+
+HeaderView<ip> PacketView::get_ip_header() const {
+    if (layers.network != NetworkKind::IPV4) {
+        throw WrongNetworkProtocol {};
+    }
+    return HeaderView<ip> {layers.buffer+layers.network_offset};
+}
+
+HeaderView<ip6_hdr> PacketView::get_ip6_header() const {
+    if (layers.network != NetworkKind::IPV6) {
+        throw WrongNetworkProtocol {};
+    }
+    return HeaderView<ip6_hdr> {layers.buffer+layers.network_offset};
+}
+
+HeaderView<ether_arp> PacketView::get_arp_header() const {
+    if (layers.network != NetworkKind::ARP) {
+        throw WrongNetworkProtocol {};
+    }
+    return HeaderView<ether_arp> {layers.buffer+layers.network_offset};
+}
+
+HeaderView<tcphdr> PacketView::get_tcp_header() const {
+    if (layers.transport != TransportKind::TCP) {
+        throw WrongTransportProtocol {};
+    }
+    return HeaderView<tcphdr> {layers.buffer+layers.transport_offset};
+}
+
+HeaderView<udphdr> PacketView::get_udp_header() const {
+    if (layers.transport != TransportKind::UDP) {
+        throw WrongTransportProtocol {};
+    }
+    return HeaderView<udphdr> {layers.buffer+layers.transport_offset};
+}
+
+HeaderView<icmp_header> PacketView::get_icmp_header() const {
+    if (layers.transport != TransportKind::ICMP && layers.transport != TransportKind::ICMPV6) {
+        throw WrongTransportProtocol {};
+    }
+    return HeaderView<icmp_header> {layers.buffer+layers.transport_offset};
+}
+
+Packet PacketView::to_packet() const {
+    TransportHeader tph;
+    switch (layers.transport) {
+        case TransportKind::TCP:
+            tph = TransportHeader {get_tcp_header().to_wrapped()};
+            break;
+        case TransportKind::UDP:
+            tph = TransportHeader {get_udp_header().to_wrapped()};
+            break;
+        default:
+            throw WrongTransportProtocol {};
+    }
+    PacketHeader phdr {get_ether_header().to_wrapped(), get_ip_header().to_wrapped(), std::move(tph), layers.protocol};
+    vector<byte_t> data {get_data(), get_data()+get_data_len()};
+    return Packet {std::move(phdr), std::move(data)};
+}
+
+Packet PacketView::to_packet(PacketArena& arena) const {
+    TransportHeader tph;
+    switch (layers.transport) {
+        case TransportKind::TCP:
+            tph = TransportHeader {get_tcp_header().to_wrapped(arena)};
+            break;
+        case TransportKind::UDP:
+            tph = TransportHeader {get_udp_header().to_wrapped(arena)};
+            break;
+        default:
+            throw WrongTransportProtocol {};
+    }
+    PacketHeader phdr {get_ether_header().to_wrapped(arena), get_ip_header().to_wrapped(arena), std::move(tph), layers.protocol};
+    PacketData data {get_data(), get_data()+get_data_len(), ArenaAllocator<byte_t> {arena}};
+    return Packet {std::move(phdr), std::move(data)};
+}
+
+ostream& operator<<(ostream& os, const PacketView& pv) {
+    os << "Packet" << endl;
+    os << pv.get_ether_header() << endl;
+    for (size_t i = 0; i < pv.get_vlan_count(); ++i) {
+        os << "VLAN Tag" << endl << "\t|-ID: " << pv.get_vlan_id(i) << endl;
+    }
+    switch (pv.get_network_kind()) {
+        case NetworkKind::IPV4:
+            os << pv.get_ip_header() << endl;
+            break;
+        case NetworkKind::IPV6:
+            os << pv.get_ip6_header() << endl;
+            break;
+        case NetworkKind::ARP:
+            os << pv.get_arp_header() << endl;
+            break;
+        case NetworkKind::OTHER:
+            break;
+    }
+    switch (pv.get_transport_kind()) {
+        case TransportKind::TCP:
+            os << pv.get_tcp_header() << endl;
+            break;
+        case TransportKind::UDP:
+            os << pv.get_udp_header() << endl;
+            break;
+        case TransportKind::ICMP:
+        case TransportKind::ICMPV6:
+            os << pv.get_icmp_header() << endl;
+            break;
+        case TransportKind::NONE:
+            break;
+    }
+    os << endl;
+    return print_payload(os, pv.get_data(), pv.get_data_len());
+}
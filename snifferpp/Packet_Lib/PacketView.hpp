@@ -0,0 +1,147 @@
+//
+//  PacketView.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef PacketView_hpp
+#define PacketView_hpp
+
+#include "Packet.hpp"
+#include "Dissector.hpp"
+
+/*
+ For checking that accesses to a PacketView's network header are for the header it has
+ */
+class WrongNetworkProtocol : public std::exception {
+private:
+    std::string message;
+public:
+    WrongNetworkProtocol() :message{} {};
+    WrongNetworkProtocol(std::string m) :message{m} {};
+
+    const char * what(void) {
+        message += "Attempted to access header for incorrect network protocol";
+        return message.c_str();
+    }
+};
+
+/*
+ Non-owning counterpart of WrappedHeader: points at a header sitting in someone else's buffer (a BPFDevice buffer, a mapped ring, ...)
+
+ Never allocates or copies. Only valid for as long as the underlying buffer is, use to_wrapped() to keep a copy past that
+ */
+template <typename StandardHeader>
+class HeaderView {
+private:
+    const StandardHeader* sth;
+
+public:
+    HeaderView() :sth{nullptr} {};
+    HeaderView(const byte_t* buffer) :sth{reinterpret_cast<const StandardHeader*>(buffer)} {};
+
+    bool empty(void) const { return sth == nullptr; }
+
+    const StandardHeader& get_header(void) const { return *sth; }
+    const StandardHeader* operator->(void) const { return sth; }
+
+    const byte_t* get_bytes(void) const { return reinterpret_cast<const byte_t*>(sth); }
+    size_t get_len(void) const { return sizeof(StandardHeader); }
+
+    /*
+     Owning copy of the header
+     */
+    WrappedHeader<StandardHeader> to_wrapped(void) const {
+        std::unique_ptr<StandardHeader> h {new StandardHeader{}};
+        memcpy(h.get(), sth, sizeof(StandardHeader));
+        return WrappedHeader<StandardHeader> {std::move(h)};
+    }
+
+    /*
+     Copy of the header in arena, valid until its reset()
+     */
+    WrappedHeader<StandardHeader> to_wrapped(PacketArena& arena) const {
+        return WrappedHeader<StandardHeader> {*sth, arena};
+    }
+};
+
+/*
+ A packet parsed in place over a capture buffer: records where each header starts instead of copying it out.
+ Constructing one does no allocation (see view_packet and parse_packet in packet_sniffer.hpp); to_packet() gives the
+ owning Packet when one is needed.
+
+ One from parse_packet may be only partly decoded (get_parse_status() is not OK): the layers before the failure can
+ still be read, the kinds after it are OTHER / NONE.
+
+ Accessors are checked: asking for a header the packet does not have throws WrongNetworkProtocol or
+ WrongTransportProtocol, as TransportHeader does. Like HeaderView, only valid while the underlying buffer is.
+ */
+class PacketView {
+private:
+    Dissection layers;
+
+public:
+    PacketView(const Dissection& layers) :layers{layers} {};
+
+    bool ok(void) const { return layers.status == ParseStatus::OK; }
+    ParseStatus get_parse_status(void) const { return layers.status; }
+    ParseLayer get_failed_layer(void) const { return layers.failed_layer; }
+    const char* get_parse_error(void) const { return layers.error != nullptr ? layers.error : ""; }
+
+    HeaderView<ether_header> get_ether_header(void) const { return HeaderView<ether_header> {layers.buffer}; }
+
+    // 802.1Q / 802.1ad tags, outermost first
+    size_t get_vlan_count(void) const { return layers.vlan_count; }
+    uint16_t get_vlan_id(size_t i) const { return layers.vlan_ids[i]; }
+
+    // EtherType of the network layer, inside any VLAN tags (host order)
+    uint16_t get_ether_type(void) const { return layers.ether_type; }
+    NetworkKind get_network_kind(void) const { return layers.network; }
+    HeaderView<ip> get_ip_header(void) const;
+    HeaderView<ip6_hdr> get_ip6_header(void) const;
+    HeaderView<ether_arp> get_arp_header(void) const;
+
+    TransportKind get_transport_kind(void) const { return layers.transport; }
+    int get_protocol(void) const { return layers.protocol; }
+    HeaderView<tcphdr> get_tcp_header(void) const;
+    HeaderView<udphdr> get_udp_header(void) const;
+    HeaderView<icmp_header> get_icmp_header(void) const; // ICMP or ICMPv6
+
+    // Payload (everything after the transport header, or the network header if there is none)
+    const byte_t* get_data(void) const { return layers.buffer+layers.data_offset; }
+    size_t get_data_len(void) const { return layers.len-layers.data_offset; }
+
+    // The whole packet, from the ethernet header on
+    const byte_t* get_bytes(void) const { return layers.buffer; }
+    size_t get_len(void) const { return layers.len; }
+
+    // Whether to_packet() can copy this one out: Packet only holds TCP and UDP over IPv4
+    bool fits_packet(void) const {
+        return layers.network == NetworkKind::IPV4 && (layers.transport == TransportKind::TCP || layers.transport == TransportKind::UDP);
+    }
+
+    /*
+     Copies the headers and payload out into an owning Packet
+     Anything fits_packet() turns down throws WrongNetworkProtocol or WrongTransportProtocol
+     */
+    Packet to_packet(void) const;
+
+    /*
+     Same, but everything is copied into arena (no heap allocation once the arena has grown to a batch's worth)
+     */
+    Packet to_packet(PacketArena& arena) const;
+};
+
+/*
+ Same layout as the Packet/PacketHeader output, but reads straight from the buffer
+ */
+template <typename StandardHeader>
+std::ostream& operator<<(std::ostream& os, const HeaderView<StandardHeader>& hv) {
+    return os << hv.get_header();
+}
+
+std::ostream& operator<<(std::ostream& os, const PacketView& pv);
+
+#endif /* PacketView_hpp */
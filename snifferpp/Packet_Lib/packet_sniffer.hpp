@@ -14,6 +14,10 @@
 #include <string>
 #include "standard_headers.hpp"
 #include "Packet.hpp"
+#include "PacketView.hpp"
+#include "CaptureCounters.hpp"
+#include "LatencyHistogram.hpp"
+#include "Log.hpp"
 
 /*
  For Flagging that the sniffer has encountered a transport protocol it does not support
@@ -51,8 +55,38 @@ public:
 };
 
 /*
- Attempts to strip a TCP or UDP packet from the buffer
-    If the IP header suggests an alternate packet, throws UnsupportedProtocolPacket
+ Parses a packet in place, without copying anything out of the buffer (see try_dissect in Dissector.hpp for the
+ protocols understood). Never throws or allocates, so it costs the same whether or not the packet is one we understand:
+ check ok() / get_parse_status() on the result. Failures are counted, by status, in the calling thread's CaptureCounters
+ 
+ Inputs:    buffer: pointer to the start of the packet (the ethernet header). Caller keeps ownership,
+                        and the returned view is only valid while the buffer is.
+            buff_len: size of the data on the buffer
+ 
+ Return:    PacketView (as declared in PacketView.hpp), decoded as far as it could be
+*/
+PacketView parse_packet(const byte_t* buffer, size_t buffer_len);
+
+/*
+ parse_packet for callers that would rather catch
+    If the EtherType or an IP protocol on the way has no dissector, throws UnsupportedProtocol
+    If a header length points past the end of the buffer, throws InvalidInput
+    Either is also counted in the calling thread's CaptureCounters
+ 
+ Inputs:    buffer: pointer to the start of the packet (the ethernet header). Caller keeps ownership,
+                        and the returned view is only valid while the buffer is.
+            buff_len: size of the data on the buffer
+ 
+ Return:    PacketView (as declared in PacketView.hpp)
+*/
+PacketView view_packet(const byte_t* buffer, size_t buffer_len);
+
+/*
+ Attempts to strip a TCP or UDP over IPv4 packet from the buffer
+    For anything else view_packet accepts, throws UnsupportedProtocol (parse_packet and fits_packet() check first
+    without throwing)
+ 
+ Owning version of view_packet: the headers and payload are copied out into the Packet.
  
  Inputs:    buffer: unique_ptr to byte_t buffer containing the packet.
             buff_len: size of the data on the buffer (to be used to check whether
@@ -62,4 +96,10 @@ public:
 */
 Packet strip_packet(std::unique_ptr<byte_t> buffer, size_t buffer_len);
 
+/*
+ strip_packet drawing from a PacketArena instead of the heap, for buffers the caller keeps alive
+ (e.g. from readPacket(arena) on a device). The Packet is only valid until the arena's reset()
+*/
+Packet strip_packet(const byte_t* buffer, size_t buffer_len, PacketArena& arena);
+
 #endif /* packet_sniffer_hpp */
@@ -106,3 +106,69 @@ ostream& operator<<(ostream& os, const tcphdr& tcp) {
     os.copyfmt(tmp);
     return os;
 }
+
+ostream& operator<<(ostream& os, const ip6_hdr& ip6) {
+    std::ios tmp {NULL};
+    tmp.copyfmt(os);
+    uint32_t flow = ntohl(ip6.ip6_flow);
+    char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+    inet_ntop(AF_INET6, &ip6.ip6_src, src, sizeof(src));
+    inet_ntop(AF_INET6, &ip6.ip6_dst, dst, sizeof(dst));
+    os << "IPv6 Header" << endl;
+    os << "\t|-Version: " << (flow >> 28) << endl;
+    os << "\t|-Traffic Class: " << ((flow >> 20) & 0xff) << endl;
+    os << "\t|-Flow Label: " << (flow & 0xfffff) << endl;
+    os << "\t|-Payload Length: " << ntohs(ip6.ip6_plen) << endl;
+    os << "\t|-Next Header: " << +ip6.ip6_nxt << endl;
+    os << "\t|-Hop Limit: " << +ip6.ip6_hlim << endl;
+    os << "\t|-Source IP: " << src << endl;
+    os << "\t|-Destination IP: " << dst << endl;
+    os << endl;
+    os.copyfmt(tmp);
+    return os;
+}
+
+ostream& operator<<(ostream& os, const ether_arp& arp) {
+    std::ios tmp {NULL};
+    tmp.copyfmt(os);
+    char sender[INET_ADDRSTRLEN], target[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, arp.arp_spa, sender, sizeof(sender));
+    inet_ntop(AF_INET, arp.arp_tpa, target, sizeof(target));
+    os << "ARP Header" << endl;
+    os << "\t|-Hardware Type: " << ntohs(arp.arp_hrd) << endl;
+    os << "\t|-Protocol Type: " << ntohs(arp.arp_pro) << endl;
+    os << "\t|-Operation: " << ntohs(arp.arp_op) << endl;
+    os << "\t|-Sender Address: ";
+    for(int i = 0; i < ETHER_ADDR_LEN; ++i){
+        os << std::setfill('0') << std::setw(2) << std::hex << (0xff & arp.arp_sha[i]);
+        if(i < ETHER_ADDR_LEN-1){
+            os << ":";
+        }
+    }
+    os << std::dec << endl;
+    os << "\t|-Sender IP: " << sender << endl;
+    os << "\t|-Target Address: ";
+    for(int i = 0; i < ETHER_ADDR_LEN; ++i){
+        os << std::setfill('0') << std::setw(2) << std::hex << (0xff & arp.arp_tha[i]);
+        if(i < ETHER_ADDR_LEN-1){
+            os << ":";
+        }
+    }
+    os << std::dec << endl;
+    os << "\t|-Target IP: " << target << endl;
+    os << endl;
+    os.copyfmt(tmp);
+    return os;
+}
+
+ostream& operator<<(ostream& os, const icmp_header& icmp) {
+    std::ios tmp {NULL};
+    tmp.copyfmt(os);
+    os << "ICMP Header" << endl;
+    os << "\t|-Type: " << +icmp.icmp_type << endl;
+    os << "\t|-Code: " << +icmp.icmp_code << endl;
+    os << "\t|-Checksum: " << icmp.icmp_cksum << endl;
+    os << endl;
+    os.copyfmt(tmp);
+    return os;
+}
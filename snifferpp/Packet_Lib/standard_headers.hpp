@@ -14,15 +14,56 @@
 #include <exception>
 #include <cstdlib>
 #include <iomanip>
+#include <memory>
+#include <cstring>
 #include <arpa/inet.h>
 #include <netinet/if_ether.h>
 #include <netinet/ip.h>
+#include <netinet/ip6.h>
 #include <netinet/tcp.h>
 #include <netinet/udp.h>
 #include <arpa/inet.h>
 
 using byte_t = char; // Used by the entire library to represent packet data
 
+const size_t CACHE_LINE_LEN = 64; // For keeping data written by different threads on separate lines
+
+// glibc's netinet/tcp.h stops at TH_URG
+#ifndef TH_ECE
+#define TH_ECE 0x40
+#endif
+#ifndef TH_CWR
+#define TH_CWR 0x80
+#endif
+
+// EtherTypes we dissect that not every platform names
+#ifndef ETHERTYPE_IPV6
+#define ETHERTYPE_IPV6 0x86dd
+#endif
+#ifndef ETHERTYPE_VLAN
+#define ETHERTYPE_VLAN 0x8100
+#endif
+#define ETHERTYPE_QINQ 0x88a8 // 802.1ad service tag
+#define ETHERTYPE_QINQ_OLD 0x9100 // Pre-standard QinQ, still seen on older switches
+
+/*
+ The first 8 bytes of every ICMP and ICMPv6 message (what follows depends on the type)
+ */
+struct icmp_header {
+    uint8_t icmp_type;
+    uint8_t icmp_code;
+    uint16_t icmp_cksum;
+    uint32_t icmp_rest;
+};
+
+/*
+ An 802.1Q / 802.1ad tag, after the EtherType (TPID) that announced it
+ */
+struct vlan_tag {
+    uint16_t vlan_tci; // Priority, drop eligible bit and the 12 bit VLAN ID
+    uint16_t vlan_type; // EtherType of what follows
+};
+
 // Overload output functions for headers
 std::ostream& operator<<(std::ostream& os, const ether_header& eth);
 
@@ -32,6 +73,12 @@ std::ostream& operator<<(std::ostream& os, const udphdr& udp);
 
 std::ostream& operator<<(std::ostream& os, const tcphdr& tcp);
 
+std::ostream& operator<<(std::ostream& os, const ip6_hdr& ip6);
+
+std::ostream& operator<<(std::ostream& os, const ether_arp& arp);
+
+std::ostream& operator<<(std::ostream& os, const icmp_header& icmp);
+
 /*
  Strip Packet Headers from the start of the buffer -- caller responsibility for passing a pointer to the correct starting point
  
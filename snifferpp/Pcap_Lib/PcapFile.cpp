@@ -0,0 +1,327 @@
+//
+//  PcapFile.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include "PcapFile.hpp"
+
+using std::string;
+using std::to_string;
+
+// pcap
+const uint32_t PCAP_MAGIC_USEC = 0xa1b2c3d4;
+const uint32_t PCAP_MAGIC_NSEC = 0xa1b23c4d;
+const size_t PCAP_FILE_HEADER_LEN = 24;
+const size_t PCAP_RECORD_HEADER_LEN = 16;
+const uint16_t LINKTYPE_ETHERNET = 1; // DLT_EN10MB, the only framing the dissector understands
+
+// pcapng
+const uint32_t PCAPNG_SHB = 0x0A0D0D0A;
+const uint32_t PCAPNG_IDB = 0x00000001;
+const uint32_t PCAPNG_PB = 0x00000002; // Obsolete packet block
+const uint32_t PCAPNG_SPB = 0x00000003;
+const uint32_t PCAPNG_EPB = 0x00000006;
+const uint32_t PCAPNG_BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+const uint16_t PCAPNG_OPT_ENDOFOPT = 0;
+const uint16_t PCAPNG_OPT_IF_TSRESOL = 9;
+const uint16_t PCAPNG_OPT_IF_TSOFFSET = 14;
+const size_t PCAPNG_BLOCK_OVERHEAD = 12; // Type, and the total length at both ends
+
+const uint64_t NSEC_PER_SEC = 1000000000;
+
+PcapFile::PcapFile(string p) :fd{-1}, path{p}, map{nullptr}, map_len{0}, offset{0}, format{Format::PCAP}, swapped{false} {
+    if ((fd = open(path.c_str(), O_RDONLY)) == -1) {
+        string m {"Opening " + path + ": "};
+        m += strerror(errno);
+        m += "\n";
+        throw PcapFileNotOpened {m};
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        string m {"Reading size of " + path + ": "};
+        m += strerror(errno);
+        m += "\n";
+        close();
+        throw PcapFileNotOpened {m};
+    }
+    map_len = st.st_size;
+    if (map_len < sizeof(uint32_t)) {
+        close();
+        throw PcapFileNotOpened {"Empty file " + path + ": "};
+    }
+
+    void* mapped = mmap(nullptr, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+        string m {"Mapping " + path + ": "};
+        m += strerror(errno);
+        m += "\n";
+        close();
+        throw PcapFileNotOpened {m};
+    }
+    map = static_cast<const byte_t*>(mapped);
+    madvise(mapped, map_len, MADV_SEQUENTIAL);
+
+    rewind();
+}
+
+void PcapFile::rewind() {
+    offset = 0;
+    swapped = false;
+    interfaces.clear();
+
+    uint32_t magic;
+    memcpy(&magic, map, sizeof(magic));
+    if (magic == PCAPNG_SHB) {
+        // Byte order is set per section, when we read the section header
+        format = Format::PCAPNG;
+        return;
+    }
+
+    format = Format::PCAP;
+    read_pcap_header();
+}
+
+void PcapFile::read_pcap_header() {
+    if (map_len < PCAP_FILE_HEADER_LEN) {
+        close();
+        throw PcapFileNotOpened {"Short pcap header in " + path + ": "};
+    }
+
+    uint32_t magic;
+    memcpy(&magic, map, sizeof(magic));
+    swapped = (magic == __builtin_bswap32(PCAP_MAGIC_USEC) || magic == __builtin_bswap32(PCAP_MAGIC_NSEC));
+    magic = read_u32(map);
+    if (magic != PCAP_MAGIC_USEC && magic != PCAP_MAGIC_NSEC) {
+        close();
+        throw PcapFileNotOpened {"Not a pcap or pcapng file " + path + ": "};
+    }
+
+    Interface iface;
+    iface.snaplen = read_u32(map + 16);
+    iface.link_type = static_cast<uint16_t>(read_u32(map + 20));
+    if (iface.link_type != LINKTYPE_ETHERNET) {
+        close();
+        throw MalformedPcap {"Link type " + to_string(iface.link_type) + " of " + path + " is not Ethernet: "};
+    }
+    iface.units_per_sec = (magic == PCAP_MAGIC_NSEC) ? NSEC_PER_SEC : 1000000;
+    iface.ts_offset = 0;
+    interfaces.push_back(iface);
+
+    offset = PCAP_FILE_HEADER_LEN;
+}
+
+PcapRecord PcapFile::make_record(const byte_t* data, uint32_t caplen, uint32_t origlen, uint32_t interface_id, uint64_t ts) const {
+    const Interface& iface = interfaces[interface_id];
+    uint64_t sec = ts / iface.units_per_sec;
+    uint64_t frac = ts % iface.units_per_sec;
+
+    // frac * 1e9 overflows for resolutions finer than ~10^-10, so scale those down instead
+    uint32_t nsec;
+    if (iface.units_per_sec <= NSEC_PER_SEC) {
+        nsec = static_cast<uint32_t>(frac * (NSEC_PER_SEC / iface.units_per_sec));
+    } else {
+        nsec = static_cast<uint32_t>(frac / (iface.units_per_sec / NSEC_PER_SEC));
+    }
+    return PcapRecord {data, caplen, origlen, sec + iface.ts_offset, nsec, interface_id, iface.link_type};
+}
+
+bool PcapFile::next_pcap(PcapRecord& out) {
+    if (offset + PCAP_RECORD_HEADER_LEN > map_len) {
+        return false;
+    }
+    const byte_t* rec = map + offset;
+    uint32_t ts_sec = read_u32(rec);
+    uint32_t ts_frac = read_u32(rec + 4);
+    uint32_t caplen = read_u32(rec + 8);
+    uint32_t origlen = read_u32(rec + 12);
+    if (offset + PCAP_RECORD_HEADER_LEN + caplen > map_len) {
+        return false;
+    }
+
+    const Interface& iface = interfaces[0];
+    out = PcapRecord {rec + PCAP_RECORD_HEADER_LEN, caplen, origlen, ts_sec, static_cast<uint32_t>(ts_frac * (NSEC_PER_SEC / iface.units_per_sec)), 0, iface.link_type};
+    offset += PCAP_RECORD_HEADER_LEN + caplen;
+    return true;
+}
+
+void PcapFile::read_section_header(const byte_t* block, size_t block_len) {
+    if (block_len < PCAPNG_BLOCK_OVERHEAD + 4) {
+        throw MalformedPcap {"Section header at offset " + to_string(offset) + ": "};
+    }
+    uint32_t bom;
+    memcpy(&bom, block + 8, sizeof(bom));
+    if (bom == PCAPNG_BYTE_ORDER_MAGIC) {
+        swapped = false;
+    } else if (bom == __builtin_bswap32(PCAPNG_BYTE_ORDER_MAGIC)) {
+        swapped = true;
+    } else {
+        throw MalformedPcap {"Byte order magic at offset " + to_string(offset) + ": "};
+    }
+    // Interface ids are per section
+    interfaces.clear();
+}
+
+void PcapFile::read_interface(const byte_t* block, size_t block_len) {
+    if (block_len < PCAPNG_BLOCK_OVERHEAD + 8) {
+        throw MalformedPcap {"Interface description at offset " + to_string(offset) + ": "};
+    }
+    Interface iface;
+    iface.link_type = read_u16(block + 8);
+    if (iface.link_type != LINKTYPE_ETHERNET) {
+        throw MalformedPcap {"Link type " + to_string(iface.link_type) + " of interface " + to_string(interfaces.size()) + " at offset " + to_string(offset) + " is not Ethernet: "};
+    }
+    iface.snaplen = read_u32(block + 12);
+    iface.units_per_sec = 1000000; // Default resolution is microseconds
+    iface.ts_offset = 0;
+
+    // Options run from after the fixed fields up to the trailing length
+    const byte_t* opt = block + 16;
+    const byte_t* opt_end = block + block_len - 4;
+    while (opt + 4 <= opt_end) {
+        uint16_t code = read_u16(opt);
+        uint16_t len = read_u16(opt + 2);
+        const byte_t* value = opt + 4;
+        if (code == PCAPNG_OPT_ENDOFOPT || value + len > opt_end) {
+            break;
+        }
+        if (code == PCAPNG_OPT_IF_TSRESOL && len >= 1) {
+            uint8_t resol = static_cast<uint8_t>(value[0]);
+            uint8_t exponent = resol & 0x7f;
+            if (resol & 0x80) {
+                iface.units_per_sec = (exponent < 64) ? (uint64_t {1} << exponent) : 1;
+            } else {
+                iface.units_per_sec = 1;
+                for (uint8_t i = 0; i < exponent && i < 19; ++i) {
+                    iface.units_per_sec *= 10;
+                }
+            }
+        } else if (code == PCAPNG_OPT_IF_TSOFFSET && len >= 8) {
+            // A single 64 bit value in file byte order
+            uint64_t v;
+            memcpy(&v, value, sizeof(v));
+            iface.ts_offset = static_cast<int64_t>(swapped ? __builtin_bswap64(v) : v);
+        }
+        opt = value + ((len + 3) & ~3); // Options are padded to 32 bits
+    }
+    interfaces.push_back(iface);
+}
+
+bool PcapFile::next_pcapng(PcapRecord& out) {
+    while (offset + PCAPNG_BLOCK_OVERHEAD <= map_len) {
+        const byte_t* block = map + offset;
+
+        uint32_t type;
+        memcpy(&type, block, sizeof(type)); // The section header magic reads the same in either byte order
+        if (type == PCAPNG_SHB) {
+            uint32_t bom;
+            memcpy(&bom, block + 8, sizeof(bom));
+            swapped = (bom == __builtin_bswap32(PCAPNG_BYTE_ORDER_MAGIC));
+        } else {
+            type = read_u32(block);
+        }
+
+        uint32_t block_len = read_u32(block + 4);
+        if (block_len < PCAPNG_BLOCK_OVERHEAD || block_len % 4 != 0) {
+            throw MalformedPcap {"Block length " + to_string(block_len) + " at offset " + to_string(offset) + ": "};
+        }
+        if (offset + block_len > map_len) {
+            return false; // Cut off by the end of the file
+        }
+
+        switch (type) {
+            case PCAPNG_SHB:
+                read_section_header(block, block_len);
+                break;
+            case PCAPNG_IDB:
+                read_interface(block, block_len);
+                break;
+            case PCAPNG_EPB: {
+                if (block_len < PCAPNG_BLOCK_OVERHEAD + 20) {
+                    throw MalformedPcap {"Enhanced packet block at offset " + to_string(offset) + ": "};
+                }
+                uint32_t interface_id = read_u32(block + 8);
+                uint64_t ts = (uint64_t {read_u32(block + 12)} << 32) | read_u32(block + 16);
+                uint32_t caplen = read_u32(block + 20);
+                uint32_t origlen = read_u32(block + 24);
+                if (interface_id >= interfaces.size() || caplen > block_len - 32) {
+                    throw MalformedPcap {"Enhanced packet block at offset " + to_string(offset) + ": "};
+                }
+                out = make_record(block + 28, caplen, origlen, interface_id, ts);
+                offset += block_len;
+                return true;
+            }
+            case PCAPNG_SPB: {
+                if (block_len < PCAPNG_BLOCK_OVERHEAD + 4 || interfaces.empty()) {
+                    throw MalformedPcap {"Simple packet block at offset " + to_string(offset) + ": "};
+                }
+                // No caplen field: it is whatever fits in the block, bounded by the snaplen
+                uint32_t origlen = read_u32(block + 8);
+                uint32_t caplen = std::min<uint32_t>(origlen, block_len - PCAPNG_BLOCK_OVERHEAD - 4);
+                if (interfaces[0].snaplen != 0) {
+                    caplen = std::min(caplen, interfaces[0].snaplen);
+                }
+                // No timestamp either
+                out = PcapRecord {block + 12, caplen, origlen, 0, 0, 0, interfaces[0].link_type};
+                offset += block_len;
+                return true;
+            }
+            case PCAPNG_PB: {
+                if (block_len < PCAPNG_BLOCK_OVERHEAD + 20) {
+                    throw MalformedPcap {"Packet block at offset " + to_string(offset) + ": "};
+                }
+                uint32_t interface_id = read_u16(block + 8);
+                uint64_t ts = (uint64_t {read_u32(block + 12)} << 32) | read_u32(block + 16);
+                uint32_t caplen = read_u32(block + 20);
+                uint32_t origlen = read_u32(block + 24);
+                if (interface_id >= interfaces.size() || caplen > block_len - 32) {
+                    throw MalformedPcap {"Packet block at offset " + to_string(offset) + ": "};
+                }
+                out = make_record(block + 28, caplen, origlen, interface_id, ts);
+                offset += block_len;
+                return true;
+            }
+            default:
+                // Name resolution, statistics, custom blocks, ...
+                break;
+        }
+        offset += block_len;
+    }
+    return false;
+}
+
+bool PcapFile::next(PcapRecord& out) {
+    if (format == Format::PCAPNG) {
+        return next_pcapng(out);
+    }
+    return next_pcap(out);
+}
+
+PcapBatch PcapFile::readBatch() {
+    return PcapBatch {this};
+}
+
+string PcapFile::get_device_name() {
+    return path;
+}
+
+size_t PcapFile::get_len() {
+    return map_len;
+}
+
+size_t PcapFile::get_curr_bytes_consumed() {
+    return offset;
+}
+
+// PcapBatch
+PcapBatch::iterator::iterator(PcapFile* file) :file{file}, done{false} {
+    done = !file->next(curr);
+}
+
+PcapBatch::iterator& PcapBatch::iterator::operator++() {
+    done = !file->next(curr);
+    return *this;
+}
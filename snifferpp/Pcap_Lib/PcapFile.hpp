@@ -0,0 +1,235 @@
+//
+//  PcapFile.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef PcapFile_hpp
+#define PcapFile_hpp
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <exception>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Packet.hpp"
+#include "BPFPacket.hpp"
+
+/*
+ Used to signal that a capture file could not be opened or is not a pcap/pcapng file
+ */
+class PcapFileNotOpened : public std::exception {
+private:
+    std::string message;
+public:
+    PcapFileNotOpened() {};
+    PcapFileNotOpened(std::string m) :message{m} {};
+
+    const char * what() {
+        message += "Capture file not opened";
+        return message.c_str();
+    }
+};
+
+/*
+ Used to signal a record or block whose lengths do not fit in the file
+ */
+class MalformedPcap : public std::exception {
+private:
+    std::string message;
+public:
+    MalformedPcap() {};
+    MalformedPcap(std::string m) :message{m} {};
+
+    const char * what() {
+        message += "Malformed capture file";
+        return message.c_str();
+    }
+};
+
+/*
+ One packet of a capture file, read in place out of the mapping. Same accessors as BPFRecord so it feeds the same parse path
+
+ Non-owning, only valid while the PcapFile is alive
+ */
+class PcapRecord {
+private:
+    const byte_t* data;
+    uint32_t caplen, origlen;
+    uint64_t ts_sec;
+    uint32_t ts_nsec;
+    uint32_t interface_id;
+    uint16_t link_type;
+
+public:
+    PcapRecord() :data{nullptr}, caplen{0}, origlen{0}, ts_sec{0}, ts_nsec{0}, interface_id{0}, link_type{0} {};
+    PcapRecord(const byte_t* data, uint32_t caplen, uint32_t origlen, uint64_t ts_sec, uint32_t ts_nsec, uint32_t interface_id, uint16_t link_type) :data{data}, caplen{caplen}, origlen{origlen}, ts_sec{ts_sec}, ts_nsec{ts_nsec}, interface_id{interface_id}, link_type{link_type} {};
+
+    /*
+     Built on the fly from the record (by value, no allocation), sub-microsecond precision is dropped
+     */
+    bpf_hdr get_bpf_header(void) const {
+        bpf_hdr bhdr;
+        memset(&bhdr, 0, sizeof(bhdr));
+        bhdr.bh_tstamp.tv_sec = ts_sec;
+        bhdr.bh_tstamp.tv_usec = ts_nsec / 1000;
+        bhdr.bh_caplen = caplen;
+        bhdr.bh_datalen = origlen;
+        bhdr.bh_hdrlen = sizeof(bpf_hdr);
+        return bhdr;
+    }
+
+    // Just the underlying packet
+    const byte_t* get_data(void) const { return data; }
+    size_t get_data_len(void) const { return caplen; }
+
+    // Whether the capture was cut short of the original packet length
+    bool is_truncated(void) const { return caplen != origlen; }
+
+    // Capture files do not record whether checksums were left to the NIC
+    bool is_checksum_partial(void) const { return false; }
+
+    uint64_t get_ts_sec(void) const { return ts_sec; }
+    uint32_t get_ts_nsec(void) const { return ts_nsec; }
+    uint32_t get_interface_id(void) const { return interface_id; }
+    uint16_t get_link_type(void) const { return link_type; }
+};
+
+class PcapFile;
+
+/*
+ Iterable range over the records left in a PcapFile. Single pass: iterating moves the file along with it
+ */
+class PcapBatch {
+private:
+    PcapFile* file;
+
+public:
+    class iterator {
+    private:
+        PcapFile* file;
+        PcapRecord curr;
+        bool done;
+    public:
+        iterator() :file{nullptr}, done{true} {};
+        iterator(PcapFile* file);
+
+        const PcapRecord& operator*(void) const { return curr; }
+        iterator& operator++(void);
+
+        bool operator!=(const iterator& other) const { return done != other.done; }
+        bool operator==(const iterator& other) const { return done == other.done; }
+    };
+
+    PcapBatch(PcapFile* file) :file{file} {};
+
+    iterator begin(void) const { return iterator {file}; }
+    iterator end(void) const { return iterator {}; }
+};
+
+/*
+ Offline capture source: a pcap or pcapng file mapped into memory, with records handed out in place (no read() or copy per packet)
+
+ Handles both byte orders, microsecond and nanosecond pcap files, and for pcapng any number of sections and interfaces
+ (each with its own link type and if_tsresol / if_tsoffset). Enhanced, simple and obsolete packet blocks are returned;
+ every other block type is skipped.
+
+ Only Ethernet captures (LINKTYPE_ETHERNET) are read: the packets go to the Ethernet dissector, which would fail every
+ one of a raw IP or Linux cooked capture. A pcap file of any other link type throws MalformedPcap when opened, a pcapng
+ one when its interface description is reached.
+ */
+class PcapFile {
+private:
+    /*
+     What we need to know about a pcapng interface description block to decode its packets
+     */
+    struct Interface {
+        uint16_t link_type;
+        uint32_t snaplen;
+        uint64_t units_per_sec; // From if_tsresol
+        int64_t ts_offset; // From if_tsoffset, seconds
+    };
+
+    enum class Format {PCAP, PCAPNG};
+
+    int fd;
+    std::string path;
+    const byte_t* map;
+    size_t map_len;
+    size_t offset; // Next unread byte
+    Format format;
+    bool swapped; // File byte order differs from ours
+
+    // pcap: the one implicit interface. pcapng: the interfaces of the current section
+    std::vector<Interface> interfaces;
+
+    void close(void) {
+        if (map != nullptr) {
+            munmap(const_cast<byte_t*>(map), map_len);
+            map = nullptr;
+        }
+        if (fd != -1) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    uint16_t read_u16(const byte_t* p) const {
+        uint16_t v;
+        memcpy(&v, p, sizeof(v));
+        return swapped ? __builtin_bswap16(v) : v;
+    }
+
+    uint32_t read_u32(const byte_t* p) const {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return swapped ? __builtin_bswap32(v) : v;
+    }
+
+    void read_pcap_header(void);
+    bool next_pcap(PcapRecord& out);
+
+    void read_section_header(const byte_t* block, size_t block_len);
+    void read_interface(const byte_t* block, size_t block_len);
+    bool next_pcapng(PcapRecord& out);
+
+    PcapRecord make_record(const byte_t* data, uint32_t caplen, uint32_t origlen, uint32_t interface_id, uint64_t ts) const;
+
+public:
+    // Throws PcapFileNotOpened, or MalformedPcap for a pcap file that is not Ethernet
+    PcapFile(std::string path);
+
+    PcapFile(const PcapFile& other)= delete;
+    PcapFile operator=(const PcapFile& other)=delete;
+
+    ~PcapFile() {
+        close();
+    }
+
+    std::string get_device_name(void);
+    size_t get_len(void);
+    size_t get_curr_bytes_consumed(void);
+
+    /*
+     Fills out with the next packet record, returns false at the end of the file
+     A record cut short by the end of the file (e.g. a capture still being written) counts as the end
+     Throws MalformedPcap on a block that does not fit, or a pcapng interface that is not Ethernet
+     */
+    bool next(PcapRecord& out);
+
+    /*
+     Every record left in the file
+     */
+    PcapBatch readBatch(void);
+
+    // Back to the first record
+    void rewind(void);
+};
+
+#endif /* PcapFile_hpp */
@@ -0,0 +1,321 @@
+//
+//  PcapWriter.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include "PcapWriter.hpp"
+
+using std::string;
+using std::to_string;
+using std::cerr;
+using std::endl;
+
+const size_t BUFFER_ALIGNMENT = 4096;
+
+const uint32_t PCAP_MAGIC_NSEC = 0xa1b23c4d;
+const size_t PCAP_FILE_HEADER_LEN = 24;
+const size_t PCAP_RECORD_HEADER_LEN = 16;
+
+const uint32_t PCAPNG_SHB = 0x0A0D0D0A;
+const uint32_t PCAPNG_IDB = 0x00000001;
+const uint32_t PCAPNG_EPB = 0x00000006;
+const uint32_t PCAPNG_BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+const size_t PCAPNG_SHB_LEN = 28;
+const size_t PCAPNG_IDB_LEN = 32; // Carries if_tsresol = 9 (nanoseconds)
+const size_t PCAPNG_EPB_OVERHEAD = 32;
+
+// Helpers for laying out little fixed fields, in our byte order (readers cope with either)
+static byte_t* put_u16(byte_t* p, uint16_t v) { memcpy(p, &v, sizeof(v)); return p + sizeof(v); }
+static byte_t* put_u32(byte_t* p, uint32_t v) { memcpy(p, &v, sizeof(v)); return p + sizeof(v); }
+
+PcapWriter::PcapWriter(string p, PcapWriterOptions o) :path{p}, opts{o}, full_head{0}, full_count{0}, stopping{false}, curr{NO_BUFFER}, pending_new_file{true}, file_bytes{0}, file_start_sec{0}, dropped_bytes{0}, dropped_packets{0}, fd{-1}, file_index{0}, written_bytes{0}, write_errors{0}, files_opened{0} {
+    if (opts.buffer_count == 0) {
+        opts.buffer_count = 1;
+    }
+    // Every buffer has to fit a file header plus the largest record we'll write
+    size_t min_len = file_header_len() + record_len(opts.snaplen);
+    if (opts.buffer_len < min_len) {
+        opts.buffer_len = min_len;
+    }
+    opts.buffer_len = ((opts.buffer_len + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT) * BUFFER_ALIGNMENT;
+
+    buffers.reserve(opts.buffer_count);
+    free_list.reserve(opts.buffer_count);
+    full.resize(opts.buffer_count);
+    for (size_t i = 0; i < opts.buffer_count; ++i) {
+        void* mem = nullptr;
+        if (posix_memalign(&mem, BUFFER_ALIGNMENT, opts.buffer_len) != 0) {
+            for (Buffer& b : buffers) {
+                free(b.data);
+            }
+            throw PcapWriterNotOpened {"Allocating write buffers: "};
+        }
+        buffers.push_back(Buffer {static_cast<byte_t*>(mem), 0, false});
+        free_list.push_back(i);
+    }
+
+    // Open the first file up front so a bad path shows up here rather than on the writer thread
+    open_next_file();
+    if (fd == -1) {
+        for (Buffer& b : buffers) {
+            free(b.data);
+        }
+        buffers.clear();
+        string m {"Opening " + path + ": "};
+        m += strerror(errno);
+        m += "\n";
+        throw PcapWriterNotOpened {m};
+    }
+
+    writer = std::thread {&PcapWriter::run, this};
+}
+
+size_t PcapWriter::file_header_len() const {
+    if (opts.format == PcapFormat::PCAPNG) {
+        return PCAPNG_SHB_LEN + PCAPNG_IDB_LEN;
+    }
+    return PCAP_FILE_HEADER_LEN;
+}
+
+size_t PcapWriter::record_len(uint32_t caplen) const {
+    if (opts.format == PcapFormat::PCAPNG) {
+        return PCAPNG_EPB_OVERHEAD + ((caplen + 3) & ~3u);
+    }
+    return PCAP_RECORD_HEADER_LEN + caplen;
+}
+
+void PcapWriter::put_file_header(Buffer& b) {
+    byte_t* p = b.data + b.len;
+    if (opts.format == PcapFormat::PCAPNG) {
+        // Section header
+        p = put_u32(p, PCAPNG_SHB);
+        p = put_u32(p, PCAPNG_SHB_LEN);
+        p = put_u32(p, PCAPNG_BYTE_ORDER_MAGIC);
+        p = put_u16(p, 1); // Version 1.0
+        p = put_u16(p, 0);
+        p = put_u32(p, 0xffffffff); // Section length not known
+        p = put_u32(p, 0xffffffff);
+        p = put_u32(p, PCAPNG_SHB_LEN);
+
+        // The one interface
+        p = put_u32(p, PCAPNG_IDB);
+        p = put_u32(p, PCAPNG_IDB_LEN);
+        p = put_u16(p, opts.link_type);
+        p = put_u16(p, 0);
+        p = put_u32(p, opts.snaplen);
+        p = put_u16(p, 9); // if_tsresol
+        p = put_u16(p, 1);
+        p = put_u32(p, 9); // 10^-9, padded out to 32 bits
+        p = put_u32(p, 0); // opt_endofopt
+        p = put_u32(p, PCAPNG_IDB_LEN);
+    } else {
+        p = put_u32(p, PCAP_MAGIC_NSEC);
+        p = put_u16(p, 2); // Version 2.4
+        p = put_u16(p, 4);
+        p = put_u32(p, 0); // thiszone
+        p = put_u32(p, 0); // sigfigs
+        p = put_u32(p, opts.snaplen);
+        p = put_u32(p, opts.link_type);
+    }
+    b.len = p - b.data;
+}
+
+void PcapWriter::put_record(Buffer& b, uint64_t ts_sec, uint32_t ts_nsec, const byte_t* data, uint32_t caplen, uint32_t origlen) {
+    byte_t* p = b.data + b.len;
+    if (opts.format == PcapFormat::PCAPNG) {
+        uint32_t padded = (caplen + 3) & ~3u;
+        uint32_t block_len = static_cast<uint32_t>(PCAPNG_EPB_OVERHEAD + padded);
+        uint64_t ts = ts_sec * 1000000000 + ts_nsec;
+        p = put_u32(p, PCAPNG_EPB);
+        p = put_u32(p, block_len);
+        p = put_u32(p, 0); // Interface id
+        p = put_u32(p, static_cast<uint32_t>(ts >> 32));
+        p = put_u32(p, static_cast<uint32_t>(ts));
+        p = put_u32(p, caplen);
+        p = put_u32(p, origlen);
+        memcpy(p, data, caplen);
+        memset(p + caplen, 0, padded - caplen);
+        p = put_u32(p + padded, block_len);
+    } else {
+        p = put_u32(p, static_cast<uint32_t>(ts_sec));
+        p = put_u32(p, ts_nsec);
+        p = put_u32(p, caplen);
+        p = put_u32(p, origlen);
+        memcpy(p, data, caplen);
+        p += caplen;
+    }
+    b.len = p - b.data;
+}
+
+bool PcapWriter::acquire() {
+    std::lock_guard<std::mutex> guard {lock};
+    if (free_list.empty()) {
+        return false;
+    }
+    curr = free_list.back();
+    free_list.pop_back();
+    buffers[curr].len = 0;
+    buffers[curr].new_file = false;
+    return true;
+}
+
+void PcapWriter::submit() {
+    if (curr == NO_BUFFER) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard {lock};
+        full[(full_head + full_count) % full.size()] = curr;
+        ++full_count;
+    }
+    work_ready.notify_one();
+    curr = NO_BUFFER;
+}
+
+bool PcapWriter::write(uint64_t ts_sec, uint32_t ts_nsec, const byte_t* data, uint32_t caplen, uint32_t origlen) {
+    if (caplen > opts.snaplen) {
+        caplen = opts.snaplen;
+    }
+    size_t len = record_len(caplen);
+
+    // Rotate once this record would take the file past its limits (never leaving a file with no records)
+    if (!pending_new_file && file_bytes > file_header_len()) {
+        bool too_big = opts.rotate_bytes != 0 && file_bytes + len > opts.rotate_bytes;
+        bool too_old = opts.rotate_seconds != 0 && ts_sec >= file_start_sec + opts.rotate_seconds;
+        if (too_big || too_old) {
+            submit();
+            pending_new_file = true;
+        }
+    }
+
+    if (curr != NO_BUFFER && buffers[curr].len + len > opts.buffer_len) {
+        submit();
+    }
+    if (curr == NO_BUFFER && !acquire()) {
+        // Writer thread is behind. We are the only thread updating these, so no need for an atomic add
+        dropped_bytes.store(dropped_bytes.load(std::memory_order_relaxed) + len, std::memory_order_relaxed);
+        dropped_packets.store(dropped_packets.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Buffer& b = buffers[curr];
+    if (pending_new_file) {
+        // The first file is already open, every later one starts when the writer thread sees this flag
+        b.new_file = file_bytes != 0;
+        put_file_header(b);
+        pending_new_file = false;
+        file_bytes = file_header_len();
+        file_start_sec = ts_sec;
+    }
+    put_record(b, ts_sec, ts_nsec, data, caplen, origlen);
+    file_bytes += len;
+    return true;
+}
+
+void PcapWriter::flush() {
+    submit();
+}
+
+void PcapWriter::close() {
+    if (!writer.joinable()) {
+        return;
+    }
+    submit();
+    {
+        std::lock_guard<std::mutex> guard {lock};
+        stopping = true;
+    }
+    work_ready.notify_one();
+    writer.join();
+
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+    for (Buffer& b : buffers) {
+        free(b.data);
+    }
+    buffers.clear();
+}
+
+// Writer thread
+void PcapWriter::open_next_file() {
+    if (fd != -1) {
+        ::close(fd);
+    }
+    string name = file_index == 0 ? path : path + "." + to_string(file_index);
+    fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        LOG_ERROR("Could not open %s: %s", name.c_str(), strerror(errno));
+        write_errors.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        files_opened.fetch_add(1, std::memory_order_relaxed);
+    }
+    ++file_index;
+}
+
+void PcapWriter::write_out(const Buffer& b) {
+    if (b.new_file) {
+        open_next_file();
+    }
+    if (fd == -1) {
+        return;
+    }
+    size_t done = 0;
+    while (done < b.len) {
+        ssize_t n = ::write(fd, b.data + done, b.len - done);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Could not write capture file: %s", strerror(errno));
+            write_errors.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        done += n;
+    }
+    written_bytes.fetch_add(b.len, std::memory_order_relaxed);
+}
+
+void PcapWriter::run() {
+    std::unique_lock<std::mutex> guard {lock};
+    for (;;) {
+        work_ready.wait(guard, [this] { return full_count > 0 || stopping; });
+        if (full_count == 0) {
+            return; // Stopping, and everything is written
+        }
+        size_t idx = full[full_head];
+        full_head = (full_head + 1) % full.size();
+        --full_count;
+
+        // Only the disk write happens without the lock
+        guard.unlock();
+        write_out(buffers[idx]);
+        guard.lock();
+
+        free_list.push_back(idx);
+    }
+}
+
+uint64_t PcapWriter::get_dropped_bytes() {
+    return dropped_bytes.load(std::memory_order_relaxed);
+}
+
+uint64_t PcapWriter::get_dropped_packets() {
+    return dropped_packets.load(std::memory_order_relaxed);
+}
+
+uint64_t PcapWriter::get_written_bytes() {
+    return written_bytes.load(std::memory_order_relaxed);
+}
+
+uint64_t PcapWriter::get_write_errors() {
+    return write_errors.load(std::memory_order_relaxed);
+}
+
+unsigned int PcapWriter::get_files_opened() {
+    return files_opened.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,156 @@
+//
+//  PcapWriter.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef PcapWriter_hpp
+#define PcapWriter_hpp
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <exception>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <unistd.h>
+#include <fcntl.h>
+#include "Packet.hpp"
+#include "BPFPacket.hpp"
+#include "Log.hpp"
+
+/*
+ Used to signal that the writer could not be set up
+ */
+class PcapWriterNotOpened : public std::exception {
+private:
+    std::string message;
+public:
+    PcapWriterNotOpened() {};
+    PcapWriterNotOpened(std::string m) :message{m} {};
+
+    const char * what() {
+        message += "Capture file writer not opened";
+        return message.c_str();
+    }
+};
+
+enum class PcapFormat {PCAP, PCAPNG};
+
+/*
+ How a PcapWriter lays out and rotates its files
+ */
+struct PcapWriterOptions {
+    PcapFormat format = PcapFormat::PCAP;
+    size_t buffer_len = 1 << 20; // Bytes per buffer handed to the writer thread
+    size_t buffer_count = 8; // Buffers in flight before we start dropping
+    uint64_t rotate_bytes = 0; // Start a new file past this many bytes, 0 for never
+    uint64_t rotate_seconds = 0; // Start a new file once records are this much newer than the first in the file, 0 for never
+    uint32_t snaplen = 65535; // Longer records are cut down to this
+    uint16_t link_type = 1; // Ethernet
+};
+
+/*
+ Persists captured records as pcap (nanosecond timestamps) or pcapng without putting the disk on the capture thread
+
+ write() only appends to a page-aligned in-memory buffer. Full buffers are handed to a background thread which does the
+ actual write()s, and come back to us once on disk. If every buffer is still waiting on the disk the record is dropped
+ (and counted) rather than stalling capture, so get_dropped_bytes() tells you when the writer can't keep up with the device.
+
+ Files rotate by size and/or capture time: the first file is path, the following ones path.1, path.2, ...
+
+ write() and flush() are for the capture thread only, the counters may be read from anywhere.
+ */
+class PcapWriter {
+private:
+    struct Buffer {
+        byte_t* data;
+        size_t len;
+        bool new_file; // Open the next file before writing this one out
+    };
+
+    std::string path;
+    PcapWriterOptions opts;
+    std::vector<Buffer> buffers;
+
+    // Buffer indices. free_list is a stack, full is a ring of buffer_count slots
+    std::vector<size_t> free_list;
+    std::vector<size_t> full;
+    size_t full_head, full_count;
+    std::mutex lock;
+    std::condition_variable work_ready;
+    bool stopping;
+    std::thread writer;
+
+    // Capture thread state
+    static const size_t NO_BUFFER = static_cast<size_t>(-1);
+    size_t curr;
+    bool pending_new_file;
+    uint64_t file_bytes;
+    uint64_t file_start_sec;
+    std::atomic<uint64_t> dropped_bytes, dropped_packets;
+
+    // Writer thread state
+    int fd;
+    unsigned int file_index;
+    std::atomic<uint64_t> written_bytes;
+    std::atomic<uint64_t> write_errors;
+    std::atomic<unsigned int> files_opened;
+
+    size_t file_header_len(void) const;
+    size_t record_len(uint32_t caplen) const;
+    void put_file_header(Buffer& b);
+    void put_record(Buffer& b, uint64_t ts_sec, uint32_t ts_nsec, const byte_t* data, uint32_t caplen, uint32_t origlen);
+
+    // Capture side of the hand-off
+    bool acquire(void);
+    void submit(void);
+
+    // Writer thread
+    void run(void);
+    void open_next_file(void);
+    void write_out(const Buffer& b);
+
+public:
+    PcapWriter(std::string path, PcapWriterOptions opts = PcapWriterOptions {});
+
+    PcapWriter(const PcapWriter& other)= delete;
+    PcapWriter operator=(const PcapWriter& other)=delete;
+
+    ~PcapWriter() {
+        close();
+    }
+
+    /*
+     Queues one record, returns false if it had to be dropped
+     */
+    bool write(uint64_t ts_sec, uint32_t ts_nsec, const byte_t* data, uint32_t caplen, uint32_t origlen);
+
+    /*
+     Queues any record type with the BPFRecord accessors (BPFRecord, AFPacketRecord, PcapRecord)
+     */
+    template <typename Record>
+    bool write(const Record& record) {
+        bpf_hdr bhdr = record.get_bpf_header();
+        return write(bhdr.bh_tstamp.tv_sec, static_cast<uint32_t>(bhdr.bh_tstamp.tv_usec) * 1000, record.get_data(), bhdr.bh_caplen, bhdr.bh_datalen);
+    }
+
+    // Hands the partly filled buffer to the writer thread
+    void flush(void);
+
+    // Flushes, waits for everything to reach the file and stops the writer thread
+    void close(void);
+
+    uint64_t get_dropped_bytes(void);
+    uint64_t get_dropped_packets(void);
+    uint64_t get_written_bytes(void);
+    uint64_t get_write_errors(void);
+    unsigned int get_files_opened(void);
+};
+
+#endif /* PcapWriter_hpp */
@@ -0,0 +1,250 @@
+//
+//  FanoutCapture.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sstream>
+#include "FanoutCapture.hpp"
+#include "CountingSource.hpp"
+
+using std::string;
+using std::vector;
+using std::unique_ptr;
+
+vector<int> allowed_cpus() {
+    vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == -1) {
+        return cpus;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+vector<int> parse_cpu_list(const string& list) {
+    vector<int> cpus;
+    std::istringstream is {list};
+    string item;
+    while (std::getline(is, item, ',')) {
+        size_t dash = item.find('-');
+        int first = std::stoi(item.substr(0, dash));
+        int last = dash == string::npos ? first : std::stoi(item.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+FanoutCapture::Member::Member(int cpu) :cpu{cpu}, node{-1}, captured{0}, processed{0}, unsupported{0}, invalid{0} {}
+
+FanoutCapture::FanoutCapture(FanoutOptions o, Handler h) :opts{o}, handler{h}, stop_requested{false}, members_started{0} {
+    if (opts.cpus.empty()) {
+        opts.cpus = allowed_cpus();
+    }
+    if (opts.group_id == 0) {
+        opts.group_id = static_cast<uint16_t>(getpid());
+    }
+    members.reserve(opts.cpus.size());
+    for (int cpu : opts.cpus) {
+        members.emplace_back(new Member {cpu});
+    }
+}
+
+void FanoutCapture::setup_member(Member& m) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(m.cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+        string msg {"Pinning to CPU "};
+        msg += std::to_string(m.cpu) + ": " + strerror(err) + "\n";
+        throw AFPacketDeviceNotOpened {msg};
+    }
+    // Now running where it will stay, so this is the node the kernel allocates the ring on
+    unsigned int cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+        m.node.store(static_cast<int>(node), std::memory_order_relaxed);
+    }
+
+    unique_ptr<AFPacketDevice> dev = open_new_device(opts.interface, opts.block_len, opts.blocks);
+    dev->set_read_timeout(opts.read_timeout_ms);
+    if (!opts.filter.empty() && !dev->set_filter(opts.filter)) {
+        throw AFPacketDeviceNotOpened {"Attaching filter on CPU " + std::to_string(m.cpu) + ": "};
+    }
+    // Only join once the filter is on, or the group hands this member packets the filter would have dropped
+    if (!dev->join_fanout(opts.group_id, opts.mode)) {
+        throw AFPacketDeviceNotOpened {"Joining fanout group on CPU " + std::to_string(m.cpu) + ": "};
+    }
+
+    std::lock_guard<std::mutex> guard {setup_lock};
+    m.dev = std::move(dev);
+}
+
+void FanoutCapture::run_member(unsigned int idx) {
+    Member& m = *members[idx];
+    try {
+        setup_member(m);
+    } catch(AFPacketDeviceNotOpened& e) {
+        // Rethrown by start(), on the thread that can report it
+        std::lock_guard<std::mutex> guard {setup_lock};
+        if (setup_error == nullptr) {
+            setup_error = std::current_exception();
+        }
+        ++members_started;
+        setup_changed.notify_all();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard {setup_lock};
+        ++members_started;
+        setup_changed.notify_all();
+    }
+
+    // m.dev is only replaced by this thread, so it is safe to use without the lock from here on
+    CountingSource<AFPacketDevice> counted {*m.dev, true, opts.checksums};
+    try {
+        while (!stop_requested.load(std::memory_order_relaxed)) {
+            for (auto&& record : counted.readBatch()) {
+                m.captured.store(m.captured.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                PacketView packet = parse_packet(record.get_data(), record.get_data_len());
+                switch (packet.get_parse_status()) {
+                    case ParseStatus::OK:
+                        handler(idx, record.get_bpf_header(), packet);
+                        m.processed.store(m.processed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                        break;
+                    case ParseStatus::UNSUPPORTED_ETHERTYPE:
+                    case ParseStatus::UNSUPPORTED_PROTOCOL:
+                        m.unsupported.store(m.unsupported.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                        break;
+                    case ParseStatus::TRUNCATED:
+                    case ParseStatus::MALFORMED:
+                        m.invalid.store(m.invalid.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                        break;
+                }
+                if (stop_requested.load(std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+        }
+    } catch(CouldNotRead e) {
+        LOG_ERROR("Fanout member on CPU %d stopped: %s", m.cpu, e.what());
+    } catch(WrongNetworkProtocol e) {
+        member_failed(m, e.what());
+    } catch(WrongTransportProtocol e) {
+        member_failed(m, e.what());
+    } catch(UnsupportedProtocol e) {
+        member_failed(m, e.what());
+    } catch(InvalidInput e) {
+        member_failed(m, e.what());
+    } catch(std::exception& e) {
+        // The standard library's own (bad_alloc, ...), whose what() is the real one
+        member_failed(m, e.what());
+    }
+}
+
+void FanoutCapture::member_failed(Member& m, const char* reason) {
+    // The capture cannot be trusted any more: stop the rest and hand the exception to whoever waits
+    LOG_ERROR("Fanout member on CPU %d failed: %s", m.cpu, reason);
+    {
+        std::lock_guard<std::mutex> guard {setup_lock};
+        if (run_error == nullptr) {
+            run_error = std::current_exception();
+        }
+    }
+    stop();
+}
+
+void FanoutCapture::start() {
+    if (members.empty()) {
+        throw AFPacketDeviceNotOpened {"No CPUs to run on: "};
+    }
+    for (unsigned int i = 0; i < members.size(); ++i) {
+        members[i]->thread = std::thread {&FanoutCapture::run_member, this, i};
+    }
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> guard {setup_lock};
+        setup_changed.wait(guard, [this] { return members_started == members.size(); });
+        error = setup_error;
+    }
+    if (error != nullptr) {
+        stop();
+        join_members();
+        std::rethrow_exception(error);
+    }
+}
+
+void FanoutCapture::stop() {
+    stop_requested.store(true, std::memory_order_relaxed);
+}
+
+void FanoutCapture::join_members() {
+    for (unique_ptr<Member>& m : members) {
+        if (m->thread.joinable()) {
+            m->thread.join();
+        }
+    }
+}
+
+void FanoutCapture::wait() {
+    join_members();
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> guard {setup_lock};
+        std::swap(error, run_error);
+    }
+    if (error != nullptr) {
+        std::rethrow_exception(error);
+    }
+}
+
+FanoutStats FanoutCapture::get_stats() {
+    FanoutStats stats {0, 0, 0, 0, {}};
+    stats.members.reserve(members.size());
+    for (unique_ptr<Member>& m : members) {
+        FanoutMemberStats ms;
+        ms.cpu = m->cpu;
+        ms.node = m->node.load(std::memory_order_relaxed);
+        ms.captured = m->captured.load(std::memory_order_relaxed);
+        ms.processed = m->processed.load(std::memory_order_relaxed);
+        ms.unsupported = m->unsupported.load(std::memory_order_relaxed);
+        ms.invalid = m->invalid.load(std::memory_order_relaxed);
+        stats.captured += ms.captured;
+        stats.processed += ms.processed;
+        stats.unsupported += ms.unsupported;
+        stats.invalid += ms.invalid;
+        stats.members.push_back(ms);
+    }
+    return stats;
+}
+
+bool FanoutCapture::get_kernel_stats(KernelStats& stats) {
+    stats.received = 0;
+    stats.dropped = 0;
+    bool ok = true;
+    // Also serialises callers, the devices' counters reset on every read
+    std::lock_guard<std::mutex> guard {setup_lock};
+    for (unique_ptr<Member>& m : members) {
+        KernelStats member {0, 0};
+        if (m->dev == nullptr || !m->dev->get_kernel_stats(member)) {
+            ok = false;
+            continue;
+        }
+        stats.received += member.received;
+        stats.dropped += member.dropped;
+    }
+    return ok;
+}
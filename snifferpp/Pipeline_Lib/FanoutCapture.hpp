@@ -0,0 +1,164 @@
+//
+//  FanoutCapture.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef FanoutCapture_hpp
+#define FanoutCapture_hpp
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include "AFPacket_util.hpp"
+#include "packet_sniffer.hpp"
+
+/*
+ Settings for a FanoutCapture
+ */
+struct FanoutOptions {
+    std::string interface;
+    FanoutMode mode = FanoutMode::HASH;
+    uint16_t group_id = 0; // 0 picks one from the process id, so two captures on one interface stay apart
+    std::vector<int> cpus; // One member per entry, pinned to that CPU. Empty: one per CPU we may run on
+    ssize_t block_len = 1 << 20; // Ring of every member
+    unsigned int blocks = 64;
+    int read_timeout_ms = 100; // How soon an idle member notices stop()
+    std::vector<sock_filter> filter; // Attached to every member, if not empty
+    bool checksums = true; // Verify checksums as records are counted (see CountingSource)
+};
+
+/*
+ What one member has done (a snapshot, see FanoutCapture::get_stats)
+ */
+struct FanoutMemberStats {
+    int cpu;
+    int node; // NUMA node it runs and allocated its ring on, -1 until known
+    uint64_t captured; // Records read from its ring
+    uint64_t processed; // Handed to the handler
+    uint64_t unsupported; // parse_packet found an unsupported EtherType or protocol
+    uint64_t invalid; // parse_packet found it truncated or malformed
+};
+
+struct FanoutStats {
+    // Summed over every member
+    uint64_t captured;
+    uint64_t processed;
+    uint64_t unsupported;
+    uint64_t invalid;
+    std::vector<FanoutMemberStats> members;
+};
+
+/*
+ Linux multi-queue capture: N AF_PACKET sockets on one interface joined into a PACKET_FANOUT group, so the kernel spreads
+ the packets over them (see FanoutMode), each read by its own capture + parse thread. Where Pipeline has one capture
+ thread copying packets out to the parsers, here nothing is shared between members: a packet is parsed where the kernel
+ put it, and throughput grows with the number of members until the NIC's queues or the handler run out.
+
+ Every member pins itself to its CPU before opening its socket, so the ring the kernel allocates for it, its counters
+ and anything else it allocates come from that CPU's NUMA node (first touch), and stay there. With FanoutMode::CPU, pin
+ the members to the CPUs the NIC's queues interrupt, or packets arriving on other CPUs have no member to go to.
+
+ Each member counts what it reads into its own CaptureCounters, so the metrics export (and sum_thread_counters) sees
+ the sum of the group; get_stats and get_kernel_stats give the same per member and summed.
+
+ The handler is called from every member's thread, concurrently, with the member's index.
+ */
+class FanoutCapture {
+public:
+    using Handler = std::function<void(unsigned int member, const bpf_hdr& bhdr, const PacketView& packet)>;
+
+private:
+    /*
+     Allocated one at a time, padded so two members' counters never share a cache line
+     */
+    struct Member {
+        int cpu;
+        std::atomic<int> node;
+        std::unique_ptr<AFPacketDevice> dev; // Opened by the member's own thread, guarded by setup_lock
+
+        // Written by the member's thread only
+        std::atomic<uint64_t> captured;
+        std::atomic<uint64_t> processed;
+        std::atomic<uint64_t> unsupported;
+        std::atomic<uint64_t> invalid;
+        char pad[CACHE_LINE_LEN];
+
+        std::thread thread;
+
+        Member(int cpu);
+    };
+
+    FanoutOptions opts;
+    Handler handler;
+    std::vector<std::unique_ptr<Member>> members;
+    std::atomic<bool> stop_requested;
+
+    std::mutex setup_lock; // Guards the members' devices and the three below
+    std::condition_variable setup_changed;
+    unsigned int members_started; // Ready or failed
+    std::exception_ptr setup_error; // From the first member that could not set up
+    std::exception_ptr run_error; // From the first member to stop on one, rethrown by wait()
+
+    // Pins the calling thread and opens, filters and joins its socket. Throws AFPacketDeviceNotOpened
+    void setup_member(Member& m);
+    void run_member(unsigned int idx);
+    // From run_member's catch blocks: logs reason, keeps the exception being handled for wait() and stops the group
+    void member_failed(Member& m, const char* reason);
+    void join_members(void);
+
+public:
+    FanoutCapture(FanoutOptions opts, Handler handler);
+
+    FanoutCapture(const FanoutCapture& other)= delete;
+    FanoutCapture operator=(const FanoutCapture& other)=delete;
+
+    ~FanoutCapture() {
+        stop();
+        join_members();
+    }
+
+    /*
+     Starts every member and returns once all of them have joined the group.
+     Throws AFPacketDeviceNotOpened, after stopping the rest, if any could not
+     */
+    void start(void);
+
+    // Ask every member to stop, safe to call from any thread (including the handler)
+    void stop(void);
+
+    /*
+     Blocks until every member has exited. If one stopped on an exception (from its device, or the handler) the whole
+     group was stopped with it, and that exception is rethrown here
+     */
+    void wait(void);
+
+    unsigned int get_member_count(void) const { return static_cast<unsigned int>(members.size()); }
+
+    FanoutStats get_stats(void);
+
+    /*
+     The kernel's packet counts (PACKET_STATISTICS) summed over every member. Returns false if one could not be read
+     */
+    bool get_kernel_stats(KernelStats& stats);
+};
+
+/*
+ CPUs this process may run on (its affinity mask), in order
+ */
+std::vector<int> allowed_cpus(void);
+
+/*
+ CPUs from a list like "0,2,4-7". Throws std::invalid_argument if an entry is not a number or range
+ */
+std::vector<int> parse_cpu_list(const std::string& list);
+
+#endif /* FanoutCapture_hpp */
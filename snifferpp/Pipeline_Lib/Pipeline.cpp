@@ -0,0 +1,161 @@
+//
+//  Pipeline.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include "Pipeline.hpp"
+
+using std::unique_ptr;
+using std::vector;
+
+Pipeline::Worker::Worker(size_t depth, size_t slot_len) :ring{depth}, arena(ring.capacity() * slot_len), enqueued{0}, dropped{0}, max_depth{0}, processed{0}, unsupported{0}, invalid{0} {
+    for (size_t i = 0; i < ring.capacity(); ++i) {
+        ring.slot(i).data = arena.data() + i * slot_len;
+        ring.slot(i).len = 0;
+    }
+}
+
+Pipeline::Pipeline(PipelineOptions o, Handler h) :opts{o}, handler{h}, stop_requested{false}, capture_done{false}, captured{0}, non_ip{0} {
+    if (opts.workers == 0) {
+        opts.workers = 1;
+    }
+    workers.reserve(opts.workers);
+    for (unsigned int i = 0; i < opts.workers; ++i) {
+        workers.emplace_back(new Worker {opts.ring_depth, opts.slot_len});
+    }
+}
+
+void Pipeline::start_workers() {
+    for (unsigned int i = 0; i < workers.size(); ++i) {
+        workers[i]->thread = std::thread {&Pipeline::run_worker, this, i};
+    }
+}
+
+void Pipeline::finish_capture() {
+    // Everything we committed before this is visible to a worker that sees capture_done
+    capture_done.store(true, std::memory_order_release);
+}
+
+void Pipeline::dispatch(const bpf_hdr& bhdr, const byte_t* data, size_t len, bool wait_for_room) {
+    captured.store(captured.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    size_t idx = 0;
+    FlowKey key;
+    if (peek_flow_key(data, len, key)) {
+        idx = key.symmetric_hash() % workers.size();
+    } else {
+        non_ip.store(non_ip.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    Worker& w = *workers[idx];
+
+    // Only this thread writes the capture-side counters, so plain load/store is enough
+    PipelineSlot* slot = w.ring.reserve();
+    // A file waits for the worker to catch up, nothing is lost by it. Unless stop() is what the worker is waiting on
+    unsigned int spins = 0;
+    while (slot == nullptr && wait_for_room && !stop_requested.load(std::memory_order_relaxed)) {
+        if (++spins > 64) {
+            std::this_thread::yield();
+        }
+        slot = w.ring.reserve();
+    }
+    if (slot == nullptr) {
+        w.dropped.store(w.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        CaptureCounters::add(thread_counters().queue_dropped);
+        return;
+    }
+    slot->bhdr = bhdr;
+    slot->len = len < opts.slot_len ? len : opts.slot_len;
+    memcpy(slot->data, data, slot->len);
+    w.ring.commit();
+
+    uint64_t n = w.enqueued.load(std::memory_order_relaxed) + 1;
+    w.enqueued.store(n, std::memory_order_relaxed);
+    if (n % DEPTH_SAMPLE_INTERVAL == 0) {
+        size_t depth = w.ring.size();
+        if (depth > w.max_depth.load(std::memory_order_relaxed)) {
+            w.max_depth.store(depth, std::memory_order_relaxed);
+        }
+    }
+}
+
+void Pipeline::run_worker(unsigned int idx) {
+    Worker& w = *workers[idx];
+    unsigned int idle = 0;
+    for (;;) {
+        PipelineSlot* slot = w.ring.front();
+        if (slot == nullptr) {
+            if (capture_done.load(std::memory_order_acquire)) {
+                // Nothing more is coming, but make sure nothing slipped in before the flag
+                if ((slot = w.ring.front()) == nullptr) {
+                    return;
+                }
+            } else {
+                // Back off gradually so an idle worker does not burn its core
+                ++idle;
+                if (idle < 64) {
+                    continue;
+                } else if (idle < 128) {
+                    std::this_thread::yield();
+                } else {
+                    std::this_thread::sleep_for(std::chrono::microseconds {50});
+                }
+                continue;
+            }
+        }
+        idle = 0;
+
+        PacketView packet = parse_packet(slot->data, slot->len);
+        switch (packet.get_parse_status()) {
+            case ParseStatus::OK:
+                handler(idx, slot->bhdr, packet);
+                w.processed.store(w.processed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                break;
+            case ParseStatus::UNSUPPORTED_ETHERTYPE:
+            case ParseStatus::UNSUPPORTED_PROTOCOL:
+                w.unsupported.store(w.unsupported.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                break;
+            case ParseStatus::TRUNCATED:
+            case ParseStatus::MALFORMED:
+                w.invalid.store(w.invalid.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                break;
+        }
+        w.ring.pop();
+    }
+}
+
+void Pipeline::stop() {
+    stop_requested.store(true, std::memory_order_relaxed);
+}
+
+void Pipeline::wait() {
+    if (capture.joinable()) {
+        capture.join();
+    }
+    for (unique_ptr<Worker>& w : workers) {
+        if (w->thread.joinable()) {
+            w->thread.join();
+        }
+    }
+}
+
+PipelineStats Pipeline::get_stats() {
+    PipelineStats stats;
+    stats.captured = captured.load(std::memory_order_relaxed);
+    stats.non_ip = non_ip.load(std::memory_order_relaxed);
+    stats.workers.reserve(workers.size());
+    for (unique_ptr<Worker>& w : workers) {
+        WorkerStats ws;
+        ws.depth = w->ring.size();
+        ws.max_depth = w->max_depth.load(std::memory_order_relaxed);
+        ws.enqueued = w->enqueued.load(std::memory_order_relaxed);
+        ws.dropped = w->dropped.load(std::memory_order_relaxed);
+        ws.processed = w->processed.load(std::memory_order_relaxed);
+        ws.unsupported = w->unsupported.load(std::memory_order_relaxed);
+        ws.invalid = w->invalid.load(std::memory_order_relaxed);
+        stats.workers.push_back(ws);
+    }
+    return stats;
+}
@@ -0,0 +1,179 @@
+//
+//  Pipeline.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef Pipeline_hpp
+#define Pipeline_hpp
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include "packet_sniffer.hpp"
+#include "FlowKey.hpp"
+#include "BPFPacket.hpp"
+#include "SPSCRing.hpp"
+
+/*
+ Sizing for a Pipeline
+ */
+struct PipelineOptions {
+    unsigned int workers = 2; // Parser threads
+    size_t ring_depth = 4096; // Packets queued per worker before the capture thread starts dropping (or waiting, for files)
+    size_t slot_len = 2048; // Bytes of each packet handed to the workers, longer packets are truncated
+};
+
+/*
+ A packet on its way from the capture thread to a worker: its capture header plus a copy of its bytes.
+ data points into the worker's arena and is set up once, so queueing a packet is a memcpy and an index bump
+ */
+struct PipelineSlot {
+    bpf_hdr bhdr;
+    size_t len;
+    byte_t* data;
+};
+
+/*
+ Queue and throughput counters for one worker (a snapshot, see Pipeline::get_stats)
+ */
+struct WorkerStats {
+    size_t depth; // Packets waiting right now
+    size_t max_depth; // Deepest the ring has been (sampled)
+    uint64_t enqueued;
+    uint64_t dropped; // Ring was full
+    uint64_t processed;
+    uint64_t unsupported; // parse_packet found an unsupported EtherType or protocol
+    uint64_t invalid; // parse_packet found it truncated or malformed
+};
+
+struct PipelineStats {
+    uint64_t captured; // Records pulled from the source
+    uint64_t non_ip; // Records we could not take a 5-tuple from, neither IPv4 nor IPv6 (sent to worker 0)
+    std::vector<WorkerStats> workers;
+};
+
+/*
+ Spreads capture, parsing and consumption over several cores.
+
+ A dedicated capture thread drains the source (anything with a readBatch(), e.g. BPFDevice, AFPacketDevice, PcapFile) and
+ copies each packet into one of N single-producer/single-consumer rings. The ring is picked by the symmetric 5-tuple hash, so
+ both directions of a flow always go to the same worker. Each worker parses its packets with parse_packet and hands the
+ ones it fully understands to the handler, which therefore sees every flow from one thread only.
+
+ Reading a device, the capture thread never blocks on a worker: if a ring is full the packet is dropped and counted, as
+ the kernel would drop it anyway if we fell behind. Reading a file (drain_source) it waits for room instead, so every
+ record reaches a worker however slow the handler.
+
+ Shutdown: stop() asks the capture thread to finish up, workers then drain what is left in their rings and exit; wait()
+ joins everything. For devices set a read timeout first, or the capture thread can sit in a read until traffic shows up.
+ */
+class Pipeline {
+public:
+    using Handler = std::function<void(unsigned int worker, const bpf_hdr& bhdr, const PacketView& packet)>;
+
+private:
+    /*
+     Counters are split by which thread writes them so the two sides never share a cache line
+     */
+    struct Worker {
+        SPSCRing<PipelineSlot> ring;
+        std::vector<byte_t> arena;
+
+        // Written by the capture thread
+        std::atomic<uint64_t> enqueued;
+        std::atomic<uint64_t> dropped;
+        std::atomic<size_t> max_depth;
+        char capture_pad[CACHE_LINE_LEN];
+
+        // Written by the worker thread
+        std::atomic<uint64_t> processed;
+        std::atomic<uint64_t> unsupported;
+        std::atomic<uint64_t> invalid;
+        char worker_pad[CACHE_LINE_LEN];
+
+        std::thread thread;
+
+        Worker(size_t depth, size_t slot_len);
+    };
+
+    // How often the capture thread samples a ring's depth (reading the consumer's index costs a cache miss)
+    static const uint64_t DEPTH_SAMPLE_INTERVAL = 64;
+
+    PipelineOptions opts;
+    Handler handler;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::thread capture;
+
+    std::atomic<bool> stop_requested;
+    std::atomic<bool> capture_done;
+    std::atomic<uint64_t> captured;
+    std::atomic<uint64_t> non_ip;
+
+    // Capture thread: copy one packet into the ring of the worker that owns its flow. If the ring is full, wait_for_room
+    // waits for the worker to make some (until stop()), otherwise the packet is dropped
+    void dispatch(const bpf_hdr& bhdr, const byte_t* data, size_t len, bool wait_for_room);
+    void start_workers(void);
+    void finish_capture(void);
+
+    void run_worker(unsigned int idx);
+
+public:
+    Pipeline(PipelineOptions opts, Handler handler);
+
+    Pipeline(const Pipeline& other)= delete;
+    Pipeline operator=(const Pipeline& other)=delete;
+
+    ~Pipeline() {
+        stop();
+        wait();
+    }
+
+    /*
+     Starts the workers and a capture thread reading from source (which must outlive the pipeline)
+
+     drain_source: an empty batch means the source is exhausted (files) rather than a read timeout (devices), and a
+     full ring is waited on rather than dropped from
+     */
+    template <typename Source>
+    void start(Source& source, bool drain_source = false) {
+        start_workers();
+        capture = std::thread {[this, &source, drain_source] {
+            try {
+                while (!stop_requested.load(std::memory_order_relaxed)) {
+                    size_t in_batch = 0;
+                    for (auto&& record : source.readBatch()) {
+                        ++in_batch;
+                        dispatch(record.get_bpf_header(), record.get_data(), record.get_data_len(), drain_source);
+                        if (stop_requested.load(std::memory_order_relaxed)) {
+                            break;
+                        }
+                    }
+                    if (in_batch == 0 && drain_source) {
+                        break;
+                    }
+                }
+            } catch(...) {
+                // Each source has its own exception types (CouldNotRead, MalformedPcap, ...), none of which we can handle here
+                LOG_ERROR("Capture source failed, stopping pipeline");
+            }
+            finish_capture();
+        }};
+    }
+
+    // Ask the capture thread to stop, safe to call from any thread (including the handler)
+    void stop(void);
+
+    // Blocks until the capture thread and every worker have exited
+    void wait(void);
+
+    PipelineStats get_stats(void);
+};
+
+#endif /* Pipeline_hpp */
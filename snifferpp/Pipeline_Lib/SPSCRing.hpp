@@ -0,0 +1,131 @@
+//
+//  SPSCRing.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef SPSCRing_hpp
+#define SPSCRing_hpp
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include "standard_headers.hpp"
+
+/*
+ Bounded lock-free queue for exactly one producer thread and one consumer thread
+
+ Slots are filled in place: the producer reserve()s the next free slot, fills it, then commit()s it; the consumer
+ looks at front() and pop()s it once done. Nothing is copied in or out and nothing is allocated after construction.
+
+ The indices live on their own cache lines, and each side keeps a cached copy of the other side's index so it only
+ touches the shared line when the ring looks full (producer) or empty (consumer).
+ */
+template <typename T>
+class SPSCRing {
+private:
+    std::vector<T> slots;
+    size_t mask;
+    char shared_pad[CACHE_LINE_LEN]; // Keeps the read-only fields above off the index lines
+
+    // Consumer side
+    std::atomic<size_t> head;
+    size_t cached_tail;
+    char head_pad[CACHE_LINE_LEN];
+
+    // Producer side
+    std::atomic<size_t> tail;
+    size_t cached_head;
+    char tail_pad[CACHE_LINE_LEN];
+
+    static size_t round_up(size_t n) {
+        size_t p = 1;
+        while (p < n) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+public:
+    // Capacity is rounded up to a power of two
+    SPSCRing(size_t capacity) :slots(round_up(capacity < 2 ? 2 : capacity)), mask{slots.size()-1}, head{0}, cached_tail{0}, tail{0}, cached_head{0} {};
+
+    SPSCRing(const SPSCRing& other)= delete;
+    SPSCRing operator=(const SPSCRing& other)=delete;
+
+    size_t capacity(void) const { return slots.size(); }
+
+    // Approximate when called from a third thread
+    size_t size(void) const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    // Direct access to every slot, for setting them up before either thread starts
+    T& slot(size_t i) { return slots[i]; }
+
+    /*
+     Producer: next free slot, or nullptr if the ring is full
+     */
+    T* reserve(void) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head == slots.size()) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head == slots.size()) {
+                return nullptr;
+            }
+        }
+        return &slots[t & mask];
+    }
+
+    /*
+     Producer: publishes the slot from reserve()
+     */
+    void commit(void) {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool try_push(const T& value) {
+        T* s = reserve();
+        if (s == nullptr) {
+            return false;
+        }
+        *s = value;
+        commit();
+        return true;
+    }
+
+    /*
+     Consumer: oldest published slot, or nullptr if the ring is empty
+     */
+    T* front(void) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail) {
+                return nullptr;
+            }
+        }
+        return &slots[h & mask];
+    }
+
+    /*
+     Consumer: hands the slot from front() back to the producer
+     */
+    void pop(void) {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool try_pop(T& out) {
+        T* s = front();
+        if (s == nullptr) {
+            return false;
+        }
+        out = *s;
+        pop();
+        return true;
+    }
+};
+
+#endif /* SPSCRing_hpp */
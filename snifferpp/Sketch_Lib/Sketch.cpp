@@ -0,0 +1,120 @@
+//
+//  Sketch.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include <cmath>
+#include "Sketch.hpp"
+
+using std::to_string;
+
+static uint32_t round_up_pow2(uint32_t n) {
+    uint32_t p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+CountMinSketch::CountMinSketch(uint32_t w, uint32_t d) :width{round_up_pow2(std::max<uint32_t>(w, 1))}, depth{std::max<uint32_t>(d, 1)} {
+    cells.assign(static_cast<size_t>(width) * depth, CountMinCell {0, 0});
+}
+
+CountMinCell CountMinSketch::estimate(uint64_t hash) const {
+    uint32_t h1 = static_cast<uint32_t>(hash);
+    uint32_t h2 = static_cast<uint32_t>(hash >> 32) | 1;
+    CountMinCell least {UINT64_MAX, UINT64_MAX};
+    const CountMinCell* row = cells.data();
+    for (uint32_t i = 0; i < depth; ++i, row += width) {
+        const CountMinCell& cell = row[(h1 + i * h2) & (width - 1)];
+        least.packets = std::min(least.packets, cell.packets);
+        least.bytes = std::min(least.bytes, cell.bytes);
+    }
+    return least;
+}
+
+void CountMinSketch::merge(const CountMinSketch& other) {
+    if (other.width != width || other.depth != depth) {
+        throw SketchMismatch {"Count-min " + to_string(width) + "x" + to_string(depth) + " and " + to_string(other.width) + "x" + to_string(other.depth) + ": "};
+    }
+    for (size_t i = 0; i < cells.size(); ++i) {
+        cells[i].packets += other.cells[i].packets;
+        cells[i].bytes += other.cells[i].bytes;
+    }
+}
+
+void CountMinSketch::write(SketchWriter& w) const {
+    w.put_u32(width);
+    w.put_u32(depth);
+    for (const CountMinCell& cell : cells) {
+        w.put_u64(cell.packets);
+        w.put_u64(cell.bytes);
+    }
+}
+
+void CountMinSketch::read(SketchReader& r) {
+    uint32_t w = r.get_u32();
+    uint32_t d = r.get_u32();
+    if (w == 0 || (w & (w - 1)) != 0 || w > (1u << 24) || d == 0 || d > 16) {
+        throw MalformedSketch {"Count-min " + to_string(w) + "x" + to_string(d) + ": "};
+    }
+    // A snapshot cut short or made up should not get a table of the size it claims
+    if (r.remaining() / 16 < uint64_t {w} * d) {
+        throw MalformedSketch {"Snapshot ends early: "};
+    }
+    CountMinSketch read_sketch {w, d};
+    for (CountMinCell& cell : read_sketch.cells) {
+        cell.packets = r.get_u64();
+        cell.bytes = r.get_u64();
+    }
+    *this = std::move(read_sketch);
+}
+
+HyperLogLog::HyperLogLog(unsigned int p) :precision{std::min(std::max(p, 4u), 18u)} {
+    registers.assign(size_t {1} << precision, 0);
+}
+
+double HyperLogLog::estimate() const {
+    double m = static_cast<double>(registers.size());
+    double sum = 0;
+    size_t zeroes = 0;
+    for (uint8_t r : registers) {
+        sum += std::ldexp(1.0, -r);
+        zeroes += r == 0;
+    }
+    double alpha = 0.7213 / (1 + 1.079 / m);
+    double raw = alpha * m * m / sum;
+    // Few keys leave registers empty, and counting those (linear counting) is closer there
+    if (raw <= 2.5 * m && zeroes != 0) {
+        return m * std::log(m / static_cast<double>(zeroes));
+    }
+    // With 64 bit hashes there is no large range correction to make
+    return raw;
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+    if (other.precision != precision) {
+        throw SketchMismatch {"HyperLogLog precision " + to_string(precision) + " and " + to_string(other.precision) + ": "};
+    }
+    for (size_t i = 0; i < registers.size(); ++i) {
+        registers[i] = std::max(registers[i], other.registers[i]);
+    }
+}
+
+void HyperLogLog::write(SketchWriter& w) const {
+    w.put_u8(static_cast<uint8_t>(precision));
+    w.put_bytes(registers.data(), registers.size());
+}
+
+void HyperLogLog::read(SketchReader& r) {
+    unsigned int p = r.get_u8();
+    if (p < 4 || p > 18) {
+        throw MalformedSketch {"HyperLogLog precision " + to_string(p) + ": "};
+    }
+    HyperLogLog read_sketch {p};
+    r.get_bytes(read_sketch.registers.data(), read_sketch.registers.size());
+    *this = std::move(read_sketch);
+}
@@ -0,0 +1,491 @@
+//
+//  Sketch.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef Sketch_hpp
+#define Sketch_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include "standard_headers.hpp"
+
+/*
+ Fixed size summaries of a stream of keyed counts, for traffic too varied to keep exact per-key state for:
+
+    CountMinSketch   packets and bytes of any key, overestimated by at most a small share of the total
+    SpaceSaving      the keys with the largest counts (heavy hitters), each with a bound on its error
+    HyperLogLog      how many distinct keys there were, to within a percent or two
+
+ Each is updated with the key's 64 bit hash (and SpaceSaving with the key itself), so one hash per key per packet
+ feeds all three. Sketches of the same size can be merged, giving the sketch of both streams: one per worker thread,
+ merged for reporting, or snapshots written with write() and combined later with read() and merge().
+ */
+
+/*
+ Used to signal a snapshot we could not read
+ */
+class MalformedSketch : public std::exception {
+private:
+    std::string message;
+public:
+    MalformedSketch() {};
+    MalformedSketch(std::string m) :message{m} {};
+
+    const char * what() {
+        message += "Malformed sketch snapshot";
+        return message.c_str();
+    }
+};
+
+/*
+ Used to signal a merge of sketches with different sizes
+ */
+class SketchMismatch : public std::exception {
+private:
+    std::string message;
+public:
+    SketchMismatch() {};
+    SketchMismatch(std::string m) :message{m} {};
+
+    const char * what() {
+        message += "Sketches differ in size, cannot merge";
+        return message.c_str();
+    }
+};
+
+/*
+ Appends integers to a snapshot, little endian whatever the host
+ */
+class SketchWriter {
+private:
+    std::string& out;
+public:
+    SketchWriter(std::string& out) :out{out} {};
+
+    void put_u8(uint8_t v) { out += static_cast<char>(v); }
+    void put_u16(uint16_t v) { put_u8(static_cast<uint8_t>(v)); put_u8(static_cast<uint8_t>(v >> 8)); }
+    void put_u32(uint32_t v) { put_u16(static_cast<uint16_t>(v)); put_u16(static_cast<uint16_t>(v >> 16)); }
+    void put_u64(uint64_t v) { put_u32(static_cast<uint32_t>(v)); put_u32(static_cast<uint32_t>(v >> 32)); }
+    void put_bytes(const void* data, size_t len) { out.append(static_cast<const char*>(data), len); }
+};
+
+/*
+ Reads back what a SketchWriter wrote. Throws MalformedSketch on reading past the end
+ */
+class SketchReader {
+private:
+    const byte_t* data;
+    size_t len;
+    size_t pos;
+
+    const byte_t* take(size_t n) {
+        if (len - pos < n) {
+            throw MalformedSketch {"Snapshot ends early: "};
+        }
+        pos += n;
+        return data + pos - n;
+    }
+
+public:
+    SketchReader(const byte_t* data, size_t len) :data{data}, len{len}, pos{0} {};
+
+    uint8_t get_u8(void) { return static_cast<uint8_t>(*take(1)); }
+    uint16_t get_u16(void) { uint16_t lo = get_u8(); return static_cast<uint16_t>(lo | get_u8() << 8); }
+    uint32_t get_u32(void) { uint32_t lo = get_u16(); return lo | static_cast<uint32_t>(get_u16()) << 16; }
+    uint64_t get_u64(void) { uint64_t lo = get_u32(); return lo | static_cast<uint64_t>(get_u32()) << 32; }
+    void get_bytes(void* out, size_t n) { memcpy(out, take(n), n); }
+    bool at_end(void) const { return pos == len; }
+    // Bytes not yet read, to check a count against before allocating for it
+    size_t remaining(void) const { return len - pos; }
+};
+
+// Keys are written as they are held (network order for addresses and ports)
+inline void put_key(SketchWriter& w, uint16_t key) { w.put_bytes(&key, sizeof(key)); }
+inline void put_key(SketchWriter& w, uint32_t key) { w.put_bytes(&key, sizeof(key)); }
+inline void get_key(SketchReader& r, uint16_t& key) { r.get_bytes(&key, sizeof(key)); }
+inline void get_key(SketchReader& r, uint32_t& key) { r.get_bytes(&key, sizeof(key)); }
+
+// Murmur3 finaliser: every input bit reaches every output bit
+inline uint64_t sketch_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+struct CountMinCell {
+    uint64_t packets;
+    uint64_t bytes;
+};
+
+/*
+ Packets and bytes per key, in depth rows of width cells: a key adds to one cell in each row, picked by its hash, and
+ its estimate is the smallest of those. Never an underestimate; with width w, over by more than e/w of the total in
+ at most e^-depth of the keys. The two counts share a cell, so an update touches depth cache lines
+ */
+class CountMinSketch {
+private:
+    uint32_t width; // A power of two
+    uint32_t depth;
+    std::vector<CountMinCell> cells; // Row by row
+
+public:
+    // width is rounded up to a power of two
+    CountMinSketch(uint32_t width = 2048, uint32_t depth = 4);
+
+    // Returns the key's estimate with this packet, as estimate() would, while the cells are at hand
+    CountMinCell add(uint64_t hash, uint64_t bytes) {
+        // Row i hashes with h1 + i*h2, as good as depth independent hashes (Kirsch and Mitzenmacher)
+        uint32_t h1 = static_cast<uint32_t>(hash);
+        uint32_t h2 = static_cast<uint32_t>(hash >> 32) | 1;
+        CountMinCell least {UINT64_MAX, UINT64_MAX};
+        CountMinCell* row = cells.data();
+        for (uint32_t i = 0; i < depth; ++i, row += width) {
+            CountMinCell& cell = row[(h1 + i * h2) & (width - 1)];
+            ++cell.packets;
+            cell.bytes += bytes;
+            least.packets = std::min(least.packets, cell.packets);
+            least.bytes = std::min(least.bytes, cell.bytes);
+        }
+        return least;
+    }
+
+    CountMinCell estimate(uint64_t hash) const;
+
+    uint32_t get_width(void) const { return width; }
+    uint32_t get_depth(void) const { return depth; }
+
+    // Throws SketchMismatch
+    void merge(const CountMinSketch& other);
+    void write(SketchWriter& w) const;
+    // Replaces this sketch (size included) with the one read. Throws MalformedSketch
+    void read(SketchReader& r);
+};
+
+/*
+ Distinct keys, from 2^precision one byte registers: the hash's top bits pick a register, which keeps the longest run
+ of leading zeroes seen in the rest. Standard error 1.04/sqrt(2^precision), 0.8% at the default 14 (16KB)
+ */
+class HyperLogLog {
+private:
+    unsigned int precision;
+    std::vector<uint8_t> registers;
+
+public:
+    // precision from 4 to 18
+    HyperLogLog(unsigned int precision = 14);
+
+    void add(uint64_t hash) {
+        size_t idx = static_cast<size_t>(hash >> (64 - precision));
+        // The bit below the used ones stops the count on a hash whose remaining bits are all zero
+        uint64_t rest = (hash << precision) | (uint64_t {1} << (precision - 1));
+        uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+        if (rank > registers[idx]) {
+            registers[idx] = rank;
+        }
+    }
+
+    double estimate(void) const;
+
+    unsigned int get_precision(void) const { return precision; }
+
+    // Throws SketchMismatch
+    void merge(const HyperLogLog& other);
+    void write(SketchWriter& w) const;
+    // Replaces this sketch (size included) with the one read. Throws MalformedSketch
+    void read(SketchReader& r);
+};
+
+/*
+ The keys with the largest counts (Metwally et al.'s Space-Saving), in capacity counters: a key already counted adds to
+ its counter; a new one takes over the smallest counter, inheriting its count as its possible error. Any key whose true
+ count is over total/capacity is held, and a held key's true count is between count - error and count.
+
+ Counters stay where they are put. An open addressing index (twice as many slots, linear probing) finds a key's
+ counter, and a 4-ary min-heap of counter numbers, each with a copy of its count, finds the smallest; heap moves only
+ touch the heap, so an update is a probe and a few compares. Key needs == and put_key / get_key; Hash gives the same
+ 64 bit hash the caller passes to update
+ */
+template <typename Key, typename Hash>
+class SpaceSaving {
+public:
+    struct Counter {
+        Key key;
+        uint64_t count;
+        uint64_t error; // count is at most this much over the true count
+    };
+
+private:
+    struct Slot {
+        uint32_t counter; // Index into counters + 1, 0 if empty
+        uint32_t tag; // Low bits of the key's hash, so probes rarely compare keys and deletes can find its home slot
+    };
+
+    struct HeapEntry {
+        uint64_t count;
+        uint32_t counter;
+    };
+
+    uint32_t capacity;
+    std::vector<Counter> counters;
+    std::vector<uint32_t> slot_of; // Per counter
+    std::vector<uint32_t> heap_pos; // Per counter
+    std::vector<HeapEntry> heap;
+    std::vector<Slot> slots;
+    uint32_t mask;
+    uint64_t total;
+
+    void sift_down(uint32_t i) {
+        uint32_t n = static_cast<uint32_t>(heap.size());
+        HeapEntry e = heap[i];
+        for (;;) {
+            uint32_t first = 4 * i + 1;
+            if (first >= n) {
+                break;
+            }
+            // Which child is smallest is a coin toss, so pick it with selects rather than branches
+            uint32_t least = first;
+            uint64_t least_count = heap[first].count;
+            uint32_t last = std::min(first + 4, n);
+            for (uint32_t c = first + 1; c < last; ++c) {
+                bool smaller = heap[c].count < least_count;
+                least = smaller ? c : least;
+                least_count = smaller ? heap[c].count : least_count;
+            }
+            if (least_count >= e.count) {
+                break;
+            }
+            heap[i] = heap[least];
+            heap_pos[heap[i].counter] = i;
+            i = least;
+        }
+        heap[i] = e;
+        heap_pos[e.counter] = i;
+    }
+
+    void sift_up(uint32_t i) {
+        HeapEntry e = heap[i];
+        while (i > 0 && heap[(i - 1) / 4].count > e.count) {
+            heap[i] = heap[(i - 1) / 4];
+            heap_pos[heap[i].counter] = i;
+            i = (i - 1) / 4;
+        }
+        heap[i] = e;
+        heap_pos[e.counter] = i;
+    }
+
+    uint32_t free_slot(uint32_t tag) const {
+        uint32_t s = tag & mask;
+        while (slots[s].counter != 0) {
+            s = (s + 1) & mask;
+        }
+        return s;
+    }
+
+    // Empties slot s, moving later entries of its probe run back so none is left behind a gap
+    void erase_slot(uint32_t s) {
+        slots[s].counter = 0;
+        uint32_t j = s;
+        for (;;) {
+            j = (j + 1) & mask;
+            if (slots[j].counter == 0) {
+                return;
+            }
+            uint32_t home = slots[j].tag & mask;
+            bool reachable = s < j ? (home > s && home <= j) : (home > s || home <= j);
+            if (!reachable) {
+                slots[s] = slots[j];
+                slot_of[slots[s].counter - 1] = s;
+                slots[j].counter = 0;
+                s = j;
+            }
+        }
+    }
+
+    // Rebuilds the index and heap from some counters (at most capacity)
+    void rebuild(std::vector<Counter>& from) {
+        std::fill(slots.begin(), slots.end(), Slot {0, 0});
+        counters.assign(from.begin(), from.end());
+        uint32_t n = static_cast<uint32_t>(counters.size());
+        slot_of.assign(n, 0);
+        heap_pos.assign(n, 0);
+        heap.resize(n);
+        Hash hash;
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t tag = static_cast<uint32_t>(hash(counters[i].key));
+            uint32_t s = free_slot(tag);
+            slots[s] = Slot {i + 1, tag};
+            slot_of[i] = s;
+            heap[i] = HeapEntry {counters[i].count, i};
+            heap_pos[i] = i;
+        }
+        for (uint32_t i = n / 4 + 1; i-- > 0;) {
+            if (i < n) {
+                sift_down(i);
+            }
+        }
+    }
+
+    // Count to assume for a key this summary does not hold: if it ever dropped one, anything could have had that much
+    uint64_t floor(void) const { return counters.size() == capacity ? heap[0].count : 0; }
+
+public:
+    SpaceSaving(uint32_t capacity = 256) :capacity{std::max<uint32_t>(capacity, 1)}, total{0} {
+        uint32_t n = 2;
+        while (n < 2 * this->capacity) {
+            n <<= 1;
+        }
+        slots.assign(n, Slot {0, 0});
+        mask = n - 1;
+        counters.reserve(this->capacity);
+        slot_of.reserve(this->capacity);
+        heap_pos.reserve(this->capacity);
+        heap.reserve(this->capacity);
+    }
+
+    /*
+     Adds weight to key. bound, if given, is at most a little over key's true count with this weight (a count-min
+     estimate taken after adding it): a key not held whose bound is no more than the smallest count could not be in the
+     top, so it is left out rather than taking over a counter (Homem and Carvalho's Filtered Space-Saving). Either way an
+     unheld key's true count stays under the smallest, so the guarantees above still hold, and most keys outside the top
+     cost a probe and a compare instead of a trip through the heap
+     */
+    void update(const Key& key, uint64_t hash, uint64_t weight, uint64_t bound = UINT64_MAX) {
+        total += weight;
+        uint32_t tag = static_cast<uint32_t>(hash);
+        uint32_t s = tag & mask;
+        while (slots[s].counter != 0) {
+            uint32_t i = slots[s].counter - 1;
+            if (slots[s].tag == tag && counters[i].key == key) {
+                counters[i].count += weight;
+                heap[heap_pos[i]].count += weight;
+                sift_down(heap_pos[i]);
+                return;
+            }
+            s = (s + 1) & mask;
+        }
+        if (counters.size() < capacity) {
+            uint32_t i = static_cast<uint32_t>(counters.size());
+            counters.push_back(Counter {key, weight, 0});
+            slot_of.push_back(s);
+            slots[s] = Slot {i + 1, tag};
+            heap_pos.push_back(i);
+            heap.push_back(HeapEntry {weight, i});
+            sift_up(i);
+            return;
+        }
+        uint64_t smallest = heap[0].count;
+        if (bound <= smallest) {
+            return;
+        }
+        // Take over the smallest counter. Erasing its slot can move others into s, so look again
+        uint32_t i = heap[0].counter;
+        erase_slot(slot_of[i]);
+        s = free_slot(tag);
+        slots[s] = Slot {i + 1, tag};
+        slot_of[i] = s;
+        counters[i] = Counter {key, smallest + weight, smallest};
+        heap[0].count = smallest + weight;
+        sift_down(0);
+    }
+
+    const Counter* find(const Key& key, uint64_t hash) const {
+        uint32_t tag = static_cast<uint32_t>(hash);
+        for (uint32_t s = tag & mask; slots[s].counter != 0; s = (s + 1) & mask) {
+            const Counter& c = counters[slots[s].counter - 1];
+            if (slots[s].tag == tag && c.key == key) {
+                return &c;
+            }
+        }
+        return nullptr;
+    }
+
+    // The n largest counters, largest first
+    std::vector<Counter> top(size_t n) const {
+        std::vector<Counter> sorted {counters};
+        std::sort(sorted.begin(), sorted.end(), [](const Counter& a, const Counter& b) { return a.count > b.count; });
+        if (sorted.size() > n) {
+            sorted.resize(n);
+        }
+        return sorted;
+    }
+
+    uint64_t get_total(void) const { return total; }
+    uint32_t get_capacity(void) const { return capacity; }
+
+    /*
+     Adds other's stream to this one (Agarwal et al.'s mergeable summaries): counts of keys both hold are added, a key
+     only one holds gets the other's floor on top (count and error), and the largest capacity of those are kept.
+     Throws SketchMismatch
+     */
+    void merge(const SpaceSaving& other) {
+        if (other.capacity != capacity) {
+            throw SketchMismatch {"Top counters " + std::to_string(capacity) + " and " + std::to_string(other.capacity) + ": "};
+        }
+        Hash hash;
+        uint64_t own_floor = floor();
+        uint64_t other_floor = other.floor();
+        std::vector<Counter> merged;
+        merged.reserve(counters.size() + other.counters.size());
+        for (const Counter& c : counters) {
+            const Counter* o = other.find(c.key, hash(c.key));
+            merged.push_back(o != nullptr ? Counter {c.key, c.count + o->count, c.error + o->error} : Counter {c.key, c.count + other_floor, c.error + other_floor});
+        }
+        for (const Counter& o : other.counters) {
+            if (find(o.key, hash(o.key)) == nullptr) {
+                merged.push_back(Counter {o.key, o.count + own_floor, o.error + own_floor});
+            }
+        }
+        if (merged.size() > capacity) {
+            std::nth_element(merged.begin(), merged.begin() + capacity, merged.end(), [](const Counter& a, const Counter& b) { return a.count > b.count; });
+            merged.resize(capacity);
+        }
+        total += other.total;
+        rebuild(merged);
+    }
+
+    void write(SketchWriter& w) const {
+        w.put_u32(capacity);
+        w.put_u64(total);
+        w.put_u32(static_cast<uint32_t>(counters.size()));
+        for (const Counter& c : counters) {
+            put_key(w, c.key);
+            w.put_u64(c.count);
+            w.put_u64(c.error);
+        }
+    }
+
+    // Replaces this summary (capacity included) with the one read. Throws MalformedSketch
+    void read(SketchReader& r) {
+        uint32_t cap = r.get_u32();
+        uint64_t read_total = r.get_u64();
+        uint32_t n = r.get_u32();
+        if (cap == 0 || cap > (1u << 24) || n > cap) {
+            throw MalformedSketch {"Top counters " + std::to_string(n) + " of " + std::to_string(cap) + ": "};
+        }
+        // Each counter is at least its count and error
+        if (r.remaining() / 16 < n) {
+            throw MalformedSketch {"Snapshot ends early: "};
+        }
+        std::vector<Counter> read_counters(n);
+        for (Counter& c : read_counters) {
+            get_key(r, c.key);
+            c.count = r.get_u64();
+            c.error = r.get_u64();
+        }
+        *this = SpaceSaving {cap};
+        total = read_total;
+        rebuild(read_counters);
+    }
+};
+
+#endif /* Sketch_hpp */
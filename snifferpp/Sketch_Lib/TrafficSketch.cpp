@@ -0,0 +1,117 @@
+//
+//  TrafficSketch.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include <iomanip>
+#include <sstream>
+#include "TrafficSketch.hpp"
+
+using std::ostream;
+using std::string;
+using std::endl;
+
+// Start of every snapshot, then its version
+static const char snapshot_magic[8] = {'S', 'N', 'F', 'S', 'K', 'E', 'T', 'C'};
+static const uint32_t snapshot_version = 1;
+
+TrafficSketch::TrafficSketch(TrafficSketchOptions opts) :sources{opts}, ports{opts}, flows{opts}, packets{0}, bytes{0}, skipped{0} {}
+
+void TrafficSketch::merge(const TrafficSketch& other) {
+    sources.merge(other.sources);
+    ports.merge(other.ports);
+    flows.merge(other.flows);
+    packets += other.packets;
+    bytes += other.bytes;
+    skipped += other.skipped;
+}
+
+void TrafficSketch::write(string& out) const {
+    SketchWriter w {out};
+    w.put_bytes(snapshot_magic, sizeof(snapshot_magic));
+    w.put_u32(snapshot_version);
+    w.put_u64(packets);
+    w.put_u64(bytes);
+    w.put_u64(skipped);
+    sources.write(w);
+    ports.write(w);
+    flows.write(w);
+}
+
+void TrafficSketch::read(const string& in) {
+    SketchReader r {in.data(), in.size()};
+    char magic[sizeof(snapshot_magic)];
+    r.get_bytes(magic, sizeof(magic));
+    if (memcmp(magic, snapshot_magic, sizeof(magic)) != 0) {
+        throw MalformedSketch {"Not a sketch snapshot: "};
+    }
+    uint32_t version = r.get_u32();
+    if (version != snapshot_version) {
+        throw MalformedSketch {"Snapshot version " + std::to_string(version) + ": "};
+    }
+    packets = r.get_u64();
+    bytes = r.get_u64();
+    skipped = r.get_u64();
+    sources.read(r);
+    ports.read(r);
+    flows.read(r);
+    if (!r.at_end()) {
+        throw MalformedSketch {"Trailing bytes after snapshot: "};
+    }
+}
+
+static string key_name(uint32_t addr) {
+    in_addr a {addr};
+    return inet_ntoa(a);
+}
+
+static string key_name(uint16_t port) {
+    return std::to_string(ntohs(port));
+}
+
+static string key_name(const FlowKey& key) {
+    std::ostringstream os;
+    // inet_ntoa shares one buffer, so each address goes out before the next is made
+    os << key_name(key.src) << ":" << ntohs(key.sport) << " <-> ";
+    os << key_name(key.dst) << ":" << ntohs(key.dport) << " proto " << +key.proto;
+    return os.str();
+}
+
+/*
+ One kind of key's top n by bytes then by packets. The ranked count is what Space-Saving holds (true count within its
+ error), the other comes from the count-min sketch (at most a little over)
+ */
+template <typename Key, typename Hash>
+static void report_keys(ostream& os, const char* kind, const KeySketch<Key, Hash>& sketch, size_t n) {
+    os << "Top " << kind << " by bytes:" << endl;
+    for (auto& c : sketch.get_top_bytes().top(n)) {
+        os << "\t|-" << std::left << std::setw(16) << key_name(c.key) << std::right << " " << c.count << " Bytes";
+        if (c.error != 0) {
+            os << " (-" << c.error << ")";
+        }
+        os << ", ~" << sketch.estimate(c.key).packets << " packets" << endl;
+    }
+    os << "Top " << kind << " by packets:" << endl;
+    for (auto& c : sketch.get_top_packets().top(n)) {
+        os << "\t|-" << std::left << std::setw(16) << key_name(c.key) << std::right << " " << c.count << " packets";
+        if (c.error != 0) {
+            os << " (-" << c.error << ")";
+        }
+        os << ", ~" << sketch.estimate(c.key).bytes << " Bytes" << endl;
+    }
+}
+
+void TrafficSketch::write_report(ostream& os, size_t top) const {
+    std::ios tmp {NULL};
+    tmp.copyfmt(os);
+    os << "Sketched " << packets << " IPv4 packets (" << bytes << " Bytes), " << skipped << " other packets skipped" << endl;
+    os << std::fixed << std::setprecision(0);
+    os << "Distinct: ~" << sources.estimate_distinct() << " sources, ~" << ports.estimate_distinct() << " destination ports, ~" << flows.estimate_distinct() << " flows" << endl;
+    report_keys(os, "sources", sources, top);
+    report_keys(os, "destination ports", ports, top);
+    report_keys(os, "flows", flows, top);
+    os.copyfmt(tmp);
+}
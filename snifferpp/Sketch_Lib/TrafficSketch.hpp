@@ -0,0 +1,173 @@
+//
+//  TrafficSketch.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef TrafficSketch_hpp
+#define TrafficSketch_hpp
+
+#include <ostream>
+#include "Sketch.hpp"
+#include "FlowKey.hpp"
+#include "BPFPacket.hpp"
+
+/*
+ Sizes of every sketch in a TrafficSketch. Sketches can only be merged with others of the same sizes
+ */
+struct TrafficSketchOptions {
+    uint32_t top_counters = 256; // Per top-K list: a key with more than 1/256 of the traffic is always in it
+    uint32_t count_width = 2048; // Count-min cells per row: estimates over by at most e/2048 (0.13%) of the total...
+    uint32_t count_depth = 4; // ...for all but e^-4 (2%) of keys
+    unsigned int distinct_precision = 14; // HyperLogLog registers 2^14: distinct counts within about 0.8%
+};
+
+struct SourceHash {
+    uint64_t operator()(uint32_t addr) const { return sketch_mix(addr + 0x9e3779b97f4a7c15ULL); }
+};
+
+struct PortHash {
+    uint64_t operator()(uint16_t port) const { return sketch_mix(port + 0x9e3779b97f4a7c15ULL); }
+};
+
+struct FlowSketchHash {
+    uint64_t operator()(const FlowKey& key) const { return key.symmetric_hash(); }
+};
+
+inline void put_key(SketchWriter& w, const FlowKey& key) {
+    put_key(w, key.src);
+    put_key(w, key.dst);
+    put_key(w, key.sport);
+    put_key(w, key.dport);
+    w.put_u8(key.proto);
+}
+
+inline void get_key(SketchReader& r, FlowKey& key) {
+    get_key(r, key.src);
+    get_key(r, key.dst);
+    get_key(r, key.sport);
+    get_key(r, key.dport);
+    key.proto = r.get_u8();
+}
+
+/*
+ Everything sketched about one kind of key: the top keys by bytes and by packets, packets and bytes of any key, and how
+ many distinct keys there were. One hash of the key feeds all four, and the count-min estimates decide which keys are
+ worth a top-K counter
+ */
+template <typename Key, typename Hash>
+class KeySketch {
+private:
+    SpaceSaving<Key, Hash> top_bytes;
+    SpaceSaving<Key, Hash> top_packets;
+    CountMinSketch counts;
+    HyperLogLog distinct;
+
+public:
+    KeySketch(const TrafficSketchOptions& opts) :top_bytes{opts.top_counters}, top_packets{opts.top_counters}, counts{opts.count_width, opts.count_depth}, distinct{opts.distinct_precision} {};
+
+    void add(const Key& key, uint64_t bytes) {
+        uint64_t hash = Hash {}(key);
+        CountMinCell bound = counts.add(hash, bytes);
+        top_bytes.update(key, hash, bytes, bound.bytes);
+        top_packets.update(key, hash, 1, bound.packets);
+        distinct.add(hash);
+    }
+
+    const SpaceSaving<Key, Hash>& get_top_bytes(void) const { return top_bytes; }
+    const SpaceSaving<Key, Hash>& get_top_packets(void) const { return top_packets; }
+    CountMinCell estimate(const Key& key) const { return counts.estimate(Hash {}(key)); }
+    double estimate_distinct(void) const { return distinct.estimate(); }
+
+    // Throws SketchMismatch
+    void merge(const KeySketch& other) {
+        top_bytes.merge(other.top_bytes);
+        top_packets.merge(other.top_packets);
+        counts.merge(other.counts);
+        distinct.merge(other.distinct);
+    }
+
+    void write(SketchWriter& w) const {
+        top_bytes.write(w);
+        top_packets.write(w);
+        counts.write(w);
+        distinct.write(w);
+    }
+
+    // Throws MalformedSketch
+    void read(SketchReader& r) {
+        top_bytes.read(r);
+        top_packets.read(r);
+        counts.read(r);
+        distinct.read(r);
+    }
+};
+
+/*
+ Top talkers and distinct counts of IPv4 traffic in fixed memory (about 450KB with the default options, however many
+ hosts and flows there are), from the ip / tcphdr / udphdr a parse already found: per source address, per TCP / UDP
+ destination port and per flow (both directions together, as FlowKey::canonical).
+
+ Packets and bytes are counted as on the wire (bh_datalen), so a short snaplen does not shrink them. An update is three
+ hashes, three count-min and three HyperLogLog updates (a few ns each) and six top-K updates: cheap for a key already
+ held or one the count-min estimate keeps out, a trip through the heap for one that takes a counter over. Concentrated
+ traffic is mostly the former; with every key distinct (snifferpp_bench's sketch_update) about one in ten is the latter.
+
+ Not thread safe: give each thread its own and merge them, which gives the same answers (within the sketches' error
+ bounds) as one sketch would have over all the packets. write() and read() take the same to a snapshot and back, so
+ sketches from separate runs or hosts can be merged too.
+ */
+class TrafficSketch {
+private:
+    KeySketch<uint32_t, SourceHash> sources;
+    KeySketch<uint16_t, PortHash> ports;
+    KeySketch<FlowKey, FlowSketchHash> flows;
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t skipped; // Not IPv4
+
+public:
+    TrafficSketch(TrafficSketchOptions opts = TrafficSketchOptions {});
+
+    void update(const bpf_hdr& bhdr, const PacketView& packet) {
+        if (packet.get_network_kind() != NetworkKind::IPV4) {
+            ++skipped;
+            return;
+        }
+        uint64_t len = bhdr.bh_datalen;
+        FlowKey key = flow_key(packet);
+        ++packets;
+        bytes += len;
+        sources.add(key.src, len);
+        if (packet.get_transport_kind() == TransportKind::TCP || packet.get_transport_kind() == TransportKind::UDP) {
+            ports.add(key.dport, len);
+        }
+        flows.add(key.canonical(), len);
+    }
+
+    const KeySketch<uint32_t, SourceHash>& get_sources(void) const { return sources; }
+    const KeySketch<uint16_t, PortHash>& get_ports(void) const { return ports; }
+    const KeySketch<FlowKey, FlowSketchHash>& get_flows(void) const { return flows; }
+    uint64_t get_packets(void) const { return packets; }
+    uint64_t get_bytes(void) const { return bytes; }
+    uint64_t get_skipped(void) const { return skipped; }
+
+    // Throws SketchMismatch
+    void merge(const TrafficSketch& other);
+
+    // Appends a snapshot to out
+    void write(std::string& out) const;
+
+    // Replaces this sketch (sizes included) with a snapshot. Throws MalformedSketch
+    void read(const std::string& in);
+
+    /*
+     Totals, distinct counts and the top keys of each kind by bytes and by packets, with each count's error bound and
+     the other count's estimate
+     */
+    void write_report(std::ostream& os, size_t top) const;
+};
+
+#endif /* TrafficSketch_hpp */
@@ -0,0 +1,128 @@
+//
+//  CountingSource.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef CountingSource_hpp
+#define CountingSource_hpp
+
+#include <sys/time.h>
+#include "CaptureCounters.hpp"
+#include "LatencyHistogram.hpp"
+#include "Checksum.hpp"
+#include "BPFPacket.hpp"
+
+/*
+ A batch whose records are counted (packets, bytes, truncation, protocol) in counters as they are reached. Works with
+ single pass batches (PcapBatch) and only counts records the loop actually gets to, so a consumer that breaks out early
+ leaves the rest uncounted
+
+ pickup_us, when not 0, is the wall clock time the batch was handed over: each record's kernel timestamp to then goes
+ into the KERNEL_TO_USER latency histogram (in SNIFFERPP_LATENCY builds)
+
+ checksums: each record's IPv4 header and TCP / UDP checksums are verified, and the results counted
+ */
+template <typename Batch>
+class CountedBatch {
+public:
+    using base_iterator = typename Batch::iterator;
+
+    class iterator {
+    private:
+        base_iterator curr, last;
+        CaptureCounters* counters;
+        uint64_t pickup_us;
+        bool checksums;
+
+        void count(void) {
+            if (curr != last) {
+                auto&& record = *curr;
+                auto&& bhdr = record.get_bpf_header();
+                counters->count_record(record.get_data(), record.get_data_len(), bhdr.bh_datalen);
+                if (checksums) {
+                    counters->count_checksums(verify_checksums(record.get_data(), record.get_data_len(), record.is_checksum_partial()));
+                }
+#ifdef SNIFFERPP_LATENCY
+                if (pickup_us != 0) {
+                    int64_t waited_us = static_cast<int64_t>(pickup_us) - (static_cast<int64_t>(bhdr.bh_tstamp.tv_sec) * 1000000 + bhdr.bh_tstamp.tv_usec);
+                    LATENCY_RECORD(LatencyStage::KERNEL_TO_USER, waited_us > 0 ? static_cast<uint64_t>(waited_us) * 1000 : 0);
+                }
+#endif
+            }
+        }
+
+    public:
+        iterator(base_iterator curr, base_iterator last, CaptureCounters* counters, uint64_t pickup_us, bool checksums) :curr{curr}, last{last}, counters{counters}, pickup_us{pickup_us}, checksums{checksums} {};
+
+        decltype(auto) operator*(void) const { return *curr; }
+
+        iterator& operator++(void) {
+            ++curr;
+            count();
+            return *this;
+        }
+
+        bool operator!=(const iterator& other) const { return curr != other.curr; }
+        bool operator==(const iterator& other) const { return !(*this != other); }
+
+        friend class CountedBatch;
+    };
+
+private:
+    iterator first;
+    iterator last;
+
+public:
+    CountedBatch(base_iterator begin, base_iterator end, CaptureCounters* counters, uint64_t pickup_us = 0, bool checksums = false) :first{begin, end, counters, pickup_us, checksums}, last{end, end, counters, pickup_us, checksums} {
+        first.count();
+    };
+
+    iterator begin(void) const { return first; }
+    iterator end(void) const { return last; }
+
+    bool empty(void) const { return !(first != last); }
+};
+
+/*
+ Wraps a source (anything with readBatch(): a capture device, PcapFile, FilteredSource) so every record read from it is
+ counted in the reading thread's CaptureCounters, for the metrics export
+
+ live: the records' timestamps come from the kernel just now (a device, not a file), so the time from each of them
+ to the batch reaching us is worth recording
+
+ checksums: verify every record's checksums as it is counted (see verify_checksums). Errors are only counted, the
+ records are still passed on
+ */
+template <typename Source>
+class CountingSource {
+private:
+    Source& source;
+    bool live;
+    bool checksums;
+
+public:
+    CountingSource(Source& source, bool live = false, bool checksums = false) :source{source}, live{live}, checksums{checksums} {};
+
+    CountingSource(const CountingSource& other)= delete;
+    CountingSource operator=(const CountingSource& other)=delete;
+
+    auto readBatch(void) {
+        auto batch = source.readBatch();
+        uint64_t pickup_us = 0;
+#ifdef SNIFFERPP_LATENCY
+        if (live) {
+            timeval now;
+            gettimeofday(&now, nullptr);
+            pickup_us = static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_usec;
+        }
+#endif
+        // begin() only once, it reads the first record of single pass batches
+        auto it = batch.begin();
+        return CountedBatch<decltype(batch)> {it, batch.end(), &thread_counters(), pickup_us, checksums};
+    }
+};
+
+#endif /* CountingSource_hpp */
@@ -0,0 +1,302 @@
+//
+//  MetricsExporter.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <chrono>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "MetricsExporter.hpp"
+
+using std::string;
+using std::to_string;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+// HELP and TYPE lines that start a metric family
+static void add_family(string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+static void add_sample(string& out, const char* name, const string& labels, uint64_t value) {
+    out += name;
+    if (!labels.empty()) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    out += ' ';
+    out += to_string(value);
+    out += '\n';
+}
+
+#ifdef SNIFFERPP_LATENCY
+static void add_sample(string& out, const char* name, const string& labels, double value) {
+    char number[32];
+    snprintf(number, sizeof(number), "%.9g", value);
+    out += name;
+    out += '{';
+    out += labels;
+    out += "} ";
+    out += number;
+    out += '\n';
+}
+#endif
+
+string format_latency_prometheus() {
+    string out;
+#ifdef SNIFFERPP_LATENCY
+    const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    const char* quantile_names[] = {"0.5", "0.9", "0.99", "0.999"};
+    add_family(out, "snifferpp_stage_latency_seconds", "summary", "Time spent per packet (or per buffer fill) in each capture stage.");
+    for (size_t i = 0; i < LATENCY_STAGES; ++i) {
+        LatencyStage s = static_cast<LatencyStage>(i);
+        LatencySnapshot snap = merge_latency(s);
+        string stage = string {"stage=\""} + latency_stage_name(s) + "\"";
+        // No quantiles until something was recorded
+        for (size_t q = 0; q < 4 && snap.get_count() != 0; ++q) {
+            add_sample(out, "snifferpp_stage_latency_seconds", stage + ",quantile=\"" + quantile_names[q] + "\"", snap.percentile(quantiles[q]) / 1e9);
+        }
+        add_sample(out, "snifferpp_stage_latency_seconds_sum", stage, snap.get_mean() * snap.get_count() / 1e9);
+        add_sample(out, "snifferpp_stage_latency_seconds_count", stage, snap.get_count());
+    }
+#endif
+    return out;
+}
+
+string format_prometheus(const CaptureTotals& totals, const KernelStats* kernel) {
+    string out;
+    add_family(out, "snifferpp_packets_total", "counter", "Packets read from the capture source.");
+    add_sample(out, "snifferpp_packets_total", "", totals.packets);
+    add_family(out, "snifferpp_bytes_total", "counter", "Length on the wire of the packets read.");
+    add_sample(out, "snifferpp_bytes_total", "", totals.bytes);
+    add_family(out, "snifferpp_truncated_packets_total", "counter", "Packets captured short of their length on the wire.");
+    add_sample(out, "snifferpp_truncated_packets_total", "", totals.truncated);
+
+    add_family(out, "snifferpp_parse_errors_total", "counter", "Packets the parser rejected.");
+    add_sample(out, "snifferpp_parse_errors_total", "reason=\"unsupported_protocol\"", totals.unsupported);
+    add_sample(out, "snifferpp_parse_errors_total", "reason=\"invalid_input\"", totals.invalid);
+
+    add_family(out, "snifferpp_parse_failures_total", "counter", "Packets that could not be fully dissected, by reason.");
+    for (size_t i = 0; i < PARSE_STATUSES; ++i) {
+        if (static_cast<ParseStatus>(i) == ParseStatus::OK) {
+            continue;
+        }
+        string labels = string {"status=\""} + parse_status_name(static_cast<ParseStatus>(i)) + "\"";
+        add_sample(out, "snifferpp_parse_failures_total", labels, totals.parse_failures[i]);
+    }
+
+    add_family(out, "snifferpp_protocol_packets_total", "counter", "Packets read, by protocol.");
+    for (size_t i = 0; i < PROTOCOL_CLASSES; ++i) {
+        string labels = string {"protocol=\""} + protocol_class_name(static_cast<ProtocolClass>(i)) + "\"";
+        add_sample(out, "snifferpp_protocol_packets_total", labels, totals.protocol_packets[i]);
+    }
+    add_family(out, "snifferpp_protocol_bytes_total", "counter", "Length on the wire of the packets read, by protocol.");
+    for (size_t i = 0; i < PROTOCOL_CLASSES; ++i) {
+        string labels = string {"protocol=\""} + protocol_class_name(static_cast<ProtocolClass>(i)) + "\"";
+        add_sample(out, "snifferpp_protocol_bytes_total", labels, totals.protocol_bytes[i]);
+    }
+
+    add_family(out, "snifferpp_checksums_verified_total", "counter", "IPv4 header and TCP / UDP checksums checked (good or bad), by protocol.");
+    for (size_t i = 0; i < CHECKSUM_PROTOCOLS; ++i) {
+        string labels = string {"protocol=\""} + checksum_protocol_name(static_cast<ChecksumProtocol>(i)) + "\"";
+        add_sample(out, "snifferpp_checksums_verified_total", labels, totals.checksums_verified[i]);
+    }
+    add_family(out, "snifferpp_checksum_errors_total", "counter", "Checksums that did not add up, by protocol.");
+    for (size_t i = 0; i < CHECKSUM_PROTOCOLS; ++i) {
+        string labels = string {"protocol=\""} + checksum_protocol_name(static_cast<ChecksumProtocol>(i)) + "\"";
+        add_sample(out, "snifferpp_checksum_errors_total", labels, totals.checksum_errors[i]);
+    }
+
+    add_family(out, "snifferpp_queue_dropped_packets_total", "counter", "Packets dropped because a worker's queue was full.");
+    add_sample(out, "snifferpp_queue_dropped_packets_total", "", totals.queue_dropped);
+
+    if (kernel != nullptr) {
+        add_family(out, "snifferpp_kernel_received_packets_total", "counter", "Packets that reached the capture device, as counted by the kernel.");
+        add_sample(out, "snifferpp_kernel_received_packets_total", "", kernel->received);
+        add_family(out, "snifferpp_kernel_dropped_packets_total", "counter", "Packets the kernel dropped because the capture buffer was full.");
+        add_sample(out, "snifferpp_kernel_dropped_packets_total", "", kernel->dropped);
+    }
+    return out;
+}
+
+MetricsExporter::MetricsExporter(MetricsOptions o, std::function<bool(KernelStats&)> k) :opts{o}, kernel_stats{k}, listen_fd{-1}, stop_requested{false} {
+    if (opts.port == 0) {
+        return;
+    }
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd == -1) {
+        string m {"Opening metrics socket: "};
+        m += strerror(errno);
+        m += "\n";
+        throw MetricsNotStarted {m};
+    }
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(opts.port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 || listen(listen_fd, 8) == -1) {
+        string m {"Binding metrics port "};
+        m += to_string(opts.port) + ": " + strerror(errno) + "\n";
+        ::close(listen_fd);
+        listen_fd = -1;
+        throw MetricsNotStarted {m};
+    }
+}
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+    if (listen_fd != -1) {
+        ::close(listen_fd);
+    }
+}
+
+string MetricsExporter::render() {
+    KernelStats kernel;
+    bool have_kernel = kernel_stats && kernel_stats(kernel);
+    return format_prometheus(sum_thread_counters(), have_kernel ? &kernel : nullptr) + format_latency_prometheus();
+}
+
+void MetricsExporter::start() {
+    thread = std::thread {&MetricsExporter::run, this};
+}
+
+void MetricsExporter::stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+    stop_requested.store(true, std::memory_order_relaxed);
+    thread.join();
+    if (!opts.file.empty()) {
+        write_file();
+    }
+}
+
+void MetricsExporter::run() {
+    // Wake up at least this often to notice stop()
+    const int poll_ms = 100;
+    unsigned int since_write = opts.interval_ms;
+    unsigned int since_latency = 0;
+    while (!stop_requested.load(std::memory_order_relaxed)) {
+        if (!opts.file.empty() && since_write >= opts.interval_ms) {
+            write_file();
+            since_write = 0;
+        }
+        if (opts.latency_interval_ms != 0 && since_latency >= opts.latency_interval_ms) {
+            cerr << format_latency_report();
+            since_latency = 0;
+        }
+        if (listen_fd == -1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds {poll_ms});
+            since_write += poll_ms;
+            since_latency += poll_ms;
+            continue;
+        }
+
+        pollfd pfd {listen_fd, POLLIN, 0};
+        auto before = std::chrono::steady_clock::now();
+        if (poll(&pfd, 1, poll_ms) > 0) {
+            int client = accept(listen_fd, nullptr, nullptr);
+            if (client != -1) {
+                serve_client(client);
+                ::close(client);
+            }
+        }
+        unsigned int waited = static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - before).count());
+        since_write += waited;
+        since_latency += waited;
+    }
+}
+
+void MetricsExporter::serve_client(int client) {
+    // A slow or silent client must not hold up the next scrape for long
+    timeval tv {1, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    // Only the request line matters, the rest of the request is read so closing does not reset the connection
+    string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == string::npos && request.size() < 8192) {
+        ssize_t n = read(client, buffer, sizeof(buffer));
+        if (n <= 0) {
+            break;
+        }
+        request.append(buffer, n);
+    }
+
+    string status = "200 OK";
+    string body;
+    if (request.compare(0, 12, "GET /metrics") == 0 && request.size() > 12 && (request[12] == ' ' || request[12] == '?')) {
+        body = render();
+    } else {
+        status = "404 Not Found";
+        body = "Metrics are at /metrics\n";
+    }
+    string response = "HTTP/1.0 " + status + "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+
+    size_t done = 0;
+    while (done < response.size()) {
+        ssize_t w = write(client, response.data() + done, response.size() - done);
+        if (w <= 0) {
+            if (w == -1 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        done += w;
+    }
+}
+
+void MetricsExporter::write_file() {
+    // Readers (node_exporter's textfile collector, a tail) only ever see a complete file
+    string tmp = opts.file + ".tmp";
+    string text = render();
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        LOG_WARNING("Could not write metrics to %s: %s", tmp.c_str(), strerror(errno));
+        return;
+    }
+    size_t done = 0;
+    bool failed = false;
+    while (done < text.size()) {
+        ssize_t w = write(fd, text.data() + done, text.size() - done);
+        if (w == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            failed = true;
+            break;
+        }
+        done += w;
+    }
+    ::close(fd);
+    if (failed || rename(tmp.c_str(), opts.file.c_str()) == -1) {
+        LOG_WARNING("Could not write metrics to %s: %s", opts.file.c_str(), strerror(errno));
+        unlink(tmp.c_str());
+    }
+}
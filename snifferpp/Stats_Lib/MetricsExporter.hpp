@@ -0,0 +1,97 @@
+//
+//  MetricsExporter.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef MetricsExporter_hpp
+#define MetricsExporter_hpp
+
+#include <string>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <exception>
+#include "CaptureCounters.hpp"
+#include "LatencyHistogram.hpp"
+#include "Log.hpp"
+#include "BPFPacket.hpp"
+
+/*
+ Used to signal that the metrics endpoint could not be set up
+ */
+class MetricsNotStarted : public std::exception {
+private:
+    std::string message;
+public:
+    MetricsNotStarted() {};
+    MetricsNotStarted(std::string m) :message{m} {};
+
+    const char * what() {
+        message += "Metrics endpoint not started";
+        return message.c_str();
+    }
+};
+
+/*
+ Where the metrics go: a file rewritten every interval and/or a local HTTP endpoint (either can be left off)
+ */
+struct MetricsOptions {
+    std::string file; // Replaced atomically (written next to it, then renamed)
+    int port = 0; // Served on 127.0.0.1
+    unsigned int interval_ms = 1000; // How often the file is rewritten
+    unsigned int latency_interval_ms = 0; // How often the latency report goes to cerr, 0 for never
+};
+
+/*
+ The capture counters (summed over every thread) and, when given, the device's kernel counters as Prometheus text
+ */
+std::string format_prometheus(const CaptureTotals& totals, const KernelStats* kernel);
+
+/*
+ Every stage's latency histogram as a Prometheus summary (p50, p90, p99, p99.9, count and sum, in seconds)
+ Empty in builds without SNIFFERPP_LATENCY
+ */
+std::string format_latency_prometheus(void);
+
+/*
+ Publishes the metrics from a background thread, so exporting never runs on the capture path: the counters are read
+ with relaxed loads while the capture threads keep writing them.
+
+ With a port, GET /metrics is answered with the current text (anything else gets a 404), one connection at a time.
+ With a file, it is rewritten every interval and once more on stop(), so even a short run leaves the final totals.
+ With a latency interval, the latency report is printed to cerr that often.
+ */
+class MetricsExporter {
+private:
+    MetricsOptions opts;
+    std::function<bool(KernelStats&)> kernel_stats; // Empty if there is no device (reading a file)
+    int listen_fd;
+    std::atomic<bool> stop_requested;
+    std::thread thread;
+
+    void run(void);
+    void serve_client(int client);
+    void write_file(void);
+
+public:
+    // Binds the port, if one is set; throws MetricsNotStarted if that fails
+    MetricsExporter(MetricsOptions opts, std::function<bool(KernelStats&)> kernel_stats = nullptr);
+
+    MetricsExporter(const MetricsExporter& other)= delete;
+    MetricsExporter operator=(const MetricsExporter& other)=delete;
+
+    ~MetricsExporter();
+
+    void start(void);
+
+    // Writes the file one last time and waits for the thread to exit
+    void stop(void);
+
+    // The current metrics text
+    std::string render(void);
+};
+
+#endif /* MetricsExporter_hpp */
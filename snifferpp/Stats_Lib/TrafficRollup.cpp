@@ -0,0 +1,305 @@
+//
+//  TrafficRollup.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#include <algorithm>
+#include "TrafficRollup.hpp"
+
+using std::string;
+
+// Preamble and start of frame delimiter (8), FCS (4) and inter-frame gap (12): what a frame takes on the link besides bh_datalen
+static const uint64_t frame_overhead = 24;
+
+// Marks a row without a link share
+static const uint64_t no_permille = UINT64_MAX;
+
+bool parse_rollup_key(const string& name, RollupKey& key) {
+    if (name == "none") {
+        key = RollupKey::NONE;
+    } else if (name == "src") {
+        key = RollupKey::SOURCE;
+    } else if (name == "dst") {
+        key = RollupKey::DESTINATION;
+    } else if (name == "sport") {
+        key = RollupKey::SOURCE_PORT;
+    } else if (name == "dport") {
+        key = RollupKey::DESTINATION_PORT;
+    } else if (name == "vlan") {
+        key = RollupKey::VLAN;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+TrafficRollup::TrafficRollup(const string& interface, OutputBuffer& out, RollupOptions opts) :opts{opts}, interface{interface}, out{out}, stats{} {
+    // Every protocol class can have a series without a key and one for the keys past max_keys on top
+    uint32_t series = opts.max_keys + 2 * PROTOCOL_CLASSES;
+    uint32_t slots = 2;
+    while (slots < 2 * series) {
+        slots <<= 1;
+    }
+    mask = slots - 1;
+
+    levels[0] = Level {"ms", 1000, {}, 0, 0, false};
+    levels[1] = Level {"s", 1000000, {}, 0, 0, false};
+    levels[2] = Level {"min", 60000000, {}, 0, 0, false};
+    size_t ring_len[3] = {std::max<uint32_t>(opts.reorder_ms, 1), 2, 2};
+    for (int i = 0; i < 3; ++i) {
+        levels[i].ring.resize(ring_len[i]);
+        for (Window& w : levels[i].ring) {
+            w.index = 0;
+            w.open = false;
+            w.overflowed = false;
+            w.packets = 0;
+            w.bytes = 0;
+            w.count = 0;
+            w.keyed = 0;
+            w.series.resize(series);
+            w.slots.assign(slots, 0);
+        }
+    }
+
+    out.write("resolution,start_ms,interface,protocol,key,packets,bytes,link_pct\n");
+}
+
+uint64_t TrafficRollup::hash_key(const SeriesKey& key) {
+    uint64_t a, b;
+    memcpy(&a, key.value, sizeof(a));
+    memcpy(&b, key.value + sizeof(a), sizeof(b));
+    uint64_t h = a ^ (b * 0x9e3779b97f4a7c15ULL) ^ (uint64_t {key.protocol} << 56) ^ (uint64_t {key.kind} << 48);
+    // Murmur3 finaliser
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void TrafficRollup::make_key(const PacketView& packet, ProtocolClass protocol, SeriesKey& key) const {
+    memset(&key, 0, sizeof(key));
+    key.protocol = static_cast<uint8_t>(protocol);
+    key.kind = NO_VALUE;
+    // Headers a failed parse did get through are still good
+    bool network = packet.ok() || packet.get_failed_layer() == ParseLayer::TRANSPORT;
+    uint32_t number = 0;
+    switch (opts.key) {
+        case RollupKey::NONE:
+            return;
+        case RollupKey::SOURCE:
+        case RollupKey::DESTINATION:
+            if (network && packet.get_network_kind() == NetworkKind::IPV4) {
+                const ip& h = packet.get_ip_header().get_header();
+                memcpy(key.value, opts.key == RollupKey::SOURCE ? &h.ip_src : &h.ip_dst, sizeof(in_addr));
+                key.kind = IPV4_ADDRESS;
+            } else if (network && packet.get_network_kind() == NetworkKind::IPV6) {
+                const ip6_hdr& h = packet.get_ip6_header().get_header();
+                memcpy(key.value, opts.key == RollupKey::SOURCE ? &h.ip6_src : &h.ip6_dst, sizeof(in6_addr));
+                key.kind = IPV6_ADDRESS;
+            }
+            return;
+        case RollupKey::SOURCE_PORT:
+        case RollupKey::DESTINATION_PORT:
+            if (!packet.ok()) {
+                return;
+            }
+            if (packet.get_transport_kind() == TransportKind::TCP) {
+                const tcphdr& h = packet.get_tcp_header().get_header();
+                number = ntohs(opts.key == RollupKey::SOURCE_PORT ? h.th_sport : h.th_dport);
+            } else if (packet.get_transport_kind() == TransportKind::UDP) {
+                const udphdr& h = packet.get_udp_header().get_header();
+                number = ntohs(opts.key == RollupKey::SOURCE_PORT ? h.uh_sport : h.uh_dport);
+            } else {
+                return;
+            }
+            break;
+        case RollupKey::VLAN:
+            if (packet.get_vlan_count() == 0) {
+                return;
+            }
+            number = packet.get_vlan_id(0);
+            break;
+    }
+    memcpy(key.value, &number, sizeof(number));
+    key.kind = NUMBER;
+}
+
+void TrafficRollup::count(Window& w, const SeriesKey& key, uint64_t hash, uint64_t bytes) {
+    size_t s = hash & mask;
+    while (w.slots[s] != 0) {
+        Series& series = w.series[w.slots[s] - 1];
+        if (memcmp(&series.key, &key, sizeof(key)) == 0) {
+            ++series.packets;
+            series.bytes += bytes;
+            return;
+        }
+        s = (s + 1) & mask;
+    }
+    if (key.kind != NO_VALUE && key.kind != OTHER_KEYS) {
+        if (w.keyed == opts.max_keys) {
+            w.overflowed = true;
+            SeriesKey other;
+            memset(&other, 0, sizeof(other));
+            other.protocol = key.protocol;
+            other.kind = OTHER_KEYS;
+            count(w, other, hash_key(other), bytes);
+            return;
+        }
+        ++w.keyed;
+    }
+    w.series[w.count] = Series {key, 1, bytes};
+    w.slots[s] = ++w.count;
+}
+
+void TrafficRollup::add(Level& level, uint64_t index, const SeriesKey& key, uint64_t hash, uint64_t bytes) {
+    if (!level.started) {
+        level.started = true;
+        level.oldest = index;
+        level.newest = index;
+    }
+    if (index < level.oldest) {
+        if (&level == &levels[0]) {
+            ++stats.late;
+        }
+        return;
+    }
+    uint64_t ring_len = level.ring.size();
+    if (index >= level.oldest + ring_len) {
+        close_before(level, index - ring_len + 1);
+    }
+    level.newest = std::max(level.newest, index);
+    // Everything open is within ring_len of oldest, so the slot is this window's or free
+    Window& w = level.ring[index % ring_len];
+    if (!w.open) {
+        w.open = true;
+        w.index = index;
+    }
+    ++w.packets;
+    w.bytes += bytes;
+    count(w, key, hash, bytes);
+}
+
+void TrafficRollup::update(const bpf_hdr& bhdr, const PacketView& packet) {
+    SeriesKey key;
+    make_key(packet, classify_protocol(packet.get_bytes(), packet.get_len()), key);
+    uint64_t hash = hash_key(key);
+    uint64_t us = static_cast<uint64_t>(bhdr.bh_tstamp.tv_sec) * 1000000 + static_cast<uint64_t>(bhdr.bh_tstamp.tv_usec);
+    ++stats.packets;
+    stats.bytes += bhdr.bh_datalen;
+    for (Level& level : levels) {
+        add(level, us / level.resolution_us, key, hash, bhdr.bh_datalen);
+    }
+}
+
+void TrafficRollup::advance(uint64_t now_us) {
+    for (Level& level : levels) {
+        uint64_t index = now_us / level.resolution_us;
+        if (level.started && index >= level.oldest + level.ring.size()) {
+            close_before(level, index - level.ring.size() + 1);
+        }
+    }
+}
+
+void TrafficRollup::flush() {
+    for (Level& level : levels) {
+        if (level.started) {
+            close_before(level, level.newest + 1);
+        }
+    }
+    out.flush();
+}
+
+void TrafficRollup::close_before(Level& level, uint64_t end) {
+    uint64_t ring_len = level.ring.size();
+    // After a long gap only one turn of the ring can hold anything
+    uint64_t last = std::min(end, level.oldest + ring_len);
+    for (uint64_t i = level.oldest; i < last; ++i) {
+        Window& w = level.ring[i % ring_len];
+        if (w.open && w.index == i) {
+            close(level, w);
+        }
+    }
+    level.oldest = std::max(level.oldest, end);
+}
+
+void TrafficRollup::close(Level& level, Window& w) {
+    uint64_t start_ms = w.index * (level.resolution_us / 1000);
+    for (uint32_t i = 0; i < w.count; ++i) {
+        const Series& s = w.series[i];
+        write_row(level.name, start_ms, protocol_class_name(static_cast<ProtocolClass>(s.key.protocol)), &s.key, s.packets, s.bytes, no_permille);
+    }
+    if (&level == &levels[0] && opts.link_bps != 0) {
+        // Bits in the millisecond, times 1000 for per second, times 1000 for tenths of a percent
+        uint64_t permille = (w.bytes + frame_overhead * w.packets) * 8 * 1000000 / opts.link_bps;
+        if (permille > stats.peak_permille) {
+            stats.peak_permille = permille;
+            stats.peak_start_ms = start_ms;
+        }
+        if (permille > uint64_t {opts.burst_percent} * 10) {
+            ++stats.bursts;
+            write_row("burst", start_ms, "all", nullptr, w.packets, w.bytes, permille);
+        }
+    }
+    if (w.overflowed) {
+        ++stats.overflowed_windows;
+    }
+    std::fill(w.slots.begin(), w.slots.end(), 0);
+    w.open = false;
+    w.overflowed = false;
+    w.packets = 0;
+    w.bytes = 0;
+    w.count = 0;
+    w.keyed = 0;
+}
+
+void TrafficRollup::write_row(const char* resolution, uint64_t start_ms, const char* protocol, const SeriesKey* key, uint64_t packets, uint64_t bytes, uint64_t permille) {
+    out.write(resolution);
+    out.put(',');
+    out.write_uint(start_ms);
+    out.put(',');
+    out.write(interface);
+    out.put(',');
+    out.write(protocol);
+    out.put(',');
+    char addr[INET6_ADDRSTRLEN];
+    uint32_t number;
+    switch (key != nullptr ? key->kind : NO_VALUE) {
+        case NUMBER:
+            memcpy(&number, key->value, sizeof(number));
+            out.write_uint(number);
+            break;
+        case IPV4_ADDRESS:
+            // inet_ntop goes through sprintf, which would be most of the cost of a row
+            for (int i = 0; i < 4; ++i) {
+                if (i != 0) {
+                    out.put('.');
+                }
+                out.write_uint(key->value[i]);
+            }
+            break;
+        case IPV6_ADDRESS:
+            out.write(inet_ntop(AF_INET6, key->value, addr, sizeof(addr)));
+            break;
+        case OTHER_KEYS:
+            out.write("other");
+            break;
+        default:
+            out.put('-');
+    }
+    out.put(',');
+    out.write_uint(packets);
+    out.put(',');
+    out.write_uint(bytes);
+    out.put(',');
+    if (permille != no_permille) {
+        out.write_uint(permille / 10);
+        out.put('.');
+        out.write_uint(permille % 10);
+    }
+    out.put('\n');
+}
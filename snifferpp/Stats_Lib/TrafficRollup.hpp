@@ -0,0 +1,151 @@
+//
+//  TrafficRollup.hpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+#ifndef TrafficRollup_hpp
+#define TrafficRollup_hpp
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "CaptureCounters.hpp"
+#include "PacketView.hpp"
+#include "BPFPacket.hpp"
+#include "OutputBuffer.hpp"
+
+/*
+ What a rollup splits each protocol's traffic by, besides time: nothing, an address, a port or the outermost VLAN
+ */
+enum class RollupKey {NONE, SOURCE, DESTINATION, SOURCE_PORT, DESTINATION_PORT, VLAN};
+
+// none, src, dst, sport, dport or vlan. Returns false for anything else
+bool parse_rollup_key(const std::string& name, RollupKey& key);
+
+/*
+ Sizing and microburst detection for a TrafficRollup
+ */
+struct RollupOptions {
+    RollupKey key = RollupKey::NONE;
+    uint32_t max_keys = 128; // Per window; traffic of any more keys is counted under "other"
+    uint32_t reorder_ms = 64; // How far behind the latest capture timestamp a packet can be and still count
+    uint64_t link_bps = 0; // Link capacity, 0 to not look for microbursts
+    unsigned int burst_percent = 50; // A 1ms window over this share of link_bps is a microburst
+};
+
+/*
+ Totals over a rollup's life
+ */
+struct RollupStats {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t late; // Too far behind to count in their 1ms window (still counted in the coarser ones if they can be)
+    uint64_t overflowed_windows; // Windows that had more than max_keys keys
+    uint64_t bursts;
+    uint64_t peak_permille; // Busiest 1ms window, in tenths of a percent of link_bps
+    uint64_t peak_start_ms;
+};
+
+/*
+ Packets and bytes per protocol class and key, in tumbling windows of 1ms, 1s and 1min of capture time (bh_tstamp), so
+ a capture file rolls up exactly as the traffic did live. Bytes are as on the wire (bh_datalen), and frames that do not
+ dissect count too (under their protocol class, with no key), so the totals are the link's.
+
+ Each resolution is a ring of windows, one per slot, recycled in place: a window is written out when a packet arrives
+ too far ahead for it to get any more (reorder_ms for 1ms; one window for the others), and its slot reused. A window
+ is a small open addressing table of series (protocol class and key), sized for max_keys at construction, so nothing
+ is allocated per packet. An update is a probe per resolution; what costs is writing rows, so with every packet from a
+ new key (snifferpp_bench's rollup_update) it is about one row per packet, and with a few busy keys next to nothing.
+
+ Every closed window goes to out as one CSV row per series:
+
+    resolution,start_ms,interface,protocol,key,packets,bytes,link_pct
+    ms,1700000000123,eth0,tcp,10.0.0.1,12,15000,
+
+ resolution is ms, s or min, start_ms the window's start in milliseconds since the epoch, protocol a ProtocolClass
+ name. With link_bps set, a 1ms window whose traffic (with 24 bytes of preamble, FCS and inter-frame gap per frame) is
+ over burst_percent of it also gets a row with resolution burst, protocol all and link_pct its share of the link.
+
+ Not thread safe: feed it from the capture thread, which sees packets in (nearly) timestamp order.
+ */
+class TrafficRollup {
+private:
+    enum ValueKind : uint8_t {NO_VALUE, NUMBER, IPV4_ADDRESS, IPV6_ADDRESS, OTHER_KEYS};
+
+    struct SeriesKey {
+        uint8_t protocol; // ProtocolClass
+        ValueKind kind; // What value holds
+        uint8_t value[16]; // An address (IPv4 in the first 4 bytes) or a number, zero padded
+    };
+
+    struct Series {
+        SeriesKey key;
+        uint64_t packets;
+        uint64_t bytes;
+    };
+
+    struct Window {
+        uint64_t index; // Start time over the resolution
+        bool open;
+        bool overflowed;
+        uint64_t packets;
+        uint64_t bytes;
+        uint32_t count; // Series in use
+        uint32_t keyed; // Of which for a key (not NO_VALUE or OTHER_KEYS), at most max_keys
+        std::vector<Series> series;
+        std::vector<uint32_t> slots; // Index into series + 1, 0 if empty
+    };
+
+    struct Level {
+        const char* name;
+        uint64_t resolution_us;
+        std::vector<Window> ring;
+        uint64_t oldest; // Lowest window index that may still be open
+        uint64_t newest;
+        bool started;
+    };
+
+    RollupOptions opts;
+    std::string interface;
+    OutputBuffer& out;
+    Level levels[3];
+    uint32_t mask; // Of each window's slots
+    RollupStats stats;
+
+    static uint64_t hash_key(const SeriesKey& key);
+    void make_key(const PacketView& packet, ProtocolClass protocol, SeriesKey& key) const;
+
+    void count(Window& w, const SeriesKey& key, uint64_t hash, uint64_t bytes);
+    void add(Level& level, uint64_t index, const SeriesKey& key, uint64_t hash, uint64_t bytes);
+
+    // Writes out and empties every window of level with an index below end
+    void close_before(Level& level, uint64_t end);
+    void close(Level& level, Window& w);
+    // key nullptr for none; permille UINT64_MAX leaves link_pct empty
+    void write_row(const char* resolution, uint64_t start_ms, const char* protocol, const SeriesKey* key, uint64_t packets, uint64_t bytes, uint64_t permille);
+
+public:
+    // interface labels every row. Writes the header row to out
+    TrafficRollup(const std::string& interface, OutputBuffer& out, RollupOptions opts = RollupOptions {});
+
+    TrafficRollup(const TrafficRollup& other)= delete;
+    TrafficRollup operator=(const TrafficRollup& other)=delete;
+
+    // packet may be only partly parsed (see parse_packet)
+    void update(const bpf_hdr& bhdr, const PacketView& packet);
+
+    /*
+     Closes the windows a packet stamped now_us (microseconds since the epoch) would, for when a live capture goes quiet
+     */
+    void advance(uint64_t now_us);
+
+    // Closes every window still open, oldest first (at the end of a capture)
+    void flush(void);
+
+    const RollupStats& get_stats(void) const { return stats; }
+};
+
+#endif /* TrafficRollup_hpp */
@@ -0,0 +1,391 @@
+//
+//  filter_test.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+/*
+ Checks filter expressions against synthetic frames through the BPF interpreter: protocols, hosts, nets, ports and TCP
+ flags on plain IPv4 frames, and the frames the generated code has to be careful with (IP options moving the transport
+ header, VLAN tags moving everything, fragments after the first carrying no transport header, captures cut short).
+
+ Every expression is compiled with and without the optimiser; both programs have to pass validate() and give the
+ expected verdict on every frame, so an optimisation that changes what a filter matches shows up here.
+
+ Exits non-zero, listing the failures, if any check fails.
+
+    snifferpp_filter_test
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include "FilterCompiler.hpp"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static const uint32_t snaplen = 65535;
+
+static void put16(vector<byte_t>& v, size_t off, uint16_t x) {
+    v[off] = static_cast<byte_t>(x >> 8);
+    v[off+1] = static_cast<byte_t>(x);
+}
+
+static void put32(vector<byte_t>& v, size_t off, uint32_t x) {
+    put16(v, off, static_cast<uint16_t>(x >> 16));
+    put16(v, off+2, static_cast<uint16_t>(x));
+}
+
+static uint32_t ipv4(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    return static_cast<uint32_t>(a) << 24 | static_cast<uint32_t>(b) << 16 | static_cast<uint32_t>(c) << 8 | d;
+}
+
+/*
+ What goes into a synthetic IPv4 frame. fragment is the IP flags and fragment offset field as it goes on the wire
+ */
+struct FrameSpec {
+    uint32_t src = ipv4(10, 0, 0, 1);
+    uint32_t dst = ipv4(192, 168, 1, 2);
+    uint8_t protocol = IPPROTO_TCP;
+    uint16_t sport = 40000;
+    uint16_t dport = 80;
+    uint8_t tcp_flags = TH_ACK;
+    uint16_t fragment = 0;
+    size_t ip_opts = 0; // Bytes of NOPs, a multiple of 4
+    bool vlan = false; // An 802.1Q tag between the MACs and the EtherType
+};
+
+static vector<byte_t> make_frame(const FrameSpec& s) {
+    size_t l4_len = s.protocol == IPPROTO_TCP ? 20 : 8;
+    size_t eth_len = s.vlan ? 18 : 14;
+    size_t ip_len = 20 + s.ip_opts + l4_len + 16;
+    vector<byte_t> d(eth_len + ip_len, 0);
+    for (int b = 0; b < 6; ++b) {
+        d[b] = static_cast<byte_t>(0x02);
+        d[6+b] = static_cast<byte_t>(0x04);
+    }
+    if (s.vlan) {
+        put16(d, 12, 0x8100);
+        put16(d, 14, 100);
+    }
+    put16(d, eth_len - 2, 0x0800);
+
+    size_t ip = eth_len;
+    d[ip] = static_cast<byte_t>(0x40 | ((20 + s.ip_opts) / 4));
+    put16(d, ip+2, static_cast<uint16_t>(ip_len));
+    put16(d, ip+4, 0x1234);
+    put16(d, ip+6, s.fragment);
+    d[ip+8] = 64;
+    d[ip+9] = static_cast<byte_t>(s.protocol);
+    put32(d, ip+12, s.src);
+    put32(d, ip+16, s.dst);
+    memset(&d[ip+20], 1, s.ip_opts);
+
+    // Filled in whatever the protocol, so a filter reading a fragment's data as ports or flags would find these
+    size_t l4 = ip + 20 + s.ip_opts;
+    put16(d, l4, s.sport);
+    put16(d, l4+2, s.dport);
+    if (s.protocol == IPPROTO_TCP) {
+        d[l4+12] = static_cast<byte_t>(5 << 4);
+        d[l4+13] = static_cast<byte_t>(s.tcp_flags);
+        put16(d, l4+14, 65535);
+    } else {
+        put16(d, l4+4, static_cast<uint16_t>(8 + 16));
+    }
+    return d;
+}
+
+static vector<byte_t> make_arp(void) {
+    vector<byte_t> d(14 + 28, 0);
+    for (int b = 0; b < 6; ++b) {
+        d[b] = static_cast<byte_t>(0xff);
+        d[6+b] = static_cast<byte_t>(0x04);
+    }
+    put16(d, 12, 0x0806);
+    put16(d, 14, 1);
+    put16(d, 16, 0x0800);
+    d[18] = 6;
+    d[19] = 4;
+    put16(d, 20, 1);
+    // Where an IPv4 header has its protocol and addresses (inside the sender's MAC and address) put a TCP frame's,
+    // so only the EtherType tells them apart
+    d[14+9] = static_cast<byte_t>(IPPROTO_TCP);
+    put32(d, 14+12, ipv4(10, 0, 0, 1));
+    put32(d, 14+16, ipv4(192, 168, 1, 2));
+    return d;
+}
+
+struct TestFrame {
+    const char* name;
+    vector<byte_t> data;
+    size_t captured; // Bytes the interpreter gets to see, the rest were cut off by the snaplen
+};
+
+static TestFrame frame(const char* name, const FrameSpec& s) {
+    vector<byte_t> d = make_frame(s);
+    size_t len = d.size();
+    return TestFrame {name, std::move(d), len};
+}
+
+static TestFrame truncated(const char* name, const FrameSpec& s, size_t captured) {
+    return TestFrame {name, make_frame(s), captured};
+}
+
+struct Case {
+    const char* expression;
+    const char* frame;
+    bool matches;
+};
+
+static int failures = 0;
+
+static void fail(const Case& c, const string& what) {
+    cerr << "FAIL \"" << c.expression << "\" on " << c.frame << ": " << what << endl;
+    ++failures;
+}
+
+static const TestFrame* find_frame(const vector<TestFrame>& frames, const char* name) {
+    for (const TestFrame& f : frames) {
+        if (strcmp(f.name, name) == 0) {
+            return &f;
+        }
+    }
+    return nullptr;
+}
+
+int main(void) {
+    FrameSpec tcp_syn;
+    tcp_syn.tcp_flags = TH_SYN;
+    FrameSpec tcp_synack;
+    tcp_synack.sport = 80;
+    tcp_synack.dport = 40000;
+    tcp_synack.src = ipv4(192, 168, 1, 2);
+    tcp_synack.dst = ipv4(10, 0, 0, 1);
+    tcp_synack.tcp_flags = TH_SYN | TH_ACK;
+    FrameSpec tcp_fin;
+    tcp_fin.tcp_flags = TH_FIN | TH_ACK;
+    tcp_fin.dport = 443;
+    FrameSpec udp_dns;
+    udp_dns.protocol = IPPROTO_UDP;
+    udp_dns.sport = 5353;
+    udp_dns.dport = 53;
+    udp_dns.dst = ipv4(10, 1, 2, 3);
+    FrameSpec icmp;
+    icmp.protocol = IPPROTO_ICMP;
+    icmp.sport = 80; // Type and code, then the checksum: reads as port 80 to a filter that forgets the protocol
+    icmp.dport = 80;
+    FrameSpec gre;
+    gre.protocol = 47;
+    FrameSpec ip_opts;
+    ip_opts.ip_opts = 12;
+    ip_opts.tcp_flags = TH_RST;
+    FrameSpec vlan_tcp;
+    vlan_tcp.vlan = true;
+    FrameSpec first_fragment;
+    first_fragment.fragment = IP_MF;
+    FrameSpec later_fragment;
+    later_fragment.fragment = 185; // 1480 bytes in, no MF: the last piece
+    later_fragment.tcp_flags = TH_SYN;
+    FrameSpec later_udp_fragment;
+    later_udp_fragment.protocol = IPPROTO_UDP;
+    later_udp_fragment.fragment = IP_MF | 100;
+    later_udp_fragment.dport = 53;
+    FrameSpec dont_fragment;
+    dont_fragment.fragment = IP_DF;
+
+    vector<TestFrame> frames;
+    frames.push_back(frame("tcp syn", tcp_syn));
+    frames.push_back(frame("tcp syn-ack", tcp_synack));
+    frames.push_back(frame("tcp fin", tcp_fin));
+    frames.push_back(frame("udp dns", udp_dns));
+    frames.push_back(frame("icmp", icmp));
+    frames.push_back(frame("gre", gre));
+    frames.push_back(frame("ip options", ip_opts));
+    frames.push_back(frame("vlan tcp", vlan_tcp));
+    frames.push_back(frame("first fragment", first_fragment));
+    frames.push_back(frame("later fragment", later_fragment));
+    frames.push_back(frame("later udp fragment", later_udp_fragment));
+    frames.push_back(frame("dont fragment", dont_fragment));
+    frames.push_back(TestFrame {"arp", make_arp(), 14 + 28});
+    // Cut off before the IP protocol, and just before the TCP flags
+    frames.push_back(truncated("tcp cut in ip", tcp_syn, 14 + 8));
+    frames.push_back(truncated("tcp cut before flags", tcp_syn, 14 + 20 + 12));
+
+    const Case cases[] = {
+        // Link and network layer protocols
+        {"ip", "tcp syn", true},
+        {"ip", "arp", false},
+        {"ip", "vlan tcp", false},
+        {"arp", "arp", true},
+        {"arp", "tcp syn", false},
+        {"not ip", "vlan tcp", true},
+        {"not ip", "arp", true},
+        {"ip", "tcp cut in ip", true},
+
+        // Transport protocols
+        {"tcp", "tcp syn", true},
+        {"tcp", "udp dns", false},
+        {"tcp", "arp", false},
+        {"tcp", "vlan tcp", false},
+        {"tcp", "later fragment", true},
+        {"udp", "udp dns", true},
+        {"udp", "later udp fragment", true},
+        {"icmp", "icmp", true},
+        {"icmp", "tcp syn", false},
+        {"proto 47", "gre", true},
+        {"proto 47", "tcp syn", false},
+        {"proto tcp", "tcp fin", true},
+        {"proto 6", "udp dns", false},
+        {"tcp or udp", "icmp", false},
+        {"tcp or udp", "udp dns", true},
+        {"tcp", "tcp cut in ip", false},
+
+        // Hosts
+        {"host 10.0.0.1", "tcp syn", true},
+        {"host 10.0.0.1", "tcp syn-ack", true},
+        {"src host 10.0.0.1", "tcp syn", true},
+        {"src host 10.0.0.1", "tcp syn-ack", false},
+        {"dst host 10.0.0.1", "tcp syn-ack", true},
+        {"dst host 10.0.0.1", "tcp syn", false},
+        {"host 10.0.0.2", "tcp syn", false},
+        {"host 192.168.1.2", "later fragment", true},
+        {"host 10.0.0.1", "arp", false},
+        {"host 10.0.0.1", "vlan tcp", false},
+        {"host 10.0.0.1 and host 192.168.1.2", "tcp syn", true},
+        {"host 10.0.0.1 and host 10.1.2.3", "udp dns", true},
+        {"host 10.0.0.1 and host 10.1.2.3", "tcp syn", false},
+
+        // Nets
+        {"net 10.0.0.0/8", "udp dns", true},
+        {"net 10.0.0.0/8", "tcp syn-ack", true},
+        {"src net 10.0.0.0/8", "tcp syn-ack", false},
+        {"dst net 10.1.0.0/16", "udp dns", true},
+        {"dst net 10.1.0.0/16", "tcp syn", false},
+        {"net 192.168.1.0/24", "tcp syn", true},
+        {"net 192.168.0.0/24", "tcp syn", false},
+        {"net 10.1.2.3", "udp dns", true},
+        {"net 10.1.2.0/31", "udp dns", false},
+        {"net 0.0.0.0/0", "gre", true},
+        {"net 0.0.0.0/0", "arp", false},
+        {"not net 172.16.0.0/12", "tcp syn", true},
+
+        // Ports
+        {"port 80", "tcp syn", true},
+        {"port 80", "tcp syn-ack", true},
+        {"dst port 80", "tcp syn", true},
+        {"dst port 80", "tcp syn-ack", false},
+        {"src port 80", "tcp syn-ack", true},
+        {"port 53", "udp dns", true},
+        {"udp port 53", "udp dns", true},
+        {"tcp port 53", "udp dns", false},
+        {"udp dst port 53", "udp dns", true},
+        {"udp src port 53", "udp dns", false},
+        {"port 80", "icmp", false},
+        {"port 80", "gre", false},
+        {"port 80", "ip options", true},
+        {"dst port 40000", "ip options", false},
+        {"port 80", "vlan tcp", false},
+        {"port 80", "first fragment", true},
+        {"port 80", "dont fragment", true},
+        {"port 80", "later fragment", false},
+        {"not port 80", "later fragment", true},
+        {"port 53", "later udp fragment", false},
+        {"port 80", "tcp cut in ip", false},
+        {"port 443 or port 80", "tcp fin", true},
+        {"tcp port 80 or udp", "udp dns", true},
+        {"tcp port 80 or udp", "tcp fin", false},
+
+        // TCP flags
+        {"flags syn", "tcp syn", true},
+        {"flags syn", "tcp syn-ack", true},
+        {"flags syn", "tcp fin", false},
+        {"flags syn|fin", "tcp fin", true},
+        {"flags rst", "ip options", true},
+        {"flags ack", "ip options", false},
+        {"flags syn and not flags ack", "tcp syn", true},
+        {"flags syn and not flags ack", "tcp syn-ack", false},
+        {"flags syn", "udp dns", false},
+        {"flags syn", "later fragment", false},
+        {"flags ack", "vlan tcp", false},
+        {"flags ack", "first fragment", true},
+        {"flags syn", "tcp cut before flags", false},
+        {"port 80", "tcp cut before flags", true},
+
+        // Combinations the optimiser folds
+        {"ip and tcp and port 80", "tcp syn", true},
+        {"tcp and (port 80 or port 443) and not host 10.9.9.9", "tcp fin", true},
+        {"(tcp or udp) and not (port 80 or port 53)", "tcp fin", true},
+        {"(tcp or udp) and not (port 80 or port 53)", "udp dns", false},
+        {"not (ip and not arp)", "arp", true},
+        {"not (ip and not arp)", "tcp syn", false},
+        {"ip && (udp || flags rst) && !port 53", "ip options", true},
+        {"ip && (udp || flags rst) && !port 53", "udp dns", false},
+    };
+
+    int checked = 0;
+    for (const Case& c : cases) {
+        const TestFrame* f = find_frame(frames, c.frame);
+        if (f == nullptr) {
+            fail(c, "no such frame");
+            continue;
+        }
+        BPFProgram programs[2];
+        try {
+            programs[0] = compile_filter(c.expression, false, snaplen);
+            programs[1] = compile_filter(c.expression, true, snaplen);
+        } catch(FilterSyntaxError e) {
+            fail(c, e.what());
+            continue;
+        }
+        uint32_t verdicts[2];
+        for (int optimized = 0; optimized < 2; ++optimized) {
+            const BPFProgram& prog = programs[optimized];
+            const char* which = optimized ? "optimised" : "unoptimised";
+            if (!prog.validate()) {
+                fail(c, string {which} + " program does not validate");
+            }
+            verdicts[optimized] = prog.run(f->data.data(), f->data.size(), f->captured);
+            if (verdicts[optimized] != (c.matches ? snaplen : 0)) {
+                fail(c, string {which} + " program returned " + std::to_string(verdicts[optimized]) + (c.matches ? ", expected a match" : ", expected no match"));
+            }
+        }
+        if (verdicts[0] != verdicts[1]) {
+            fail(c, "optimised and unoptimised programs disagree");
+        }
+        if (programs[1].get_len() > programs[0].get_len()) {
+            fail(c, "optimised program is longer");
+        }
+        ++checked;
+    }
+
+    // Every expression against every frame: the two programs must agree wherever no verdict is written down
+    for (const Case& c : cases) {
+        BPFProgram unoptimized, optimized;
+        try {
+            unoptimized = compile_filter(c.expression, false, snaplen);
+            optimized = compile_filter(c.expression, true, snaplen);
+        } catch(FilterSyntaxError e) {
+            continue;
+        }
+        for (const TestFrame& f : frames) {
+            if (unoptimized.run(f.data.data(), f.data.size(), f.captured) != optimized.run(f.data.data(), f.data.size(), f.captured)) {
+                fail(Case {c.expression, f.name, false}, "optimised and unoptimised programs disagree");
+            }
+            ++checked;
+        }
+    }
+
+    if (failures != 0) {
+        cerr << failures << " of " << checked << " filter checks failed" << endl;
+        return 1;
+    }
+    cout << checked << " filter checks passed" << endl;
+    return 0;
+}
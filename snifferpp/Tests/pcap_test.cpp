@@ -0,0 +1,351 @@
+//
+//  pcap_test.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+/*
+ Writes small pcap and pcapng files and reads them back through PcapFile: records and their timestamps in both byte
+ orders and both pcap resolutions, records captured short of the packet (is_truncated()), files cut off in the middle of
+ a record or block (the end of the file, not an error), and captures of a link type other than Ethernet, which have to
+ be turned down with MalformedPcap rather than handed to the Ethernet dissector.
+
+ The files go to $TMPDIR (or /tmp) and are removed again.
+
+ Exits non-zero, listing the failures, if any check fails.
+
+    snifferpp_pcap_test
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include "PcapFile.hpp"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static const uint16_t linktype_ethernet = 1;
+static const uint16_t linktype_raw = 101;
+static const uint16_t linktype_linux_sll = 113;
+
+static int failures = 0;
+static int checked = 0;
+
+static void fail(const char* test, const string& what) {
+    cerr << "FAIL " << test << ": " << what << endl;
+    ++failures;
+}
+
+static void expect(const char* test, const char* what, uint64_t got, uint64_t want) {
+    ++checked;
+    if (got != want) {
+        fail(test, string {what} + " is " + std::to_string(got) + ", expected " + std::to_string(want));
+    }
+}
+
+/*
+ Builds a capture file in memory, in either byte order
+ */
+class FileBuilder {
+private:
+    bool swapped;
+
+public:
+    vector<byte_t> bytes;
+
+    FileBuilder(bool swapped = false) :swapped{swapped} {}
+
+    void u16(uint16_t x) {
+        if (swapped) {
+            x = __builtin_bswap16(x);
+        }
+        const byte_t* p = reinterpret_cast<const byte_t*>(&x);
+        bytes.insert(bytes.end(), p, p + sizeof(x));
+    }
+
+    void u32(uint32_t x) {
+        if (swapped) {
+            x = __builtin_bswap32(x);
+        }
+        const byte_t* p = reinterpret_cast<const byte_t*>(&x);
+        bytes.insert(bytes.end(), p, p + sizeof(x));
+    }
+
+    void data(const vector<byte_t>& d) { bytes.insert(bytes.end(), d.begin(), d.end()); }
+
+    void pad(void) {
+        while (bytes.size() % 4 != 0) {
+            bytes.push_back(0);
+        }
+    }
+
+    void pcap_header(uint32_t magic, uint16_t link_type) {
+        u32(magic);
+        u16(2);
+        u16(4);
+        u32(0); // thiszone
+        u32(0); // sigfigs
+        u32(65535);
+        u32(link_type);
+    }
+
+    void pcap_record(uint32_t ts_sec, uint32_t ts_frac, const vector<byte_t>& d, uint32_t origlen) {
+        u32(ts_sec);
+        u32(ts_frac);
+        u32(static_cast<uint32_t>(d.size()));
+        u32(origlen);
+        data(d);
+    }
+
+    void pcapng_section(void) {
+        u32(0x0A0D0D0A);
+        u32(28);
+        u32(0x1A2B3C4D);
+        u16(1);
+        u16(0);
+        u32(0xffffffff); // Section length unknown
+        u32(0xffffffff);
+        u32(28);
+    }
+
+    void pcapng_interface(uint16_t link_type) {
+        u32(0x00000001);
+        u32(20);
+        u16(link_type);
+        u16(0);
+        u32(65535);
+        u32(20);
+    }
+
+    // Timestamps in the default resolution, microseconds
+    void pcapng_packet(uint32_t interface_id, uint64_t ts_usec, const vector<byte_t>& d, uint32_t origlen) {
+        uint32_t block_len = static_cast<uint32_t>(32 + ((d.size() + 3) & ~size_t {3}));
+        u32(0x00000006);
+        u32(block_len);
+        u32(interface_id);
+        u32(static_cast<uint32_t>(ts_usec >> 32));
+        u32(static_cast<uint32_t>(ts_usec));
+        u32(static_cast<uint32_t>(d.size()));
+        u32(origlen);
+        data(d);
+        pad();
+        u32(block_len);
+    }
+};
+
+/*
+ A FileBuilder's bytes written out to a temporary file, removed again when it goes
+ */
+class TempFile {
+private:
+    string path;
+
+public:
+    TempFile(const vector<byte_t>& bytes) {
+        const char* dir = getenv("TMPDIR");
+        path = string {dir != nullptr && *dir != '\0' ? dir : "/tmp"} + "/snifferpp_pcap_test.XXXXXX";
+        int fd = mkstemp(&path[0]);
+        if (fd == -1) {
+            cerr << "Creating " << path << ": " << strerror(errno) << endl;
+            exit(1);
+        }
+        if (write(fd, bytes.data(), bytes.size()) != static_cast<ssize_t>(bytes.size())) {
+            cerr << "Writing " << path << ": " << strerror(errno) << endl;
+            exit(1);
+        }
+        ::close(fd);
+    }
+
+    TempFile(const TempFile& other)= delete;
+    TempFile operator=(const TempFile& other)=delete;
+
+    ~TempFile() {
+        unlink(path.c_str());
+    }
+
+    const string& get_path(void) const { return path; }
+};
+
+static vector<byte_t> frame(size_t len, byte_t fill) {
+    return vector<byte_t>(len, fill);
+}
+
+static vector<PcapRecord> read_all(PcapFile& file) {
+    vector<PcapRecord> records;
+    PcapRecord rec;
+    while (file.next(rec)) {
+        records.push_back(rec);
+    }
+    return records;
+}
+
+// Opening and reading every record has to throw MalformedPcap
+static void expect_malformed(const char* test, const vector<byte_t>& bytes) {
+    TempFile tmp {bytes};
+    ++checked;
+    try {
+        PcapFile file {tmp.get_path()};
+        read_all(file);
+        fail(test, "read without MalformedPcap");
+    } catch(MalformedPcap e) {
+    } catch(PcapFileNotOpened e) {
+        fail(test, string {"PcapFileNotOpened instead of MalformedPcap: "} + e.what());
+    }
+}
+
+static void check_pcap(const char* test, bool swapped, uint32_t magic, uint32_t frac_per_usec) {
+    FileBuilder b {swapped};
+    b.pcap_header(magic, linktype_ethernet);
+    b.pcap_record(100, 250 * frac_per_usec, frame(60, 1), 60);
+    b.pcap_record(101, 999999 * frac_per_usec, frame(96, 2), 1514); // Cut to a 96 byte snaplen
+    TempFile tmp {b.bytes};
+
+    try {
+        PcapFile file {tmp.get_path()};
+        vector<PcapRecord> records = read_all(file);
+        expect(test, "records", records.size(), 2);
+        if (records.size() != 2) {
+            return;
+        }
+        expect(test, "first record length", records[0].get_data_len(), 60);
+        expect(test, "first record truncated", records[0].is_truncated(), false);
+        expect(test, "first record seconds", records[0].get_ts_sec(), 100);
+        expect(test, "first record nanoseconds", records[0].get_ts_nsec(), 250000);
+        expect(test, "first record link type", records[0].get_link_type(), linktype_ethernet);
+        expect(test, "first record first byte", records[0].get_data()[0], 1);
+        expect(test, "second record length", records[1].get_data_len(), 96);
+        expect(test, "second record truncated", records[1].is_truncated(), true);
+        expect(test, "second record capture length", records[1].get_bpf_header().bh_caplen, 96);
+        expect(test, "second record original length", records[1].get_bpf_header().bh_datalen, 1514);
+        expect(test, "second record microseconds", static_cast<uint64_t>(records[1].get_bpf_header().bh_tstamp.tv_usec), 999999);
+        expect(test, "bytes consumed", file.get_curr_bytes_consumed(), b.bytes.size());
+
+        file.rewind();
+        size_t again = 0;
+        for (auto&& rec : file.readBatch()) {
+            (void)rec;
+            ++again;
+        }
+        expect(test, "records after rewind", again, 2);
+    } catch(MalformedPcap e) {
+        fail(test, e.what());
+    } catch(PcapFileNotOpened e) {
+        fail(test, e.what());
+    }
+}
+
+int main(void) {
+    check_pcap("pcap", false, 0xa1b2c3d4, 1);
+    check_pcap("pcap byte swapped", true, 0xa1b2c3d4, 1);
+    check_pcap("pcap nanosecond", false, 0xa1b23c4d, 1000);
+    check_pcap("pcap nanosecond byte swapped", true, 0xa1b23c4d, 1000);
+
+    // Cut off in the record header, then in the record data: both are the end of the file, after the whole records
+    for (size_t cut : {size_t {8}, size_t {16 + 30}}) {
+        const char* test = cut == 8 ? "pcap cut in a record header" : "pcap cut in a record";
+        FileBuilder b;
+        b.pcap_header(0xa1b2c3d4, linktype_ethernet);
+        b.pcap_record(1, 0, frame(60, 1), 60);
+        size_t whole = b.bytes.size();
+        b.pcap_record(2, 0, frame(60, 2), 60);
+        b.bytes.resize(whole + cut);
+        TempFile tmp {b.bytes};
+        try {
+            PcapFile file {tmp.get_path()};
+            expect(test, "records", read_all(file).size(), 1);
+            expect(test, "bytes consumed", file.get_curr_bytes_consumed(), whole);
+        } catch(MalformedPcap e) {
+            fail(test, e.what());
+        } catch(PcapFileNotOpened e) {
+            fail(test, e.what());
+        }
+    }
+
+    {
+        FileBuilder b;
+        b.pcap_header(0xa1b2c3d4, linktype_raw);
+        b.pcap_record(1, 0, frame(40, 0x45), 40);
+        expect_malformed("pcap raw IP", b.bytes);
+    }
+    {
+        FileBuilder b {true};
+        b.pcap_header(0xa1b2c3d4, linktype_linux_sll);
+        b.pcap_record(1, 0, frame(60, 0), 60);
+        expect_malformed("pcap Linux cooked byte swapped", b.bytes);
+    }
+
+    for (bool swapped : {false, true}) {
+        const char* test = swapped ? "pcapng byte swapped" : "pcapng";
+        FileBuilder b {swapped};
+        b.pcapng_section();
+        b.pcapng_interface(linktype_ethernet);
+        b.pcapng_packet(0, 5000001ULL, frame(62, 3), 62); // Length not a multiple of 4, so the block is padded
+        b.pcapng_packet(0, 6000000ULL, frame(128, 4), 9000);
+        size_t whole = b.bytes.size();
+        b.pcapng_packet(0, 7000000ULL, frame(60, 5), 60);
+        b.bytes.resize(b.bytes.size() - 4); // The last block loses its trailing length
+        TempFile tmp {b.bytes};
+        try {
+            PcapFile file {tmp.get_path()};
+            vector<PcapRecord> records = read_all(file);
+            expect(test, "records", records.size(), 2);
+            expect(test, "bytes consumed", file.get_curr_bytes_consumed(), whole);
+            if (records.size() == 2) {
+                expect(test, "first record length", records[0].get_data_len(), 62);
+                expect(test, "first record truncated", records[0].is_truncated(), false);
+                expect(test, "first record seconds", records[0].get_ts_sec(), 5);
+                expect(test, "first record nanoseconds", records[0].get_ts_nsec(), 1000);
+                expect(test, "first record last byte", records[0].get_data()[61], 3);
+                expect(test, "second record length", records[1].get_data_len(), 128);
+                expect(test, "second record truncated", records[1].is_truncated(), true);
+                expect(test, "second record original length", records[1].get_bpf_header().bh_datalen, 9000);
+            }
+        } catch(MalformedPcap e) {
+            fail(test, e.what());
+        } catch(PcapFileNotOpened e) {
+            fail(test, e.what());
+        }
+    }
+
+    {
+        FileBuilder b;
+        b.pcapng_section();
+        b.pcapng_interface(linktype_linux_sll);
+        b.pcapng_packet(0, 0, frame(60, 0), 60);
+        expect_malformed("pcapng Linux cooked", b.bytes);
+    }
+    {
+        // Only the second interface is the wrong type
+        FileBuilder b;
+        b.pcapng_section();
+        b.pcapng_interface(linktype_ethernet);
+        b.pcapng_packet(0, 0, frame(60, 0), 60);
+        b.pcapng_interface(linktype_raw);
+        b.pcapng_packet(1, 0, frame(40, 0x45), 40);
+        expect_malformed("pcapng second interface raw IP", b.bytes);
+    }
+    {
+        // Says it holds more than the block does
+        FileBuilder b;
+        b.pcapng_section();
+        b.pcapng_interface(linktype_ethernet);
+        b.pcapng_packet(0, 0, frame(60, 0), 60);
+        b.bytes[b.bytes.size() - 60 - 4 - 8] = 200;
+        expect_malformed("pcapng capture length past the block", b.bytes);
+    }
+
+    if (failures != 0) {
+        cerr << failures << " of " << checked << " pcap checks failed" << endl;
+        return 1;
+    }
+    cout << checked << " pcap checks passed" << endl;
+    return 0;
+}
@@ -0,0 +1,288 @@
+//
+//  reassembler_test.cpp
+//  tcp_demo
+//
+//  Created by Robert Arnott on 10/17/26.
+//  Copyright © 2026 Robert Arnott. All rights reserved.
+//
+
+/*
+ Feeds the TCP reassembler hand-built segments and checks the byte streams it hands back: segments in order, out of
+ order (held in the pool until the hole fills, including ones split over several chunks), overlapping what was already
+ delivered or what is already queued, plain retransmissions, sequence numbers wrapping past 2^32, holes skipped once the
+ other side acknowledges past them, and connections closed by FIN, RST and flush().
+
+ After every case the pool has to be empty again, so a chunk that is never handed back shows up here too.
+
+ Exits non-zero, listing the failures, if any check fails.
+
+    snifferpp_reassembler_test
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include "TCPReassembler.hpp"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static const uint32_t client_isn = 1000;
+static const uint32_t server_isn = 5000;
+
+static int failures = 0;
+static int checked = 0;
+
+static void fail(const char* test, const string& what) {
+    cerr << "FAIL " << test << ": " << what << endl;
+    ++failures;
+}
+
+static void expect(const char* test, const char* what, const string& got, const string& want) {
+    ++checked;
+    if (got != want) {
+        fail(test, string {what} + " is \"" + got + "\", expected \"" + want + "\"");
+    }
+}
+
+static void expect(const char* test, const char* what, uint64_t got, uint64_t want) {
+    ++checked;
+    if (got != want) {
+        fail(test, string {what} + " is " + std::to_string(got) + ", expected " + std::to_string(want));
+    }
+}
+
+// Room for a few dozen segments is all any case needs
+static TCPReassemblerOptions small_pool(size_t chunk_len = 2048) {
+    TCPReassemblerOptions opts;
+    opts.pool_bytes = 64 * chunk_len;
+    opts.chunk_len = chunk_len;
+    return opts;
+}
+
+/*
+ One connection between a client and a server, and what the reassembler handed back for it
+ */
+class Conversation {
+private:
+    FlowKey client;
+    TCPReassembler reassembler;
+
+    void send(const FlowKey& key, uint8_t flags, uint32_t seq, uint32_t ack, const string& payload) {
+        tcphdr tcp;
+        memset(&tcp, 0, sizeof(tcp));
+        tcp.th_seq = htonl(seq);
+        tcp.th_ack = htonl(ack);
+        tcp.th_off = 5;
+        tcp.th_flags = flags;
+        reassembler.process(key, tcp, reinterpret_cast<const byte_t*>(payload.data()), payload.size(), 0);
+    }
+
+public:
+    string streams[2]; // Client to server, server to client
+    vector<StreamClose> closes;
+
+    Conversation(TCPReassemblerOptions opts = small_pool())
+        :client{htonl(0x0a000001), htonl(0xc0a80102), htons(40000), htons(80), IPPROTO_TCP},
+         reassembler{opts,
+            // The client always sends the first segment, so dir 0 is its stream
+            [this](const FlowKey&, int dir, const byte_t* data, size_t len) { streams[dir].append(reinterpret_cast<const char*>(data), len); },
+            [this](const FlowKey&, StreamClose reason) { closes.push_back(reason); }} {}
+
+    Conversation(const Conversation& other)= delete;
+    Conversation operator=(const Conversation& other)=delete;
+
+    void from_client(uint8_t flags, uint32_t seq, uint32_t ack, const string& payload = "") { send(client, flags, seq, ack, payload); }
+    void from_server(uint8_t flags, uint32_t seq, uint32_t ack, const string& payload = "") { send(client.reversed(), flags, seq, ack, payload); }
+
+    // SYN, SYN-ACK: the client's data then starts at client_isn+1, the server's at server_isn+1
+    void handshake(void) {
+        from_client(TH_SYN, client_isn, 0);
+        from_server(TH_SYN | TH_ACK, server_isn, client_isn + 1);
+    }
+
+    void flush(void) { reassembler.flush(); }
+    TCPReassemblerStats get_stats(void) const { return reassembler.get_stats(); }
+};
+
+// Nothing queued may be left behind once a case is over
+static void expect_pool_empty(const char* test, Conversation& c) {
+    c.flush();
+    expect(test, "pool chunks in use after flush", c.get_stats().pool_in_use, 0);
+}
+
+int main(void) {
+    const uint32_t c0 = client_isn + 1;
+    const uint32_t s0 = server_isn + 1;
+
+    {
+        const char* test = "in order";
+        Conversation c;
+        c.handshake();
+        c.from_client(TH_ACK, c0, s0, "GET / ");
+        c.from_client(TH_ACK, c0 + 6, s0, "HTTP/1.1");
+        c.from_server(TH_ACK, s0, c0 + 14, "200 OK");
+        expect(test, "client stream", c.streams[0], "GET / HTTP/1.1");
+        expect(test, "server stream", c.streams[1], "200 OK");
+        expect(test, "out of order segments", c.get_stats().out_of_order_segments, 0);
+        expect(test, "pool chunks in use", c.get_stats().pool_in_use, 0);
+        expect_pool_empty(test, c);
+    }
+
+    {
+        const char* test = "out of order";
+        Conversation c;
+        c.handshake();
+        c.from_client(TH_ACK, c0 + 8, s0, "ijkl");
+        c.from_client(TH_ACK, c0 + 4, s0, "efgh");
+        expect(test, "client stream before the hole fills", c.streams[0], "");
+        expect(test, "out of order segments", c.get_stats().out_of_order_segments, 2);
+        expect(test, "pool chunks in use", c.get_stats().pool_in_use, 2);
+        c.from_client(TH_ACK, c0, s0, "abcd");
+        expect(test, "client stream", c.streams[0], "abcdefghijkl");
+        expect(test, "pool chunks in use once drained", c.get_stats().pool_in_use, 0);
+        expect_pool_empty(test, c);
+    }
+
+    {
+        const char* test = "out of order over several chunks";
+        Conversation c {small_pool(4)};
+        c.handshake();
+        c.from_client(TH_ACK, c0 + 3, s0, "defghijklm");
+        expect(test, "pool chunks in use", c.get_stats().pool_in_use, 3);
+        c.from_client(TH_ACK, c0, s0, "abc");
+        expect(test, "client stream", c.streams[0], "abcdefghijklm");
+        expect_pool_empty(test, c);
+    }
+
+    {
+        const char* test = "retransmission";
+        Conversation c;
+        c.handshake();
+        c.from_client(TH_ACK, c0, s0, "abcd");
+        c.from_client(TH_ACK, c0, s0, "abcd");
+        c.from_client(TH_ACK, c0 + 4, s0, "efgh");
+        expect(test, "client stream", c.streams[0], "abcdefgh");
+        expect(test, "duplicate bytes", c.get_stats().duplicate_bytes, 4);
+        expect_pool_empty(test, c);
+    }
+
+    {
+        const char* test = "overlapping delivered data";
+        Conversation c;
+        c.handshake();
+        c.from_client(TH_ACK, c0, s0, "abcd");
+        c.from_client(TH_ACK, c0 + 2, s0, "cdefg");
+        expect(test, "client stream", c.streams[0], "abcdefg");
+        expect(test, "duplicate bytes", c.get_stats().duplicate_bytes, 2);
+        expect_pool_empty(test, c);
+    }
+
+    {
+        const char* test = "overlapping queued data";
+        Conversation c;
+        c.handshake();
+        c.from_client(TH_ACK, c0 + 6, s0, "ghij");
+        c.from_client(TH_ACK, c0 + 4, s0, "efgh");
+        c.from_client(TH_ACK, c0 + 4, s0, "efgh"); // Same segment queued twice
+        c.from_client(TH_ACK, c0, s0, "abcdef"); // Reaches into the first queued segment
+        expect(test, "client stream", c.streams[0], "abcdefghij");
+        expect(test, "duplicate bytes", c.get_stats().duplicate_bytes, 4 + 2 + 2);
+        expect_pool_empty(test, c);
+    }
+
+    {
+        const char* test = "sequence wraparound";
+        Conversation c;
+        // The client's data starts 2 bytes short of 2^32
+        c.from_client(TH_SYN, 0xfffffffd, 0);
+        c.from_server(TH_SYN | TH_ACK, server_isn, 0xfffffffe);
+        c.from_client(TH_ACK, 0xfffffffe, s0, "abcd");
+        c.from_client(TH_ACK, 2, s0, "efgh");
+        expect(test, "client stream", c.streams[0], "abcdefgh");
+        expect(test, "out of order segments", c.get_stats().out_of_order_segments, 0);
+        expect_pool_empty(test, c);
+    }
+
+    {
+        const char* test = "out of order across wraparound";
+        Conversation c;
+        c.from_client(TH_SYN, 0xfffffffb, 0);
+        c.from_server(TH_SYN | TH_ACK, server_isn, 0xfffffffc);
+        c.from_client(TH_ACK, 4, s0, "ijkl");
+        c.from_client(TH_ACK, 0, s0, "efgh");
+        c.from_client(TH_ACK, 0xfffffffe, s0, "cdef"); // Overlaps the segment queued at 0
+        expect(test, "client stream before the hole fills", c.streams[0], "");
+        c.from_client(TH_ACK, 0xfffffffc, s0, "ab");
+        expect(test, "client stream", c.streams[0], "abcdefghijkl");
+        expect(test, "duplicate bytes", c.get_stats().duplicate_bytes, 2);
+        expect_pool_empty(test, c);
+    }
+
+    {
+        const char* test = "hole skipped on ack";
+        Conversation c;
+        c.handshake();
+        c.from_client(TH_ACK, c0, s0, "abcd");
+        c.from_client(TH_ACK, c0 + 8, s0, "ijkl"); // The capture lost "efgh"
+        c.from_server(TH_ACK, s0, c0 + 12);
+        expect(test, "client stream", c.streams[0], "abcdijkl");
+        expect(test, "gap bytes", c.get_stats().gap_bytes, 4);
+        expect_pool_empty(test, c);
+    }
+
+    {
+        const char* test = "fin";
+        Conversation c;
+        c.handshake();
+        c.from_client(TH_ACK | TH_FIN, c0, s0, "bye");
+        c.from_server(TH_ACK | TH_FIN, s0, c0 + 4, "ok");
+        expect(test, "client stream", c.streams[0], "bye");
+        expect(test, "server stream", c.streams[1], "ok");
+        expect(test, "closes", c.closes.size(), 1);
+        if (c.closes.size() == 1) {
+            expect(test, "close reason", static_cast<uint64_t>(c.closes[0]), static_cast<uint64_t>(StreamClose::FIN));
+        }
+        expect(test, "connections", c.get_stats().connections, 0);
+    }
+
+    {
+        const char* test = "rst";
+        Conversation c;
+        c.handshake();
+        c.from_client(TH_ACK, c0 + 4, s0, "efgh");
+        c.from_server(TH_RST, s0, 0);
+        expect(test, "closes", c.closes.size(), 1);
+        if (c.closes.size() == 1) {
+            expect(test, "close reason", static_cast<uint64_t>(c.closes[0]), static_cast<uint64_t>(StreamClose::RST));
+        }
+        // Queued data is handed over, past the hole, before the connection goes
+        expect(test, "client stream", c.streams[0], "efgh");
+        expect(test, "pool chunks in use", c.get_stats().pool_in_use, 0);
+    }
+
+    {
+        const char* test = "flush";
+        Conversation c;
+        c.handshake();
+        c.from_client(TH_ACK, c0, s0, "ab");
+        c.from_client(TH_ACK, c0 + 6, s0, "gh");
+        c.from_client(TH_ACK, c0 + 4, s0, "ef");
+        c.flush();
+        expect(test, "client stream", c.streams[0], "abefgh");
+        expect(test, "gap bytes", c.get_stats().gap_bytes, 2);
+        expect(test, "closes", c.closes.size(), 1);
+        expect(test, "pool chunks in use", c.get_stats().pool_in_use, 0);
+    }
+
+    if (failures != 0) {
+        cerr << failures << " of " << checked << " reassembler checks failed" << endl;
+        return 1;
+    }
+    cout << checked << " reassembler checks passed" << endl;
+    return 0;
+}
@@ -8,10 +8,35 @@
 
 #include <iostream>
 #include <iomanip>
+#include <fstream>
+#include <sstream>
 #include <map>
 #include <unordered_map>
+#include <mutex>
+#include <cstdlib>
+#include <fcntl.h>
 #include "packet_sniffer.hpp"
+#include "PcapFile.hpp"
+#include "PcapWriter.hpp"
+#include "Pipeline.hpp"
+#include "FlowTable.hpp"
+#include "TCPReassembler.hpp"
+#include "FilterCompiler.hpp"
+#include "FilteredSource.hpp"
+#include "PatternMatcher.hpp"
+#include "TrafficSketch.hpp"
+#include "PacketFormatter.hpp"
+#include "CountingSource.hpp"
+#include "MetricsExporter.hpp"
+#include "TrafficRollup.hpp"
+#include "ColumnWriter.hpp"
+#include "ColumnFile.hpp"
+#ifdef __linux__
+#include "AFPacket_util.hpp"
+#include "FanoutCapture.hpp"
+#else
 #include "BPF_util.hpp"
+#endif
 
 using std::unordered_map;
 using std::string;
@@ -22,6 +47,16 @@ using std::cout;
 using std::cerr;
 using std::endl;
 
+#ifdef __linux__
+using CaptureDevice = AFPacketDevice;
+using DeviceNotOpened = AFPacketDeviceNotOpened;
+const string default_interface = "eth0";
+#else
+using CaptureDevice = BPFDevice;
+using DeviceNotOpened = BPFDeviceNotOpened;
+const string default_interface = "en0";
+#endif
+
 // Generic code for parsing commandline arguments into a map
 // Assume --key value pairs.
 unordered_map<string, string> get_arg_dict(int argc, const char * argv[]) {
@@ -37,45 +72,921 @@ unordered_map<string, string> get_arg_dict(int argc, const char * argv[]) {
     return arg_dict;
 }
 
-void print_bytes(vector<byte_t> bytes) {
-    for(auto b : bytes) {
-        std::cout << std::setfill('0') << std::setw(2) << std::hex << (0xff & (unsigned char) b) << " ";
+void print_bytes(const vector<byte_t>& bytes) {
+    vector<char> dump(hex_dump_size(bytes.size()));
+    cout.write(dump.data(), hex_dump(dump.data(), bytes.data(), bytes.size()));
+}
+
+
+/*
+ Writes a sketch snapshot to path. Returns false, having said why, if it could not
+ */
+bool save_sketch(const TrafficSketch& sketch, const string& path) {
+    string snapshot;
+    sketch.write(snapshot);
+    std::ofstream out {path, std::ios::binary};
+    if (!out.write(snapshot.data(), static_cast<std::streamsize>(snapshot.size())) || !out.flush()) {
+        cerr << "Could not write sketch to " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+ Merges the sketch snapshots in a comma separated list of files and prints the top ones of each kind; --sketch-out
+ saves the merged sketch. Returns main's exit status
+ */
+int merge_sketches(unordered_map<string, string>& arg_dict) {
+    TrafficSketch merged;
+    std::istringstream list {arg_dict["--sketch-merge"]};
+    string path;
+    bool first = true;
+    while (std::getline(list, path, ',')) {
+        std::ifstream in {path, std::ios::binary};
+        std::ostringstream contents;
+        if (!in || !(contents << in.rdbuf())) {
+            cerr << "Could not read sketch " << path << endl;
+            return 1;
+        }
+        try {
+            TrafficSketch sketch;
+            sketch.read(contents.str());
+            if (first) {
+                merged = sketch;
+                first = false;
+            } else {
+                merged.merge(sketch);
+            }
+        } catch(MalformedSketch e) {
+            cerr << path << ": " << e.what() << endl;
+            return 1;
+        } catch(SketchMismatch e) {
+            cerr << path << ": " << e.what() << endl;
+            return 1;
+        }
+    }
+    merged.write_report(cout, arg_dict.count("--top") ? std::stoul(arg_dict["--top"]) : 10);
+    if (arg_dict.count("--sketch-out") && !save_sketch(merged, arg_dict["--sketch-out"])) {
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ Prints packets from a batch of records (BPFBatch, AFPacketBatch or PcapBatch) until max_packets supported ones have been printed
+ Returns how many were printed
+ */
+template <typename Batch>
+size_t print_packets(Batch&& batch, PacketFormatter& formatter, size_t max_packets) {
+    size_t printed = 0;
+    for (auto&& record : batch) {
+        // Parse underlying packet where it sits
+        PacketView p = parse_packet(record.get_data(), record.get_data_len());
+        if (!p.ok()) {
+            // Counted by parse_packet already; the reason only with --log-level verbose, and rate limited there
+            LOG_VERBOSE("%s (%s %s header)", p.get_parse_error(), parse_status_name(p.get_parse_status()), parse_layer_name(p.get_failed_layer()));
+            continue;
+        }
+        formatter.write(record.get_bpf_header(), p);
+        if (++printed == max_packets) {
+            break;
+        }
+    }
+    return printed;
+}
+
+/*
+ Copies records from a source (a capture device or PcapFile) into writer until max_packets have been queued
+ or the source runs dry
+ */
+template <typename Source>
+void save_packets(Source& source, PcapWriter& writer, size_t max_packets) {
+    size_t saved = 0;
+    while (saved < max_packets) {
+        size_t in_batch = 0;
+        for (auto&& record : source.readBatch()) {
+            ++in_batch;
+            writer.write(record);
+            if (++saved == max_packets) {
+                break;
+            }
+        }
+        if (in_batch == 0) {
+            break;
+        }
+    }
+    writer.close();
+    cerr << "Wrote " << writer.get_written_bytes() << " bytes to " << writer.get_files_opened() << " file(s), dropped " << writer.get_dropped_packets() << " packets (" << writer.get_dropped_bytes() << " bytes)" << endl;
+}
+
+/*
+ What a pipeline captured and each worker's queue counters, to cerr
+ */
+void print_pipeline_stats(const PipelineStats& stats) {
+    cerr << "Captured " << stats.captured << " packets (" << stats.non_ip << " not IP)" << endl;
+    for (size_t i = 0; i < stats.workers.size(); ++i) {
+        const WorkerStats& w = stats.workers[i];
+        cerr << "Worker " << i << ": enqueued " << w.enqueued << ", dropped " << w.dropped << ", processed " << w.processed << ", unsupported " << w.unsupported << ", invalid " << w.invalid << ", max depth " << w.max_depth << endl;
+    }
+}
+
+/*
+ Prints packets from source with the parsing spread over opts.workers threads (see Pipeline), until max_packets
+ supported ones have been printed or the source runs dry (drain_source, for files)
+ */
+template <typename Source>
+void pipeline_packets(Source& source, PipelineOptions opts, PacketFormatter& formatter, size_t max_packets, bool drain_source) {
+    std::mutex print_lock;
+    std::atomic<size_t> printed {0};
+    Pipeline* running = nullptr;
+    
+    Pipeline pipeline {opts, [&](unsigned int, const bpf_hdr& bhdr, const PacketView& p) {
+        // Workers can still be draining packets queued before stop() took effect
+        size_t n = printed.fetch_add(1, std::memory_order_relaxed);
+        if (n >= max_packets) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard {print_lock};
+            formatter.write(bhdr, p);
+        }
+        if (n + 1 == max_packets) {
+            running->stop();
+        }
+    }};
+    running = &pipeline;
+    pipeline.start(source, drain_source);
+    pipeline.wait();
+    formatter.flush();
+    print_pipeline_stats(pipeline.get_stats());
+}
+
+/*
+ Tracks flows over max_packets packets from source, printing each one as it expires (after idle_timeout seconds of
+ capture time without traffic) and whatever is still active at the end
+ */
+template <typename Source>
+void summarize_flows(Source& source, uint32_t idle_timeout, size_t max_packets) {
+    FlowTableOptions opts;
+    opts.idle_timeout = idle_timeout;
+    FlowTable table {opts};
+    auto print_flow = [](const FlowRecord& flow) { cout << flow << endl; };
+    
+    size_t seen = 0;
+    uint64_t now_sec = 0;
+    while (seen < max_packets) {
+        size_t in_batch = 0;
+        for (auto&& record : source.readBatch()) {
+            ++in_batch;
+            bpf_hdr bhdr = record.get_bpf_header();
+            now_sec = bhdr.bh_tstamp.tv_sec;
+            PacketView p = parse_packet(record.get_data(), record.get_data_len());
+            // Anything else is not a flow we can track, skip it
+            if (p.ok()) {
+                table.update(bhdr, p);
+            }
+            if (++seen == max_packets) {
+                break;
+            }
+        }
+        if (in_batch == 0) {
+            break;
+        }
+        // Age once per batch rather than per packet
+        table.expire(now_sec, print_flow);
+    }
+    table.flush(print_flow);
+    cerr << "Tracked " << table.get_expired() << " flows, " << table.get_insert_failures() << " refused (table full)" << endl;
+}
+
+/*
+ Searches the payloads of max_packets packets from source for the patterns matcher was built from, printing every
+ packet with a match: which patterns (as written in the file, texts) and where in the payload
+ */
+template <typename Source>
+void match_packets(Source& source, const PatternMatcher& matcher, const vector<string>& texts, size_t max_packets) {
+    vector<PatternMatch> matches;
+    size_t seen = 0;
+    uint64_t scanned_bytes = 0;
+    uint64_t matched_packets = 0;
+    uint64_t total_matches = 0;
+    while (seen < max_packets) {
+        size_t in_batch = 0;
+        for (auto&& record : source.readBatch()) {
+            ++in_batch;
+            ++seen;
+            PacketView p = parse_packet(record.get_data(), record.get_data_len());
+            if (p.ok()) {
+                matches.clear();
+                scanned_bytes += p.get_data_len();
+                if (matcher.find_all(p.get_data(), p.get_data_len(), matches) != 0) {
+                    ++matched_packets;
+                    total_matches += matches.size();
+                    cout << "Packet " << seen << " (" << p.get_data_len() << " payload bytes):";
+                    for (size_t i = 0; i < matches.size(); ++i) {
+                        cout << (i ? ", " : " ") << texts[matches[i].pattern] << " at " << matches[i].offset;
+                    }
+                    cout << endl;
+                }
+            }
+            if (seen == max_packets) {
+                break;
+            }
+        }
+        if (in_batch == 0) {
+            break;
+        }
+    }
+    cerr << "Scanned " << seen << " packets (" << scanned_bytes << " payload bytes), " << total_matches << " matches in " << matched_packets << " packets" << endl;
+}
+
+/*
+ Reassembles the TCP connections in max_packets packets from source and prints their data as it becomes contiguous,
+ giving up on connections idle for idle_timeout seconds of capture time
+ */
+template <typename Source>
+void follow_streams(Source& source, uint32_t idle_timeout, const HexDumpOptions& dump_opts, size_t max_packets) {
+    TCPReassemblerOptions opts;
+    opts.idle_timeout = idle_timeout;
+    TCPReassembler reassembler {opts, [&dump_opts](const FlowKey& conn, int dir, const byte_t* data, size_t len) {
+        in_addr src {dir == 0 ? conn.src : conn.dst};
+        in_addr dst {dir == 0 ? conn.dst : conn.src};
+        // inet_ntoa shares one buffer, so print the two addresses separately
+        cout << "Stream " << inet_ntoa(src) << ":" << ntohs(dir == 0 ? conn.sport : conn.dport);
+        cout << " -> " << inet_ntoa(dst) << ":" << ntohs(dir == 0 ? conn.dport : conn.sport) << ", " << len << " Bytes" << endl;
+        print_payload(cout, data, len, dump_opts) << endl;
+    }, [](const FlowKey& conn, StreamClose reason) {
+        in_addr src {conn.src};
+        in_addr dst {conn.dst};
+        cout << "Closed " << inet_ntoa(src) << ":" << ntohs(conn.sport);
+        cout << " <-> " << inet_ntoa(dst) << ":" << ntohs(conn.dport) << " (" << reason << ")" << endl << endl;
+    }};
+    
+    size_t seen = 0;
+    uint64_t now_sec = 0;
+    while (seen < max_packets) {
+        size_t in_batch = 0;
+        for (auto&& record : source.readBatch()) {
+            ++in_batch;
+            bpf_hdr bhdr = record.get_bpf_header();
+            now_sec = bhdr.bh_tstamp.tv_sec;
+            PacketView p = parse_packet(record.get_data(), record.get_data_len());
+            // Anything else is not TCP, skip it
+            if (p.ok()) {
+                reassembler.process(bhdr, p);
+            }
+            if (++seen == max_packets) {
+                break;
+            }
+        }
+        if (in_batch == 0) {
+            break;
+        }
+        reassembler.expire(now_sec);
+    }
+    reassembler.flush();
+    
+    TCPReassemblerStats stats = reassembler.get_stats();
+    cerr << "Delivered " << stats.delivered_bytes << " bytes, " << stats.duplicate_bytes << " duplicate, " << stats.gap_bytes << " missing; ";
+    cerr << stats.out_of_order_segments << " segments out of order, " << stats.dropped_segments << " dropped, " << stats.connections_refused << " connections refused" << endl;
+}
+
+/*
+ Payload dump layout from --dump-width (bytes per row) and --dump-bytes (at most this many bytes per payload)
+ */
+HexDumpOptions get_dump_options(unordered_map<string, string>& arg_dict) {
+    HexDumpOptions opts;
+    if (arg_dict.count("--dump-width")) {
+        opts.bytes_per_row = std::stoul(arg_dict["--dump-width"]);
+    }
+    if (arg_dict.count("--dump-bytes")) {
+        opts.max_bytes = std::stoul(arg_dict["--dump-bytes"]);
+    }
+    return opts;
+}
+
+/*
+ Pipeline settings from --workers
+ */
+PipelineOptions get_pipeline_options(unordered_map<string, string>& arg_dict) {
+    PipelineOptions opts;
+    opts.workers = static_cast<unsigned int>(std::stoul(arg_dict["--workers"]));
+    return opts;
+}
+
+/*
+ Writer settings from --format (pcap or pcapng), --rotate-mb and --rotate-sec
+ */
+PcapWriterOptions get_writer_options(unordered_map<string, string>& arg_dict) {
+    PcapWriterOptions opts;
+    if (arg_dict.count("--format") && arg_dict["--format"] == "pcapng") {
+        opts.format = PcapFormat::PCAPNG;
+    }
+    if (arg_dict.count("--rotate-mb")) {
+        opts.rotate_bytes = std::stoull(arg_dict["--rotate-mb"]) << 20;
+    }
+    if (arg_dict.count("--rotate-sec")) {
+        opts.rotate_seconds = std::stoull(arg_dict["--rotate-sec"]);
+    }
+    return opts;
+}
+
+/*
+ Metrics export from --metrics-file (rewritten every --metrics-interval seconds, 10 by default) and --metrics-port,
+ and the latency report on cerr every --latency-interval seconds
+ Returns nullptr if none of them was asked for. Throws MetricsNotStarted if the port cannot be bound
+ */
+unique_ptr<MetricsExporter> start_metrics(unordered_map<string, string>& arg_dict, std::function<bool(KernelStats&)> kernel_stats) {
+    if (!arg_dict.count("--metrics-file") && !arg_dict.count("--metrics-port") && !arg_dict.count("--latency-interval")) {
+        return nullptr;
+    }
+    MetricsOptions opts;
+    opts.interval_ms = 10000;
+    if (arg_dict.count("--metrics-file")) {
+        opts.file = arg_dict["--metrics-file"];
+    }
+    if (arg_dict.count("--metrics-port")) {
+        opts.port = std::stoi(arg_dict["--metrics-port"]);
+    }
+    if (arg_dict.count("--metrics-interval")) {
+        opts.interval_ms = static_cast<unsigned int>(std::stoul(arg_dict["--metrics-interval"]) * 1000);
+    }
+    if (arg_dict.count("--latency-interval")) {
+        opts.latency_interval_ms = static_cast<unsigned int>(std::stoul(arg_dict["--latency-interval"]) * 1000);
+    }
+    unique_ptr<MetricsExporter> exporter {new MetricsExporter {opts, kernel_stats}};
+    exporter->start();
+    return exporter;
+}
+
+/*
+ Sketches max_packets packets from source into top talkers and distinct counts (see TrafficSketch) and prints the top
+ ones of each kind. With --workers the packets are spread over that many threads, each with its own sketch, merged at
+ the end; drain_source as for pipeline_packets. --sketch-out also saves the (merged) sketch, for --sketch-merge
+ */
+template <typename Source>
+void sketch_packets(Source& source, unordered_map<string, string>& arg_dict, size_t max_packets, bool drain_source) {
+    TrafficSketch sketch;
+    if (arg_dict.count("--workers")) {
+        PipelineOptions opts = get_pipeline_options(arg_dict);
+        vector<unique_ptr<TrafficSketch>> per_worker;
+        for (unsigned int i = 0; i < opts.workers; ++i) {
+            per_worker.emplace_back(new TrafficSketch {});
+        }
+        std::atomic<size_t> seen {0};
+        Pipeline* running = nullptr;
+        Pipeline pipeline {opts, [&](unsigned int worker, const bpf_hdr& bhdr, const PacketView& p) {
+            size_t n = seen.fetch_add(1, std::memory_order_relaxed);
+            if (n >= max_packets) {
+                return;
+            }
+            per_worker[worker]->update(bhdr, p);
+            if (n + 1 == max_packets) {
+                running->stop();
+            }
+        }};
+        running = &pipeline;
+        pipeline.start(source, drain_source);
+        pipeline.wait();
+        print_pipeline_stats(pipeline.get_stats());
+        for (unique_ptr<TrafficSketch>& s : per_worker) {
+            sketch.merge(*s);
+        }
+    } else {
+        size_t seen = 0;
+        while (seen < max_packets) {
+            size_t in_batch = 0;
+            for (auto&& record : source.readBatch()) {
+                ++in_batch;
+                PacketView p = parse_packet(record.get_data(), record.get_data_len());
+                // As the pipeline's workers: only what parsed in full
+                if (p.ok()) {
+                    sketch.update(record.get_bpf_header(), p);
+                }
+                if (++seen == max_packets) {
+                    break;
+                }
+            }
+            if (in_batch == 0) {
+                break;
+            }
+        }
+    }
+    sketch.write_report(cout, std::stoul(arg_dict["--top"]));
+    if (arg_dict.count("--sketch-out")) {
+        save_sketch(sketch, arg_dict["--sketch-out"]);
+    }
+}
+
+/*
+ Rollup settings from --rollup-key (none, src, dst, sport or dport, vlan), --link-mbps and --burst-pct (share of the
+ link a millisecond must be over to be a microburst, 50 by default). Returns false, having said why, if the key is unknown
+ */
+bool get_rollup_options(unordered_map<string, string>& arg_dict, RollupOptions& opts) {
+    if (arg_dict.count("--rollup-key") && !parse_rollup_key(arg_dict["--rollup-key"], opts.key)) {
+        cerr << "Unknown rollup key " << arg_dict["--rollup-key"] << " (none, src, dst, sport, dport or vlan)" << endl;
+        return false;
+    }
+    if (arg_dict.count("--link-mbps")) {
+        opts.link_bps = std::stoull(arg_dict["--link-mbps"]) * 1000000;
+    }
+    if (arg_dict.count("--burst-pct")) {
+        opts.burst_percent = static_cast<unsigned int>(std::stoul(arg_dict["--burst-pct"]));
+    }
+    return true;
+}
+
+/*
+ Link speed of a live interface in bits per second, for microburst detection when --link-mbps is not given. 0 if the
+ driver does not say (or off Linux)
+ */
+uint64_t link_speed_bps(const string& interface) {
+#ifdef __linux__
+    std::ifstream in {"/sys/class/net/" + interface + "/speed"};
+    long long mbps = 0;
+    if (in >> mbps && mbps > 0) {
+        LOG_INFO("%s runs at %lld Mb/s", interface.c_str(), mbps);
+        return static_cast<uint64_t>(mbps) * 1000000;
+    }
+#endif
+    LOG_WARNING("Link speed of %s unknown, pass --link-mbps to look for microbursts", interface.c_str());
+    return 0;
+}
+
+/*
+ Rolls max_packets packets from source up into 1ms / 1s / 1min windows (see TrafficRollup), written as CSV to path
+ ("-" for stdout), then prints the totals and microbursts found. live: when a read times out with nothing, close the
+ windows the wall clock has passed, so a quiet link still gets its rows
+ */
+template <typename Source>
+void rollup_packets(Source& source, const string& path, const string& interface, RollupOptions opts, size_t max_packets, bool live) {
+    int fd = path == "-" ? STDOUT_FILENO : open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        cerr << "Could not open " << path << ": " << strerror(errno) << endl;
+        return;
+    }
+    {
+        OutputBuffer out {fd};
+        TrafficRollup rollup {interface, out, opts};
+        size_t seen = 0;
+        while (seen < max_packets) {
+            size_t in_batch = 0;
+            for (auto&& record : source.readBatch()) {
+                ++in_batch;
+                // Whatever parsed: frames that do not still take up the link
+                rollup.update(record.get_bpf_header(), parse_packet(record.get_data(), record.get_data_len()));
+                if (++seen == max_packets) {
+                    break;
+                }
+            }
+            if (in_batch == 0) {
+                if (!live) {
+                    break;
+                }
+                timeval now;
+                gettimeofday(&now, nullptr);
+                rollup.advance(static_cast<uint64_t>(now.tv_sec) * 1000000 + static_cast<uint64_t>(now.tv_usec));
+            }
+        }
+        rollup.flush();
+
+        const RollupStats& stats = rollup.get_stats();
+        cerr << "Rolled up " << stats.packets << " packets (" << stats.bytes << " bytes), " << stats.late << " too late for their 1ms window, ";
+        cerr << stats.overflowed_windows << " windows over " << opts.max_keys << " keys" << endl;
+        if (opts.link_bps != 0) {
+            cerr << stats.bursts << " microbursts over " << opts.burst_percent << "% of " << opts.link_bps / 1000000 << " Mb/s";
+            cerr << ", busiest millisecond " << stats.peak_permille / 10 << "." << stats.peak_permille % 10 << "% at " << stats.peak_start_ms << endl;
+        }
+    }
+    if (fd != STDOUT_FILENO) {
+        close(fd);
+    }
+}
+
+/*
+ Writes the decoded headers of max_packets packets from source as a column file at path ("-" for stdout), a block
+ every --columns-rows packets (65536 by default), then prints how big it came out. live: keep going when a read comes
+ back empty
+ */
+template <typename Source>
+void export_columns(Source& source, const string& path, unordered_map<string, string>& arg_dict, size_t max_packets, bool live) {
+    ColumnWriterOptions opts;
+    if (arg_dict.count("--columns-rows")) {
+        opts.block_rows = static_cast<uint32_t>(std::stoul(arg_dict["--columns-rows"]));
     }
-    std::cout << std::endl;
- }
+    int fd = path == "-" ? STDOUT_FILENO : open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        cerr << "Could not open " << path << ": " << strerror(errno) << endl;
+        return;
+    }
+    {
+        OutputBuffer out {fd};
+        ColumnWriter writer {out, opts};
+        size_t seen = 0;
+        while (seen < max_packets) {
+            size_t in_batch = 0;
+            for (auto&& record : source.readBatch()) {
+                ++in_batch;
+                // Frames that do not parse get a row too, with what they did have
+                writer.add(record.get_bpf_header(), parse_packet(record.get_data(), record.get_data_len()));
+                if (++seen == max_packets) {
+                    break;
+                }
+            }
+            if (in_batch == 0 && !live) {
+                break;
+            }
+        }
+        writer.flush();
+
+        const ColumnWriterStats& stats = writer.get_stats();
+        double per = stats.rows != 0 ? static_cast<double>(stats.rows) : 1.0;
+        std::ios tmp {NULL};
+        tmp.copyfmt(cerr);
+        cerr << std::fixed << std::setprecision(1);
+        cerr << "Wrote " << stats.rows << " packets in " << stats.blocks << " blocks, " << out.get_total() << " bytes (" << out.get_total() / per << " a packet)" << endl;
+        cerr << "Bytes a packet by column:";
+        for (size_t i = 0; i < HEADER_COLUMNS; ++i) {
+            cerr << " " << header_column_info(static_cast<HeaderColumn>(i)).name << " " << stats.column_bytes[i] / per;
+        }
+        cerr << endl;
+        cerr.copyfmt(tmp);
+    }
+    if (fd != STDOUT_FILENO) {
+        close(fd);
+    }
+}
+
+/*
+ Prints a column file written by --columns as CSV on stdout. Returns main's exit code
+ */
+int columns_to_csv(const string& path) {
+    try {
+        ColumnFile file {path};
+        OutputBuffer out;
+        write_columns_csv(file, out);
+        if (file.get_truncated()) {
+            cerr << path << " ends partway through block " << file.get_blocks() + 1 << ", the rows before it were read" << endl;
+        }
+    } catch(ColumnFileNotOpened e) {
+        cerr << e.what() << endl;
+        return 1;
+    } catch(MalformedColumns e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
 
+/*
+ Runs the mode picked by the arguments (--write, --streams, --flows, --match, --top, --rollup, --columns, --workers or printing) over a
+ capture file, or a filtered view of one. matcher is only set with --match
+ */
+template <typename Source>
+void read_file(Source& source, unordered_map<string, string>& arg_dict, PacketFormatter& formatter, const PatternMatcher* matcher, const vector<string>& pattern_texts, size_t max_packets) {
+    if (arg_dict.count("--write")) {
+        PcapWriter writer {arg_dict["--write"], get_writer_options(arg_dict)};
+        save_packets(source, writer, max_packets);
+    } else if (arg_dict.count("--streams")) {
+        follow_streams(source, static_cast<uint32_t>(std::stoul(arg_dict["--streams"])), get_dump_options(arg_dict), max_packets);
+    } else if (arg_dict.count("--flows")) {
+        summarize_flows(source, static_cast<uint32_t>(std::stoul(arg_dict["--flows"])), max_packets);
+    } else if (matcher != nullptr) {
+        match_packets(source, *matcher, pattern_texts, max_packets);
+    } else if (arg_dict.count("--top")) {
+        sketch_packets(source, arg_dict, max_packets, true);
+    } else if (arg_dict.count("--rollup")) {
+        // Checked in main already
+        RollupOptions opts;
+        get_rollup_options(arg_dict, opts);
+        rollup_packets(source, arg_dict["--rollup"], arg_dict["--file"], opts, max_packets, false);
+    } else if (arg_dict.count("--columns")) {
+        export_columns(source, arg_dict["--columns"], arg_dict, max_packets, false);
+    } else if (arg_dict.count("--workers")) {
+        pipeline_packets(source, get_pipeline_options(arg_dict), formatter, max_packets, true);
+    } else {
+        print_packets(source.readBatch(), formatter, max_packets);
+    }
+}
+
+#ifdef __linux__
+/*
+ Fanout settings from --fanout (hash, cpu or rollover), --cpus (a list like 0,2,4-7; every CPU we may run on by default)
+ and --fanout-group. Returns false if the mode is unknown
+ */
+bool get_fanout_options(unordered_map<string, string>& arg_dict, FanoutOptions& opts) {
+    if (!parse_fanout_mode(arg_dict["--fanout"], opts.mode)) {
+        return false;
+    }
+    if (arg_dict.count("--cpus")) {
+        opts.cpus = parse_cpu_list(arg_dict["--cpus"]);
+    }
+    if (arg_dict.count("--fanout-group")) {
+        opts.group_id = static_cast<uint16_t>(std::stoul(arg_dict["--fanout-group"]));
+    }
+    return true;
+}
+
+/*
+ Prints packets captured by a FanoutCapture (one pinned capture + parse thread per CPU) until max_packets supported ones
+ have been printed. The metrics export, if asked for, gets the kernel counts summed over every socket
+ Throws AFPacketDeviceNotOpened if a member could not set up, MetricsNotStarted if the metrics port cannot be bound,
+ or whatever a member stopped on (see FanoutCapture::wait)
+ */
+void fanout_packets(FanoutOptions opts, unordered_map<string, string>& arg_dict, PacketFormatter& formatter, size_t max_packets) {
+    std::mutex print_lock;
+    std::atomic<size_t> printed {0};
+    FanoutCapture* running = nullptr;
+    
+    FanoutCapture capture {opts, [&](unsigned int, const bpf_hdr& bhdr, const PacketView& p) {
+        size_t n = printed.fetch_add(1, std::memory_order_relaxed);
+        if (n >= max_packets) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard {print_lock};
+            formatter.write(bhdr, p);
+        }
+        if (n + 1 == max_packets) {
+            running->stop();
+        }
+    }};
+    running = &capture;
+    unique_ptr<MetricsExporter> metrics = start_metrics(arg_dict, [&capture](KernelStats& stats) { return capture.get_kernel_stats(stats); });
+    capture.start();
+    capture.wait();
+    formatter.flush();
+    
+    FanoutStats stats = capture.get_stats();
+    KernelStats kernel {0, 0};
+    capture.get_kernel_stats(kernel);
+    for (size_t i = 0; i < stats.members.size(); ++i) {
+        FanoutMemberStats& m = stats.members[i];
+        cerr << "Member " << i << " (CPU " << m.cpu << ", node " << m.node << "): captured " << m.captured << ", processed " << m.processed << ", unsupported " << m.unsupported << ", invalid " << m.invalid << endl;
+    }
+    cerr << "Captured " << stats.captured << " packets on " << stats.members.size() << " sockets (" << fanout_mode_name(opts.mode) << " fanout), kernel dropped " << kernel.dropped << endl;
+}
+#endif
+
+// Final per-stage latencies, however main ends
+void print_latency_report() {
+    cerr << format_latency_report();
+}
 
 int main(int argc, const char * argv[]) {
     unordered_map<string, string> arg_dict = get_arg_dict(argc, argv);
+#ifdef SNIFFERPP_LATENCY
+    std::atexit(print_latency_report);
+#endif
     
-    int buffer_len = 4096;
-    unique_ptr<BPFDevice> dev = open_new_device("en0", buffer_len);
-    pair<unique_ptr<byte_t>,size_t> out;
-    bool found_packet = false;
-    do {
+    // Diagnostics go to stderr from a background thread; --log-level warning quietens the device setup messages
+    if (arg_dict.count("--log-level")) {
+        LogLevel level;
+        if (!parse_log_level(arg_dict["--log-level"], level)) {
+            cerr << "Unknown log level " << arg_dict["--log-level"] << " (verbose, info, warning, error or none)" << endl;
+            return 1;
+        }
+        set_log_level(level);
+    }
+    
+    size_t max_packets = arg_dict.count("--count") ? std::stoul(arg_dict["--count"]) : 1;
+    
+    // Print the compiled filter instead of capturing
+    if (arg_dict.count("--dump-filter")) {
+        try {
+            cout << compile_filter(arg_dict["--dump-filter"]);
+        } catch(FilterSyntaxError e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+    
+    // Combine sketches saved by --sketch-out instead of capturing
+    if (arg_dict.count("--sketch-merge")) {
+        return merge_sketches(arg_dict);
+    }
+    
+    // Turn a --columns file back into text instead of capturing
+    if (arg_dict.count("--columns-csv")) {
+        return columns_to_csv(arg_dict["--columns-csv"]);
+    }
+    
+    BPFProgram filter;
+    if (arg_dict.count("--filter")) {
+        try {
+            filter = compile_filter(arg_dict["--filter"]);
+        } catch(FilterSyntaxError e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+    }
+    
+    // Packets go out through one buffer, flushed in large writes (and when main returns)
+    OutputFormat format = OutputFormat::HUMAN;
+    if (arg_dict.count("--output")) {
+        try {
+            format = parse_output_format(arg_dict["--output"]);
+        } catch(UnknownOutputFormat e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+    }
+    OutputBuffer out;
+    PacketFormatter formatter {out, format, get_dump_options(arg_dict)};
+    
+    // Payload search: one pattern per line of the file, compiled once
+    vector<string> pattern_texts;
+    unique_ptr<PatternMatcher> matcher;
+    if (arg_dict.count("--match")) {
+        try {
+            pattern_texts = read_pattern_file(arg_dict["--match"]);
+            vector<string> patterns;
+            for (const string& text : pattern_texts) {
+                patterns.push_back(parse_pattern(text));
+            }
+            matcher.reset(new PatternMatcher {patterns});
+        } catch(PatternFileNotOpened e) {
+            cerr << e.what() << endl;
+            return 1;
+        } catch(PatternSyntaxError e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        LOG_INFO("Compiled %zu patterns into %zu states (%zu KB), prefilter %s", matcher->get_pattern_count(), matcher->get_state_count(), matcher->get_table_bytes() / 1024, matcher->has_prefilter() ? pattern_prefilter_name() : "off");
+    }
+    
+    // Rollups: options checked before any capture starts
+    RollupOptions rollup_opts;
+    if (arg_dict.count("--rollup") && !get_rollup_options(arg_dict, rollup_opts)) {
+        return 1;
+    }
+    
+    // Checksums are verified as packets are counted, for the metrics, unless --checksums off
+    bool checksums = !(arg_dict.count("--checksums") && arg_dict["--checksums"] == "off");
+    
+    // Offline: everything in the file, no device (or root) needed
+    if (arg_dict.count("--file")) {
         try {
-            // Read
-            out = dev->readRaw();
-            
-            // Strip bpf header
-            unique_ptr<bpf_hdr> bhdr = strip_header<bpf_hdr>(out.first.get());
-            cout << *bhdr << endl;
-            
-            // Copy remaining packet from buffer
-            size_t data_len = out.second-(bhdr->bh_hdrlen);
-            unique_ptr<byte_t> pack {new byte_t[data_len]};
-            memcpy(pack.get(),out.first.get()+bhdr->bh_hdrlen,data_len);
-            
-            // Strip underlying packet
-            Packet p = strip_packet(std::move(pack), data_len);
-            found_packet=true;
-            cout << p << endl;
-        } catch(CouldNotRead e) {
+            PcapFile file {arg_dict["--file"]};
+            unique_ptr<MetricsExporter> metrics = start_metrics(arg_dict, nullptr);
+            if (arg_dict.count("--filter")) {
+                // No kernel in the way, so the interpreter applies the filter
+                FilteredSource<PcapFile> filtered {file, filter};
+                CountingSource<FilteredSource<PcapFile>> counted {filtered, false, checksums};
+                read_file(counted, arg_dict, formatter, matcher.get(), pattern_texts, max_packets);
+            } else {
+                CountingSource<PcapFile> counted {file, false, checksums};
+                read_file(counted, arg_dict, formatter, matcher.get(), pattern_texts, max_packets);
+            }
+        } catch(MetricsNotStarted e) {
+            cerr << e.what() << endl;
+            return 1;
+        } catch(PcapFileNotOpened e) {
+            cerr << e.what() << endl;
+            return 1;
+        } catch(MalformedPcap e) {
+            cerr << e.what() << endl;
+            return 1;
+        } catch(PcapWriterNotOpened e) {
             cerr << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+    
+    string interface = arg_dict.count("--interface") ? arg_dict["--interface"] : default_interface;
+    
+#ifdef __linux__
+    // Keep capturing, on one socket and pinned thread per CPU instead of a single device
+    if (arg_dict.count("--fanout")) {
+        FanoutOptions opts;
+        if (!get_fanout_options(arg_dict, opts)) {
+            cerr << "Unknown fanout mode " << arg_dict["--fanout"] << " (hash, cpu or rollover)" << endl;
+            return 1;
+        }
+        opts.interface = interface;
+        opts.checksums = checksums;
+        if (arg_dict.count("--filter")) {
+            opts.filter = filter.get_insns();
+        }
+        try {
+            fanout_packets(opts, arg_dict, formatter, max_packets);
+        } catch(DeviceNotOpened e) {
+            cerr << e.what() << endl;
+            return 1;
+        } catch(MetricsNotStarted e) {
+            cerr << e.what() << endl;
+            return 1;
+        } catch(WrongNetworkProtocol e) {
+            cerr << e.what() << endl;
+            return 1;
+        } catch(WrongTransportProtocol e) {
+            cerr << e.what() << endl;
+            return 1;
         } catch(UnsupportedProtocol e) {
             cerr << e.what() << endl;
+            return 1;
+        } catch(InvalidInput e) {
+            cerr << e.what() << endl;
+            return 1;
+        } catch(std::exception& e) {
+            cerr << e.what() << endl;
+            return 1;
         }
-    } while (!found_packet && dev->get_curr_bytes_consumed() < dev->get_last_read_len());
+        return 0;
+    }
+#endif
+    
+    int buffer_len = 4096;
+    unique_ptr<CaptureDevice> dev;
+    try {
+        dev = open_new_device(interface, buffer_len);
+    } catch(DeviceNotOpened e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    if (arg_dict.count("--filter") && !dev->set_filter(filter.get_insns())) {
+        return 1;
+    }
+    // Every record read goes through the counters
+    CountingSource<CaptureDevice> counted {*dev, true, checksums};
+    unique_ptr<MetricsExporter> metrics;
+    try {
+        metrics = start_metrics(arg_dict, [&dev](KernelStats& stats) { return dev->get_kernel_stats(stats); });
+    } catch(MetricsNotStarted e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    try {
+        // Keep capturing into a file
+        if (arg_dict.count("--write")) {
+            PcapWriter writer {arg_dict["--write"], get_writer_options(arg_dict)};
+            save_packets(counted, writer, max_packets);
+            return 0;
+        }
+        
+        // Keep capturing, following TCP streams
+        if (arg_dict.count("--streams")) {
+            follow_streams(counted, static_cast<uint32_t>(std::stoul(arg_dict["--streams"])), get_dump_options(arg_dict), max_packets);
+            return 0;
+        }
+        
+        // Keep capturing, tracking flows
+        if (arg_dict.count("--flows")) {
+            summarize_flows(counted, static_cast<uint32_t>(std::stoul(arg_dict["--flows"])), max_packets);
+            return 0;
+        }
+        
+        // Keep capturing, searching payloads
+        if (matcher != nullptr) {
+            match_packets(counted, *matcher, pattern_texts, max_packets);
+            return 0;
+        }
+        
+        // Keep capturing into time-windowed rollups, against the link's own speed unless --link-mbps says otherwise
+        if (arg_dict.count("--rollup")) {
+            if (!arg_dict.count("--link-mbps")) {
+                rollup_opts.link_bps = link_speed_bps(interface);
+            }
+            dev->set_read_timeout(100);
+            rollup_packets(counted, arg_dict["--rollup"], interface, rollup_opts, max_packets, true);
+            return 0;
+        }
+        
+        // Keep capturing, decoded headers into a column file
+        if (arg_dict.count("--columns")) {
+            export_columns(counted, arg_dict["--columns"], arg_dict, max_packets, true);
+            return 0;
+        }
+        
+        // Keep capturing into top talkers (on worker threads too, with --workers)
+        if (arg_dict.count("--top")) {
+            if (arg_dict.count("--workers")) {
+                dev->set_read_timeout(100);
+            }
+            sketch_packets(counted, arg_dict, max_packets, false);
+            return 0;
+        }
+        
+        // Keep capturing, parsing on worker threads
+        if (arg_dict.count("--workers")) {
+            // Wake up now and then so the capture thread notices stop()
+            dev->set_read_timeout(100);
+            pipeline_packets(counted, get_pipeline_options(arg_dict), formatter, max_packets, false);
+            return 0;
+        }
+        
+        // Everything from one buffer fill
+        if (print_packets(counted.readBatch(), formatter, max_packets) == 0) {
+            cerr << "No supported packet in buffer" << endl;
+        }
+    } catch(CouldNotRead e) {
+        cerr << e.what() << endl;
+    } catch(PcapWriterNotOpened e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
     
     return 0;
 }